@@ -1,4 +1,4 @@
-REM blender needs to be on the path and the image asset converter needs to have been built in release build
+REM blender needs to be on the path and the image asset converter and model asset optimiser need to have been built in release build
 
 mkdir build\test_assets\textures
 mkdir build\test_assets\audio
@@ -62,6 +62,9 @@ blender standard_assets\models\cube.blend --background --python-exit-code 1 --py
 blender standard_assets\models\sphere.blend --background --python-exit-code 1 --python blender_export.py -- build/standard_assets/models/sphere.blend.asset
 blender test_assets\models\pete.blend --background --python-exit-code 1 --python blender_export.py -- build/test_assets/models/pete.blend.asset
 
+x64\Release\model_asset_optimiser.exe build\standard_assets\models\cube.blend.asset build\standard_assets\models\cube.blend.asset
+x64\Release\model_asset_optimiser.exe build\standard_assets\models\sphere.blend.asset build\standard_assets\models\sphere.blend.asset
+x64\Release\model_asset_optimiser.exe build\test_assets\models\pete.blend.asset build\test_assets\models\pete.blend.asset
 
 x64\Release\image_asset_converter.exe test_assets\textures\Ch17_1001_Diffuse.jpg build\test_assets\textures\Ch17_1001_Diffuse.jpg.asset
 x64\Release\image_asset_converter.exe test_assets\textures\Ch17_1001_Normal.jpg build\test_assets\textures\Ch17_1001_Normal.jpg.asset
@@ -10,6 +10,8 @@ from math import floor,sqrt
 import bmesh
 import sys
 
+MAX_LODS = 4
+
 def clamp(i, small, big):
     return max(min(i, big), small)
 
@@ -99,10 +101,22 @@ def write_files(asset_text, data, filepath, use_zstd, zstd_path_override):
     
 
 class Object():
-    def __init__(self, blender_object, vertex_offset, vertex_count):
+    def __init__(self, blender_object, vertex_offset, vertex_count, lod):
         self.blender_object = blender_object
         self.vertex_offset = vertex_offset
         self.vertex_count = vertex_count
+        self.lod = lod
+
+
+def get_object_lod(name):
+    # Objects named xxx_LOD1, xxx_LOD2, ... are lower detail versions of the model
+    parts = name.rsplit('_LOD', 1)
+    if len(parts) == 2 and parts[1].isdigit():
+        lod = int(parts[1])
+        if lod >= MAX_LODS:
+            raise RuntimeError('Too many levels of detail. Problematic object: ' + name)
+        return lod
+    return 0
 
 class Vertex():
     def __init__(self, position, normal):
@@ -158,7 +172,8 @@ def get_objects_and_vertices(flat_shading, export_tangents, bones, bone_name_to_
         m.to_mesh(blender_object.data)
         m.free()
 
-        obj = Object(blender_object, len(vertices), len(blender_object.data.vertices))
+        obj = Object(blender_object, len(vertices), len(blender_object.data.vertices),
+            get_object_lod(original_blender_object.name))
         objects.append(obj)
 
         if flat_shading:
@@ -267,7 +282,8 @@ def get_mesh_data(flat_shading, export_tangents):
     
     class Material:
         def __init__(self, name, colour, flat_colour):
-            self.indices = []
+            # Indices for each level of detail
+            self.indices = [[] for _ in range(MAX_LODS)]
             self.name = name
             self.colour = colour
             self.flat_colour = flat_colour
@@ -342,6 +358,8 @@ def get_mesh_data(flat_shading, export_tangents):
 
     for obj in objects:
 
+        lod = obj.lod
+
         for polygon in obj.blender_object.data.polygons:
             face_indices = polygon.vertices
             loop_indices = polygon.loop_indices
@@ -386,7 +404,7 @@ def get_mesh_data(flat_shading, export_tangents):
                     vertex2.tangent = switch_coord_system(vertex2.tangent)
                     vertex2.bitangent_sign = obj.blender_object.data.loops[loop_index].bitangent_sign
 
-                    mat.indices.append(len(new_vertices))
+                    mat.indices[lod].append(len(new_vertices))
                     new_vertices.append(vertex2)
             else:
                 for j in range(len(face_indices)):
@@ -408,9 +426,9 @@ def get_mesh_data(flat_shading, export_tangents):
                         vertex.uv = uv
                         vertex.tangent = tangent
                         vertex.bitangent_sign = bitangent_sign
-                        mat.indices.append(vertex_index)
+                        mat.indices[lod].append(vertex_index)
                     elif vertex.uv == uv and vertex.tangent == tangent and vertex.bitangent_sign == bitangent_sign:
-                        mat.indices.append(vertex_index)
+                        mat.indices[lod].append(vertex_index)
                     else:
                         # Look through already generated extra vertices.
                         vertex2_index = -1
@@ -423,12 +441,12 @@ def get_mesh_data(flat_shading, export_tangents):
                             # Create a new vertex
                             vertex2 = vertex.split(uv, tangent, bitangent_sign)
                             index2 = len(vertices)
-                            mat.indices.append(index2)
+                            mat.indices[lod].append(index2)
                             vertex.extra_vertex_indices.append(index2)
                             vertices.append(vertex2)
                         else:
                             # Use existing split vertex
-                            mat.indices.append(vertex2_index)
+                            mat.indices[lod].append(vertex2_index)
 
     
     if flat_shading:
@@ -444,12 +462,15 @@ def get_mesh_data(flat_shading, export_tangents):
         while j < len(materials):
             mat2 = materials[j]
             if mat.is_equiv(mat2):
-                mat.indices += mat2.indices
+                for lod in range(MAX_LODS):
+                    mat.indices[lod] += mat2.indices[lod]
                 materials.remove(mat2)
             else:
                 j += 1
 
-        if len(mat.indices) >= 3:
+        # Materials are kept if any level of detail uses them. Levels of detail without triangles are exported
+        # with a count of 0
+        if any(len(lod_indices) >= 3 for lod_indices in mat.indices):
             optimised_materials.append(mat)
         
         i += 1
@@ -461,8 +482,9 @@ def get_mesh_data(flat_shading, export_tangents):
 
         new_vertices = []
         for mat in materials:
-            for i in mat.indices:
-                new_vertices.append(vertices[i])
+            for lod_indices in mat.indices:
+                for i in lod_indices:
+                    new_vertices.append(vertices[i])
         vertices = new_vertices
 
     return objects,vertices,min_position,max_position,materials,bones
@@ -545,7 +567,7 @@ def get_animation_data(loop_animations, bones):
     return bpy.context.scene.render.fps, animations
 
 def create_model_file(context, asset_name, filepath, use_zstd, zstd_path_override, flat_shading, \
-export_uv, export_tangents, loop_animations):
+export_uv, export_tangents, loop_animations, lod_screen_sizes):
     if filepath[-6:] != '.asset':
         raise ValueError('Output file should be a .asset file')
 
@@ -553,6 +575,10 @@ export_uv, export_tangents, loop_animations):
     objects,vertices,min_position,max_position,materials,bones = get_mesh_data(flat_shading, export_tangents)
     position_value_range = max_position - min_position
 
+    lods_count = 1 + max([o.lod for o in objects], default=0)
+    if lods_count > 1 and len(lod_screen_sizes) < lods_count-1:
+        raise RuntimeError('LOD-SCREEN-SIZES must be given for each level of detail after the first')
+
 
     asset_text_file = '#' + asset_name + '\n'
     asset_text_file += 'TYPE MODEL\n'
@@ -586,7 +612,8 @@ export_uv, export_tangents, loop_animations):
 
         if not flat_shading:
             for m in materials:
-                indices_count += len(m.indices)
+                for lod_indices in m.indices:
+                    indices_count += len(lod_indices)
 
         if indices_count == 0:
             asset_text_file += 'INDICES-COUNT 0\n'
@@ -594,6 +621,10 @@ export_uv, export_tangents, loop_animations):
             asset_text_file += 'INDICES-TYPE ' + ("U32" if len(vertices) > 65536 else "U16") + '\n'
             asset_text_file += 'INDICES-COUNT ' + str(indices_count) + '\n'
 
+        if lods_count > 1:
+            asset_text_file += 'LODS-COUNT ' + str(lods_count) + '\n'
+            asset_text_file += 'LOD-SCREEN-SIZES ' + ' '.join([str(x) for x in lod_screen_sizes[:lods_count-1]]) + '\n'
+
         asset_text_file += 'MATERIALS-COUNT ' + str(len(materials)) + '\n'
 
         indices_or_vertices_offset = 0
@@ -602,9 +633,13 @@ export_uv, export_tangents, loop_animations):
             asset_text_file += "COLOUR {:.3f} {:.3f} {:.3f}\n".format(m.colour[0], m.colour[1], m.colour[2])
             asset_text_file += "FLAT-COLOUR {:.3f} {:.3f} {:.3f}\n".format(m.flat_colour[0], m.flat_colour[1], m.flat_colour[2])
             asset_text_file += 'FIRST ' + str(indices_or_vertices_offset) + '\n'
-            material_index_count = len(m.indices)
+            material_index_count = len(m.indices[0])
             indices_or_vertices_offset += material_index_count
             asset_text_file += 'COUNT ' + str(material_index_count) + '\n'
+            for lod in range(1, lods_count):
+                asset_text_file += 'LOD ' + str(lod) + ' ' + str(indices_or_vertices_offset) + ' ' + \
+                    str(len(m.indices[lod])) + '\n'
+                indices_or_vertices_offset += len(m.indices[lod])
             if m.texture != '':
                 asset_text_file += 'TEXTURE ' + m.texture + '\n'
             if m.normal_texture != '':
@@ -715,12 +750,14 @@ export_uv, export_tangents, loop_animations):
         writers.append(w)
         if len(vertices) <= 65536:
             for m in materials:
-                for i in m.indices:
-                    w.writeWord(i)
+                for lod_indices in m.indices:
+                    for i in lod_indices:
+                        w.writeWord(i)
         else:
             for m in materials:
-                for i in m.indices:
-                    w.writeDWord(i)
+                for lod_indices in m.indices:
+                    for i in lod_indices:
+                        w.writeDWord(i)
 
     if len(bones) > 0:
 
@@ -755,6 +792,7 @@ if __name__ == "__main__":
     use_flat_shading = False
 
     loop_animations = []
+    lod_screen_sizes = []
 
     with open(sys.argv[1] + '.import', 'r') as f:
         lines = f.readlines()
@@ -765,9 +803,12 @@ if __name__ == "__main__":
                     use_flat_shading = True
                 elif x[0].upper() == 'LOOP':
                     loop_animations.append(x[1])
+                elif x[0].upper() == 'LOD-SCREEN-SIZES':
+                    lod_screen_sizes = [float(s) for s in x[1:]]
                 else:
                     print('Unrecognised import option: ' + x)
 
     print ('Outputting to ' + output_file)
     create_model_file(None, sys.argv[1], output_file, use_zstd=True, zstd_path_override='', \
-    flat_shading=use_flat_shading, export_uv=True, export_tangents=True, loop_animations=loop_animations)
+    flat_shading=use_flat_shading, export_uv=True, export_tangents=True, loop_animations=loop_animations, \
+    lod_screen_sizes=lod_screen_sizes)
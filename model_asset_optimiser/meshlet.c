@@ -0,0 +1,173 @@
+#include "meshlet.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// If the dot product of any triangle normal and the cone axis is below this then the normal cone is too wide
+// to ever cull the meshlet
+#define MIN_CONE_DOT 0.1f
+
+static void get_bounds(const uint32_t* indices, unsigned int index_count, const float* positions, PigeonWGIMeshlet* m)
+{
+	float min[3] = { INFINITY, INFINITY, INFINITY };
+	float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+	for (unsigned int i = 0; i < index_count; i++) {
+		const float* p = &positions[indices[i] * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			min[j] = fminf(min[j], p[j]);
+			max[j] = fmaxf(max[j], p[j]);
+		}
+	}
+
+	for (unsigned int j = 0; j < 3; j++) {
+		m->centre[j] = (min[j] + max[j]) * 0.5f;
+	}
+
+	float radius_squared = 0;
+	for (unsigned int i = 0; i < index_count; i++) {
+		const float* p = &positions[indices[i] * 3];
+		float d[3] = { p[0] - m->centre[0], p[1] - m->centre[1], p[2] - m->centre[2] };
+		radius_squared = fmaxf(radius_squared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	}
+	m->radius = sqrtf(radius_squared);
+}
+
+// Front faces are anticlockwise
+static bool get_triangle_normal(const uint32_t* triangle, const float* positions, float normal[3])
+{
+	const float* p0 = &positions[triangle[0] * 3];
+	const float* p1 = &positions[triangle[1] * 3];
+	const float* p2 = &positions[triangle[2] * 3];
+
+	float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+	normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+	float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	if (length < 1e-12f)
+		return false;
+
+	for (unsigned int j = 0; j < 3; j++) {
+		normal[j] /= length;
+	}
+	return true;
+}
+
+static void get_normal_cone(const uint32_t* indices, unsigned int index_count, const float* positions,
+	PigeonWGIMeshlet* m)
+{
+	m->cone_axis[0] = m->cone_axis[1] = 0;
+	m->cone_axis[2] = 1;
+	m->cone_cutoff = 1;
+
+	float axis[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < index_count; i += 3) {
+		float n[3];
+		if (get_triangle_normal(&indices[i], positions, n)) {
+			for (unsigned int j = 0; j < 3; j++) {
+				axis[j] += n[j];
+			}
+		}
+	}
+
+	float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (length < 1e-6f)
+		return;
+
+	for (unsigned int j = 0; j < 3; j++) {
+		axis[j] /= length;
+	}
+
+	float min_dot = 1;
+	for (unsigned int i = 0; i < index_count; i += 3) {
+		float n[3];
+		if (get_triangle_normal(&indices[i], positions, n))
+			min_dot = fminf(min_dot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+	}
+
+	if (min_dot < MIN_CONE_DOT)
+		return;
+
+	memcpy(m->cone_axis, axis, sizeof axis);
+
+	// The meshlet is back-facing when the view direction is within 90 degrees minus the cone angle of the axis
+	m->cone_cutoff = sqrtf(1 - min_dot * min_dot);
+}
+
+int build_meshlets(const uint32_t* indices, unsigned int index_count, unsigned int first_index,
+	const float* positions, unsigned int vertex_count, PigeonWGIMeshlet** meshlets, unsigned int* meshlets_count)
+{
+	*meshlets = NULL;
+	*meshlets_count = 0;
+
+	unsigned int triangles = index_count / 3;
+	if (!triangles)
+		return 0;
+
+	// Vertex is in the current meshlet if vertex_marks[v] == mark
+	uint32_t* vertex_marks = calloc(vertex_count, sizeof *vertex_marks);
+	if (!vertex_marks)
+		return 1;
+	uint32_t mark = 1;
+
+	unsigned int capacity = triangles / MESHLET_MAX_TRIANGLES + 16;
+	*meshlets = malloc(capacity * sizeof **meshlets);
+	if (!*meshlets) {
+		free(vertex_marks);
+		return 1;
+	}
+
+	unsigned int start = 0; // First triangle of the current meshlet
+	unsigned int vertices = 0;
+
+	for (unsigned int t = 0; t <= triangles; t++) {
+		const uint32_t* tri = &indices[t * 3];
+		unsigned int new_vertices = 0;
+
+		if (t < triangles) {
+			new_vertices = (vertex_marks[tri[0]] != mark)
+				+ (vertex_marks[tri[1]] != mark && tri[1] != tri[0])
+				+ (vertex_marks[tri[2]] != mark && tri[2] != tri[0] && tri[2] != tri[1]);
+		}
+
+		if (t == triangles || vertices + new_vertices > MESHLET_MAX_VERTICES || t - start == MESHLET_MAX_TRIANGLES) {
+			if (*meshlets_count == capacity) {
+				capacity *= 2;
+				PigeonWGIMeshlet* new_meshlets = realloc(*meshlets, capacity * sizeof **meshlets);
+				if (!new_meshlets) {
+					free(vertex_marks);
+					free(*meshlets);
+					*meshlets = NULL;
+					return 1;
+				}
+				*meshlets = new_meshlets;
+			}
+
+			PigeonWGIMeshlet* m = &(*meshlets)[(*meshlets_count)++];
+			m->first = first_index + start * 3;
+			m->count = (t - start) * 3;
+			get_bounds(&indices[start * 3], m->count, positions, m);
+			get_normal_cone(&indices[start * 3], m->count, positions, m);
+
+			if (t == triangles)
+				break;
+
+			// All vertices of this triangle are new to the next meshlet
+			mark++;
+			start = t;
+			vertices = 0;
+			new_vertices = 1 + (tri[1] != tri[0]) + (tri[2] != tri[0] && tri[2] != tri[1]);
+		}
+
+		vertex_marks[tri[0]] = vertex_marks[tri[1]] = vertex_marks[tri[2]] = mark;
+		vertices += new_vertices;
+	}
+
+	free(vertex_marks);
+	return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <pigeon/wgi/mesh.h>
+#include <stdint.h>
+
+// A meshlet is closed when adding the next triangle would exceed either limit
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 128
+
+// Index ranges with fewer triangles than this are always drawn whole so they do not get meshlets
+#define MESHLET_MIN_RANGE_TRIANGLES 512
+
+// Splits an index range into meshlets of consecutive triangles. Run after optimise_vertex_cache so that
+// consecutive triangles are close together. first_index is the offset of indices in the index buffer.
+// positions is xyz. All indices must be < vertex_count.
+// *meshlets is malloc'd. Returns 1 on allocation failure
+int build_meshlets(const uint32_t* indices, unsigned int index_count, unsigned int first_index,
+	const float* positions, unsigned int vertex_count, PigeonWGIMeshlet** meshlets, unsigned int* meshlets_count);
@@ -0,0 +1,855 @@
+#include "model_asset.h"
+#include <config_parser.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+
+typedef struct SubresourceInfo {
+	bool zstd;
+	unsigned int decompressed_size;
+	unsigned int stored_size;
+} SubresourceInfo;
+
+enum {
+	KEY_VERTEX_COUNT,
+	KEY_BOUNDS_MINIMUM,
+	KEY_BOUNDS_RANGE,
+	KEY_VERTEX_ATTRIBUTES,
+	KEY_INDICES_TYPE,
+	KEY_INDICES_COUNT,
+	KEY_LODS_COUNT,
+	KEY_LOD_SCREEN_SIZES,
+	KEY_LOD,
+	KEY_MESHLETS_COUNT,
+	KEY_MESHLETS,
+	KEY_MATERIALS_COUNT,
+	KEY_MATERIAL,
+	KEY_FIRST,
+	KEY_COUNT,
+	KEY_SUBRESOURCE_COUNT,
+	KEY_SUBRESOURCES,
+	KEY_BONES_COUNT,
+	KEY_BONE,
+	KEY_HEAD,
+	KEY_PARENT,
+	KEY_ANIMATION_SPACE,
+	KEY_ANIMATIONS_COUNT,
+	KEY_ANIMATION,
+	KEY_FRAMES,
+	KEY_COMPRESSED,
+};
+
+static const char* keys[] = {
+	"VERTEX-COUNT",
+	"BOUNDS-MINIMUM",
+	"BOUNDS-RANGE",
+	"VERTEX-ATTRIBUTES",
+	"INDICES-TYPE",
+	"INDICES-COUNT",
+	"LODS-COUNT",
+	"LOD-SCREEN-SIZES",
+	"LOD",
+	"MESHLETS-COUNT",
+	"MESHLETS",
+	"MATERIALS-COUNT",
+	"MATERIAL",
+	"FIRST",
+	"COUNT",
+	"SUBRESOURCE-COUNT",
+	"SUBRESOURCES",
+	"BONES-COUNT",
+	"BONE",
+	"HEAD",
+	"PARENT",
+	"ANIMATION-SPACE",
+	"ANIMATIONS-COUNT",
+	"ANIMATION",
+	"FRAMES",
+	"COMPRESSED",
+};
+
+static const char* skip_whitespace(const char* s)
+{
+	while (*s == ' ' || *s == '\t')
+		s++;
+	return s;
+}
+
+static const char* next_word(const char* s)
+{
+	while (*s && *s != ' ' && *s != '\t')
+		s++;
+	return skip_whitespace(s);
+}
+
+// Returns the key index or -1. value points to the text after the key
+static int match_line(const char* line, const char** value)
+{
+	line = skip_whitespace(line);
+	for (unsigned int i = 0; i < sizeof keys / sizeof *keys; i++) {
+		if (word_matches(line, keys[i])) {
+			*value = next_word(line);
+			return (int)i;
+		}
+	}
+	*value = NULL;
+	return -1;
+}
+
+unsigned int model_asset_attribute_size(PigeonWGIVertexAttributeType type)
+{
+	switch (type) {
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR:
+		return 12;
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION2D:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_UV_FLOAT:
+		return 8;
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR_RGBA8:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_NORMAL:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_TANGENT:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_UV:
+	case PIGEON_WGI_VERTEX_ATTRIBUTE_BONE:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+int model_asset_find_attribute(ModelAsset const* asset, PigeonWGIVertexAttributeType type)
+{
+	for (unsigned int i = 0; i < asset->attributes_count; i++) {
+		if (asset->attribute_types[i] == type)
+			return (int)i;
+	}
+	return -1;
+}
+
+float* model_asset_decode_positions(ModelAsset const* asset)
+{
+	float* positions = malloc(asset->vertex_count * 3 * sizeof *positions);
+	if (!positions)
+		return NULL;
+
+	int a = model_asset_find_attribute(asset, PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION);
+	if (a >= 0) {
+		memcpy(positions, asset->attribute_data[a], asset->vertex_count * 3 * sizeof *positions);
+		return positions;
+	}
+
+	a = model_asset_find_attribute(asset, PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED);
+	if (a >= 0) {
+		const uint32_t* packed = asset->attribute_data[a];
+		for (unsigned int i = 0; i < asset->vertex_count; i++) {
+			pigeon_wgi_unpack_normalised_position(packed[i], asset->bounds_min, asset->bounds_range, &positions[i * 3]);
+		}
+		return positions;
+	}
+
+	fputs("Model has no 3D position attribute\n", stderr);
+	free(positions);
+	return NULL;
+}
+
+static void* load_file(const char* path, unsigned int extra_bytes, unsigned long* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Error opening file: %s\n", path);
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long sz = ftell(f);
+	rewind(f);
+
+	char* data = NULL;
+	if (sz >= 0)
+		data = malloc((size_t)sz + extra_bytes);
+
+	if (!data || (sz > 0 && fread(data, (size_t)sz, 1, f) != 1)) {
+		fprintf(stderr, "Error reading file: %s\n", path);
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+	*size = (unsigned long)sz;
+	return data;
+}
+
+static int split_lines(ModelAsset* asset, unsigned long text_size)
+{
+	asset->text[text_size] = 0;
+
+	unsigned int max_lines = 1;
+	for (unsigned long i = 0; i < text_size; i++) {
+		if (asset->text[i] == '\n')
+			max_lines++;
+	}
+
+	asset->lines = malloc(max_lines * sizeof *asset->lines);
+	if (!asset->lines)
+		return 1;
+
+	char* line = asset->text;
+	while (*line) {
+		char* end = strchr(line, '\n');
+		char* next = end ? end + 1 : line + strlen(line);
+		if (!end)
+			end = next;
+
+		*end = 0;
+		if (end > line && end[-1] == '\r')
+			end[-1] = 0;
+
+		asset->lines[asset->lines_count++] = line;
+		line = next;
+	}
+	return 0;
+}
+
+static int parse_vertex_attributes(ModelAsset* asset, const char* value)
+{
+	static const struct {
+		const char* name;
+		PigeonWGIVertexAttributeType type;
+	} names[] = {
+		{ "POSITION", PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION },
+		{ "POSITION-2D", PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION2D },
+		{ "POSITION-NORMALISED", PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED },
+		{ "POSITION-NORMALIZED", PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED },
+		{ "COLOUR", PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR },
+		{ "COLOUR-RGBA8", PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR_RGBA8 },
+		{ "COLOR", PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR },
+		{ "COLOR-RGBA8", PIGEON_WGI_VERTEX_ATTRIBUTE_COLOUR_RGBA8 },
+		{ "NORMAL", PIGEON_WGI_VERTEX_ATTRIBUTE_NORMAL },
+		{ "TANGENT", PIGEON_WGI_VERTEX_ATTRIBUTE_TANGENT },
+		{ "UV", PIGEON_WGI_VERTEX_ATTRIBUTE_UV },
+		{ "UV-FLOAT", PIGEON_WGI_VERTEX_ATTRIBUTE_UV_FLOAT },
+		{ "BONE", PIGEON_WGI_VERTEX_ATTRIBUTE_BONE },
+	};
+
+	asset->attributes_count = 0;
+	while (*value) {
+		if (asset->attributes_count >= PIGEON_WGI_MAX_VERTEX_ATTRIBUTES) {
+			fputs("Too many vertex attributes\n", stderr);
+			return 1;
+		}
+
+		unsigned int i = 0;
+		for (; i < sizeof names / sizeof *names; i++) {
+			if (word_matches(value, names[i].name))
+				break;
+		}
+		if (i == sizeof names / sizeof *names) {
+			fputs("Unrecognised vertex attribute\n", stderr);
+			return 1;
+		}
+
+		asset->attribute_types[asset->attributes_count++] = names[i].type;
+		value = next_word(value);
+	}
+	return 0;
+}
+
+static int parse_floats(const char* value, float* out, unsigned int n)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		value = skip_whitespace(value);
+		if (!*value)
+			return 1;
+		out[i] = strtof(value, (char**)&value);
+	}
+	return 0;
+}
+
+static int parse_subresources(const char* value, SubresourceInfo* subresources, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (word_matches(value, "ZSTD")) {
+			value = next_word(value);
+			subresources[i].zstd = true;
+			subresources[i].decompressed_size = (unsigned int)strtoul(value, (char**)&value, 10);
+			if (*value != '>')
+				return 1;
+			subresources[i].stored_size = (unsigned int)strtoul(value + 1, (char**)&value, 10);
+		} else if (word_matches(value, "NONE")) {
+			value = next_word(value);
+			subresources[i].zstd = false;
+			subresources[i].decompressed_size = subresources[i].stored_size
+				= (unsigned int)strtoul(value, (char**)&value, 10);
+		} else {
+			return 1;
+		}
+		value = skip_whitespace(value);
+	}
+	return 0;
+}
+
+static int parse_meta(ModelAsset* asset, SubresourceInfo** subresources, unsigned int* subresource_count)
+{
+	bool got_vertex_count = false;
+	bool got_indices_count = false;
+	unsigned int material = 0;
+	unsigned int animation = 0;
+	unsigned int bone = 0;
+
+	for (unsigned int l = 0; l < asset->lines_count; l++) {
+		const char* value;
+		int key = match_line(asset->lines[l], &value);
+
+		if (key == KEY_VERTEX_COUNT) {
+			asset->vertex_count = (unsigned int)strtoul(value, NULL, 10);
+			got_vertex_count = true;
+		} else if (key == KEY_BOUNDS_MINIMUM) {
+			if (parse_floats(value, asset->bounds_min, 3)) {
+				fputs("Invalid BOUNDS-MINIMUM\n", stderr);
+				return 1;
+			}
+		} else if (key == KEY_BOUNDS_RANGE) {
+			if (parse_floats(value, asset->bounds_range, 3)) {
+				fputs("Invalid BOUNDS-RANGE\n", stderr);
+				return 1;
+			}
+		} else if (key == KEY_VERTEX_ATTRIBUTES) {
+			if (parse_vertex_attributes(asset, value))
+				return 1;
+		} else if (key == KEY_INDICES_TYPE) {
+			asset->big_indices = word_matches(value, "U32");
+		} else if (key == KEY_INDICES_COUNT) {
+			asset->index_count = (unsigned int)strtoul(value, NULL, 10);
+			got_indices_count = true;
+		} else if (key == KEY_LODS_COUNT) {
+			asset->lods_count = (unsigned int)strtoul(value, NULL, 10);
+			if (asset->lods_count < 1 || asset->lods_count > PIGEON_WGI_MAX_LODS) {
+				fputs("Invalid LODS-COUNT\n", stderr);
+				return 1;
+			}
+		} else if (key == KEY_LOD_SCREEN_SIZES) {
+			if (!asset->lods_count || parse_floats(value, asset->lod_screen_sizes, asset->lods_count - 1)) {
+				fputs("Invalid LOD-SCREEN-SIZES\n", stderr);
+				return 1;
+			}
+		} else if (key == KEY_LOD) {
+			// LOD <lod> <first> <count>
+			unsigned int lod = (unsigned int)strtoul(value, (char**)&value, 10);
+			if (!material || lod < 1 || lod >= asset->lods_count) {
+				fputs("Invalid LOD\n", stderr);
+				return 1;
+			}
+			asset->materials[material - 1].lod_first[lod - 1] = (unsigned int)strtoul(value, (char**)&value, 10);
+			asset->materials[material - 1].lod_count[lod - 1] = (unsigned int)strtoul(value, NULL, 10);
+		} else if (key == KEY_MESHLETS_COUNT) {
+			asset->meshlets_count = (unsigned int)strtoul(value, NULL, 10);
+		} else if (key == KEY_MESHLETS) {
+			// MESHLETS <lod> <first> <count>
+			unsigned int lod = (unsigned int)strtoul(value, (char**)&value, 10);
+			if (!material || lod >= PIGEON_WGI_MAX_LODS) {
+				fputs("Invalid MESHLETS\n", stderr);
+				return 1;
+			}
+			asset->materials[material - 1].meshlet_first[lod] = (unsigned int)strtoul(value, (char**)&value, 10);
+			asset->materials[material - 1].meshlet_count[lod] = (unsigned int)strtoul(value, NULL, 10);
+		} else if (key == KEY_MATERIALS_COUNT) {
+			if (asset->materials) {
+				fputs("Multiple MATERIALS-COUNT\n", stderr);
+				return 1;
+			}
+			asset->materials_count = (unsigned int)strtoul(value, NULL, 10);
+			asset->materials = calloc(asset->materials_count ? asset->materials_count : 1, sizeof *asset->materials);
+			if (!asset->materials)
+				return 1;
+		} else if (key == KEY_MATERIAL) {
+			if (material >= asset->materials_count) {
+				fputs("Too many materials\n", stderr);
+				return 1;
+			}
+			material++;
+		} else if (key == KEY_FIRST || key == KEY_COUNT) {
+			if (!material) {
+				fputs("FIRST/COUNT outside of material\n", stderr);
+				return 1;
+			}
+			unsigned int x = (unsigned int)strtoul(value, NULL, 10);
+			if (key == KEY_FIRST)
+				asset->materials[material - 1].first = x;
+			else
+				asset->materials[material - 1].count = x;
+		} else if (key == KEY_BONES_COUNT) {
+			if (asset->bones) {
+				fputs("Multiple BONES-COUNT\n", stderr);
+				return 1;
+			}
+			asset->bones_count = (unsigned int)strtoul(value, NULL, 10);
+			asset->bones = calloc(asset->bones_count ? asset->bones_count : 1, sizeof *asset->bones);
+			if (!asset->bones)
+				return 1;
+		} else if (key == KEY_BONE) {
+			if (bone >= asset->bones_count) {
+				fputs("Too many bones\n", stderr);
+				return 1;
+			}
+			asset->bones[bone++].parent_index = -1;
+		} else if (key == KEY_HEAD || key == KEY_PARENT) {
+			if (!bone) {
+				fputs("HEAD/PARENT outside of bone\n", stderr);
+				return 1;
+			}
+			if (key == KEY_PARENT) {
+				asset->bones[bone - 1].parent_index = (int)strtol(value, NULL, 10);
+			} else if (parse_floats(value, asset->bones[bone - 1].head, 3)) {
+				fputs("Invalid HEAD\n", stderr);
+				return 1;
+			}
+		} else if (key == KEY_ANIMATION_SPACE) {
+			asset->local_animations = word_matches(value, "LOCAL");
+		} else if (key == KEY_ANIMATIONS_COUNT) {
+			if (asset->animations) {
+				fputs("Multiple ANIMATIONS-COUNT\n", stderr);
+				return 1;
+			}
+			asset->animations_count = (unsigned int)strtoul(value, NULL, 10);
+			asset->animations
+				= calloc(asset->animations_count ? asset->animations_count : 1, sizeof *asset->animations);
+			if (!asset->animations)
+				return 1;
+		} else if (key == KEY_ANIMATION) {
+			if (animation >= asset->animations_count) {
+				fputs("Too many animations\n", stderr);
+				return 1;
+			}
+			animation++;
+		} else if (key == KEY_FRAMES || key == KEY_COMPRESSED) {
+			if (!animation) {
+				fputs("FRAMES/COMPRESSED outside of animation\n", stderr);
+				return 1;
+			}
+			if (key == KEY_FRAMES)
+				asset->animations[animation - 1].frame_count = (unsigned int)strtoul(value, NULL, 10);
+			else
+				asset->animations[animation - 1].compressed = word_matches(value, "YES");
+		} else if (key == KEY_SUBRESOURCE_COUNT) {
+			*subresource_count = (unsigned int)strtoul(value, NULL, 10);
+			free(*subresources);
+			*subresources = calloc(*subresource_count ? *subresource_count : 1, sizeof **subresources);
+			if (!*subresources)
+				return 1;
+		} else if (key == KEY_SUBRESOURCES) {
+			if (!*subresources || parse_subresources(value, *subresources, *subresource_count)) {
+				fputs("Invalid SUBRESOURCES\n", stderr);
+				return 1;
+			}
+		}
+	}
+
+	if (!got_vertex_count || !asset->attributes_count || !asset->vertex_count) {
+		fputs("Not a model asset\n", stderr);
+		return 1;
+	}
+	if (!got_indices_count) {
+		fputs("Missing INDICES-COUNT\n", stderr);
+		return 1;
+	}
+	if (material != asset->materials_count) {
+		fputs("Missing materials\n", stderr);
+		return 1;
+	}
+	if (animation != asset->animations_count) {
+		fputs("Missing animations\n", stderr);
+		return 1;
+	}
+	if (bone != asset->bones_count) {
+		fputs("Missing bones\n", stderr);
+		return 1;
+	}
+	if (*subresource_count < asset->attributes_count + (asset->index_count ? 1 : 0) + (asset->meshlets_count ? 1 : 0)) {
+		fputs("Missing subresources\n", stderr);
+		return 1;
+	}
+
+	if (!asset->lods_count)
+		asset->lods_count = 1;
+
+	// Non-indexed models have vertex ranges
+	unsigned int elements = asset->index_count ? asset->index_count : asset->vertex_count;
+
+	for (unsigned int i = 0; i < asset->materials_count; i++) {
+		ModelMaterial* m = &asset->materials[i];
+		for (unsigned int lod = 0; lod < asset->lods_count; lod++) {
+			unsigned int first = lod ? m->lod_first[lod - 1] : m->first;
+			unsigned int count = lod ? m->lod_count[lod - 1] : m->count;
+
+			if (first > elements || count > elements - first || count % 3 != 0) {
+				fputs("Invalid material index range\n", stderr);
+				return 1;
+			}
+
+			if (m->meshlet_first[lod] > asset->meshlets_count
+				|| m->meshlet_count[lod] > asset->meshlets_count - m->meshlet_first[lod]) {
+				fputs("Invalid material meshlet range\n", stderr);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void* decompress_subresource(const uint8_t* stored, SubresourceInfo const* info)
+{
+	void* data = malloc(info->decompressed_size ? info->decompressed_size : 1);
+	if (!data)
+		return NULL;
+
+	if (info->zstd) {
+		size_t sz = ZSTD_decompress(data, info->decompressed_size, stored, info->stored_size);
+		if (ZSTD_isError(sz) || sz != info->decompressed_size) {
+			fputs("Error decompressing subresource\n", stderr);
+			free(data);
+			return NULL;
+		}
+	} else {
+		memcpy(data, stored, info->decompressed_size);
+	}
+	return data;
+}
+
+static int load_data(ModelAsset* asset, const char* data_file_path, SubresourceInfo* subresources,
+	unsigned int subresource_count)
+{
+	unsigned long data_size;
+	uint8_t* data = load_file(data_file_path, 1, &data_size);
+	if (!data)
+		return 1;
+
+#define CLEANUP() free(data);
+
+	unsigned long offset = 0;
+	for (unsigned int i = 0; i < subresource_count; i++) {
+		if (subresources[i].stored_size > data_size - offset) {
+			fputs("Data file is too small\n", stderr);
+			CLEANUP();
+			return 1;
+		}
+
+		void* decompressed = decompress_subresource(&data[offset], &subresources[i]);
+		if (!decompressed) {
+			CLEANUP();
+			return 1;
+		}
+		offset += subresources[i].stored_size;
+
+		if (i < asset->attributes_count) {
+			asset->attribute_data[i] = decompressed;
+			if (subresources[i].decompressed_size
+				!= asset->vertex_count * model_asset_attribute_size(asset->attribute_types[i])) {
+				fputs("Vertex attribute subresource is the wrong size\n", stderr);
+				CLEANUP();
+				return 1;
+			}
+		} else if (i == asset->attributes_count && asset->index_count) {
+			if (subresources[i].decompressed_size != asset->index_count * (asset->big_indices ? 4 : 2)) {
+				free(decompressed);
+				fputs("Index subresource is the wrong size\n", stderr);
+				CLEANUP();
+				return 1;
+			}
+
+			if (asset->big_indices) {
+				asset->indices = decompressed;
+			} else {
+				asset->indices = malloc(asset->index_count * sizeof *asset->indices);
+				if (!asset->indices) {
+					free(decompressed);
+					CLEANUP();
+					return 1;
+				}
+				const uint16_t* indices_u16 = decompressed;
+				for (unsigned int j = 0; j < asset->index_count; j++) {
+					asset->indices[j] = indices_u16[j];
+				}
+				free(decompressed);
+			}
+		} else if (i == subresource_count - 1 && asset->meshlets_count) {
+			asset->meshlets = decompressed;
+			if (subresources[i].decompressed_size != asset->meshlets_count * sizeof *asset->meshlets) {
+				fputs("Meshlet subresource is the wrong size\n", stderr);
+				CLEANUP();
+				return 1;
+			}
+		} else {
+			unsigned int j = asset->other_subresources_count++;
+			asset->other_subresources[j] = decompressed;
+			asset->other_subresource_sizes[j] = subresources[i].decompressed_size;
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+
+	for (unsigned int i = 0; i < asset->index_count; i++) {
+		if (asset->indices[i] >= asset->vertex_count) {
+			fputs("Index out of range\n", stderr);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int model_asset_load(ModelAsset* asset, const char* asset_file_path, const char* data_file_path)
+{
+	memset(asset, 0, sizeof *asset);
+
+	unsigned long text_size;
+	asset->text = load_file(asset_file_path, 1, &text_size);
+	if (!asset->text)
+		return 1;
+
+	if (split_lines(asset, text_size))
+		return 1;
+
+	SubresourceInfo* subresources = NULL;
+	unsigned int subresource_count = 0;
+
+#define CLEANUP() free(subresources);
+
+	if (parse_meta(asset, &subresources, &subresource_count)) {
+		CLEANUP();
+		return 1;
+	}
+
+	unsigned int others = subresource_count - asset->attributes_count - (asset->index_count ? 1 : 0)
+		- (asset->meshlets_count ? 1 : 0);
+	asset->other_subresources = calloc(others ? others : 1, sizeof *asset->other_subresources);
+	asset->other_subresource_sizes = calloc(others ? others : 1, sizeof *asset->other_subresource_sizes);
+	if (!asset->other_subresources || !asset->other_subresource_sizes) {
+		CLEANUP();
+		return 1;
+	}
+
+	if (load_data(asset, data_file_path, subresources, subresource_count)) {
+		CLEANUP();
+		return 1;
+	}
+
+	if (asset->animations_count > asset->other_subresources_count) {
+		fputs("Missing animation subresources\n", stderr);
+		CLEANUP();
+		return 1;
+	}
+	for (unsigned int i = 0; i < asset->animations_count; i++) {
+		ModelAnimation const* a = &asset->animations[i];
+		if (!a->compressed
+			&& asset->other_subresource_sizes[i] != a->frame_count * asset->bones_count * sizeof(PigeonWGIBoneData)) {
+			fputs("Animation subresource is the wrong size\n", stderr);
+			CLEANUP();
+			return 1;
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+// Same settings as blender_export.py
+static int write_subresource(FILE* f, const void* data, unsigned int size, SubresourceInfo* info)
+{
+	info->zstd = false;
+	info->decompressed_size = info->stored_size = size;
+
+	void* compressed = NULL;
+
+	if (size > 512) {
+		size_t max_length = ZSTD_compressBound(size);
+		compressed = malloc(max_length);
+		if (!compressed)
+			return 1;
+
+		size_t compressed_size = ZSTD_compress(compressed, max_length, data, size, 6);
+
+		if (!ZSTD_isError(compressed_size) && compressed_size * 10 <= (size_t)size * 8) {
+			info->zstd = true;
+			info->stored_size = (unsigned int)compressed_size;
+			data = compressed;
+		}
+	}
+
+	if (info->stored_size && fwrite(data, info->stored_size, 1, f) != 1) {
+		fputs("Error writing to file\n", stderr);
+		free(compressed);
+		return 1;
+	}
+
+	free(compressed);
+	return 0;
+}
+
+static int write_data_file(ModelAsset const* asset, FILE* f, SubresourceInfo* subresources)
+{
+	unsigned int s = 0;
+
+	for (unsigned int i = 0; i < asset->attributes_count; i++) {
+		if (write_subresource(f, asset->attribute_data[i],
+				asset->vertex_count * model_asset_attribute_size(asset->attribute_types[i]), &subresources[s++]))
+			return 1;
+	}
+
+	if (!asset->index_count) {
+	} else if (asset->big_indices) {
+		if (write_subresource(f, asset->indices, asset->index_count * 4, &subresources[s++]))
+			return 1;
+	} else {
+		uint16_t* indices_u16 = malloc(asset->index_count * sizeof *indices_u16);
+		if (!indices_u16)
+			return 1;
+		for (unsigned int i = 0; i < asset->index_count; i++) {
+			indices_u16[i] = (uint16_t)asset->indices[i];
+		}
+		int err = write_subresource(f, indices_u16, asset->index_count * 2, &subresources[s++]);
+		free(indices_u16);
+		if (err)
+			return 1;
+	}
+
+	for (unsigned int i = 0; i < asset->other_subresources_count; i++) {
+		if (write_subresource(f, asset->other_subresources[i], asset->other_subresource_sizes[i], &subresources[s++]))
+			return 1;
+	}
+
+	if (asset->meshlets_count
+		&& write_subresource(f, asset->meshlets, asset->meshlets_count * sizeof *asset->meshlets, &subresources[s++]))
+		return 1;
+
+	return 0;
+}
+
+static void write_asset_file(ModelAsset const* asset, FILE* f, SubresourceInfo const* subresources)
+{
+	unsigned int material = 0;
+	unsigned int animation = 0;
+
+	for (unsigned int l = 0; l < asset->lines_count; l++) {
+		const char* value;
+		int key = match_line(asset->lines[l], &value);
+
+		if (key == KEY_INDICES_COUNT) {
+			fprintf(f, "INDICES-COUNT %u\n", asset->index_count);
+
+			if (asset->lods_count > 1) {
+				fprintf(f, "LODS-COUNT %u\nLOD-SCREEN-SIZES", asset->lods_count);
+				for (unsigned int i = 0; i < asset->lods_count - 1; i++) {
+					fprintf(f, " %g", (double)asset->lod_screen_sizes[i]);
+				}
+				fputc('\n', f);
+			}
+
+			if (asset->meshlets_count)
+				fprintf(f, "MESHLETS-COUNT %u\n", asset->meshlets_count);
+		} else if (key == KEY_MATERIAL) {
+			material++;
+			fprintf(f, "%s\n", asset->lines[l]);
+		} else if (key == KEY_ANIMATIONS_COUNT) {
+			if (asset->local_animations)
+				fputs("ANIMATION-SPACE LOCAL\n", f);
+			fprintf(f, "%s\n", asset->lines[l]);
+		} else if (key == KEY_ANIMATION) {
+			animation++;
+			fprintf(f, "%s\n", asset->lines[l]);
+		} else if (key == KEY_FRAMES) {
+			fprintf(f, "%s\n", asset->lines[l]);
+			if (asset->animations[animation - 1].compressed)
+				fputs("COMPRESSED YES\n", f);
+		} else if (key == KEY_FIRST) {
+			fprintf(f, "FIRST %u\n", asset->materials[material - 1].first);
+		} else if (key == KEY_COUNT) {
+			ModelMaterial const* m = &asset->materials[material - 1];
+			fprintf(f, "COUNT %u\n", m->count);
+
+			for (unsigned int lod = 1; lod < asset->lods_count; lod++) {
+				fprintf(f, "LOD %u %u %u\n", lod, m->lod_first[lod - 1], m->lod_count[lod - 1]);
+			}
+			for (unsigned int lod = 0; lod < asset->lods_count; lod++) {
+				if (m->meshlet_count[lod])
+					fprintf(f, "MESHLETS %u %u %u\n", lod, m->meshlet_first[lod], m->meshlet_count[lod]);
+			}
+		} else if (key == KEY_LODS_COUNT || key == KEY_LOD_SCREEN_SIZES || key == KEY_LOD || key == KEY_MESHLETS_COUNT
+			|| key == KEY_MESHLETS || key == KEY_SUBRESOURCE_COUNT || key == KEY_SUBRESOURCES
+			|| key == KEY_COMPRESSED || key == KEY_ANIMATION_SPACE) {
+			// Regenerated
+		} else {
+			fprintf(f, "%s\n", asset->lines[l]);
+		}
+	}
+
+	unsigned int subresource_count = asset->attributes_count + (asset->index_count ? 1 : 0)
+		+ asset->other_subresources_count + (asset->meshlets_count ? 1 : 0);
+
+	fprintf(f, "SUBRESOURCE-COUNT %u\nSUBRESOURCES", subresource_count);
+	for (unsigned int i = 0; i < subresource_count; i++) {
+		if (subresources[i].zstd) {
+			fprintf(f, " ZSTD %u>%u", subresources[i].decompressed_size, subresources[i].stored_size);
+		} else {
+			fprintf(f, " NONE %u", subresources[i].decompressed_size);
+		}
+	}
+	fputc('\n', f);
+}
+
+int model_asset_save(ModelAsset const* asset, const char* asset_file_path, const char* data_file_path)
+{
+	SubresourceInfo* subresources
+		= calloc(asset->attributes_count + 2 + asset->other_subresources_count, sizeof *subresources);
+	if (!subresources)
+		return 1;
+
+	FILE* data_file = fopen(data_file_path, "wb");
+	if (!data_file) {
+		fprintf(stderr, "Error opening output data file: %s\n", data_file_path);
+		free(subresources);
+		return 1;
+	}
+
+	if (write_data_file(asset, data_file, subresources)) {
+		fclose(data_file);
+		free(subresources);
+		return 1;
+	}
+	fclose(data_file);
+
+	FILE* asset_file = fopen(asset_file_path, "w");
+	if (!asset_file) {
+		fprintf(stderr, "Error opening output asset file: %s\n", asset_file_path);
+		free(subresources);
+		return 1;
+	}
+
+	write_asset_file(asset, asset_file, subresources);
+	fclose(asset_file);
+	free(subresources);
+	return 0;
+}
+
+void model_asset_free(ModelAsset* asset)
+{
+	for (unsigned int i = 0; i < asset->attributes_count; i++) {
+		free(asset->attribute_data[i]);
+	}
+	for (unsigned int i = 0; i < asset->other_subresources_count; i++) {
+		free(asset->other_subresources[i]);
+	}
+	free(asset->other_subresources);
+	free(asset->other_subresource_sizes);
+	free(asset->indices);
+	free(asset->meshlets);
+	free(asset->materials);
+	free(asset->animations);
+	free(asset->bones);
+	free(asset->lines);
+	free(asset->text);
+	memset(asset, 0, sizeof *asset);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <pigeon/wgi/material.h>
+#include <pigeon/wgi/mesh.h>
+#include <pigeon/wgi/pipeline.h>
+#include <pigeon/wgi/bone.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct ModelMaterial {
+	// Index ranges for each level of detail. LOD 0 is first & count
+	unsigned int first, count;
+	unsigned int lod_first[PIGEON_WGI_MAX_LODS - 1];
+	unsigned int lod_count[PIGEON_WGI_MAX_LODS - 1];
+
+	// Ranges of ModelAsset.meshlets for each level of detail
+	unsigned int meshlet_first[PIGEON_WGI_MAX_LODS];
+	unsigned int meshlet_count[PIGEON_WGI_MAX_LODS];
+} ModelMaterial;
+
+typedef struct ModelAnimation {
+	unsigned int frame_count;
+	bool compressed; // See pigeon/compressed_animation.h
+} ModelAnimation;
+
+// A model .asset file and its decompressed .data file
+// Lines of the .asset file that the optimiser does not change are written back out unmodified
+typedef struct ModelAsset {
+	char* text;
+	char** lines; // Pointers into text
+	unsigned int lines_count;
+
+	unsigned int vertex_count;
+	float bounds_min[3];
+	float bounds_range[3];
+
+	unsigned int attributes_count;
+	PigeonWGIVertexAttributeType attribute_types[PIGEON_WGI_MAX_VERTEX_ATTRIBUTES];
+	void* attribute_data[PIGEON_WGI_MAX_VERTEX_ATTRIBUTES];
+
+	bool big_indices;
+	unsigned int index_count;
+	uint32_t* indices; // Always 32-bit in memory
+
+	unsigned int lods_count;
+	float lod_screen_sizes[PIGEON_WGI_MAX_LODS - 1];
+
+	unsigned int materials_count;
+	ModelMaterial* materials;
+
+	// Stored in the last subresource
+	unsigned int meshlets_count;
+	PigeonWGIMeshlet* meshlets;
+
+	// Subresources after the vertex and index data (animations), not including the meshlets
+	unsigned int other_subresources_count;
+	void** other_subresources;
+	unsigned int* other_subresource_sizes;
+
+	unsigned int bones_count;
+	PigeonWGIBone* bones; // head and parent_index only
+
+	// Animation i is other_subresources[i]
+	unsigned int animations_count;
+	ModelAnimation* animations;
+	bool local_animations; // See pigeon/skeleton.h
+} ModelAsset;
+
+unsigned int model_asset_attribute_size(PigeonWGIVertexAttributeType);
+
+// Returns the index of the attribute or -1
+int model_asset_find_attribute(ModelAsset const*, PigeonWGIVertexAttributeType);
+
+// Decodes POSITION or POSITION-NORMALISED into xyz floats. Returns NULL on error
+float* model_asset_decode_positions(ModelAsset const*);
+
+int model_asset_load(ModelAsset*, const char* asset_file_path, const char* data_file_path);
+
+// Subresources are compressed with zstd if it makes them significantly smaller
+int model_asset_save(ModelAsset const*, const char* asset_file_path, const char* data_file_path);
+
+void model_asset_free(ModelAsset*);
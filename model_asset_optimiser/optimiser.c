@@ -0,0 +1,582 @@
+#include "meshlet.h"
+#include "model_asset.h"
+#include "reorder.h"
+#include "simplify.h"
+#include <pigeon/compressed_animation.h>
+#include <pigeon/job_system/job.h>
+#include <pigeon/skeleton.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Optimises a model asset that was exported by blender_export.py
+// 1. (Optional) Generates levels of detail. Simplified index ranges are appended to the index subresource
+//    and LOD lines are added to each material
+// 2. Reorders the triangles of each index range for the vertex cache and then for overdraw
+// 3. Splits large index ranges into meshlets for per-cluster culling. The meshlets are stored in the last subresource
+// 4. Reorders the vertices in all attribute streams into the order they are first used
+// Each material is processed by a separate job
+// 5. Converts the animations to local space (pigeon/skeleton.h)
+// 6. Compresses the animations (pigeon/compressed_animation.h)
+
+PIGEON_ERR_RET pigeon_init_job_system(unsigned int threads);
+void pigeon_deinit_job_system(void);
+
+typedef struct MaterialLODs {
+	// Simplified meshes
+	uint32_t* indices[PIGEON_WGI_MAX_LODS - 1];
+	unsigned int index_count[PIGEON_WGI_MAX_LODS - 1];
+
+	VertexCacheStats stats_before[PIGEON_WGI_MAX_LODS];
+	VertexCacheStats stats_after[PIGEON_WGI_MAX_LODS];
+
+	PigeonWGIMeshlet* meshlets[PIGEON_WGI_MAX_LODS];
+	unsigned int meshlets_count[PIGEON_WGI_MAX_LODS];
+} MaterialLODs;
+
+const char* input_asset_file_path;
+char* input_data_file_path;
+const char* output_asset_file_path;
+char* output_data_file_path;
+
+unsigned int threads = 4;
+
+// Levels of detail to generate
+unsigned int lods_count = 1;
+float lod_triangle_ratios[PIGEON_WGI_MAX_LODS - 1];
+float lod_screen_sizes[PIGEON_WGI_MAX_LODS - 1];
+
+ModelAsset asset;
+float* positions;
+bool* locked;
+SimplifyVertices simplify_vertices;
+MaterialLODs* material_lods;
+
+static char* get_data_file_path(const char* asset_file_path)
+{
+	const size_t length = strlen(asset_file_path);
+
+	if (length < 7 || memcmp(&asset_file_path[length - 6], ".asset", 6) != 0) {
+		fprintf(stderr, "File path must be a .asset file, got %s\n", asset_file_path);
+		return NULL;
+	}
+
+	char* data_file_path = malloc(length);
+	if (!data_file_path)
+		return NULL;
+
+	memcpy(data_file_path, asset_file_path, length - 5);
+	memcpy(&data_file_path[length - 5], "data", 5);
+	return data_file_path;
+}
+
+static int parse_arguments(int argc, const char** argv)
+{
+	int arg = 1;
+
+	if (argc > 1 && memcmp(argv[1], "-j", 2) == 0) {
+		threads = (unsigned int)strtoul(&argv[1][2], NULL, 10);
+		if (!threads)
+			threads = 1;
+		arg++;
+	}
+
+	if (argc - arg < 2 || (argc - arg) % 2 != 0 || (argc - arg - 2) / 2 > PIGEON_WGI_MAX_LODS - 1) {
+		fprintf(stderr, "Usage: %s [-jTHREADS] [INPUT_FILE] [OUTPUT_FILE] [TRIANGLE_RATIO SCREEN_SIZE]...\n", argv[0]);
+		fprintf(stderr, "Up to %u levels of detail can be generated\n", PIGEON_WGI_MAX_LODS - 1);
+		return 1;
+	}
+
+	input_asset_file_path = argv[arg++];
+	output_asset_file_path = argv[arg++];
+
+	input_data_file_path = get_data_file_path(input_asset_file_path);
+	output_data_file_path = get_data_file_path(output_asset_file_path);
+	if (!input_data_file_path || !output_data_file_path)
+		return 1;
+
+	for (; arg < argc; arg += 2) {
+		float ratio = strtof(argv[arg], NULL);
+		float screen_size = strtof(argv[arg + 1], NULL);
+
+		float previous_ratio = lods_count > 1 ? lod_triangle_ratios[lods_count - 2] : 1.0f;
+		if (!(ratio > 0.0f && ratio < previous_ratio)) {
+			fputs("Triangle ratios must be between 0 and 1 and decreasing\n", stderr);
+			return 1;
+		}
+
+		if (!(screen_size > 0.0f && (lods_count == 1 || screen_size < lod_screen_sizes[lods_count - 2]))) {
+			fputs("Screen sizes must be positive and decreasing\n", stderr);
+			return 1;
+		}
+
+		lod_triangle_ratios[lods_count - 1] = ratio;
+		lod_screen_sizes[lods_count - 1] = screen_size;
+		lods_count++;
+	}
+
+	return 0;
+}
+
+static int compare_positions(const void* a_, const void* b_)
+{
+	const float* a = &positions[*(const uint32_t*)a_ * 3];
+	const float* b = &positions[*(const uint32_t*)b_ * 3];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		if (a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+// The exporter splits vertices along UV seams (and tangent seams) so the same position is used by multiple
+// vertices. Collapsing those vertices would tear the seam open, so they are locked.
+// Vertices used by more than one material are locked so that the materials stay connected.
+static int lock_vertices(void)
+{
+	locked = calloc(asset.vertex_count, sizeof *locked);
+	uint32_t* sorted = malloc(asset.vertex_count * sizeof *sorted);
+	int* vertex_material = malloc(asset.vertex_count * sizeof *vertex_material);
+
+#define CLEANUP()                                                                                                      \
+	free(sorted);                                                                                                      \
+	free(vertex_material);
+
+	if (!locked || !sorted || !vertex_material) {
+		CLEANUP();
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < asset.vertex_count; i++) {
+		sorted[i] = i;
+	}
+	qsort(sorted, asset.vertex_count, sizeof *sorted, compare_positions);
+
+	for (unsigned int i = 1; i < asset.vertex_count; i++) {
+		if (compare_positions(&sorted[i - 1], &sorted[i]) == 0) {
+			locked[sorted[i - 1]] = true;
+			locked[sorted[i]] = true;
+		}
+	}
+
+	memset(vertex_material, 0xff, asset.vertex_count * sizeof *vertex_material);
+
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		ModelMaterial const* material = &asset.materials[m];
+		for (unsigned int i = material->first; i < material->first + material->count; i++) {
+			uint32_t v = asset.indices[i];
+			if (vertex_material[v] >= 0 && vertex_material[v] != (int)m)
+				locked[v] = true;
+			vertex_material[v] = (int)m;
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static PIGEON_ERR_RET simplify_material(uint64_t material_index, void* arg1)
+{
+	(void)arg1;
+
+	ModelMaterial const* material = &asset.materials[material_index];
+	MaterialLODs* lods = &material_lods[material_index];
+
+	// Each level of detail is simplified from the previous one
+
+	const uint32_t* indices = &asset.indices[material->first];
+	unsigned int index_count = material->count;
+
+	for (unsigned int lod = 1; lod < lods_count; lod++) {
+		unsigned int target = (unsigned int)((float)material->count * lod_triangle_ratios[lod - 1]) / 3 * 3;
+
+		lods->indices[lod - 1] = malloc((index_count ? index_count : 1) * sizeof *lods->indices[lod - 1]);
+		if (!lods->indices[lod - 1])
+			return 1;
+
+		if (simplify_mesh(&simplify_vertices, indices, index_count, target, lods->indices[lod - 1],
+				&lods->index_count[lod - 1]))
+			return 1;
+
+		indices = lods->indices[lod - 1];
+		index_count = lods->index_count[lod - 1];
+	}
+	return 0;
+}
+
+static int run_material_jobs(PigeonJobFunction function)
+{
+	if (!asset.materials_count)
+		return 0;
+
+	PigeonJob* jobs = calloc(asset.materials_count, sizeof *jobs);
+	if (!jobs)
+		return 1;
+
+	for (unsigned int i = 0; i < asset.materials_count; i++) {
+		jobs[i].function = function;
+		jobs[i].arg0 = i;
+	}
+
+	int err = pigeon_dispatch_jobs(jobs, asset.materials_count);
+	free(jobs);
+	return err;
+}
+
+// The index buffer is rebuilt with the LODs of each material after LOD 0 of that material
+static int rebuild_index_buffer(void)
+{
+	unsigned int index_count = 0;
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		index_count += asset.materials[m].count;
+		for (unsigned int lod = 1; lod < lods_count; lod++) {
+			index_count += material_lods[m].index_count[lod - 1];
+		}
+	}
+
+	uint32_t* indices = malloc(index_count * sizeof *indices);
+	if (!indices)
+		return 1;
+
+	unsigned int offset = 0;
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		ModelMaterial* material = &asset.materials[m];
+		MaterialLODs const* lods = &material_lods[m];
+
+		memcpy(&indices[offset], &asset.indices[material->first], material->count * sizeof *indices);
+		material->first = offset;
+		offset += material->count;
+
+		for (unsigned int lod = 1; lod < lods_count; lod++) {
+			memcpy(&indices[offset], lods->indices[lod - 1], lods->index_count[lod - 1] * sizeof *indices);
+			material->lod_first[lod - 1] = offset;
+			material->lod_count[lod - 1] = lods->index_count[lod - 1];
+			offset += lods->index_count[lod - 1];
+		}
+	}
+
+	free(asset.indices);
+	asset.indices = indices;
+	asset.index_count = index_count;
+	asset.lods_count = lods_count;
+	memcpy(asset.lod_screen_sizes, lod_screen_sizes, sizeof lod_screen_sizes);
+	return 0;
+}
+
+static void print_lod_stats(void)
+{
+	for (unsigned int lod = 0; lod < lods_count; lod++) {
+		unsigned int index_count = 0;
+		for (unsigned int m = 0; m < asset.materials_count; m++) {
+			index_count += lod ? material_lods[m].index_count[lod - 1] : asset.materials[m].count;
+		}
+		printf("LOD %u: %u triangles\n", lod, index_count / 3);
+	}
+}
+
+static PIGEON_ERR_RET optimise_material(uint64_t material_index, void* arg1)
+{
+	(void)arg1;
+
+	ModelMaterial const* material = &asset.materials[material_index];
+	MaterialLODs* lods = &material_lods[material_index];
+
+	for (unsigned int lod = 0; lod < asset.lods_count; lod++) {
+		unsigned int first = lod ? material->lod_first[lod - 1] : material->first;
+		uint32_t* indices = &asset.indices[first];
+		unsigned int index_count = lod ? material->lod_count[lod - 1] : material->count;
+
+		if (analyse_vertex_cache(indices, index_count, asset.vertex_count, &lods->stats_before[lod]))
+			return 1;
+		if (optimise_vertex_cache(indices, index_count, asset.vertex_count))
+			return 1;
+		if (optimise_overdraw(indices, index_count, positions, asset.vertex_count))
+			return 1;
+		if (analyse_vertex_cache(indices, index_count, asset.vertex_count, &lods->stats_after[lod]))
+			return 1;
+
+		if (index_count / 3 >= MESHLET_MIN_RANGE_TRIANGLES
+			&& build_meshlets(indices, index_count, first, positions, asset.vertex_count, &lods->meshlets[lod],
+				&lods->meshlets_count[lod]))
+			return 1;
+	}
+	return 0;
+}
+
+// Concatenates the meshlets of every material. Existing meshlets are replaced
+static int gather_meshlets(void)
+{
+	unsigned int meshlets_count = 0;
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		for (unsigned int lod = 0; lod < asset.lods_count; lod++) {
+			meshlets_count += material_lods[m].meshlets_count[lod];
+		}
+	}
+
+	free(asset.meshlets);
+	asset.meshlets = NULL;
+	asset.meshlets_count = 0;
+
+	if (!meshlets_count)
+		return 0;
+
+	asset.meshlets = malloc(meshlets_count * sizeof *asset.meshlets);
+	if (!asset.meshlets)
+		return 1;
+
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		ModelMaterial* material = &asset.materials[m];
+		for (unsigned int lod = 0; lod < asset.lods_count; lod++) {
+			unsigned int count = material_lods[m].meshlets_count[lod];
+			material->meshlet_first[lod] = count ? asset.meshlets_count : 0;
+			material->meshlet_count[lod] = count;
+			if (count)
+				memcpy(&asset.meshlets[asset.meshlets_count], material_lods[m].meshlets[lod],
+					count * sizeof *asset.meshlets);
+			asset.meshlets_count += count;
+		}
+	}
+
+	printf("%u meshlets\n", asset.meshlets_count);
+	return 0;
+}
+
+static void print_vertex_cache_stats(void)
+{
+	printf("Vertex cache (FIFO, %u entries)\n", VERTEX_CACHE_SIZE);
+
+	for (unsigned int lod = 0; lod < asset.lods_count; lod++) {
+		VertexCacheStats before = { 0 }, after = { 0 };
+
+		for (unsigned int m = 0; m < asset.materials_count; m++) {
+			before.triangles += material_lods[m].stats_before[lod].triangles;
+			before.vertices += material_lods[m].stats_before[lod].vertices;
+			before.misses += material_lods[m].stats_before[lod].misses;
+			after.misses += material_lods[m].stats_after[lod].misses;
+		}
+
+		if (!before.triangles)
+			continue;
+
+		printf("LOD %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", lod, (double)before.misses / before.triangles,
+			(double)after.misses / before.triangles, (double)before.misses / before.vertices,
+			(double)after.misses / before.vertices);
+	}
+}
+
+// Vertices are moved to the order that they are first used in the index buffer
+static int reorder_vertices(void)
+{
+	uint32_t* remap = malloc(asset.vertex_count * sizeof *remap);
+	if (!remap)
+		return 1;
+
+	optimise_vertex_fetch(asset.indices, asset.index_count, asset.vertex_count, remap);
+
+	for (unsigned int a = 0; a < asset.attributes_count; a++) {
+		unsigned int size = model_asset_attribute_size(asset.attribute_types[a]);
+		uint8_t* old_data = asset.attribute_data[a];
+		uint8_t* new_data = malloc(asset.vertex_count * size);
+		if (!new_data) {
+			free(remap);
+			return 1;
+		}
+
+		for (unsigned int v = 0; v < asset.vertex_count; v++) {
+			memcpy(&new_data[remap[v] * size], &old_data[v * size], size);
+		}
+
+		free(old_data);
+		asset.attribute_data[a] = new_data;
+	}
+
+	free(remap);
+	return 0;
+}
+
+static void free_material_lods(void)
+{
+	if (!material_lods)
+		return;
+
+	for (unsigned int m = 0; m < asset.materials_count; m++) {
+		for (unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS - 1; lod++) {
+			free(material_lods[m].indices[lod]);
+		}
+		for (unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS; lod++) {
+			free(material_lods[m].meshlets[lod]);
+		}
+	}
+	free(material_lods);
+	material_lods = NULL;
+}
+
+static int generate_lods(void)
+{
+	if (asset.lods_count > 1) {
+		fputs("Model already has levels of detail\n", stderr);
+		return 1;
+	}
+
+	if (lock_vertices())
+		return 1;
+
+	int bone_attribute = model_asset_find_attribute(&asset, PIGEON_WGI_VERTEX_ATTRIBUTE_BONE);
+
+	simplify_vertices.count = asset.vertex_count;
+	simplify_vertices.positions = positions;
+	simplify_vertices.bones = bone_attribute >= 0 ? asset.attribute_data[bone_attribute] : NULL;
+	simplify_vertices.locked = locked;
+
+	if (run_material_jobs(simplify_material)) {
+		fputs("Error simplifying mesh\n", stderr);
+		return 1;
+	}
+
+	print_lod_stats();
+	return rebuild_index_buffer();
+}
+
+static int optimise(void)
+{
+	if (!asset.index_count) {
+		if (lods_count > 1) {
+			fputs("Only models with index buffers can be simplified\n", stderr);
+			return 1;
+		}
+		puts("Model has no index buffer, nothing to optimise");
+		return 0;
+	}
+
+	positions = model_asset_decode_positions(&asset);
+	material_lods = calloc(asset.materials_count ? asset.materials_count : 1, sizeof *material_lods);
+	if (!positions || !material_lods)
+		return 1;
+
+	if (lods_count > 1 && generate_lods())
+		return 1;
+
+	if (run_material_jobs(optimise_material)) {
+		fputs("Error optimising index buffer\n", stderr);
+		return 1;
+	}
+
+	print_vertex_cache_stats();
+
+	if (gather_meshlets())
+		return 1;
+
+	return reorder_vertices();
+}
+
+static int convert_animations_to_local_space(void)
+{
+	if (asset.local_animations || !asset.animations_count || !asset.bones_count)
+		return 0;
+
+	for (unsigned int i = 0; i < asset.animations_count; i++) {
+		if (asset.animations[i].compressed) {
+			puts("Animations are already compressed, not converting them to local space");
+			return 0;
+		}
+	}
+
+	PigeonSkeleton skeleton;
+	if (pigeon_create_skeleton(&skeleton, asset.bones, asset.bones_count))
+		return 1;
+
+	PigeonWGIBoneData* local = malloc(asset.bones_count * sizeof *local);
+	if (!local) {
+		pigeon_destroy_skeleton(&skeleton);
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < asset.animations_count; i++) {
+		PigeonWGIBoneData* frames = asset.other_subresources[i];
+		for (unsigned int f = 0; f < asset.animations[i].frame_count; f++) {
+			pigeon_skeleton_local_pose(&skeleton, &frames[f * asset.bones_count], local);
+			memcpy(&frames[f * asset.bones_count], local, asset.bones_count * sizeof *local);
+		}
+	}
+
+	free(local);
+	pigeon_destroy_skeleton(&skeleton);
+	asset.local_animations = true;
+	return 0;
+}
+
+static int compress_animations(void)
+{
+	const PigeonAnimationCompressionErrors errors = { PIGEON_ANIMATION_DEFAULT_ROTATION_ERROR,
+		PIGEON_ANIMATION_DEFAULT_TRANSLATION_ERROR, PIGEON_ANIMATION_DEFAULT_SCALE_ERROR };
+
+	for (unsigned int i = 0; i < asset.animations_count; i++) {
+		ModelAnimation* a = &asset.animations[i];
+		if (a->compressed || !a->frame_count || !asset.bones_count)
+			continue;
+
+		unsigned int size;
+		void* compressed = pigeon_compress_animation(
+			asset.other_subresources[i], asset.bones_count, a->frame_count, &errors, &size);
+		if (!compressed) {
+			fputs("Error compressing animation\n", stderr);
+			return 1;
+		}
+
+		printf("Animation %u: %u bytes -> %u bytes\n", i, asset.other_subresource_sizes[i], size);
+
+		if (size >= asset.other_subresource_sizes[i]) {
+			free(compressed);
+			continue;
+		}
+
+		free(asset.other_subresources[i]);
+		asset.other_subresources[i] = compressed;
+		asset.other_subresource_sizes[i] = size;
+		a->compressed = true;
+	}
+	return 0;
+}
+
+int main(int argc, const char** argv)
+{
+	if (parse_arguments(argc, argv))
+		return 1;
+
+#define CLEANUP()                                                                                                      \
+	free_material_lods();                                                                                              \
+	free(positions);                                                                                                   \
+	free(locked);                                                                                                      \
+	model_asset_free(&asset);
+
+	if (model_asset_load(&asset, input_asset_file_path, input_data_file_path)) {
+		CLEANUP();
+		return 1;
+	}
+
+	if (pigeon_init_job_system(threads)) {
+		CLEANUP();
+		return 1;
+	}
+
+	int err = optimise();
+	pigeon_deinit_job_system();
+
+	if (!err)
+		err = convert_animations_to_local_space();
+	if (!err)
+		err = compress_animations();
+
+	if (err || model_asset_save(&asset, output_asset_file_path, output_data_file_path)) {
+		remove(output_asset_file_path);
+		remove(output_data_file_path);
+		CLEANUP();
+		return 1;
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
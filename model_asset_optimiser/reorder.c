@@ -0,0 +1,408 @@
+#include "reorder.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FIFO cache simulation. A vertex is in the cache if fewer than VERTEX_CACHE_SIZE vertices have been added since it
+typedef struct CacheSimulation {
+	uint32_t* inserted; // Per-vertex. Value of time when the vertex was added. 0 = never
+	uint32_t time;
+} CacheSimulation;
+
+typedef struct Cluster {
+	float sort_key;
+	uint32_t first_triangle;
+	uint32_t triangle_count;
+} Cluster;
+
+static bool cache_contains(CacheSimulation const* c, uint32_t v)
+{
+	return c->inserted[v] && c->time - c->inserted[v] < VERTEX_CACHE_SIZE;
+}
+
+// Returns the number of cache misses
+static unsigned int cache_add_triangle(CacheSimulation* c, const uint32_t* triangle)
+{
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < 3; i++) {
+		if (!cache_contains(c, triangle[i])) {
+			c->inserted[triangle[i]] = ++c->time;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+static void cache_flush(CacheSimulation* c) { c->time += VERTEX_CACHE_SIZE; }
+
+int analyse_vertex_cache(
+	const uint32_t* indices, unsigned int index_count, unsigned int vertex_count, VertexCacheStats* stats)
+{
+	memset(stats, 0, sizeof *stats);
+
+	CacheSimulation cache = { 0 };
+	cache.inserted = calloc(vertex_count ? vertex_count : 1, sizeof *cache.inserted);
+	if (!cache.inserted)
+		return 1;
+
+	stats->triangles = index_count / 3;
+
+	for (unsigned int i = 0; i < stats->triangles; i++) {
+		const uint32_t* triangle = &indices[i * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			if (!cache.inserted[triangle[j]])
+				stats->vertices++;
+		}
+		stats->misses += cache_add_triangle(&cache, triangle);
+	}
+
+	free(cache.inserted);
+
+	stats->acmr = stats->triangles ? (float)stats->misses / (float)stats->triangles : 0;
+	stats->atvr = stats->vertices ? (float)stats->misses / (float)stats->vertices : 0;
+	return 0;
+}
+
+typedef struct Tipsify {
+	const uint32_t* indices;
+	unsigned int vertex_count;
+
+	// Triangles using each vertex
+	uint32_t* adjacency_offsets;
+	uint32_t* adjacency;
+
+	uint32_t* live_triangles; // Per-vertex count of triangles that have not been output yet
+	uint32_t* cache_time; // Per-vertex
+	uint32_t time;
+
+	uint32_t* dead_end_stack;
+	unsigned int dead_end_stack_size;
+	unsigned int cursor; // Next vertex to check when the dead-end stack is empty
+
+	uint32_t* candidates;
+	bool* emitted; // Per-triangle
+} Tipsify;
+
+// Returns -1 when all triangles have been output
+static int64_t tipsify_skip_dead_end(Tipsify* t)
+{
+	while (t->dead_end_stack_size) {
+		uint32_t v = t->dead_end_stack[--t->dead_end_stack_size];
+		if (t->live_triangles[v])
+			return v;
+	}
+
+	for (; t->cursor < t->vertex_count; t->cursor++) {
+		if (t->live_triangles[t->cursor])
+			return t->cursor;
+	}
+	return -1;
+}
+
+// Picks the candidate that will still be in the cache after its remaining triangles are output,
+// preferring the one that has been in the cache longest
+static int64_t tipsify_next_vertex(Tipsify* t, unsigned int candidates_count)
+{
+	int64_t best = -1;
+	int64_t best_priority = -1;
+
+	for (unsigned int i = 0; i < candidates_count; i++) {
+		uint32_t v = t->candidates[i];
+		if (!t->live_triangles[v])
+			continue;
+
+		int64_t priority = 0;
+		int64_t age = (int64_t)t->time - t->cache_time[v];
+		if (age + 2 * (int64_t)t->live_triangles[v] <= VERTEX_CACHE_SIZE)
+			priority = age;
+
+		if (priority > best_priority) {
+			best_priority = priority;
+			best = v;
+		}
+	}
+
+	return best >= 0 ? best : tipsify_skip_dead_end(t);
+}
+
+int optimise_vertex_cache(uint32_t* indices, unsigned int index_count, unsigned int vertex_count)
+{
+	unsigned int triangle_count = index_count / 3;
+	if (triangle_count < 2)
+		return 0;
+
+	Tipsify t = { 0 };
+	t.indices = indices;
+	t.vertex_count = vertex_count;
+	t.adjacency_offsets = calloc(vertex_count + 1, sizeof *t.adjacency_offsets);
+	t.adjacency = malloc(triangle_count * 3 * sizeof *t.adjacency);
+	t.live_triangles = calloc(vertex_count, sizeof *t.live_triangles);
+	t.cache_time = calloc(vertex_count, sizeof *t.cache_time);
+	t.dead_end_stack = malloc(triangle_count * 3 * sizeof *t.dead_end_stack);
+	t.candidates = malloc(triangle_count * 3 * sizeof *t.candidates);
+	t.emitted = calloc(triangle_count, sizeof *t.emitted);
+	uint32_t* output = malloc(triangle_count * 3 * sizeof *output);
+
+#define CLEANUP()                                                                                                      \
+	free(t.adjacency_offsets);                                                                                         \
+	free(t.adjacency);                                                                                                 \
+	free(t.live_triangles);                                                                                            \
+	free(t.cache_time);                                                                                                \
+	free(t.dead_end_stack);                                                                                            \
+	free(t.candidates);                                                                                                \
+	free(t.emitted);                                                                                                   \
+	free(output);
+
+	if (!t.adjacency_offsets || !t.adjacency || !t.live_triangles || !t.cache_time || !t.dead_end_stack
+		|| !t.candidates || !t.emitted || !output) {
+		CLEANUP();
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < triangle_count * 3; i++) {
+		t.live_triangles[indices[i]]++;
+	}
+	for (unsigned int i = 0; i < vertex_count; i++) {
+		t.adjacency_offsets[i + 1] = t.adjacency_offsets[i] + t.live_triangles[i];
+	}
+
+	// cache_time is used as a write cursor
+	memcpy(t.cache_time, t.adjacency_offsets, vertex_count * sizeof *t.cache_time);
+	for (unsigned int i = 0; i < triangle_count * 3; i++) {
+		t.adjacency[t.cache_time[indices[i]]++] = i / 3;
+	}
+	memset(t.cache_time, 0, vertex_count * sizeof *t.cache_time);
+
+	t.time = VERTEX_CACHE_SIZE + 1;
+	unsigned int output_count = 0;
+
+	int64_t fanning_vertex = tipsify_skip_dead_end(&t);
+
+	while (fanning_vertex >= 0) {
+		unsigned int candidates_count = 0;
+		uint32_t f = (uint32_t)fanning_vertex;
+
+		for (uint32_t i = t.adjacency_offsets[f]; i < t.adjacency_offsets[f + 1]; i++) {
+			uint32_t triangle = t.adjacency[i];
+			if (t.emitted[triangle])
+				continue;
+			t.emitted[triangle] = true;
+
+			for (unsigned int j = 0; j < 3; j++) {
+				uint32_t v = indices[triangle * 3 + j];
+
+				output[output_count++] = v;
+				t.dead_end_stack[t.dead_end_stack_size++] = v;
+				t.candidates[candidates_count++] = v;
+				t.live_triangles[v]--;
+
+				if (t.time - t.cache_time[v] > VERTEX_CACHE_SIZE) {
+					t.cache_time[v] = t.time++;
+				}
+			}
+		}
+
+		fanning_vertex = tipsify_next_vertex(&t, candidates_count);
+	}
+
+	memcpy(indices, output, triangle_count * 3 * sizeof *indices);
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static void triangle_centroid_and_normal(
+	const uint32_t* triangle, const float* positions, float centroid[3], float normal[3])
+{
+	const float* p0 = &positions[triangle[0] * 3];
+	const float* p1 = &positions[triangle[1] * 3];
+	const float* p2 = &positions[triangle[2] * 3];
+
+	float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+	// Length is 2x the area
+	normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+	normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+	normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		centroid[i] = (p0[i] + p1[i] + p2[i]) / 3.0f;
+	}
+}
+
+// Clusters are split where the cache would be flushed anyway (all 3 vertices miss). Each of these is then split
+// again where the ACMR of the cluster so far is good enough
+static unsigned int find_clusters(
+	const uint32_t* indices, unsigned int triangle_count, CacheSimulation* cache, bool* hard_boundary, Cluster* clusters)
+{
+	for (unsigned int i = 0; i < triangle_count; i++) {
+		hard_boundary[i] = cache_add_triangle(cache, &indices[i * 3]) == 3;
+	}
+
+	unsigned int clusters_count = 0;
+	unsigned int hard_start = 0;
+
+	while (hard_start < triangle_count) {
+		unsigned int hard_end = hard_start + 1;
+		while (hard_end < triangle_count && !hard_boundary[hard_end]) {
+			hard_end++;
+		}
+
+		cache_flush(cache);
+		unsigned int misses = 0;
+		for (unsigned int i = hard_start; i < hard_end; i++) {
+			misses += cache_add_triangle(cache, &indices[i * 3]);
+		}
+		float threshold = OVERDRAW_ACMR_THRESHOLD * (float)misses / (float)(hard_end - hard_start);
+
+		cache_flush(cache);
+		misses = 0;
+		unsigned int start = hard_start;
+		for (unsigned int i = hard_start; i < hard_end; i++) {
+			misses += cache_add_triangle(cache, &indices[i * 3]);
+
+			if (i + 1 == hard_end || (float)misses / (float)(i + 1 - start) <= threshold) {
+				clusters[clusters_count].first_triangle = start;
+				clusters[clusters_count].triangle_count = i + 1 - start;
+				clusters_count++;
+
+				start = i + 1;
+				misses = 0;
+				cache_flush(cache);
+			}
+		}
+
+		hard_start = hard_end;
+	}
+
+	return clusters_count;
+}
+
+static int compare_clusters(const void* a_, const void* b_)
+{
+	Cluster const* a = a_;
+	Cluster const* b = b_;
+
+	// Descending
+	if (a->sort_key != b->sort_key)
+		return a->sort_key > b->sort_key ? -1 : 1;
+	return a->first_triangle < b->first_triangle ? -1 : 1;
+}
+
+int optimise_overdraw(uint32_t* indices, unsigned int index_count, const float* positions, unsigned int vertex_count)
+{
+	unsigned int triangle_count = index_count / 3;
+	if (triangle_count < 2)
+		return 0;
+
+	CacheSimulation cache = { 0 };
+	cache.inserted = calloc(vertex_count, sizeof *cache.inserted);
+	bool* hard_boundary = malloc(triangle_count * sizeof *hard_boundary);
+	Cluster* clusters = malloc(triangle_count * sizeof *clusters);
+	uint32_t* output = malloc(triangle_count * 3 * sizeof *output);
+
+#define CLEANUP()                                                                                                      \
+	free(cache.inserted);                                                                                              \
+	free(hard_boundary);                                                                                               \
+	free(clusters);                                                                                                    \
+	free(output);
+
+	if (!cache.inserted || !hard_boundary || !clusters || !output) {
+		CLEANUP();
+		return 1;
+	}
+
+	unsigned int clusters_count = find_clusters(indices, triangle_count, &cache, hard_boundary, clusters);
+
+	// Area-weighted centroid of the mesh
+
+	float mesh_centroid[3] = { 0 };
+	float mesh_area = 0;
+
+	for (unsigned int i = 0; i < triangle_count; i++) {
+		float centroid[3], normal[3];
+		triangle_centroid_and_normal(&indices[i * 3], positions, centroid, normal);
+		float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		for (unsigned int j = 0; j < 3; j++) {
+			mesh_centroid[j] += centroid[j] * area;
+		}
+		mesh_area += area;
+	}
+
+	if (mesh_area > 0) {
+		for (unsigned int j = 0; j < 3; j++) {
+			mesh_centroid[j] /= mesh_area;
+		}
+	}
+
+	// Clusters that face away from the centre of the mesh are more likely to occlude other clusters
+
+	for (unsigned int c = 0; c < clusters_count; c++) {
+		Cluster* cluster = &clusters[c];
+
+		float cluster_centroid[3] = { 0 };
+		float cluster_normal[3] = { 0 };
+		float cluster_area = 0;
+
+		for (unsigned int i = cluster->first_triangle; i < cluster->first_triangle + cluster->triangle_count; i++) {
+			float centroid[3], normal[3];
+			triangle_centroid_and_normal(&indices[i * 3], positions, centroid, normal);
+			float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+			for (unsigned int j = 0; j < 3; j++) {
+				cluster_centroid[j] += centroid[j] * area;
+				cluster_normal[j] += normal[j];
+			}
+			cluster_area += area;
+		}
+
+		float normal_length = sqrtf(cluster_normal[0] * cluster_normal[0] + cluster_normal[1] * cluster_normal[1]
+			+ cluster_normal[2] * cluster_normal[2]);
+
+		cluster->sort_key = 0;
+		if (cluster_area > 0 && normal_length > 0) {
+			for (unsigned int j = 0; j < 3; j++) {
+				cluster->sort_key
+					+= (cluster_centroid[j] / cluster_area - mesh_centroid[j]) * (cluster_normal[j] / normal_length);
+			}
+		}
+	}
+
+	qsort(clusters, clusters_count, sizeof *clusters, compare_clusters);
+
+	unsigned int output_count = 0;
+	for (unsigned int c = 0; c < clusters_count; c++) {
+		memcpy(&output[output_count], &indices[clusters[c].first_triangle * 3],
+			clusters[c].triangle_count * 3 * sizeof *output);
+		output_count += clusters[c].triangle_count * 3;
+	}
+
+	memcpy(indices, output, triangle_count * 3 * sizeof *indices);
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+void optimise_vertex_fetch(uint32_t* indices, unsigned int index_count, unsigned int vertex_count, uint32_t* remap)
+{
+	memset(remap, 0xff, vertex_count * sizeof *remap);
+
+	uint32_t next = 0;
+
+	for (unsigned int i = 0; i < index_count; i++) {
+		uint32_t v = indices[i];
+		if (remap[v] == UINT32_MAX)
+			remap[v] = next++;
+		indices[i] = remap[v];
+	}
+
+	for (unsigned int i = 0; i < vertex_count; i++) {
+		if (remap[i] == UINT32_MAX)
+			remap[i] = next++;
+	}
+}
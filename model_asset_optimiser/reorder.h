@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Size of the simulated FIFO post-transform vertex cache
+#define VERTEX_CACHE_SIZE 16
+
+// Overdraw optimisation is allowed to make ACMR this much worse
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+typedef struct VertexCacheStats {
+	unsigned int triangles;
+	unsigned int vertices; // Unique vertices referenced
+	unsigned int misses;
+	float acmr; // Average cache miss ratio: misses per triangle. 0.5 is ideal, 3 is the worst
+	float atvr; // Average transform to vertex ratio: misses per vertex. 1 is ideal
+} VertexCacheStats;
+
+// Functions that take a vertex_count use it to size per-vertex arrays. All indices must be < vertex_count.
+// Functions that return int return 1 on allocation failure
+
+int analyse_vertex_cache(
+	const uint32_t* indices, unsigned int index_count, unsigned int vertex_count, VertexCacheStats*);
+
+// Reorders triangles for the post-transform vertex cache
+// Sander et al. 2007, Fast Triangle Reordering for Vertex Locality and Reduced Overdraw (Tipsify)
+int optimise_vertex_cache(uint32_t* indices, unsigned int index_count, unsigned int vertex_count);
+
+// Reorders clusters of triangles so that triangles facing outwards are drawn first.
+// The clusters are chosen so that ACMR stays within OVERDRAW_ACMR_THRESHOLD of the input.
+// Run after optimise_vertex_cache. positions is xyz
+int optimise_overdraw(uint32_t* indices, unsigned int index_count, const float* positions, unsigned int vertex_count);
+
+// Fills remap[old vertex index] with the new vertex index so that vertices are stored in the order that they are
+// first used. Vertices that are not used are moved to the end. Indices are updated.
+void optimise_vertex_fetch(uint32_t* indices, unsigned int index_count, unsigned int vertex_count, uint32_t* remap);
@@ -0,0 +1,490 @@
+#include "simplify.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Based on Garland & Heckbert, Surface Simplification Using Quadric Error Metrics (1997)
+// Collapses are done in passes. Each pass sorts all candidate edges by cost and collapses the cheapest ones
+// that do not touch a vertex that was already changed in that pass.
+
+// Symmetric 4x4 matrix
+typedef struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} Quadric;
+
+typedef struct Collapse {
+	uint32_t from, to;
+	double cost;
+} Collapse;
+
+// Edges on the boundary of open meshes have planes perpendicular to the surface added to their quadrics
+// so that the outline of the mesh does not shrink
+#define BOUNDARY_WEIGHT 10.0
+
+#define EMPTY_EDGE UINT64_MAX
+
+// Hash table of undirected edges -> number of triangles using that edge
+typedef struct EdgeTable {
+	uint64_t* keys;
+	uint32_t* counts;
+	size_t capacity; // Power of 2
+} EdgeTable;
+
+typedef struct Simplifier {
+	SimplifyVertices const* vertices;
+
+	uint32_t* indices;
+	unsigned int triangles;
+	bool* removed; // Per-triangle
+
+	Quadric* quadrics;
+
+	// Triangles using each vertex. Rebuilt each pass
+	uint32_t* adjacency_offsets;
+	uint32_t* adjacency;
+
+	EdgeTable edges; // Rebuilt each pass
+	bool* boundary; // Vertex is on a boundary or non-manifold edge. Rebuilt each pass
+
+	bool* touched; // Vertex has been changed in this pass
+	uint32_t* marks; // Used for finding the common neighbours of two vertices
+	uint32_t mark;
+
+	Collapse* collapses;
+} Simplifier;
+
+static void quadric_add_plane(Quadric* q, const double n[3], double d, double w)
+{
+	q->a2 += w * n[0] * n[0];
+	q->ab += w * n[0] * n[1];
+	q->ac += w * n[0] * n[2];
+	q->ad += w * n[0] * d;
+	q->b2 += w * n[1] * n[1];
+	q->bc += w * n[1] * n[2];
+	q->bd += w * n[1] * d;
+	q->c2 += w * n[2] * n[2];
+	q->cd += w * n[2] * d;
+	q->d2 += w * d * d;
+}
+
+static void quadric_add(Quadric* q, Quadric const* q2)
+{
+	q->a2 += q2->a2;
+	q->ab += q2->ab;
+	q->ac += q2->ac;
+	q->ad += q2->ad;
+	q->b2 += q2->b2;
+	q->bc += q2->bc;
+	q->bd += q2->bd;
+	q->c2 += q2->c2;
+	q->cd += q2->cd;
+	q->d2 += q2->d2;
+}
+
+static double quadric_error(Quadric const* q, const float* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+
+	double e = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x + q->b2 * y * y
+		+ 2.0 * q->bc * y * z + 2.0 * q->bd * y + q->c2 * z * z + 2.0 * q->cd * z + q->d2;
+
+	return e < 0.0 ? 0.0 : e;
+}
+
+static void vec3_cross(const double a[3], const double b[3], double out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double vec3_dot(const double a[3], const double b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+static double vec3_normalise(double v[3])
+{
+	double length = sqrt(vec3_dot(v, v));
+	if (length > 0.0) {
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+	return length;
+}
+
+// Not normalised. Length is 2x the area of the triangle
+static void triangle_normal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+	double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	vec3_cross(e0, e1, n);
+}
+
+static const float* vertex_position(Simplifier const* s, uint32_t v) { return &s->vertices->positions[v * 3]; }
+
+static uint64_t edge_key(uint32_t a, uint32_t b)
+{
+	return a < b ? (((uint64_t)a << 32) | b) : (((uint64_t)b << 32) | a);
+}
+
+static size_t edge_slot(EdgeTable const* t, uint64_t key)
+{
+	size_t i = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (t->capacity - 1);
+	while (t->keys[i] != EMPTY_EDGE && t->keys[i] != key) {
+		i = (i + 1) & (t->capacity - 1);
+	}
+	return i;
+}
+
+static unsigned int edge_count(EdgeTable const* t, uint32_t a, uint32_t b)
+{
+	uint64_t key = edge_key(a, b);
+	size_t i = edge_slot(t, key);
+	return t->keys[i] == key ? t->counts[i] : 0;
+}
+
+static void edge_table_fill(Simplifier* s)
+{
+	EdgeTable* t = &s->edges;
+	memset(t->keys, 0xff, t->capacity * sizeof *t->keys);
+	memset(t->counts, 0, t->capacity * sizeof *t->counts);
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		if (s->removed[i])
+			continue;
+
+		const uint32_t* tri = &s->indices[i * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			uint64_t key = edge_key(tri[j], tri[(j + 1) % 3]);
+			size_t slot = edge_slot(t, key);
+			t->keys[slot] = key;
+			t->counts[slot]++;
+		}
+	}
+}
+
+static void init_quadrics(Simplifier* s)
+{
+	memset(s->quadrics, 0, s->vertices->count * sizeof *s->quadrics);
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		const uint32_t* tri = &s->indices[i * 3];
+		const float* p[3] = { vertex_position(s, tri[0]), vertex_position(s, tri[1]), vertex_position(s, tri[2]) };
+
+		double n[3];
+		triangle_normal(p[0], p[1], p[2], n);
+		double area = vec3_normalise(n) * 0.5;
+		double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+
+		for (unsigned int j = 0; j < 3; j++) {
+			quadric_add_plane(&s->quadrics[tri[j]], n, d, area);
+		}
+
+		for (unsigned int j = 0; j < 3; j++) {
+			uint32_t a = tri[j], b = tri[(j + 1) % 3];
+			if (edge_count(&s->edges, a, b) != 1)
+				continue;
+
+			double edge[3] = { p[(j + 1) % 3][0] - p[j][0], p[(j + 1) % 3][1] - p[j][1], p[(j + 1) % 3][2] - p[j][2] };
+			double edge_length_sq = vec3_dot(edge, edge);
+
+			double m[3];
+			vec3_cross(edge, n, m);
+			vec3_normalise(m);
+			double md = -(m[0] * p[j][0] + m[1] * p[j][1] + m[2] * p[j][2]);
+
+			quadric_add_plane(&s->quadrics[a], m, md, BOUNDARY_WEIGHT * edge_length_sq);
+			quadric_add_plane(&s->quadrics[b], m, md, BOUNDARY_WEIGHT * edge_length_sq);
+		}
+	}
+}
+
+static void build_adjacency(Simplifier* s)
+{
+	unsigned int vertex_count = s->vertices->count;
+	memset(s->adjacency_offsets, 0, (vertex_count + 1) * sizeof *s->adjacency_offsets);
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		if (s->removed[i])
+			continue;
+		for (unsigned int j = 0; j < 3; j++) {
+			s->adjacency_offsets[s->indices[i * 3 + j] + 1]++;
+		}
+	}
+
+	for (unsigned int i = 0; i < vertex_count; i++) {
+		s->adjacency_offsets[i + 1] += s->adjacency_offsets[i];
+	}
+
+	// marks is used as a write cursor
+	memcpy(s->marks, s->adjacency_offsets, vertex_count * sizeof *s->marks);
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		if (s->removed[i])
+			continue;
+		for (unsigned int j = 0; j < 3; j++) {
+			s->adjacency[s->marks[s->indices[i * 3 + j]]++] = i;
+		}
+	}
+
+	memset(s->marks, 0, vertex_count * sizeof *s->marks);
+	s->mark = 0;
+
+	memset(s->boundary, 0, vertex_count * sizeof *s->boundary);
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		if (s->removed[i])
+			continue;
+		const uint32_t* tri = &s->indices[i * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			if (edge_count(&s->edges, tri[j], tri[(j + 1) % 3]) != 2) {
+				s->boundary[tri[j]] = true;
+				s->boundary[tri[(j + 1) % 3]] = true;
+			}
+		}
+	}
+}
+
+static bool vertices_compatible(Simplifier const* s, uint32_t from, uint32_t to)
+{
+	if (s->vertices->locked && s->vertices->locked[from])
+		return false;
+
+	// Only the bone indices are compared, the weights are allowed to differ
+	if (s->vertices->bones && (s->vertices->bones[from] & 0xffff) != (s->vertices->bones[to] & 0xffff))
+		return false;
+
+	return true;
+}
+
+// If the vertices share more neighbours than there are triangles on the edge then collapsing
+// the edge would create non-manifold geometry
+static bool collapse_keeps_manifold(Simplifier* s, uint32_t from, uint32_t to)
+{
+	s->mark += 2;
+	uint32_t mark = s->mark;
+
+	for (uint32_t i = s->adjacency_offsets[to]; i < s->adjacency_offsets[to + 1]; i++) {
+		const uint32_t* tri = &s->indices[s->adjacency[i] * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			s->marks[tri[j]] = mark;
+		}
+	}
+
+	unsigned int common = 0;
+	for (uint32_t i = s->adjacency_offsets[from]; i < s->adjacency_offsets[from + 1]; i++) {
+		const uint32_t* tri = &s->indices[s->adjacency[i] * 3];
+		for (unsigned int j = 0; j < 3; j++) {
+			uint32_t v = tri[j];
+			if (v != from && v != to && s->marks[v] == mark) {
+				s->marks[v] = mark + 1; // Only count each vertex once
+				common++;
+			}
+		}
+	}
+
+	return common <= edge_count(&s->edges, from, to);
+}
+
+static bool collapse_flips_triangle(Simplifier const* s, uint32_t from, uint32_t to)
+{
+	for (uint32_t i = s->adjacency_offsets[from]; i < s->adjacency_offsets[from + 1]; i++) {
+		const uint32_t* tri = &s->indices[s->adjacency[i] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+			continue; // Triangle is removed by the collapse
+
+		double before[3], after[3];
+		triangle_normal(vertex_position(s, tri[0]), vertex_position(s, tri[1]), vertex_position(s, tri[2]), before);
+		triangle_normal(vertex_position(s, tri[0] == from ? to : tri[0]),
+			vertex_position(s, tri[1] == from ? to : tri[1]), vertex_position(s, tri[2] == from ? to : tri[2]), after);
+
+		// Also rejects collapses that rotate a triangle by more than ~75 degrees. Lots of small rotations can
+		// otherwise add up to a fold
+		if (vec3_dot(before, after) <= 0.25 * sqrt(vec3_dot(before, before) * vec3_dot(after, after)))
+			return true;
+	}
+	return false;
+}
+
+static void do_collapse(Simplifier* s, uint32_t from, uint32_t to, unsigned int* live_triangles)
+{
+	for (uint32_t i = s->adjacency_offsets[from]; i < s->adjacency_offsets[from + 1]; i++) {
+		uint32_t t = s->adjacency[i];
+		uint32_t* tri = &s->indices[t * 3];
+
+		for (unsigned int j = 0; j < 3; j++) {
+			if (tri[j] == from)
+				tri[j] = to;
+			s->touched[tri[j]] = true;
+		}
+
+		if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+			s->removed[t] = true;
+			*live_triangles -= 1;
+		}
+	}
+
+	s->touched[from] = true;
+	quadric_add(&s->quadrics[to], &s->quadrics[from]);
+}
+
+static int compare_collapses(const void* a_, const void* b_)
+{
+	Collapse const* a = a_;
+	Collapse const* b = b_;
+
+	if (a->cost != b->cost)
+		return a->cost < b->cost ? -1 : 1;
+	if (a->from != b->from)
+		return a->from < b->from ? -1 : 1;
+	if (a->to != b->to)
+		return a->to < b->to ? -1 : 1;
+	return 0;
+}
+
+// Returns the number of collapses done
+static unsigned int collapse_pass(Simplifier* s, unsigned int target_triangles, unsigned int* live_triangles)
+{
+	edge_table_fill(s);
+	build_adjacency(s);
+	memset(s->touched, 0, s->vertices->count * sizeof *s->touched);
+
+	unsigned int collapses_count = 0;
+
+	for (unsigned int i = 0; i < s->triangles; i++) {
+		if (s->removed[i])
+			continue;
+
+		const uint32_t* tri = &s->indices[i * 3];
+		for (unsigned int j = 0; j < 6; j++) {
+			uint32_t from = tri[j % 3];
+			uint32_t to = tri[(j + 1 + j / 3) % 3];
+
+			if (!vertices_compatible(s, from, to))
+				continue;
+
+			Collapse* c = &s->collapses[collapses_count++];
+			c->from = from;
+			c->to = to;
+			c->cost = quadric_error(&s->quadrics[from], vertex_position(s, to))
+				+ quadric_error(&s->quadrics[to], vertex_position(s, to));
+		}
+	}
+
+	if (!collapses_count)
+		return 0;
+
+	qsort(s->collapses, collapses_count, sizeof *s->collapses, compare_collapses);
+
+	// Only the cheapest quarter of the edges are collapsed in one pass.
+	// The rest are re-evaluated next pass with the updated quadrics
+	double max_cost = s->collapses[(collapses_count - 1) / 4].cost;
+
+	unsigned int done = 0;
+
+	for (unsigned int i = 0; i < collapses_count && *live_triangles > target_triangles; i++) {
+		Collapse const* c = &s->collapses[i];
+
+		if (c->cost > max_cost) {
+			if (done)
+				break;
+			max_cost = c->cost * 1.5;
+		}
+
+		if (s->touched[c->from] || s->touched[c->to])
+			continue;
+
+		// Vertices on the edge of the mesh can only move along the edge
+		if (s->boundary[c->from] && edge_count(&s->edges, c->from, c->to) != 1)
+			continue;
+
+		if (!collapse_keeps_manifold(s, c->from, c->to))
+			continue;
+
+		if (collapse_flips_triangle(s, c->from, c->to))
+			continue;
+
+		do_collapse(s, c->from, c->to, live_triangles);
+		done++;
+	}
+
+	return done;
+}
+
+int simplify_mesh(SimplifyVertices const* vertices, const uint32_t* indices, unsigned int index_count,
+	unsigned int target_index_count, uint32_t* output, unsigned int* output_index_count)
+{
+	Simplifier s = { 0 };
+	s.vertices = vertices;
+
+	unsigned int vertex_count = vertices->count;
+	unsigned int max_triangles = index_count / 3;
+
+	s.indices = malloc(max_triangles * 3 * sizeof *s.indices);
+	s.removed = calloc(max_triangles, sizeof *s.removed);
+	s.quadrics = malloc(vertex_count * sizeof *s.quadrics);
+	s.adjacency_offsets = malloc((vertex_count + 1) * sizeof *s.adjacency_offsets);
+	s.adjacency = malloc(max_triangles * 3 * sizeof *s.adjacency);
+	s.boundary = malloc(vertex_count * sizeof *s.boundary);
+	s.touched = malloc(vertex_count * sizeof *s.touched);
+	s.marks = malloc(vertex_count * sizeof *s.marks);
+	s.collapses = malloc(max_triangles * 6 * sizeof *s.collapses);
+
+	s.edges.capacity = 16;
+	while (s.edges.capacity < (size_t)max_triangles * 6) {
+		s.edges.capacity *= 2;
+	}
+	s.edges.keys = malloc(s.edges.capacity * sizeof *s.edges.keys);
+	s.edges.counts = malloc(s.edges.capacity * sizeof *s.edges.counts);
+
+#define CLEANUP()                                                                                                      \
+	free(s.indices);                                                                                                   \
+	free(s.removed);                                                                                                   \
+	free(s.quadrics);                                                                                                  \
+	free(s.adjacency_offsets);                                                                                         \
+	free(s.adjacency);                                                                                                 \
+	free(s.boundary);                                                                                                  \
+	free(s.touched);                                                                                                   \
+	free(s.marks);                                                                                                     \
+	free(s.collapses);                                                                                                 \
+	free(s.edges.keys);                                                                                                \
+	free(s.edges.counts);
+
+	if (!s.indices || !s.removed || !s.quadrics || !s.adjacency_offsets || !s.adjacency || !s.boundary || !s.touched
+		|| !s.marks || !s.collapses || !s.edges.keys || !s.edges.counts) {
+		CLEANUP();
+		return 1;
+	}
+
+	// Degenerate triangles are dropped
+
+	for (unsigned int i = 0; i < max_triangles; i++) {
+		const uint32_t* tri = &indices[i * 3];
+		if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+			continue;
+		memcpy(&s.indices[s.triangles * 3], tri, 3 * sizeof *tri);
+		s.triangles++;
+	}
+
+	edge_table_fill(&s);
+	init_quadrics(&s);
+
+	unsigned int live_triangles = s.triangles;
+	unsigned int target_triangles = target_index_count / 3;
+
+	while (live_triangles > target_triangles) {
+		if (!collapse_pass(&s, target_triangles, &live_triangles))
+			break;
+	}
+
+	*output_index_count = 0;
+	for (unsigned int i = 0; i < s.triangles; i++) {
+		if (!s.removed[i]) {
+			memcpy(&output[*output_index_count], &s.indices[i * 3], 3 * sizeof *output);
+			*output_index_count += 3;
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct SimplifyVertices {
+	unsigned int count;
+	const float* positions; // xyz
+
+	// PIGEON_WGI_VERTEX_ATTRIBUTE_BONE data. Can be NULL
+	// Vertices are only merged if they are influenced by the same bones
+	const uint32_t* bones;
+
+	// Vertices that must not be removed (UV seams, vertices shared between materials). Can be NULL
+	const bool* locked;
+} SimplifyVertices;
+
+// Reduces the number of triangles in a triangle list using quadric error metrics
+// Edges are collapsed onto one of their existing vertices so the vertex data does not change
+// output must have space for index_count indices
+// Stops when the index count is <= target_index_count or when no more edges can be collapsed
+// Returns 1 on allocation failure
+int simplify_mesh(SimplifyVertices const*, const uint32_t* indices, unsigned int index_count,
+	unsigned int target_index_count, uint32_t* output, unsigned int* output_index_count);
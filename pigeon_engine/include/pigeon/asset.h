@@ -5,6 +5,7 @@
 #include <pigeon/wgi/material.h>
 #include <pigeon/wgi/animation.h>
 #include <pigeon/audio/audio.h>
+#include <pigeon/skeleton.h>
 #include <pigeon/util.h>
 
 typedef enum {
@@ -44,8 +45,10 @@ typedef struct PigeonAsset {
     unsigned int subresource_count;
     PigeonAssetSubresource* subresources;
 
-    // If not NULL, was malloc'd
+    // If not NULL, was malloc'd (pigeon_load_asset_data) or mapped (pigeon_map_asset_data)
     void * original_data;
+    unsigned long original_data_size;
+    bool original_data_is_mapped;
 
 
     union {
@@ -59,11 +62,29 @@ typedef struct PigeonAsset {
             unsigned int materials_count;
             PigeonWGIMaterialImport* materials;
 
+            // 1 if the model has no extra levels of detail
+            unsigned int lods_count;
+
+            // LOD n+1 is used when the projected bounding sphere diameter
+            // (as a fraction of the screen height) drops below lod_screen_sizes[n]
+            float lod_screen_sizes[PIGEON_WGI_MAX_LODS - 1];
+
+            // Meshlets of all materials and LODs. If not 0, the last subresource is an array of PigeonWGIMeshlet
+            unsigned int meshlets_count;
+
             unsigned int bones_count;
             PigeonWGIBone* bones;
+            PigeonSkeleton skeleton;
 
             unsigned int animations_count;
             PigeonWGIAnimationMeta* animations;
+
+            // Index of the subresource of the first animation. Each animation is an array of PigeonWGIBoneData
+            // (bones_count for each frame)
+            unsigned int animations_first_subresource;
+
+            // Animations are local poses rather than model space (see pigeon/skeleton.h)
+            bool local_animations;
         };
 
         // Textures
@@ -81,12 +102,31 @@ typedef struct PigeonAsset {
 PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset *, const char * meta_file_path);
 
 // Loads ZSTD compressed data (or decompressed if available)
+// Fails if a subresource is outside the file or an uncompressed compressed animation (see below) is invalid
 PIGEON_ERR_RET pigeon_load_asset_data(PigeonAsset *, const char * data_file_path);
 
+// Same as pigeon_load_asset_data but the data file is mapped read-only instead of being read into memory.
+// Uncompressed subresources point into the mapping (no copy). The pages of a subresource are dropped once it has
+// been decompressed or copied by pigeon_decompress_asset
+PIGEON_ERR_RET pigeon_map_asset_data(PigeonAsset *, const char * data_file_path);
+
 // Decompresses data into given buffer
 // buffer must be >= asset->subresources[i].decompressed_data_length
+// Fails if the subresource is a compressed animation that is invalid
 PIGEON_ERR_RET pigeon_decompress_asset(PigeonAsset *, void * buffer, unsigned int i);
 
+// Returns NULL if the model has no meshlets or the meshlet subresource has not been decompressed
+const PigeonWGIMeshlet* pigeon_get_model_meshlets(PigeonAsset const*);
+
+// Returns NULL if the animation does not exist, is compressed or its subresource has not been decompressed
+const PigeonWGIBoneData* pigeon_get_animation_bone_data(PigeonAsset const*, unsigned int animation_index);
+
+// Returns NULL if the animation does not exist, is not compressed or its subresource has not been decompressed.
+// Use with pigeon_decompress_animation_frame. The data was checked with pigeon_compressed_animation_valid when it
+// was loaded or decompressed. Uncompressed subresources that are not aligned to PIGEON_COMPRESSED_ANIMATION_ALIGNMENT
+// in the data file are copied when loaded
+const void* pigeon_get_compressed_animation(PigeonAsset const*, unsigned int animation_index);
+
 // Use this if the asset is not compressed to fread the data into buffer
 // buffer must be >= raw_data_length
 // PIGEON_ERR_RET pigeon_load_decompressed(PigeonAsset *, void * buffer);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <pigeon/wgi/bone.h>
+#include <stdbool.h>
+
+// Compressed animation subresources (ANIMATION ... COMPRESSED YES in the .asset file), made by the model asset optimiser.
+// Every bone has a rotation, translation and scale track.
+// - Tracks that do not change (within the error bounds) are stored as a single key
+// - Other tracks only keep the frames needed to rebuild every frame within the error bounds by interpolating
+//   between keys
+// - Rotations are quantised to 48 bits (smallest three components). Translations and scales are 16-bit values
+//   within the range of the track
+// Keys are decoded when sampling so the animation never has to be decompressed into PigeonWGIBoneData
+
+// Maximum difference between a decoded frame and the original.
+// Translations and scales also lose precision from the quantisation (1/65535 of the range of the track)
+typedef struct PigeonAnimationCompressionErrors {
+	float rotation; // Radians
+	float translation; // Model units
+	float scale;
+} PigeonAnimationCompressionErrors;
+
+#define PIGEON_ANIMATION_DEFAULT_ROTATION_ERROR 0.001f
+#define PIGEON_ANIMATION_DEFAULT_TRANSLATION_ERROR 0.001f
+#define PIGEON_ANIMATION_DEFAULT_SCALE_ERROR 0.001f
+
+// The data is read in place (32-bit and float fields) so must be aligned to this
+#define PIGEON_COMPRESSED_ANIMATION_ALIGNMENT 4
+
+// frames is frame_count * bones_count bones. frame_count must be <= 65536
+// Returns malloc'd data (size bytes) or NULL on error
+void* pigeon_compress_animation(PigeonWGIBoneData const* frames, unsigned int bones_count, unsigned int frame_count,
+	PigeonAnimationCompressionErrors const*, unsigned int* size);
+
+// Checks the alignment, the header, the size of the data and the keys of every track (within the data, frames
+// increasing and < frame_count). Data that has not been checked must not be decoded as it could read out of bounds.
+// The cost is linear in the number of keys so check once, not every time a frame is decoded
+bool pigeon_compressed_animation_valid(
+	const void* data, unsigned int size, unsigned int bones_count, unsigned int frame_count);
+
+// Decodes bones [first_bone, first_bone + n) of one frame. Rotations are normalised
+void pigeon_decompress_animation_frame(
+	const void* data, unsigned int frame, unsigned int first_bone, unsigned int n, PigeonWGIBoneData* out);
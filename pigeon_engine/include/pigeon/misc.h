@@ -8,6 +8,14 @@
 // Returns malloc'd pointer. Call free on it when done
 void* pigeon_load_file(const char* file, unsigned int extra, unsigned long * file_size);
 
+// Maps the file read-only. Call pigeon_unmap_file on it when done.
+// Falls back to pigeon_load_file on platforms without mmap
+void* pigeon_map_file(const char* file, unsigned long * file_size);
+void pigeon_unmap_file(void* data, unsigned long file_size);
+
+// Lets the OS drop the pages of a range of a mapped file (the range can still be read, it is loaded again from the file)
+void pigeon_discard_mapped_range(void* data, unsigned long offset, unsigned long length);
+
 #define free_if(x) \
     if((x)) { free(x); x = NULL; }
 
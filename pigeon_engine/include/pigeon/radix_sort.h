@@ -0,0 +1,16 @@
+#pragma once
+
+#include <pigeon/util.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct PigeonSortItem {
+	uint64_t key;
+	uint32_t value;
+} PigeonSortItem;
+
+// Stable least significant digit radix sort, ascending by key.
+// temp must have space for count items. Passes for bytes that are the same in every key are skipped.
+// If use_jobs is true then large arrays are split between the job system threads.
+// Jobs must not be in progress (this cannot be called from a job)
+PIGEON_ERR_RET pigeon_radix_sort(PigeonSortItem* items, PigeonSortItem* temp, unsigned int count, bool use_jobs);
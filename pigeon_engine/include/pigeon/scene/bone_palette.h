@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pigeon/skeleton.h>
+#include <pigeon/wgi/bone.h>
+
+// Bone matrices are evaluated 4 at a time (SSE2 or NEON). The remaining bones use the same maths without SIMD
+#define PIGEON_BONE_PALETTE_BATCH 4
+
+// Writes bones_count identity matrices (T pose)
+void pigeon_bone_palette_identity(PigeonWGIBoneMatrix* out, unsigned int bones_count);
+
+// Interpolates between the bones of 2 frames of an animation (bones_count bones in each frame).
+// Rotations use normalised lerp along the shortest path with a correction to the interpolation factor
+// which keeps the angular velocity close to that of slerp.
+// Each matrix is translate * rotate * scale, written directly in the PigeonWGIBoneMatrix (3x4) layout
+void pigeon_bone_palette_interpolate(PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* frame0,
+	PigeonWGIBoneData const* frame1, float t, unsigned int bones_count);
+
+// Poses are arrays of PigeonWGIBoneData (one for each bone) that have not been converted to matrices yet.
+// They are used to blend animations. The cost of each function is linear in the number of bones
+
+// Same as pigeon_bone_palette_interpolate but writes a pose. Rotations are normalised
+void pigeon_bone_pose_interpolate(PigeonWGIBoneData* out, PigeonWGIBoneData const* frame0,
+	PigeonWGIBoneData const* frame1, float t, unsigned int bones_count);
+
+// Adds pose * weight to sum and the weight to weights (both start at 0).
+// bone_weights is NULL or a weight (0 to 1) for each bone which is multiplied with weight
+void pigeon_bone_pose_accumulate(PigeonWGIBoneData* sum, float* weights, PigeonWGIBoneData const* pose, float weight,
+	const float* bone_weights, unsigned int bones_count);
+
+// Turns the sum from pigeon_bone_pose_accumulate into a pose.
+// Bones with a total weight below 1 are blended with the identity transform (T pose)
+void pigeon_bone_pose_normalise(PigeonWGIBoneData* pose, const float* weights, unsigned int bones_count);
+
+// Additive blending. Applies the difference between pose and reference (multiplied by weight) to out
+void pigeon_bone_pose_add(PigeonWGIBoneData* out, PigeonWGIBoneData const* pose, PigeonWGIBoneData const* reference,
+	float weight, const float* bone_weights, unsigned int bones_count);
+
+void pigeon_bone_palette_from_pose(PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* pose, unsigned int bones_count);
+
+// pose is a local pose (see pigeon/skeleton.h) with skeleton->bones_count bones.
+// The local transforms are converted to matrices 4 at a time, then concatenated down the hierarchy in one pass over
+// skeleton->order and multiplied with the inverse bind matrices
+void pigeon_bone_palette_from_local_pose(
+	PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* pose, PigeonSkeleton const* skeleton);
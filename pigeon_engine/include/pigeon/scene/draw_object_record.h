@@ -0,0 +1,39 @@
+#pragma once
+
+#include <pigeon/array_list.h>
+#include <pigeon/util.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct PigeonTransform;
+struct PigeonMaterialRenderer;
+
+// What each CPU-written draw object holds, by draw index. Draw objects are only written when these change
+typedef struct PigeonDrawObjectRecord {
+	struct PigeonTransform const* transform;
+	struct PigeonMaterialRenderer const* mr;
+	uint32_t world_transform_version;
+	uint32_t material_index;
+	int first_bone_index;
+	uint64_t changed_frame; // WGI frame number
+} PigeonDrawObjectRecord;
+
+typedef struct PigeonDrawObjectRecords {
+	PigeonArrayList records; // PigeonDrawObjectRecord
+	uint64_t topology_version; // pigeon_scene_topology_version that the records were made with
+} PigeonDrawObjectRecords;
+
+void pigeon_create_draw_object_records(PigeonDrawObjectRecords*);
+void pigeon_destroy_draw_object_records(PigeonDrawObjectRecords*);
+
+// Makes a record for each draw. New records don't match any instance.
+// All records are cleared when the topology version changes: the object pools reuse freed slots so a new transform or
+// material renderer can have the same address (and world transform version) as a destroyed one
+PIGEON_ERR_RET pigeon_draw_object_records_resize(
+	PigeonDrawObjectRecords*, unsigned int draws, uint64_t topology_version);
+
+// Returns true if the draw object needs writing: the record changed after written_frame (the frame that the draw
+// objects in the buffer were written for). frame is the current WGI frame number
+bool pigeon_update_draw_object_record(PigeonDrawObjectRecords*, unsigned int draw_index,
+	struct PigeonTransform const*, uint32_t world_transform_version, struct PigeonMaterialRenderer const*,
+	uint32_t material_index, int first_bone_index, uint64_t frame, uint64_t written_frame);
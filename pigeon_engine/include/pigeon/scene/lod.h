@@ -0,0 +1,11 @@
+#pragma once
+
+// Fraction of the LOD screen size thresholds that objects must move past before switching LOD
+#define PIGEON_LOD_HYSTERESIS 0.1f
+
+// lod_screen_sizes has lods_count - 1 thresholds (see PigeonAsset). LOD n+1 is used when screen_size (the projected
+// bounding sphere diameter as a fraction of the screen height) drops below lod_screen_sizes[n].
+// The thresholds are moved away from previous_lod (the LOD used last frame) by PIGEON_LOD_HYSTERESIS
+// to stop objects flickering between LODs
+unsigned int pigeon_select_lod(
+	const float* lod_screen_sizes, unsigned int lods_count, unsigned int previous_lod, float screen_size);
@@ -1,11 +1,13 @@
 #include <pigeon/scene/component.h>
 #include <pigeon/util.h>
+#include <pigeon/wgi/bone.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 struct PigeonAsset;
 struct PigeonWGIMultiMesh;
 struct PigeonWGIPipeline;
+struct PigeonOccluderMesh;
 struct PigeonAsset;
 
 typedef struct PigeonRenderState {
@@ -16,14 +18,35 @@ typedef struct PigeonRenderState {
 	struct PigeonArrayList* mr; // array of PigeonMaterialRenderer*
 
 	unsigned int _index;
+
+	// Models of this render state in the cached instance list (see draw.c)
+	unsigned int _first_scene_model;
+	unsigned int _scene_models;
+
 	unsigned int _draws, _multidraws;
 	unsigned int _start_draw_index;
 	unsigned int _start_multidraw_index;
 
+	// Multidraw commands for the depth pre-pass and render stages. Only differs when occlusion culling is enabled
+	unsigned int _visible_multidraws;
+	unsigned int _start_visible_multidraw_index;
+
+	// Range of the draw list (see draw.c)
+	unsigned int _start_draw_command;
+	unsigned int _draw_commands;
+	uint32_t _sort_state; // Pipeline and mesh bits of the draw sort keys
+
+	// GPU culling. _cull_groups is 0 if it is not used
+	unsigned int _first_cull_group;
+	unsigned int _cull_groups;
+	unsigned int _cull_render_state;
+	unsigned int _first_cull_command;
+
 	//  Valid when multidraw is supported by _multidraws is 1
 
 	uint32_t start_vertex;
 	uint32_t instances;
+	uint32_t visible_instances; // Instances that were not occlusion culled
 	uint32_t first;
 	uint32_t count;
 } PigeonRenderState;
@@ -38,14 +61,57 @@ typedef struct PigeonModelMaterial {
 
 } PigeonModelMaterial;
 
+#define PIGEON_MAX_ANIMATION_CLIPS 8
+
+// An animation that is blended with the other clips of an animation state
+typedef struct PigeonAnimationClip {
+	int animation_index; // < 0 if this clip is not in use
+	double start_time;
+
+	// Clips that are not additive are blended by weight.
+	// Where the weights add up to less than 1 the T pose is blended in
+	// This is the weight at the end of the fade if the clip is fading (see pigeon_fade_animation_clip)
+	float weight;
+
+	// The difference between the animation and its first frame is added on top of the other clips
+	// Additive clips are applied in order after all other clips
+	bool additive;
+
+	// NULL or a weight (0 to 1) for each bone of the model. Not owned by the clip
+	const float* bone_weights;
+
+	float _fade_start_weight;
+	double _fade_start_time;
+	double _fade_duration; // 0 if not fading
+} PigeonAnimationClip;
+
 typedef struct PigeonAnimationState {
 	struct PigeonAsset* model_asset;
 	struct PigeonArrayList* mr; // array of PigeonMaterialRenderer*
 
+	// Ignored if any clips are in use
 	double animation_start_time;
 	int animation_index; // < 0 for T pose
 
+	PigeonAnimationClip clips[PIGEON_MAX_ANIMATION_CLIPS];
+
+	// Optional. Called from a job thread with the pose of a model with local space animations before it is converted
+	// to matrices (see pigeon/skeleton.h). The pose can be modified for procedural animation and inverse kinematics
+	void (*modify_pose)(struct PigeonAnimationState const*, PigeonWGIBoneData* local_pose, void* arg);
+	void* modify_pose_arg;
+
+	// The bones are evaluated every update_interval frames (0 or 1 for every frame) and reused in between.
+	// The update-rate LOD (see pigeon_set_animation_update_lod) can make the interval longer
+	unsigned int update_interval;
+
 	unsigned int _first_bone_index;
+	double _frame; // Frame of animation_index that is evaluated this frame (when no clips are in use)
+	bool _shared_pose; // The bones are evaluated by another animation state (see pigeon_set_animation_pose_sharing)
+
+	unsigned int _update_interval; // update_interval or the update-rate LOD interval, whichever is longer
+	bool _reuse_bones; // _previous_bones are copied this frame instead of evaluating the bones
+	bool _previous_bones_valid;
+	PigeonWGIBoneMatrix* _previous_bones; // Allocated when the bones are not evaluated every frame
 } PigeonAnimationState;
 
 // PIGEON_COMPONENT_TYPE_MATERIAL_RENDERER
@@ -65,8 +131,18 @@ typedef struct PigeonMaterialRenderer {
 	bool use_transparency;
 	bool use_under_colour;
 
+	// The bounding box of this object hides objects behind it (see pigeon_set_occlusion_culling)
+	// Only set this for large objects that fill their bounding box (walls, floors, buildings)
+	bool occluder;
+
+	// Optional low-poly mesh rasterised instead of the bounding box when occluder is true
+	// Not owned by the material renderer
+	struct PigeonOccluderMesh* occluder_mesh;
+
 	PigeonAnimationState* animation_state;
 
+	unsigned int _material_index; // Index into the WGI material table
+
 	// unsigned int _draw_index;
 } PigeonMaterialRenderer;
 
@@ -89,3 +165,23 @@ void pigeon_unjoin_rs_model(PigeonRenderState*, PigeonModelMaterial*);
 
 PIGEON_ERR_RET pigeon_join_mr_anim(PigeonMaterialRenderer*, PigeonAnimationState*);
 void pigeon_unjoin_mr_anim(PigeonMaterialRenderer*, PigeonAnimationState*);
+
+// Times are from pigeon_wgi_get_time_seconds_double
+
+// Returns the index of the new clip or -1 if all clips are in use
+int pigeon_add_animation_clip(PigeonAnimationState*, unsigned int animation_index, float weight, double start_time);
+void pigeon_remove_animation_clip(PigeonAnimationState*, unsigned int clip);
+
+// Changes the weight of a clip linearly over duration seconds.
+// Clips that fade out to 0 are removed at the end of the fade
+void pigeon_fade_animation_clip(PigeonAnimationState*, unsigned int clip, float weight, double time, double duration);
+
+// Fades out all clips that are not additive and fades in a new clip (starting at time).
+// If all clips are in use then the clip with the lowest weight is replaced.
+// Returns the index of the new clip or -1 on error
+int pigeon_cross_fade_animation(PigeonAnimationState*, unsigned int animation_index, double time, double duration);
+
+float pigeon_get_animation_clip_weight(PigeonAnimationClip const*, double time);
+
+// Removes clips that have finished fading out
+void pigeon_remove_faded_animation_clips(PigeonAnimationState*, double time);
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef CGLM_FORCE_DEPTH_ZERO_TO_ONE
+#define CGLM_FORCE_DEPTH_ZERO_TO_ONE
+#endif
+#include <cglm/types.h>
+#include <pigeon/array_list.h>
+#include <pigeon/util.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct PigeonAsset;
+struct PigeonWGIMeshlet;
+
+// Hierarchical depth buffer (Hi-Z) for CPU-side occlusion culling
+// Depth is reversed (1 = near plane, 0 = far plane) to match pigeon_wgi_perspective
+// Each texel in level n+1 stores the furthest (minimum) depth of the 2x2 texels below it in level n
+
+#define PIGEON_HIZ_MAX_LEVELS 12
+
+// Level 0 is split into tiles of this size. Tiles are rasterised in parallel using the job system
+// Levels 1-5 of each tile are generated by the same job
+#define PIGEON_HIZ_TILE_SIZE 32
+
+typedef struct PigeonHiZ {
+	unsigned int width, height; // Size of level 0
+	unsigned int levels;
+
+	unsigned int level_width[PIGEON_HIZ_MAX_LEVELS];
+	unsigned int level_height[PIGEON_HIZ_MAX_LEVELS];
+	unsigned int level_offset[PIGEON_HIZ_MAX_LEVELS]; // Index into data
+
+	float* data; // All levels, level 0 first
+
+	// Matrix that occluders were rasterised with (or that the loaded depth image was rendered with)
+	// Bounds are tested using this matrix
+	mat4 proj_view;
+
+	unsigned int tiles_x, tiles_y;
+	PigeonArrayList triangles; // Screen-space triangles waiting to be rasterised
+	PigeonArrayList* tile_bins; // Array of triangle indices (uint32_t) for each tile
+	PigeonArrayList jobs;
+} PigeonHiZ;
+
+PIGEON_ERR_RET pigeon_create_hiz(PigeonHiZ*, unsigned int width, unsigned int height);
+void pigeon_destroy_hiz(PigeonHiZ*);
+
+// Resets level 0 to the far plane
+void pigeon_hiz_clear(PigeonHiZ*, mat4 proj_view);
+
+// Transforms and bins the triangles of an occluder mesh. positions is tightly packed xyz.
+// indices can be NULL for non-indexed triangle lists.
+// Triangles that cross the near plane are skipped (they would only ever cull more than they should)
+// Rasterisation happens in pigeon_hiz_build.
+PIGEON_ERR_RET pigeon_hiz_rasterise(PigeonHiZ*, mat4 model, const float* positions, unsigned int vertex_count,
+	const uint32_t* indices, unsigned int index_count);
+
+// Rasterises a solid box. Only use this for objects that fill their bounding box (walls, floors, buildings)
+PIGEON_ERR_RET pigeon_hiz_rasterise_box(PigeonHiZ*, mat4 model, const float bounds_min[3], const float bounds_max[3]);
+
+// Fills level 0 from a depth image (e.g. the depth pre-pass of the previous frame)
+// The image is downscaled conservatively (furthest depth of all covered pixels)
+void pigeon_hiz_load_depth(PigeonHiZ*, mat4 proj_view, const float* depth, unsigned int width, unsigned int height);
+
+// Rasterises binned triangles (one job per tile) and generates levels 1+.
+// Call after rasterising / loading depth and before testing
+// The result does not depend on the number of threads
+PIGEON_ERR_RET pigeon_hiz_build(PigeonHiZ*);
+
+// Returns false if the box is definitely hidden behind the occluders
+bool pigeon_hiz_test_box(PigeonHiZ const*, mat4 model, const float bounds_min[3], const float bounds_max[3]);
+
+// Low-poly mesh used as an occluder
+typedef struct PigeonOccluderMesh {
+	unsigned int vertex_count;
+	unsigned int index_count; // 0 for non-indexed meshes
+	float* positions; // xyz
+	uint32_t* indices;
+} PigeonOccluderMesh;
+
+// Decodes the position (and index) subresources of a model asset
+// The asset data must be loaded (pigeon_load_asset_data)
+PIGEON_ERR_RET pigeon_create_occluder_mesh(PigeonOccluderMesh*, struct PigeonAsset*);
+void pigeon_destroy_occluder_mesh(PigeonOccluderMesh*);
+
+// Index range (relative to the start of the model's indices) that survived meshlet culling
+typedef struct PigeonMeshletDraw {
+	uint32_t first;
+	uint32_t count;
+} PigeonMeshletDraw;
+
+// Culls the meshlets of one instance against the view frustum, against the Hi-Z buffer (if hiz is not NULL)
+// and by normal cone (if cull_back_facing is true). camera is the camera position in world space.
+// Visible meshlets that are next to each other in the index buffer are merged into one PigeonMeshletDraw,
+// which are appended to draws.
+PIGEON_ERR_RET pigeon_cull_meshlets(PigeonHiZ const*, mat4 proj_view, mat4 model, const float camera[3],
+	bool cull_back_facing, const struct PigeonWGIMeshlet* meshlets, unsigned int meshlets_count,
+	PigeonArrayList* draws);
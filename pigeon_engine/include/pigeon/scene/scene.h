@@ -1,10 +1,46 @@
 #pragma once
 
 #include <pigeon/util.h>
+#include <stdbool.h>
 
 struct PigeonTransform;
 struct PigeonWGIPipeline;
 
+// Objects hidden behind occluders (PigeonMaterialRenderer.occluder) are not drawn in the depth pre-pass
+// and render stages. Occluders are rasterised into a small depth buffer on the CPU each frame.
+PIGEON_ERR_RET pigeon_set_occlusion_culling(bool enabled);
+
+// Model assets with meshlets (see model_asset_optimiser) are culled per meshlet in the depth pre-pass and render
+// stages: by view frustum, normal cone and (if occlusion culling is enabled) the occluders.
+// Skinned meshes are always drawn whole.
+void pigeon_set_meshlet_culling(bool enabled);
+
+// Frustum culling and LOD selection are done by a compute shader, which writes the indirect draw commands.
+// Only if pigeon_wgi_gpu_culling_supported(), otherwise this does nothing.
+// Occlusion and meshlet culling are not used while this is enabled.
+void pigeon_set_gpu_culling(bool enabled);
+
+// Animation states of the same model asset that play the same animation at the same time are evaluated once
+// and share one block of bone matrices. Animation times are rounded down to 1/steps_per_frame of a frame
+// so that states which started at nearly the same time share their pose.
+// States with animation clips or a modify_pose callback (local space animations) are not shared.
+// 0 (the default) disables sharing
+void pigeon_set_animation_pose_sharing(unsigned int steps_per_frame);
+
+// Update-rate LOD for animation. Animation states whose largest instance is smaller than screen_size
+// (projected diameter of the bounding sphere as a fraction of the screen height, like the mesh LODs) are evaluated
+// every 2 frames, every 4 frames below screen_size / 2 and so on, up to every max_interval frames.
+// The bones from the last evaluation are used in between. Updates are spread across frames.
+// States that are not evaluated every frame do not share poses.
+// screen_size 0 (the default) disables this. See also PigeonAnimationState.update_interval
+void pigeon_set_animation_update_lod(float screen_size, unsigned int max_interval);
+
+// Animated instances of skinned render states are skinned once per frame by a compute shader, before the depth
+// pre-pass. The shadow, depth and render stages then read the skinned vertices instead of skinning every vertex
+// in each pass. Only if pigeon_wgi_compute_skinning_supported(), otherwise this does nothing.
+// The meshes must have PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED vertices
+void pigeon_set_compute_skinning(bool enabled);
+
 PIGEON_ERR_RET pigeon_prepare_draw_frame(struct PigeonTransform* camera);
 
 // Run upload render stage between these
@@ -5,6 +5,8 @@
 #endif
 #include <cglm/types.h>
 #include <pigeon/array_list.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 struct PigeonComponent;
 
@@ -30,6 +32,13 @@ typedef struct PigeonTransform {
 
 	mat4 world_transform_cache;
 	bool world_transform_cached;
+	uint32_t _world_transform_version; // Incremented when world_transform_cache is recalculated
+
+	// Level of detail chosen last frame, for the LOD hysteresis (see pigeon/scene/lod.h).
+	// Shared by every material renderer and render state drawn with this transform. Materials of one model have the
+	// same LOD thresholds. Different models on one transform each move their thresholds away from whichever LOD was
+	// chosen last
+	uint8_t _lod;
 
 	PigeonArrayList* children; // array of PigeonTransform*
 	PigeonArrayList* components; // array of PigeonComponent*
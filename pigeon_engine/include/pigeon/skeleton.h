@@ -0,0 +1,38 @@
+#pragma once
+
+#include <pigeon/util.h>
+#include <pigeon/wgi/bone.h>
+#include <stdint.h>
+
+#define PIGEON_MAX_BONES 256
+
+// Bone hierarchy of a model, shared by all instances of it.
+// The bind pose of each bone is a translation to its head. blender_export.py does not export the roll of the bones
+// so the bind rotations are the identity rotation (the axes of a local transform are the model axes).
+//
+// Animations are in model space (the skinning transform of each bone, which is what blender_export.py exports)
+// or in local space (the transform of each bone relative to its parent, model asset optimiser output).
+// Local poses can be blended and modified per bone before the transforms are concatenated down the hierarchy
+typedef struct PigeonSkeleton {
+	unsigned int bones_count;
+
+	// Bone indices sorted so that parents come before their children
+	uint8_t* order;
+
+	int* parents; // -1 for root bones
+
+	// Model space transform of each bone in the bind pose, and as a local pose
+	PigeonWGIBoneData* bind;
+	PigeonWGIBoneData* local_bind;
+
+	PigeonWGIBoneMatrix* inverse_bind;
+} PigeonSkeleton;
+
+// Fails if the hierarchy contains a cycle
+PIGEON_ERR_RET pigeon_create_skeleton(PigeonSkeleton*, PigeonWGIBone const* bones, unsigned int bones_count);
+
+void pigeon_destroy_skeleton(PigeonSkeleton*);
+
+// Converts a model space pose to a local space pose. model_space and local must not overlap
+void pigeon_skeleton_local_pose(
+	PigeonSkeleton const*, PigeonWGIBoneData const* model_space, PigeonWGIBoneData* local);
@@ -10,4 +10,7 @@ typedef struct PigeonWGIAnimationMeta {
 	float fps;
 	bool loops;
 	unsigned int frame_count;
+
+	// See pigeon/compressed_animation.h
+	bool compressed;
 } PigeonWGIAnimationMeta;
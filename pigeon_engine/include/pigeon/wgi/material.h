@@ -1,12 +1,23 @@
 #pragma once
 
+// Maximum number of discrete levels of detail in a model asset
+#define PIGEON_WGI_MAX_LODS 4
+
 typedef struct PigeonWGIMaterialImport {
 	char* name;
 
-	// Vertex/index
+	// Vertex/index range of LOD 0
 	unsigned int first;
 	unsigned int count;
 
+	// Vertex/index ranges of LODs 1+. count is 0 if the material is not in that LOD
+	unsigned int lod_first[PIGEON_WGI_MAX_LODS - 1];
+	unsigned int lod_count[PIGEON_WGI_MAX_LODS - 1];
+
+	// Range of the model's meshlets for each LOD. count is 0 if that LOD is always drawn whole
+	unsigned int meshlet_first[PIGEON_WGI_MAX_LODS];
+	unsigned int meshlet_count[PIGEON_WGI_MAX_LODS];
+
 	float colour[3];
 	float specular;
 
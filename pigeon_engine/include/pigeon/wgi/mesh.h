@@ -25,6 +25,36 @@ uint64_t pigeon_wgi_mesh_meta_size_requirements(PigeonWGIMeshMeta*);
 // identity or matrix for denormalising vertex position
 void pigeon_wgi_get_mesh_matrix(PigeonWGIMeshMeta*, float*);
 
+// Decodes a PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED vertex to model space (same as object_vert.glsl)
+static inline void pigeon_wgi_unpack_normalised_position(
+	uint32_t packed, const float bounds_min[3], const float bounds_range[3], float position[3])
+{
+	uint32_t x = ((packed & 1023) << 1) | ((packed >> 30) & 1);
+	uint32_t y = (((packed >> 10) & 1023) << 1) | (packed >> 31);
+	uint32_t z = (packed >> 20) & 1023;
+
+	position[0] = bounds_min[0] + (float)x / 2047.0f * bounds_range[0];
+	position[1] = bounds_min[1] + (float)y / 2047.0f * bounds_range[1];
+	position[2] = bounds_min[2] + (float)z / 1023.0f * bounds_range[2];
+}
+
+// Cluster of up to 128 triangles that is culled as a unit. Generated by model_asset_optimiser
+typedef struct PigeonWGIMeshlet {
+	// Index range, relative to the start of the model's indices
+	uint32_t first;
+	uint32_t count;
+
+	// Bounding sphere in model space
+	float centre[3];
+	float radius;
+
+	// Normal cone. All triangles face away from a camera at position p if
+	// dot(centre - p, cone_axis) >= cone_cutoff * length(centre - p) + radius
+	// cone_cutoff is 1 if the triangles face too many different directions
+	float cone_axis[3];
+	float cone_cutoff;
+} PigeonWGIMeshlet;
+
 // Multiple meshes (with same vertex attributes and index size) combined together
 typedef struct PigeonWGIMultiMesh {
 	PigeonWGIVertexAttributeType attribute_types[PIGEON_WGI_MAX_VERTEX_ATTRIBUTES];
@@ -10,4 +10,6 @@ void pigeon_opengl_set_draw_state(struct PigeonWGIPipelineConfig const* config);
 // Bind (or unbind) VAO first
 
 void pigeon_opengl_draw(struct PigeonOpenGLVAO*, unsigned int first, unsigned int count);
-void pigeon_opengl_draw_indexed(struct PigeonOpenGLVAO*, unsigned int start_vertex, unsigned int first, unsigned int count);
+void pigeon_opengl_draw_instanced(struct PigeonOpenGLVAO*, unsigned int first, unsigned int count, unsigned int instances);
+void pigeon_opengl_draw_indexed(struct PigeonOpenGLVAO*, unsigned int start_vertex, unsigned int first, unsigned int count,
+	unsigned int instances);
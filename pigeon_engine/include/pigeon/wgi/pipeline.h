@@ -98,11 +98,20 @@ typedef struct PigeonWGIPipeline {
 			int program_mvp; // currently set value
 			int program_depth_mvp_loc;
 			int program_depth_mvp;
+
+			int program_draw_offset_loc; // uniform location for the draw index of the first instance
+			int program_draw_offset; // currently set value
+			int program_depth_draw_offset_loc;
+			int program_depth_draw_offset;
 		} gl;
 	};
 
 	bool skinned;
 	bool transparent;
+
+	// Copied from the config. Used for meshlet culling
+	PigeonWGICullMode cull_mode;
+	PigeonWGIFrontFace front_face;
 } PigeonWGIPipeline;
 
 // Shaders can be destroyed after creating the pipeline.
@@ -47,3 +47,14 @@ PIGEON_ERR_RET pigeon_wgi_record_bloom(void); // check pigeon_wgi_bloom_record_n
 
 PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage);
 PIGEON_ERR_RET pigeon_wgi_end_record(PigeonWGIRenderStage);
+
+// Only if pigeon_wgi_multithreading_supported(), for the shadow, depth and render stages.
+// Call instead of pigeon_wgi_start_record to split the draws of a stage into chunks (secondary command buffers)
+//  which can be recorded on different threads, between pigeon_wgi_start_record_chunk and pigeon_wgi_end_record_chunk.
+// Call pigeon_wgi_end_record after every chunk has been recorded. The chunks are executed in order.
+// The chunk is passed to the draw functions. It is 0 if the stage is not split into chunks
+#define PIGEON_WGI_MAX_RECORD_CHUNKS 16
+
+PIGEON_ERR_RET pigeon_wgi_start_record_chunks(PigeonWGIRenderStage, unsigned int chunks);
+PIGEON_ERR_RET pigeon_wgi_start_record_chunk(PigeonWGIRenderStage, unsigned int chunk);
+PIGEON_ERR_RET pigeon_wgi_end_record_chunk(PigeonWGIRenderStage, unsigned int chunk);
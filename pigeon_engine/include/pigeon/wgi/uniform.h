@@ -3,6 +3,7 @@
 #ifndef CGLM_FORCE_DEPTH_ZERO_TO_ONE
 #define CGLM_FORCE_DEPTH_ZERO_TO_ONE
 #endif
+#include "material.h"
 #include <cglm/types.h>
 #include <stdint.h>
 
@@ -10,22 +11,34 @@
 #define PIGEON_WGI_ALPHA_CHANNEL_UNDER_COLOUR 1.0f
 #define PIGEON_WGI_ALPHA_CHANNEL_TRANSPARENCY 2.0f
 
-typedef struct PigeonWGIDrawObject {
-	mat4 proj_view_model[5];
+// The OpenGL light list is a uniform block so it has a fixed size (fits in the minimum 16KiB block size)
+#define PIGEON_WGI_MAX_LIGHTS_OPENGL 64
+
+// With Vulkan the view frustum is divided into clusters (exponential depth slices) and object.frag
+// only lights a fragment with the lights that overlap its cluster
+#define PIGEON_WGI_LIGHT_CLUSTERS_X 16
+#define PIGEON_WGI_LIGHT_CLUSTERS_Y 9
+#define PIGEON_WGI_LIGHT_CLUSTERS_Z 24
+#define PIGEON_WGI_LIGHT_CLUSTERS (PIGEON_WGI_LIGHT_CLUSTERS_X * PIGEON_WGI_LIGHT_CLUSTERS_Y * PIGEON_WGI_LIGHT_CLUSTERS_Z)
 
-	mat4 model;
-	mat4 normal_model_matrix;
+// Per-instance data. The camera or shadow projection is applied in the vertex shader
+typedef struct PigeonWGIDrawObject {
+	vec4 model[3]; // First 3 rows of the model matrix
 
 	vec3 position_min;
 	float first_bone_index;
 	vec3 position_range;
-	float ssao_intensity;
+	float material_index; // into the material table
+} PigeonWGIDrawObject;
+
+// With OpenGL instanced draws read their draw objects from a uniform block of this many draw objects (fits in the
+// minimum 16KiB block size). The block is bound at an aligned draw object before the first instance
+#define PIGEON_WGI_DRAW_OBJECTS_OPENGL 204
 
+typedef struct PigeonWGIMaterial {
 	uint32_t texture_sampler_index_plus1; // into array of glsl samplers
 	float texture_index; // into array texture
-
-	int rsvd0;
-
+	float ssao_intensity;
 	float specular_intensity;
 
 	vec3 colour;
@@ -38,17 +51,56 @@ typedef struct PigeonWGIDrawObject {
 	uint32_t normal_map_sampler_index_plus1;
 	float normal_map_index;
 
+	int rsvd0;
 	int rsvd1;
-	int rsvd2;
-} PigeonWGIDrawObject;
-
+} PigeonWGIMaterial;
+
+// Instances of one model in one render state, for GPU culling (see pigeon_wgi_get_cull_groups)
+// The compute shader picks a LOD for each instance, compacts the visible draw objects and writes the
+// indirect draw commands of the render state
+typedef struct PigeonWGICullGroup {
+	uint32_t first_draw_object; // Groups must be in order of first_draw_object
+	uint32_t instances;
+	uint32_t render_state; // Index of the draw counts
+	uint32_t first_command; // Commands of the render state. Passed to pigeon_wgi_gpu_culled_draw
+
+	uint32_t commands_per_set; // Maximum draws of the render state in one stage
+	int32_t vertex_offset;
+	uint32_t lods;
+	uint32_t rsvd0;
+
+	uint32_t lod_first[PIGEON_WGI_MAX_LODS]; // Index ranges
+	uint32_t lod_count[PIGEON_WGI_MAX_LODS];
+
+	// Minimum projected diameter (fraction of the screen height) of each LOD but the last
+	float lod_screen_sizes[PIGEON_WGI_MAX_LODS];
+} PigeonWGICullGroup;
+
+// One skinned instance for compute skinning (see pigeon_wgi_get_skin_jobs). The compute shader writes the skinned
+// vertices [first_vertex, first_vertex + vertex_count) of the mesh to the transient vertex buffer at output_offset.
+// Draw objects that use the skinned vertices have first_bone_index = -2 - (index of the job)
+typedef struct PigeonWGISkinJob {
+	uint32_t first_vertex; // Relative to the start of the multimesh
+	uint32_t vertex_count;
+	uint32_t output_offset; // Jobs of one mesh must be consecutive, with consecutive outputs in order of the jobs
+	int32_t first_bone_index;
+
+	vec4 position_min; // Mesh bounds (see PigeonWGIMeshMeta). w is unused
+	vec4 position_range;
+} PigeonWGISkinJob;
+
+// Element of the light list (see pigeon_wgi_get_lights) and of the shadow lights in the per-frame uniform data
+// shadow_pixel_offset and shadow_proj_view are only used in the shadow lights
 typedef struct PigeonWGILight {
 	vec3 world_position;
 	float light_type; // 0: directional, 1: point
 	vec3 neg_direction;
-	float is_shadow_caster; // 0 -> no shadows
+	float is_shadow_caster; // 0 -> no shadows, otherwise index into the shadow lights + 1
 	vec3 intensity;
-	float shadow_pixel_offset;
+	union {
+		float shadow_pixel_offset; // Shadow lights
+		float radius; // Point lights in the light list. Set by the WGI
+	};
 	mat4 shadow_proj_view;
 } PigeonWGILight;
 
@@ -60,11 +112,11 @@ typedef struct PigeonWGISceneUniformData {
 	float one_pixel_x;
 	float one_pixel_y;
 	float time;
-	uint32_t number_of_lights;
-	float rsvd2;
+	uint32_t number_of_lights; // In the light list
+	uint32_t light_cluster_words; // Set by the WGI
 	float rsvd3;
 
-	PigeonWGILight lights[4];
+	PigeonWGILight shadow_lights[4]; // Set by the WGI. Index = index into shadows (see pigeon_wgi_start_frame)
 	vec3 ambient;
 	float rsvd4;
 
@@ -77,7 +129,8 @@ typedef struct PigeonWGISceneUniformData {
 	vec3 eye_position;
 } PigeonWGISceneUniformData;
 
-void pigeon_wgi_get_normal_model_matrix(const mat4 model, mat4 normal_model_matrix);
+// index must be less than the max_materials passed to pigeon_wgi_start_frame
+// With Vulkan the material is only written to the per-frame buffer if it differs from what is already there
+void pigeon_wgi_set_material(unsigned int index, PigeonWGIMaterial const*);
 
-void pigeon_wgi_set_object_shadow_mvp_uniform(PigeonWGIDrawObject* data, mat4 model_matrix);
 PIGEON_ERR_RET pigeon_wgi_set_uniform_data(PigeonWGISceneUniformData* uniform_data);
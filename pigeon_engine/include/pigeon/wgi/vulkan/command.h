@@ -42,6 +42,7 @@ int pigeon_vulkan_start_submission2(PigeonVulkanCommandPool* command_pool, unsig
 	PigeonVulkanRenderPass* render_pass, PigeonVulkanFramebuffer* framebuffer);
 
 void pigeon_vulkan_wait_for_vertex_data_transfer(PigeonVulkanCommandPool*, unsigned int buffer_index);
+void pigeon_vulkan_wait_for_compute_write(PigeonVulkanCommandPool*, unsigned int buffer_index);
 void pigeon_vulkan_transition_image_preinit_to_shader_read(
 	PigeonVulkanCommandPool*, unsigned int buffer_index, PigeonVulkanImage*);
 void pigeon_vulkan_transition_image_to_transfer_dst(
@@ -62,6 +63,10 @@ void pigeon_vulkan_transfer_buffer_to_image(PigeonVulkanCommandPool*, unsigned i
 void pigeon_vulkan_set_viewport_size(
 	PigeonVulkanCommandPool*, unsigned int buffer_index, unsigned int width, unsigned int height);
 
+// Call after pigeon_vulkan_set_viewport_size (which sets the scissor to the viewport)
+void pigeon_vulkan_set_scissor_size(
+	PigeonVulkanCommandPool*, unsigned int buffer_index, unsigned int width, unsigned int height);
+
 void pigeon_vulkan_start_render_pass(PigeonVulkanCommandPool*, unsigned int buffer_index, PigeonVulkanRenderPass*,
 	PigeonVulkanFramebuffer*, unsigned int viewport_width, unsigned int viewport_height,
 	bool using_secondary_buffers // Drawing commands are in a secondary command buffer (not this primary one)
@@ -95,6 +100,17 @@ void pigeon_vulkan_multidraw_indexed(PigeonVulkanCommandPool*, unsigned int buff
 	unsigned int push_constants_size, void* push_constants_data, PigeonVulkanBuffer*, uint64_t buffer_offset,
 	uint32_t first_multidraw_index, uint32_t multidraw_cmd_count);
 
+// Draw count is read from count_buffer (uint32). Only if pigeon_vulkan_draw_indirect_count_supported()
+void pigeon_vulkan_multidraw_indexed_count(PigeonVulkanCommandPool*, unsigned int buffer_index, PigeonVulkanPipeline*,
+	unsigned int push_constants_size, void* push_constants_data, PigeonVulkanBuffer*, uint64_t buffer_offset,
+	uint32_t first_multidraw_index, uint32_t max_multidraw_cmd_count, PigeonVulkanBuffer* count_buffer,
+	uint64_t count_buffer_offset);
+
+// Binds the compute pipeline and descriptor set then dispatches group_count x 1 x 1 work groups
+void pigeon_vulkan_dispatch(PigeonVulkanCommandPool*, unsigned int buffer_index, PigeonVulkanPipeline*,
+	PigeonVulkanDescriptorPool*, unsigned int descriptor_set, unsigned int push_constants_size,
+	void* push_constants_data, uint32_t group_count);
+
 void pigeon_vulkan_buffer_transfer(PigeonVulkanCommandPool*, unsigned int buffer_index, PigeonVulkanBuffer* dst,
 	uint64_t dst_offset, PigeonVulkanBuffer* src, uint64_t src_offset, uint64_t size);
 
@@ -31,6 +31,7 @@ typedef struct PigeonVulkanDescriptorBinding {
 	PigeonVulkanDescriptorType type;
 	bool vertex_shader_accessible;
 	bool fragment_shader_accessible;
+	bool compute_shader_accessible;
 	unsigned int elements; // Array elements. e.g. uniform sampler2D textures[3];
 } PigeonVulkanDescriptorBinding;
 
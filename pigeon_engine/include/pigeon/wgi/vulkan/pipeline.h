@@ -34,4 +34,7 @@ PIGEON_ERR_RET pigeon_vulkan_create_pipeline(PigeonVulkanPipeline*, PigeonVulkan
 	// 1 value in sc_data for each specialisation constant. booleans are 0 (false) or 1 (true)
 	unsigned int specialisation_constants, uint32_t * sc_data);
 
+PIGEON_ERR_RET pigeon_vulkan_create_compute_pipeline(PigeonVulkanPipeline*, PigeonVulkanShader*,
+	unsigned int push_constants_size, PigeonVulkanDescriptorLayout*);
+
 void pigeon_vulkan_destroy_pipeline(PigeonVulkanPipeline*);
@@ -29,3 +29,9 @@ bool pigeon_vulkan_bc7_optimal_available(void);
 bool pigeon_vulkan_etc1_optimal_available(void);
 bool pigeon_vulkan_etc2_optimal_available(void);
 bool pigeon_vulkan_etc2_rgba_optimal_available(void);
+
+// The general queue can run compute shaders
+bool pigeon_vulkan_compute_supported(void);
+
+// Compute shaders and pigeon_vulkan_multidraw_indexed_count can be used
+bool pigeon_vulkan_draw_indirect_count_supported(void);
@@ -18,9 +18,11 @@ PIGEON_ERR_RET pigeon_wgi_init(PigeonWindowParameters window_parameters, bool pr
 bool pigeon_wgi_multithreading_supported(void);
 bool pigeon_wgi_multidraw_supported(void);
 
+// Vulkan with vkCmdDrawIndexedIndirectCount
+bool pigeon_wgi_gpu_culling_supported(void);
+
 // In bytes
-// 1 for Vulkan
-// 16, 64, 256, etc. for OpenGL
+// 1: draw objects are tightly packed so that instanced draws can read consecutive draw objects
 unsigned int pigeon_wgi_get_draw_data_alignment(void);
 
 // Alignment (number of bones) of bone data for 1 armature in the bone uniform data
@@ -34,20 +36,82 @@ void pigeon_wgi_set_brightness(float b);
 void pigeon_wgi_set_ambient(float r, float g, float b);
 void pigeon_wgi_set_ssao_cutoff(float cb);
 
+// Vulkan with timer queries
+bool pigeon_wgi_dynamic_resolution_supported(void);
+
+// Only if pigeon_wgi_dynamic_resolution_supported(), otherwise target_milliseconds must be 0.
+// The depth pre-pass, SSAO, render and bloom stages draw to part of their framebuffers, which is scaled
+//  (down to min_scale of the window size) to keep the GPU frame time near target_milliseconds.
+// The post-processing stage upscales the image to the window. 0 disables it (the default)
+PIGEON_ERR_RET pigeon_wgi_set_dynamic_resolution(double target_milliseconds, float min_scale);
+
+// 1 unless dynamic resolution is enabled
+float pigeon_wgi_get_render_scale(void);
+
 // delayed_timer_values is set to the timer query results from 2 or more frames ago
 PIGEON_ERR_RET pigeon_wgi_next_frame_wait(double delayed_timer_values[PIGEON_WGI_RENDER_STAGE__COUNT]);
 PIGEON_ERR_RET pigeon_wgi_next_frame_poll(double delayed_timer_values[PIGEON_WGI_RENDER_STAGE__COUNT], bool* ready);
 
 // max_draws determines the minimum size of the draws ssbo
 // max_multidraw_draws = maximum number of draws within multidraw draws
+// (at most 2 per draw: a single object can be in a shadow pass multidraw and an occlusion culled multidraw)
 // Instancing counts as multiple draws
-// index into shadows = index into lights array in per-frame uniform data
+// max_materials is the size of the material table (see pigeon_wgi_set_material)
+// lights is the size of the light list (see pigeon_wgi_get_lights)
+// There is no upper limit on the sizes. The per-frame buffers grow as needed
+// index into shadows = index into shadow_lights array in per-frame uniform data
 // draw_objects and bone_matrices are set to point to a uniform data mapping
 // use pigeon_wgi_get_draw_data_alignment and pigeon_wgi_get_bone_data_alignment
-PIGEON_ERR_RET pigeon_wgi_start_frame(uint32_t max_draws, uint32_t max_multidraw_draws,
-	PigeonWGIShadowParameters shadows[4], unsigned int total_bones, void** draw_objects,
+PIGEON_ERR_RET pigeon_wgi_start_frame(uint32_t max_draws, uint32_t max_multidraw_draws, uint32_t max_materials,
+	uint32_t lights, PigeonWGIShadowParameters shadows[4], unsigned int total_bones, void** draw_objects,
 	PigeonWGIBoneMatrix** bone_matrices);
 
+// Call after pigeon_wgi_start_frame. Write the lights before pigeon_wgi_set_uniform_data.
+// count is set to the number of lights that fit, which is the lights passed to pigeon_wgi_start_frame
+//  (at most PIGEON_WGI_MAX_LIGHTS_OPENGL with OpenGL)
+// pigeon_wgi_set_uniform_data copies the lights to the GPU and (with Vulkan) assigns them to light clusters
+PigeonWGILight* pigeon_wgi_get_lights(unsigned int* count);
+
+// Only if pigeon_wgi_gpu_culling_supported(). Call before pigeon_wgi_start_frame, every frame.
+// instances is the number of draw objects written by the CPU, starting at draw object 0.
+// max_draws must be at least 3*instances: the culled draw objects are written after the CPU-written ones,
+//  one copy for the shadow stages and one for the camera stages.
+// The compute work is recorded into the upload stage command buffer by pigeon_wgi_end_record
+void pigeon_wgi_set_gpu_culling_sizes(unsigned int instances, unsigned int groups, unsigned int render_states);
+
+// Call after pigeon_wgi_start_frame. Write all groups before pigeon_wgi_submit_frame
+PigeonWGICullGroup* pigeon_wgi_get_cull_groups(void);
+
+// Vulkan with compute shaders
+bool pigeon_wgi_compute_skinning_supported(void);
+
+// Only if pigeon_wgi_compute_skinning_supported(). Call before pigeon_wgi_start_frame, every frame.
+// jobs is the number of skinned instances, vertices is the total of their vertex counts and meshes is the number
+// of pigeon_wgi_skin_mesh calls.
+// The skinned vertices are written before the depth stage so every pass reads them instead of skinning each vertex
+// again. The skinned vertex shaders read them for draw objects with first_bone_index <= -2 (see PigeonWGISkinJob)
+PIGEON_ERR_RET pigeon_wgi_set_compute_skinning_sizes(unsigned int jobs, unsigned int vertices, unsigned int meshes);
+
+// Call after pigeon_wgi_start_frame. Write all jobs before pigeon_wgi_submit_frame
+PigeonWGISkinJob* pigeon_wgi_get_skin_jobs(void);
+
+// Call after pigeon_wgi_start_frame, once for each mesh with skinned instances.
+// jobs [first_job, first_job + jobs) use the mesh and write vertices [first_output, first_output + outputs).
+// The mesh must have PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED and PIGEON_WGI_VERTEX_ATTRIBUTE_BONE vertices.
+// The compute work is recorded into the upload stage command buffer by pigeon_wgi_end_record
+PIGEON_ERR_RET pigeon_wgi_skin_mesh(PigeonWGIMultiMesh*, unsigned int first_job, unsigned int jobs,
+	unsigned int first_output, unsigned int outputs);
+
+// Starts at 1 for the first frame. Incremented by pigeon_wgi_start_frame
+uint64_t pigeon_wgi_get_frame_number(void);
+
+// Call after pigeon_wgi_start_frame.
+// With Vulkan, draw objects stay in the per-frame buffers so only the ones that have changed need writing.
+// Returns the frame number of the last frame that wrote to the draw objects returned by pigeon_wgi_start_frame,
+//  or 0 if they must all be written (OpenGL, first use of the buffer, buffer was resized).
+// A draw object that has not changed since that frame can be left as it is.
+uint64_t pigeon_wgi_get_draw_objects_frame(void);
+
 // Blocks when using OpenGL
 // Call record functions first
 PIGEON_ERR_RET pigeon_wgi_submit_frame(void);
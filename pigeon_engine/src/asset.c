@@ -1,6 +1,7 @@
 #include <pigeon/asset.h>
 #include <pigeon/assert.h>
 #include <pigeon/misc.h>
+#include <pigeon/compressed_animation.h>
 #include <config_parser.h>
 #include <zstd.h>
 #include <stb_vorbis.c>
@@ -29,16 +30,23 @@ enum {
     KEY_TEXTURE,
     KEY_NORMAL_MAP,
     KEY_SPECULAR,
+    KEY_LODS_COUNT,
+    KEY_LOD_SCREEN_SIZES,
+    KEY_LOD,
+    KEY_MESHLETS_COUNT,
+    KEY_MESHLETS,
     KEY_BONES_COUNT,
     KEY_BONE,
     KEY_HEAD,
     KEY_TAIL,
     KEY_PARENT,
     KEY_FRAME_RATE,
+    KEY_ANIMATION_SPACE,
     KEY_ANIMATIONS_COUNT,
     KEY_ANIMATION,
     KEY_LOOPS,
     KEY_FRAMES,
+    KEY_COMPRESSED,
 
     KEY_WIDTH,
     KEY_HEIGHT,
@@ -82,16 +90,23 @@ const char * keys[] = {
     "TEXTURE",
     "NORMAL-MAP",
     "SPECULAR",
+    "LODS-COUNT",
+    "LOD-SCREEN-SIZES",
+    "LOD",
+    "MESHLETS-COUNT",
+    "MESHLETS",
     "BONES-COUNT",
     "BONE",
     "HEAD",
     "TAIL",
     "PARENT",
     "FRAME-RATE",
+    "ANIMATION-SPACE",
     "ANIMATIONS-COUNT",
     "ANIMATION",
     "LOOPS",
     "FRAMES",
+    "COMPRESSED",
 
     "WIDTH",
     "HEIGHT",
@@ -355,6 +370,42 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
                 asset->mesh_meta.bounds_range[1] > 0.0f &&
                 asset->mesh_meta.bounds_range[2] > 0.0f, "Invalid vertex position range");
         }
+        else if (key == KEY_LODS_COUNT) {
+            CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
+
+            ASSERT_LOG_R1(!asset->lods_count, "Multiple LODS-COUNT");
+
+            long int c = strtol(value, NULL, 10);
+            if(c < 1 || c > PIGEON_WGI_MAX_LODS) {
+                fprintf(stderr, "Invalid LODS-COUNT: %li\n", c);
+                ASSERT_R1(false);
+            }
+            asset->lods_count = (unsigned int)c;
+        }
+        else if (key == KEY_LOD_SCREEN_SIZES) {
+            CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
+            ASSERT_LOG_R1(asset->lods_count, "Missing LODS-COUNT");
+
+            for(unsigned int i = 0; i+1 < asset->lods_count; i++) {
+                while(*value == ' ' || *value == '\t') value++;
+                ASSERT_LOG_R1(*value, "Not enough LOD-SCREEN-SIZES");
+
+                float size = strtof(value, (char**)&value);
+                ASSERT_LOG_R1(size > 0 && (!i || size < asset->lod_screen_sizes[i-1]),
+                    "LOD-SCREEN-SIZES must be positive and decreasing");
+                asset->lod_screen_sizes[i] = size;
+            }
+        }
+        else if (key == KEY_MESHLETS_COUNT) {
+            CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
+
+            long int c = strtol(value, NULL, 10);
+            if(c < 0 || c > 100000000) {
+                fprintf(stderr, "Invalid MESHLETS-COUNT: %li\n", c);
+                ASSERT_R1(false);
+            }
+            asset->meshlets_count = (unsigned int)c;
+        }
         else if (key == KEY_MATERIALS_COUNT) {
             CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
 
@@ -443,13 +494,45 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
             MATERIAL_CHECKS();
             asset->materials[material_index].specular = strtof(value, (char**)&value);
         }
+        else if (key == KEY_LOD) {
+            // LOD <lod> <first> <count>
+            MATERIAL_CHECKS();
+            ASSERT_LOG_R1(asset->lods_count, "Missing LODS-COUNT");
+
+            long int lod = strtol(value, (char**)&value, 10);
+            long int f = strtol(value, (char**)&value, 10);
+            long int c = strtol(value, NULL, 10);
+
+            long int max = asset->mesh_meta.index_count ? asset->mesh_meta.index_count : asset->mesh_meta.vertex_count;
+            if(lod < 1 || (unsigned)lod >= asset->lods_count || f < 0 || c < 0 || f+c > max) {
+                fprintf(stderr, "Invalid LOD: %li %li %li\n", lod, f, c);
+                ASSERT_R1(false);
+            }
+            asset->materials[material_index].lod_first[lod-1] = (unsigned int)f;
+            asset->materials[material_index].lod_count[lod-1] = (unsigned int)c;
+        }
+        else if (key == KEY_MESHLETS) {
+            // MESHLETS <lod> <first> <count>
+            MATERIAL_CHECKS();
+
+            long int lod = strtol(value, (char**)&value, 10);
+            long int f = strtol(value, (char**)&value, 10);
+            long int c = strtol(value, NULL, 10);
+
+            if(lod < 0 || lod >= PIGEON_WGI_MAX_LODS || f < 0 || c < 0 || f+c > asset->meshlets_count) {
+                fprintf(stderr, "Invalid MESHLETS: %li %li %li\n", lod, f, c);
+                ASSERT_R1(false);
+            }
+            asset->materials[material_index].meshlet_first[lod] = (unsigned int)f;
+            asset->materials[material_index].meshlet_count[lod] = (unsigned int)c;
+        }
         #undef MATERIAL_CHECKS
 
         else if (key == KEY_BONES_COUNT) {
             CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL); 
 
             long int c = strtol(value, NULL, 10);
-            if(c < 0 || c > 256)
+            if(c < 0 || c > PIGEON_MAX_BONES)
             {
                 fprintf(stderr, "Invalid number of bones: %li\n", c);
                 ASSERT_R1(false);
@@ -506,6 +589,19 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
             asset->bones[bone_index].parent_index = (int)p;
         }
         #undef BONE_CHECKS
+        else if (key == KEY_ANIMATION_SPACE) {
+            CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
+
+            if(word_matches(value, "LOCAL")) {
+                asset->local_animations = true;
+            }
+            else if(word_matches(value, "MODEL")) {
+                asset->local_animations = false;
+            }
+            else {
+                ASSERT_R1(false);
+            }
+        }
         else if (key == KEY_FRAME_RATE) {
             CHECK_TYPE(PIGEON_ASSET_TYPE_MODEL);
 
@@ -566,6 +662,19 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
             }
             asset->animations[animation_index].frame_count = (unsigned)f;
         }
+        else if (key == KEY_COMPRESSED) {
+            ANIMATION_CHECKS();
+
+            if(word_matches(value, "YES")) {
+                asset->animations[animation_index].compressed = true;
+            }
+            else if(word_matches(value, "NO")) {
+                asset->animations[animation_index].compressed = false;
+            }
+            else {
+                ASSERT_R1(false);
+            }
+        }
         #undef ANIMATION_CHECKS
         
 
@@ -686,13 +795,20 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
         ASSERT_R1(!asset->bones_count || (unsigned)(bone_index+1) == asset->bones_count);
         ASSERT_R1(!asset->materials_count || (unsigned)(material_index+1) == asset->materials_count);
 
+        ASSERT_LOG_R1(!pigeon_create_skeleton(&asset->skeleton, asset->bones, asset->bones_count),
+            "Invalid bone hierarchy");
+
         ASSERT_LOG_R1(!asset->mesh_meta.index_count || got_indices_type, "Missing INDICES-TYPE");
         ASSERT_LOG_R1(!asset->mesh_meta.vertex_count || got_vertex_attributes, "Missing VERTEX-ATTRIBUTES");
 
+        if(!asset->lods_count) asset->lods_count = 1;
+        ASSERT_LOG_R1(asset->lods_count == 1 || asset->lod_screen_sizes[0] > 0, "Missing LOD-SCREEN-SIZES");
+
 
         uint64_t offset = 0;
         bool contains_normalised_position = false;
-        for(unsigned int i = 0; i < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES; i++) {
+        unsigned int attributes_count = 0;
+        for(unsigned int i = 0; i < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES; i++, attributes_count++) {
             PigeonWGIVertexAttributeType type = asset->mesh_meta.attribute_types[i];
             if(!type) break;
             else if (type == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED) {
@@ -702,11 +818,23 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
             offset += pigeon_wgi_get_vertex_attribute_type_size(type) * asset->mesh_meta.vertex_count;
         }
 
+        asset->animations_first_subresource = attributes_count + (asset->mesh_meta.index_count ? 1 : 0);
+        ASSERT_LOG_R1(asset->animations_first_subresource + asset->animations_count <= asset->subresource_count,
+            "Missing animation subresources");
+
         if(contains_normalised_position) {
             ASSERT_LOG_R1(got_bounds_range && got_bounds_min, 
                 "Normalised position attribute requires BOUNDS-MINIMUM and BOUNDS-RANGE");
         }
 
+        if(asset->meshlets_count) {
+            ASSERT_LOG_R1(asset->mesh_meta.index_count, "Meshlets require an index buffer");
+            ASSERT_LOG_R1(asset->subresource_count > attributes_count + 1 + asset->animations_count &&
+                asset->subresources[asset->subresource_count-1].decompressed_data_length ==
+                    asset->meshlets_count * sizeof(PigeonWGIMeshlet),
+                "Missing meshlet subresource");
+        }
+
     }
     else if (asset->type == PIGEON_ASSET_TYPE_IMAGE) {
         ASSERT_LOG_R1(asset->texture_meta.width, "Missing WIDTH");
@@ -719,20 +847,95 @@ PIGEON_ERR_RET pigeon_load_asset_meta(PigeonAsset * asset, const char * meta_fil
     return 0;
 }
 
-PIGEON_ERR_RET pigeon_load_asset_data(PigeonAsset * asset, const char * data_file_path)
+const PigeonWGIMeshlet* pigeon_get_model_meshlets(PigeonAsset const* asset)
 {
-    ASSERT_R1(asset && asset->type);
+    if(asset->type != PIGEON_ASSET_TYPE_MODEL || !asset->meshlets_count) return NULL;
+    return asset->subresources[asset->subresource_count-1].decompressed_data;
+}
+
+const PigeonWGIBoneData* pigeon_get_animation_bone_data(PigeonAsset const* asset, unsigned int animation_index)
+{
+    if(asset->type != PIGEON_ASSET_TYPE_MODEL || animation_index >= asset->animations_count ||
+        asset->animations[animation_index].compressed) return NULL;
+    return asset->subresources[asset->animations_first_subresource + animation_index].decompressed_data;
+}
+
+const void* pigeon_get_compressed_animation(PigeonAsset const* asset, unsigned int animation_index)
+{
+    if(asset->type != PIGEON_ASSET_TYPE_MODEL || animation_index >= asset->animations_count ||
+        !asset->animations[animation_index].compressed) return NULL;
+
+    const void * data = asset->subresources[asset->animations_first_subresource + animation_index].decompressed_data;
+    if((uintptr_t)data % PIGEON_COMPRESSED_ANIMATION_ALIGNMENT) return NULL;
+    return data;
+}
+
+// NULL if subresource i is not a compressed animation
+static PigeonWGIAnimationMeta const* get_compressed_animation_meta(PigeonAsset const* asset, unsigned int i)
+{
+    if(asset->type != PIGEON_ASSET_TYPE_MODEL || i < asset->animations_first_subresource ||
+        i - asset->animations_first_subresource >= asset->animations_count) return NULL;
+
+    PigeonWGIAnimationMeta const* a = &asset->animations[i - asset->animations_first_subresource];
+    return a->compressed ? a : NULL;
+}
+
+// Compressed animations are checked once, when their data is loaded or decompressed, so that frames can be decoded
+// without checks
+static bool subresource_valid(PigeonAsset const* asset, unsigned int i, const void * data)
+{
+    PigeonWGIAnimationMeta const* a = get_compressed_animation_meta(asset, i);
+    return !a || pigeon_compressed_animation_valid(data, asset->subresources[i].decompressed_data_length,
+        asset->bones_count, a->frame_count);
+}
+
+// The subresource is no longer read from the data file
+static void discard_subresource_data(PigeonAsset * asset, PigeonAssetSubresource const* subr)
+{
+    if(!asset->original_data_is_mapped) return;
+
+    unsigned long length = subr->type == PIGEON_ASSET_SUBRESOURCE_TYPE_UNCOMPRESSED ?
+        subr->decompressed_data_length : subr->compressed_data_length;
+    pigeon_discard_mapped_range(asset->original_data, subr->original_file_data_offset, length);
+}
 
-    unsigned long size;
-    asset->original_data = (char*)pigeon_load_file(data_file_path, 0, &size);
+// Uncompressed subresources are read in place but subresources in the data file are not aligned.
+// Compressed animations that are not aligned are copied
+static PIGEON_ERR_RET align_subresource(PigeonAsset * asset, unsigned int i)
+{
+    PigeonAssetSubresource * s = &asset->subresources[i];
+    if(!get_compressed_animation_meta(asset, i) ||
+        (uintptr_t)s->decompressed_data % PIGEON_COMPRESSED_ANIMATION_ALIGNMENT == 0) return 0;
+
+    void * copy = malloc(s->decompressed_data_length);
+    ASSERT_R1(copy);
+    memcpy(copy, s->decompressed_data, s->decompressed_data_length);
+    discard_subresource_data(asset, s);
+
+    s->decompressed_data = copy;
+    s->decompressed_data_was_mallocd = true;
+    return 0;
+}
+
+static PIGEON_ERR_RET set_subresource_pointers(PigeonAsset * asset)
+{
     uint8_t * data = asset->original_data;
 
-    ASSERT_R1(asset->original_data);
+    ASSERT_R1(data);
 
     for(unsigned int i = 0; i < asset->subresource_count; i++) {
+        PigeonAssetSubresource const* s = &asset->subresources[i];
+        uint64_t length = s->type == PIGEON_ASSET_SUBRESOURCE_TYPE_UNCOMPRESSED ?
+            s->decompressed_data_length : s->compressed_data_length;
+        ASSERT_LOG_R1((uint64_t)s->original_file_data_offset + length <= asset->original_data_size,
+            "Subresource is outside the data file");
+
         switch(asset->subresources[i].type) {
             case PIGEON_ASSET_SUBRESOURCE_TYPE_UNCOMPRESSED:
                 asset->subresources[i].decompressed_data = &data[asset->subresources[i].original_file_data_offset];
+                ASSERT_R1(!align_subresource(asset, i));
+                ASSERT_LOG_R1(subresource_valid(asset, i, asset->subresources[i].decompressed_data),
+                    "Invalid compressed animation");
                 break;
             case PIGEON_ASSET_SUBRESOURCE_TYPE_ZSTD:
             case PIGEON_ASSET_SUBRESOURCE_TYPE_OGG_FILE:
@@ -744,6 +947,24 @@ PIGEON_ERR_RET pigeon_load_asset_data(PigeonAsset * asset, const char * data_fil
     return 0;
 }
 
+PIGEON_ERR_RET pigeon_load_asset_data(PigeonAsset * asset, const char * data_file_path)
+{
+    ASSERT_R1(asset && asset->type);
+
+    asset->original_data = pigeon_load_file(data_file_path, 0, &asset->original_data_size);
+    asset->original_data_is_mapped = false;
+    return set_subresource_pointers(asset);
+}
+
+PIGEON_ERR_RET pigeon_map_asset_data(PigeonAsset * asset, const char * data_file_path)
+{
+    ASSERT_R1(asset && asset->type);
+
+    asset->original_data = pigeon_map_file(data_file_path, &asset->original_data_size);
+    asset->original_data_is_mapped = asset->original_data != NULL;
+    return set_subresource_pointers(asset);
+}
+
 
 PIGEON_ERR_RET pigeon_decompress_asset(PigeonAsset * asset, void * buffer, unsigned int i)
 {
@@ -753,6 +974,7 @@ PIGEON_ERR_RET pigeon_decompress_asset(PigeonAsset * asset, void * buffer, unsig
 
     if(buffer && subr->decompressed_data) {
         memcpy(buffer, subr->decompressed_data, subr->decompressed_data_length);
+        if(!subr->decompressed_data_was_mallocd) discard_subresource_data(asset, subr);
         return 0;
     }
 
@@ -771,6 +993,7 @@ PIGEON_ERR_RET pigeon_decompress_asset(PigeonAsset * asset, void * buffer, unsig
         subr->decompressed_data_length = (unsigned)sample_count * (unsigned)channels * 2;
         subr->decompressed_data_was_mallocd = true;
 
+        discard_subresource_data(asset, subr);
         return 0;
     }
 
@@ -795,6 +1018,16 @@ PIGEON_ERR_RET pigeon_decompress_asset(PigeonAsset * asset, void * buffer, unsig
             fprintf(stderr, "ZSTD error: %s\n", ZSTD_getErrorName(output_bytes_count));
             ASSERT_R1(false);
         }
+        discard_subresource_data(asset, subr);
+
+        if(!subresource_valid(asset, i, buffer)) {
+            if(buffer == subr->decompressed_data) {
+                free(subr->decompressed_data);
+                subr->decompressed_data = NULL;
+                subr->decompressed_data_was_mallocd = false;
+            }
+            ASSERT_LOG_R1(false, "Invalid compressed animation");
+        }
     }
     else {
         ASSERT_R1(false);
@@ -809,7 +1042,14 @@ void pigeon_free_asset(PigeonAsset * asset)
 
 
     free_if(asset->name);
-    free_if(asset->original_data);
+    if(asset->original_data_is_mapped) {
+        pigeon_unmap_file(asset->original_data, asset->original_data_size);
+        asset->original_data = NULL;
+        asset->original_data_is_mapped = false;
+    }
+    else {
+        free_if(asset->original_data);
+    }
 
     if(asset->subresources) {
         for(unsigned int i = 0; i < asset->subresource_count; i++) {
@@ -845,6 +1085,7 @@ void pigeon_free_asset(PigeonAsset * asset)
             free2(asset->bones);
         }
         asset->bones_count = 0;
+        pigeon_destroy_skeleton(&asset->skeleton);
 
 
         if(asset->animations_count && asset->animations) {
@@ -0,0 +1,440 @@
+#include <pigeon/compressed_animation.h>
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COMPRESSED_ANIMATION_MAGIC 0x31434150u // "PAC1"
+
+// Translation and scale keys
+#define QUANTISED_MAX 65535.0f
+
+// Rotation keys. The 3 smallest components of a normalised quaternion are between -1/sqrt(2) and 1/sqrt(2)
+#define SMALLEST_THREE_MAX 32767.0f
+#define SQRT_2 1.41421356f
+
+enum { TRACK_ROTATION, TRACK_TRANSLATION, TRACK_SCALE, TRACKS_PER_BONE };
+
+// The data is a Header, then Track[bones_count * TRACKS_PER_BONE],
+// then the frame number of each key (uint16_t[keys_count]), then the values of each key (uint16_t[keys_count][3])
+typedef struct Header {
+	uint32_t magic;
+	uint32_t bones_count;
+	uint32_t frame_count;
+	uint32_t keys_count;
+} Header;
+
+typedef struct Track {
+	uint32_t first_key;
+	uint32_t keys_count; // 1 if the value does not change
+
+	// Translation and scale values are min + quantised * range / 65535. Not used for rotations
+	float min[3];
+	float range[3];
+} Track;
+
+typedef struct Layout {
+	Header const* header;
+	Track const* tracks;
+	uint16_t const* key_frames;
+	uint16_t const* key_values;
+} Layout;
+
+static uint64_t get_size(uint64_t bones_count, uint64_t keys_count)
+{
+	return sizeof(Header) + bones_count * TRACKS_PER_BONE * sizeof(Track) + keys_count * 4 * sizeof(uint16_t);
+}
+
+static Layout get_layout(const void* data)
+{
+	Layout l;
+	l.header = data;
+	l.tracks = (Track const*)&l.header[1];
+	l.key_frames = (uint16_t const*)&l.tracks[l.header->bones_count * TRACKS_PER_BONE];
+	l.key_values = &l.key_frames[l.header->keys_count];
+	return l;
+}
+
+static unsigned int track_components(unsigned int type)
+{
+	return type == TRACK_ROTATION ? 4 : (type == TRACK_TRANSLATION ? 3 : 1);
+}
+
+static void encode_rotation(const float* q, uint16_t* out)
+{
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++) {
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+	}
+
+	// q and -q are the same rotation. The largest component is made positive so that it does not need a sign bit
+	float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+	uint16_t v[3];
+	unsigned int j = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		float f = (q[i] * sign * SQRT_2 * 0.5f + 0.5f) * SMALLEST_THREE_MAX;
+		v[j++] = (uint16_t)lrintf(fminf(fmaxf(f, 0), SMALLEST_THREE_MAX));
+	}
+
+	out[0] = (uint16_t)(v[0] | (largest & 1) << 15);
+	out[1] = (uint16_t)(v[1] | (largest >> 1) << 15);
+	out[2] = v[2];
+}
+
+static void decode_rotation(const uint16_t* in, float* q)
+{
+	unsigned int largest = (in[0] >> 15) | (in[1] >> 15) << 1;
+
+	float sum = 0;
+	unsigned int j = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		float c = ((float)(in[j++] & 0x7fff) / SMALLEST_THREE_MAX * 2 - 1) / SQRT_2;
+		q[i] = c;
+		sum += c * c;
+	}
+	q[largest] = sqrtf(fmaxf(0, 1 - sum));
+}
+
+static uint16_t quantise(float x, float min, float range)
+{
+	if (!(range > 0))
+		return 0;
+	float f = (x - min) / range * QUANTISED_MAX;
+	return (uint16_t)lrintf(fminf(fmaxf(f, 0), QUANTISED_MAX));
+}
+
+static float dequantise(uint16_t q, float min, float range)
+{
+	return min + (float)q * (range / QUANTISED_MAX);
+}
+
+static void decode_key(unsigned int type, Track const* track, const uint16_t* value, float* out)
+{
+	if (type == TRACK_ROTATION) {
+		decode_rotation(value, out);
+		return;
+	}
+	for (unsigned int i = 0; i < track_components(type); i++) {
+		out[i] = dequantise(value[i], track->min[i], track->range[i]);
+	}
+}
+
+// Rotations use normalised lerp along the shortest path
+static void interpolate(unsigned int type, const float* a, const float* b, float t, float* out)
+{
+	float sign = 1;
+	if (type == TRACK_ROTATION) {
+		float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		if (dot < 0)
+			sign = -1;
+	}
+
+	unsigned int n = track_components(type);
+	for (unsigned int i = 0; i < n; i++) {
+		out[i] = a[i] * (1 - t) + b[i] * t * sign;
+	}
+
+	if (type == TRACK_ROTATION) {
+		float length = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] + out[3] * out[3]);
+		for (unsigned int i = 0; i < 4; i++) {
+			out[i] /= length;
+		}
+	}
+}
+
+static void sample_track(Layout const* l, Track const* track, unsigned int type, unsigned int frame, float* out)
+{
+	const uint16_t* frames = &l->key_frames[track->first_key];
+	const uint16_t* values = &l->key_values[track->first_key * 3];
+	const unsigned int n = track->keys_count;
+
+	if (n == 1 || frame <= frames[0]) {
+		decode_key(type, track, values, out);
+		return;
+	}
+	if (frame >= frames[n - 1]) {
+		decode_key(type, track, &values[(n - 1) * 3], out);
+		return;
+	}
+
+	// frames[low] <= frame < frames[high]
+	unsigned int low = 0, high = n - 1;
+	while (high - low > 1) {
+		unsigned int mid = (low + high) / 2;
+		if (frames[mid] <= frame)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	float a[4], b[4];
+	decode_key(type, track, &values[low * 3], a);
+	if (frames[low] == frame) {
+		memcpy(out, a, sizeof a);
+		return;
+	}
+	decode_key(type, track, &values[high * 3], b);
+	interpolate(type, a, b, (float)(frame - frames[low]) / (float)(frames[high] - frames[low]), out);
+}
+
+// sample_track relies on these
+static bool track_valid(Layout const* l, Track const* track)
+{
+	if (!track->keys_count || (uint64_t)track->first_key + track->keys_count > l->header->keys_count)
+		return false;
+
+	const uint16_t* frames = &l->key_frames[track->first_key];
+	for (unsigned int i = 0; i < track->keys_count; i++) {
+		if (frames[i] >= l->header->frame_count || (i && frames[i] <= frames[i - 1]))
+			return false;
+	}
+	return true;
+}
+
+bool pigeon_compressed_animation_valid(
+	const void* data, unsigned int size, unsigned int bones_count, unsigned int frame_count)
+{
+	if (!data || (uintptr_t)data % PIGEON_COMPRESSED_ANIMATION_ALIGNMENT || size < sizeof(Header))
+		return false;
+
+	Header const* h = data;
+	if (h->magic != COMPRESSED_ANIMATION_MAGIC || h->bones_count != bones_count || h->frame_count != frame_count
+		|| size < get_size(bones_count, h->keys_count))
+		return false;
+
+	Layout l = get_layout(data);
+	for (unsigned int i = 0; i < bones_count * TRACKS_PER_BONE; i++) {
+		if (!track_valid(&l, &l.tracks[i]))
+			return false;
+	}
+	return true;
+}
+
+void pigeon_decompress_animation_frame(
+	const void* data, unsigned int frame, unsigned int first_bone, unsigned int n, PigeonWGIBoneData* out)
+{
+	Layout l = get_layout(data);
+	assert(frame < l.header->frame_count && first_bone + n <= l.header->bones_count);
+
+	for (unsigned int i = 0; i < n; i++) {
+		Track const* tracks = &l.tracks[(first_bone + i) * TRACKS_PER_BONE];
+		float v[4];
+
+		sample_track(&l, &tracks[TRACK_ROTATION], TRACK_ROTATION, frame, out[i].rotate);
+
+		sample_track(&l, &tracks[TRACK_TRANSLATION], TRACK_TRANSLATION, frame, v);
+		memcpy(out[i].translate, v, 3 * sizeof(float));
+
+		sample_track(&l, &tracks[TRACK_SCALE], TRACK_SCALE, frame, v);
+		out[i].scale = v[0];
+	}
+}
+
+// Values of one track for every frame
+typedef struct TrackEncoder {
+	unsigned int type;
+	unsigned int frame_count;
+	float max_error;
+
+	float (*original)[4];
+	uint16_t (*quantised)[3];
+	float (*decoded)[4]; // What the decoder will get from the quantised value
+} TrackEncoder;
+
+static bool within_error(TrackEncoder const* e, const float* value, const float* original)
+{
+	if (e->type == TRACK_ROTATION) {
+		float sign = value[0] * original[0] + value[1] * original[1] + value[2] * original[2] + value[3] * original[3]
+				< 0
+			? -1.0f
+			: 1.0f;
+
+		// Angle between the rotations. acos(dot) is not precise enough for small angles
+		float difference = 0, sum = 0;
+		for (unsigned int i = 0; i < 4; i++) {
+			float d = value[i] - original[i] * sign;
+			float s = value[i] + original[i] * sign;
+			difference += d * d;
+			sum += s * s;
+		}
+		return 4 * atan2f(sqrtf(difference), sqrtf(sum)) <= e->max_error;
+	}
+
+	float distance_squared = 0;
+	for (unsigned int i = 0; i < track_components(e->type); i++) {
+		float d = value[i] - original[i];
+		distance_squared += d * d;
+	}
+	return distance_squared <= e->max_error * e->max_error;
+}
+
+// True if the frames between the keys a and b can be interpolated from them
+static bool segment_within_error(TrackEncoder const* e, unsigned int a, unsigned int b)
+{
+	for (unsigned int f = a + 1; f < b; f++) {
+		float v[4];
+		interpolate(e->type, e->decoded[a], e->decoded[b], (float)(f - a) / (float)(b - a), v);
+		if (!within_error(e, v, e->original[f]))
+			return false;
+	}
+	return true;
+}
+
+static void get_original_values(TrackEncoder* e, PigeonWGIBoneData const* frames, unsigned int bones_count,
+	unsigned int bone)
+{
+	for (unsigned int f = 0; f < e->frame_count; f++) {
+		PigeonWGIBoneData const* b = &frames[f * bones_count + bone];
+		float* v = e->original[f];
+
+		if (e->type == TRACK_ROTATION) {
+			float length = sqrtf(b->rotate[0] * b->rotate[0] + b->rotate[1] * b->rotate[1]
+				+ b->rotate[2] * b->rotate[2] + b->rotate[3] * b->rotate[3]);
+			for (unsigned int i = 0; i < 4; i++) {
+				v[i] = length > 0 ? b->rotate[i] / length : (i == 0);
+			}
+		} else if (e->type == TRACK_TRANSLATION) {
+			memcpy(v, b->translate, 3 * sizeof(float));
+		} else {
+			v[0] = b->scale;
+		}
+	}
+}
+
+// Returns the number of keys written
+static unsigned int encode_track(TrackEncoder* e, Track* track, uint16_t* key_frames, uint16_t* key_values)
+{
+	const unsigned int n = e->frame_count;
+	const unsigned int components = track_components(e->type);
+
+	if (e->type != TRACK_ROTATION) {
+		for (unsigned int i = 0; i < components; i++) {
+			float min = e->original[0][i], max = min;
+			for (unsigned int f = 1; f < n; f++) {
+				min = fminf(min, e->original[f][i]);
+				max = fmaxf(max, e->original[f][i]);
+			}
+			track->min[i] = min;
+			track->range[i] = max - min;
+		}
+	}
+
+	for (unsigned int f = 0; f < n; f++) {
+		uint16_t* q = e->quantised[f];
+		if (e->type == TRACK_ROTATION) {
+			encode_rotation(e->original[f], q);
+		} else {
+			q[0] = q[1] = q[2] = 0;
+			for (unsigned int i = 0; i < components; i++) {
+				q[i] = quantise(e->original[f][i], track->min[i], track->range[i]);
+			}
+		}
+		decode_key(e->type, track, q, e->decoded[f]);
+	}
+
+	unsigned int keys_count = 0;
+
+#define ADD_KEY(f)                                                                                                     \
+	key_frames[keys_count] = (uint16_t)(f);                                                                            \
+	memcpy(&key_values[keys_count * 3], e->quantised[f], 3 * sizeof(uint16_t));                                        \
+	keys_count++;
+
+	ADD_KEY(0);
+
+	bool constant = true;
+	for (unsigned int f = 1; f < n && constant; f++) {
+		constant = within_error(e, e->decoded[0], e->original[f]);
+	}
+
+	if (!constant) {
+		unsigned int a = 0;
+		while (a < n - 1) {
+			unsigned int b = a + 1;
+			while (b + 1 < n && segment_within_error(e, a, b + 1))
+				b++;
+
+			ADD_KEY(b);
+			a = b;
+		}
+	}
+
+#undef ADD_KEY
+
+	track->keys_count = keys_count;
+	return keys_count;
+}
+
+void* pigeon_compress_animation(PigeonWGIBoneData const* frames, unsigned int bones_count, unsigned int frame_count,
+	PigeonAnimationCompressionErrors const* errors, unsigned int* size)
+{
+	if (!frames || !bones_count || !frame_count || frame_count > 65536 || !errors || !size)
+		return NULL;
+
+	// Every frame of every track is a key in the worst case
+	const uint64_t max_keys = (uint64_t)bones_count * TRACKS_PER_BONE * frame_count;
+	if (get_size(bones_count, max_keys) > UINT32_MAX)
+		return NULL;
+
+	Track* tracks = calloc(bones_count * TRACKS_PER_BONE, sizeof *tracks);
+	uint16_t* key_frames = malloc(max_keys * sizeof *key_frames);
+	uint16_t* key_values = malloc(max_keys * 3 * sizeof *key_values);
+
+	TrackEncoder e;
+	e.frame_count = frame_count;
+	e.original = malloc(frame_count * sizeof *e.original);
+	e.quantised = malloc(frame_count * sizeof *e.quantised);
+	e.decoded = malloc(frame_count * sizeof *e.decoded);
+
+	uint8_t* data = NULL;
+
+#define CLEANUP()                                                                                                      \
+	free(tracks);                                                                                                      \
+	free(key_frames);                                                                                                  \
+	free(key_values);                                                                                                  \
+	free(e.original);                                                                                                  \
+	free(e.quantised);                                                                                                 \
+	free(e.decoded);
+
+	if (!tracks || !key_frames || !key_values || !e.original || !e.quantised || !e.decoded) {
+		CLEANUP();
+		return NULL;
+	}
+
+	const float max_errors[TRACKS_PER_BONE] = { errors->rotation, errors->translation, errors->scale };
+
+	uint32_t keys_count = 0;
+	for (unsigned int bone = 0; bone < bones_count; bone++) {
+		for (unsigned int type = 0; type < TRACKS_PER_BONE; type++) {
+			Track* track = &tracks[bone * TRACKS_PER_BONE + type];
+			e.type = type;
+			e.max_error = max_errors[type];
+
+			get_original_values(&e, frames, bones_count, bone);
+			track->first_key = keys_count;
+			keys_count += encode_track(&e, track, &key_frames[keys_count], &key_values[keys_count * 3]);
+		}
+	}
+
+	*size = (unsigned int)get_size(bones_count, keys_count);
+	data = malloc(*size);
+	if (data) {
+		Header h = { COMPRESSED_ANIMATION_MAGIC, bones_count, frame_count, keys_count };
+		memcpy(data, &h, sizeof h);
+
+		Layout l = get_layout(data);
+		memcpy((void*)l.tracks, tracks, bones_count * TRACKS_PER_BONE * sizeof *tracks);
+		memcpy((void*)l.key_frames, key_frames, keys_count * sizeof *key_frames);
+		memcpy((void*)l.key_values, key_values, keys_count * 3 * sizeof *key_values);
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return data;
+}
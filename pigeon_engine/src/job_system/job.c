@@ -95,6 +95,10 @@ void pigeon_deinit_job_system(void)
 {
     pigeon_atomic_set_int(&kill_all_threads, 1);
     for(unsigned int i = 1; i < thread_count; i++) {
+        // Wake the thread so it sees kill_all_threads
+        if(condition_variables[i]) {
+            pigeon_notify_condition_variable(condition_variables[i]);
+        }
         if(threads[i]) {
             pigeon_join_thread(threads[i]);
         }
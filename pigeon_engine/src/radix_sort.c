@@ -0,0 +1,123 @@
+#include <pigeon/assert.h>
+#include <pigeon/job_system/job.h>
+#include <pigeon/radix_sort.h>
+#include <string.h>
+
+#define RADIX_SORT_MAX_CHUNKS 16
+
+// Arrays smaller than this (per chunk) are not worth splitting between threads
+#define RADIX_SORT_MIN_CHUNK_SIZE 4096
+
+typedef struct RadixSort {
+	PigeonSortItem* src;
+	PigeonSortItem* dst;
+	unsigned int count;
+	unsigned int chunks;
+	unsigned int shift;
+
+	// Histogram of each chunk, then the destination index of the next item of each chunk and byte value
+	uint32_t counts[RADIX_SORT_MAX_CHUNKS][256];
+} RadixSort;
+
+static void get_chunk(RadixSort const* s, unsigned int chunk, unsigned int* start, unsigned int* end)
+{
+	*start = (unsigned int)((uint64_t)s->count * chunk / s->chunks);
+	*end = (unsigned int)((uint64_t)s->count * (chunk + 1) / s->chunks);
+}
+
+static PIGEON_ERR_RET count_chunk(uint64_t chunk, void* s_)
+{
+	RadixSort* s = s_;
+	uint32_t* counts = s->counts[chunk];
+	memset(counts, 0, sizeof s->counts[0]);
+
+	unsigned int start, end;
+	get_chunk(s, (unsigned int)chunk, &start, &end);
+
+	for (unsigned int i = start; i < end; i++) {
+		counts[(s->src[i].key >> s->shift) & 0xff]++;
+	}
+	return 0;
+}
+
+static PIGEON_ERR_RET scatter_chunk(uint64_t chunk, void* s_)
+{
+	RadixSort* s = s_;
+	uint32_t* offsets = s->counts[chunk];
+
+	unsigned int start, end;
+	get_chunk(s, (unsigned int)chunk, &start, &end);
+
+	for (unsigned int i = start; i < end; i++) {
+		s->dst[offsets[(s->src[i].key >> s->shift) & 0xff]++] = s->src[i];
+	}
+	return 0;
+}
+
+static PIGEON_ERR_RET run_chunks(RadixSort* s, PigeonJobFunction function)
+{
+	if (s->chunks == 1)
+		return function(0, s);
+
+	PigeonJob jobs[RADIX_SORT_MAX_CHUNKS];
+	for (unsigned int i = 0; i < s->chunks; i++) {
+		jobs[i].function = function;
+		jobs[i].arg0 = i;
+		jobs[i].arg1 = s;
+	}
+	return pigeon_dispatch_jobs(jobs, s->chunks);
+}
+
+PIGEON_ERR_RET pigeon_radix_sort(PigeonSortItem* items, PigeonSortItem* temp, unsigned int count, bool use_jobs)
+{
+	ASSERT_R1((items && temp) || !count);
+	if (count < 2)
+		return 0;
+
+	uint64_t key_and = UINT64_MAX, key_or = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		key_and &= items[i].key;
+		key_or |= items[i].key;
+	}
+	uint64_t differing_bits = key_and ^ key_or;
+
+	RadixSort s;
+	s.src = items;
+	s.dst = temp;
+	s.count = count;
+	s.chunks = 1;
+	if (use_jobs) {
+		s.chunks = count / RADIX_SORT_MIN_CHUNK_SIZE;
+		if (s.chunks < 1)
+			s.chunks = 1;
+		if (s.chunks > RADIX_SORT_MAX_CHUNKS)
+			s.chunks = RADIX_SORT_MAX_CHUNKS;
+	}
+
+	for (s.shift = 0; s.shift < 64; s.shift += 8) {
+		if (!((differing_bits >> s.shift) & 0xff))
+			continue;
+
+		ASSERT_R1(!run_chunks(&s, count_chunk));
+
+		// Items go in byte value order, then chunk order so that the sort is stable
+		uint32_t offset = 0;
+		for (unsigned int b = 0; b < 256; b++) {
+			for (unsigned int c = 0; c < s.chunks; c++) {
+				uint32_t n = s.counts[c][b];
+				s.counts[c][b] = offset;
+				offset += n;
+			}
+		}
+
+		ASSERT_R1(!run_chunks(&s, scatter_chunk));
+
+		PigeonSortItem* t = s.src;
+		s.src = s.dst;
+		s.dst = t;
+	}
+
+	if (s.src != items)
+		memcpy(items, s.src, count * sizeof *items);
+	return 0;
+}
@@ -0,0 +1,495 @@
+#include <pigeon/scene/bone_palette.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BONE_SIMD
+
+typedef __m128 V4;
+#define v4_load _mm_loadu_ps
+#define v4_store _mm_storeu_ps
+#define v4_set1 _mm_set1_ps
+#define v4_add _mm_add_ps
+#define v4_sub _mm_sub_ps
+#define v4_mul _mm_mul_ps
+#define v4_and _mm_and_ps
+#define v4_xor _mm_xor_ps
+#define v4_transpose _MM_TRANSPOSE4_PS
+
+static inline V4 v4_recip(V4 x)
+{
+	// _mm_rcp_ps is not accurate enough, the matrices would visibly change scale
+	return _mm_div_ps(_mm_set1_ps(1), x);
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BONE_SIMD
+
+typedef float32x4_t V4;
+#define v4_load vld1q_f32
+#define v4_store vst1q_f32
+#define v4_set1 vdupq_n_f32
+#define v4_add vaddq_f32
+#define v4_sub vsubq_f32
+#define v4_mul vmulq_f32
+
+static inline V4 v4_and(V4 a, V4 b)
+{
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+static inline V4 v4_xor(V4 a, V4 b)
+{
+	return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+static inline V4 v4_recip(V4 x)
+{
+	// Estimate then 2 Newton-Raphson steps
+	V4 e = vrecpeq_f32(x);
+	e = vmulq_f32(e, vrecpsq_f32(x, e));
+	return vmulq_f32(e, vrecpsq_f32(x, e));
+}
+
+#define v4_transpose(r0, r1, r2, r3)                                                                                   \
+	do {                                                                                                               \
+		float32x4x2_t t01 = vtrnq_f32(r0, r1);                                                                         \
+		float32x4x2_t t23 = vtrnq_f32(r2, r3);                                                                         \
+		r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));                                         \
+		r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));                                         \
+		r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));                                       \
+		r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));                                       \
+	} while (0)
+
+#endif
+
+// Curve fit from "Approximating slerp" (Arseny Kapoulkine). t is adjusted by t * (t - 0.5) * (t - 1) * k
+// where k = A * (t - 0.5)^2 + B and A and B are polynomials of the dot product of the quaternions.
+// The angle is within 0.0004 radians of slerp
+#define NLERP_A0 1.0904f
+#define NLERP_A1 (-3.2452f)
+#define NLERP_A2 3.55645f
+#define NLERP_A3 (-1.43519f)
+#define NLERP_B0 0.848013f
+#define NLERP_B1 (-1.06021f)
+#define NLERP_B2 0.215638f
+
+void pigeon_bone_palette_identity(PigeonWGIBoneMatrix* out, unsigned int bones_count)
+{
+	for (unsigned int i = 0; i < bones_count; i++) {
+		float* m = out[i].mat3x4;
+		m[0] = 1;
+		m[1] = 0;
+		m[2] = 0;
+		m[3] = 0;
+		m[4] = 1;
+		m[5] = 0;
+		m[6] = 0;
+		m[7] = 0;
+		m[8] = 1;
+		m[9] = 0;
+		m[10] = 0;
+		m[11] = 0;
+	}
+}
+
+// Per-batch constants that only depend on the interpolation factor
+typedef struct Interpolation {
+	float t;
+	float t_cubic; // t * (t - 0.5) * (t - 1)
+	float t_square; // (t - 0.5)^2
+} Interpolation;
+
+static Interpolation get_interpolation(float t)
+{
+	Interpolation i;
+	i.t = t;
+	i.t_cubic = t * (t - 0.5f) * (t - 1);
+	i.t_square = (t - 0.5f) * (t - 0.5f);
+	return i;
+}
+
+// The rotation of the result is not normalised
+static void interpolate_bone(
+	PigeonWGIBoneData* out, PigeonWGIBoneData const* b0, PigeonWGIBoneData const* b1, Interpolation const* i)
+{
+	// rotate is w,x,y,z
+	float dot = b0->rotate[0] * b1->rotate[0] + b0->rotate[1] * b1->rotate[1] + b0->rotate[2] * b1->rotate[2]
+		+ b0->rotate[3] * b1->rotate[3];
+	float d = fabsf(dot);
+
+	float k_a = NLERP_A0 + d * (NLERP_A1 + d * (NLERP_A2 + d * NLERP_A3));
+	float k_b = NLERP_B0 + d * (NLERP_B1 + d * NLERP_B2);
+	float k = k_a * i->t_square + k_b;
+	float t_corrected = i->t + i->t_cubic * k;
+	float a = 1 - t_corrected;
+	float b = dot < 0 ? -t_corrected : t_corrected;
+
+	for (unsigned int j = 0; j < 4; j++) {
+		out->rotate[j] = a * b0->rotate[j] + b * b1->rotate[j];
+	}
+	for (unsigned int j = 0; j < 3; j++) {
+		out->translate[j] = b0->translate[j] + (b1->translate[j] - b0->translate[j]) * i->t;
+	}
+	out->scale = b0->scale + (b1->scale - b0->scale) * i->t;
+}
+
+// The rotation does not have to be normalised
+static void write_matrix(float* m, PigeonWGIBoneData const* b)
+{
+	float w = b->rotate[0], x = b->rotate[1], y = b->rotate[2], z = b->rotate[3];
+	float s = b->scale;
+
+	// Normalising the quaternion and multiplying by 2 (for the rotation matrix) and the scale are combined
+	float s2 = 2 * s / (w * w + x * x + y * y + z * z);
+
+	float xx = x * x * s2, yy = y * y * s2, zz = z * z * s2;
+	float xy = x * y * s2, xz = x * z * s2, yz = y * z * s2;
+	float wx = w * x * s2, wy = w * y * s2, wz = w * z * s2;
+
+	m[0] = s - yy - zz;
+	m[1] = xy + wz;
+	m[2] = xz - wy;
+	m[3] = xy - wz;
+	m[4] = s - xx - zz;
+	m[5] = yz + wx;
+	m[6] = xz + wy;
+	m[7] = yz - wx;
+	m[8] = s - xx - yy;
+
+	m[9] = b->translate[0];
+	m[10] = b->translate[1];
+	m[11] = b->translate[2];
+}
+
+static void normalise_rotation(PigeonWGIBoneData* b)
+{
+	float length_squared = b->rotate[0] * b->rotate[0] + b->rotate[1] * b->rotate[1]
+		+ b->rotate[2] * b->rotate[2] + b->rotate[3] * b->rotate[3];
+	float f = length_squared > 0 ? 1 / sqrtf(length_squared) : 0;
+	for (unsigned int j = 0; j < 4; j++) {
+		b->rotate[j] *= f;
+	}
+	if (!f)
+		b->rotate[0] = 1;
+}
+
+#ifdef BONE_SIMD
+
+// 4 bones, 1 in each lane. r = w,x,y,z. p = translate x,y,z and scale
+typedef struct Bones4 {
+	V4 r[4];
+	V4 p[4];
+} Bones4;
+
+static void load_4_bones(PigeonWGIBoneData const* b, Bones4* out)
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		out->r[i] = v4_load(b[i].rotate);
+		out->p[i] = v4_load(b[i].translate); // scale is directly after translate
+	}
+	v4_transpose(out->r[0], out->r[1], out->r[2], out->r[3]);
+	v4_transpose(out->p[0], out->p[1], out->p[2], out->p[3]);
+}
+
+static void store_4_bones(PigeonWGIBoneData* b, Bones4 in)
+{
+	v4_transpose(in.r[0], in.r[1], in.r[2], in.r[3]);
+	v4_transpose(in.p[0], in.p[1], in.p[2], in.p[3]);
+	for (unsigned int i = 0; i < 4; i++) {
+		v4_store(b[i].rotate, in.r[i]);
+		v4_store(b[i].translate, in.p[i]);
+	}
+}
+
+// Same as interpolate_bone
+static void interpolate_4_bones(
+	Bones4* out, PigeonWGIBoneData const* b0, PigeonWGIBoneData const* b1, Interpolation const* i)
+{
+	Bones4 x0, x1;
+	load_4_bones(b0, &x0);
+	load_4_bones(b1, &x1);
+
+	const V4 sign_bit = v4_set1(-0.0f);
+	const V4 t = v4_set1(i->t);
+
+	V4 dot = v4_add(v4_add(v4_mul(x0.r[0], x1.r[0]), v4_mul(x0.r[1], x1.r[1])),
+		v4_add(v4_mul(x0.r[2], x1.r[2]), v4_mul(x0.r[3], x1.r[3])));
+	V4 dot_sign = v4_and(dot, sign_bit);
+	V4 d = v4_xor(dot, dot_sign);
+
+	V4 k_a = v4_add(v4_set1(NLERP_A2), v4_mul(d, v4_set1(NLERP_A3)));
+	k_a = v4_add(v4_set1(NLERP_A1), v4_mul(d, k_a));
+	k_a = v4_add(v4_set1(NLERP_A0), v4_mul(d, k_a));
+	V4 k_b = v4_add(v4_set1(NLERP_B1), v4_mul(d, v4_set1(NLERP_B2)));
+	k_b = v4_add(v4_set1(NLERP_B0), v4_mul(d, k_b));
+	V4 k = v4_add(v4_mul(k_a, v4_set1(i->t_square)), k_b);
+	V4 t_corrected = v4_add(t, v4_mul(v4_set1(i->t_cubic), k));
+	V4 a = v4_sub(v4_set1(1), t_corrected);
+	V4 b = v4_xor(t_corrected, dot_sign);
+
+	for (unsigned int j = 0; j < 4; j++) {
+		out->r[j] = v4_add(v4_mul(a, x0.r[j]), v4_mul(b, x1.r[j]));
+		out->p[j] = v4_add(x0.p[j], v4_mul(v4_sub(x1.p[j], x0.p[j]), t));
+	}
+}
+
+// Same as write_matrix
+static void write_4_matrices(PigeonWGIBoneMatrix* out, Bones4 const* b)
+{
+	V4 w = b->r[0], x = b->r[1], y = b->r[2], z = b->r[3];
+	V4 s = b->p[3];
+
+	V4 length_squared = v4_add(v4_add(v4_mul(w, w), v4_mul(x, x)), v4_add(v4_mul(y, y), v4_mul(z, z)));
+	V4 s2 = v4_mul(v4_add(s, s), v4_recip(length_squared));
+
+	V4 xs = v4_mul(x, s2), ys = v4_mul(y, s2), zs = v4_mul(z, s2);
+	V4 xx = v4_mul(x, xs), yy = v4_mul(y, ys), zz = v4_mul(z, zs);
+	V4 xy = v4_mul(x, ys), xz = v4_mul(x, zs), yz = v4_mul(y, zs);
+	V4 wx = v4_mul(w, xs), wy = v4_mul(w, ys), wz = v4_mul(w, zs);
+
+	V4 m[12];
+	m[0] = v4_sub(v4_sub(s, yy), zz);
+	m[1] = v4_add(xy, wz);
+	m[2] = v4_sub(xz, wy);
+	m[3] = v4_sub(xy, wz);
+	m[4] = v4_sub(v4_sub(s, xx), zz);
+	m[5] = v4_add(yz, wx);
+	m[6] = v4_add(xz, wy);
+	m[7] = v4_sub(yz, wx);
+	m[8] = v4_sub(v4_sub(s, xx), yy);
+	m[9] = b->p[0];
+	m[10] = b->p[1];
+	m[11] = b->p[2];
+
+	// Back to 1 bone per 12 floats
+	for (unsigned int j = 0; j < 12; j += 4) {
+		v4_transpose(m[j], m[j + 1], m[j + 2], m[j + 3]);
+		for (unsigned int i = 0; i < 4; i++) {
+			v4_store(&out[i].mat3x4[j], m[j + i]);
+		}
+	}
+}
+
+#endif
+
+void pigeon_bone_palette_interpolate(PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* frame0,
+	PigeonWGIBoneData const* frame1, float t, unsigned int bones_count)
+{
+	assert(offsetof(PigeonWGIBoneData, scale) == offsetof(PigeonWGIBoneData, translate) + 3 * sizeof(float));
+
+	const Interpolation interpolation = get_interpolation(t);
+	unsigned int i = 0;
+
+#ifdef BONE_SIMD
+	for (; i + PIGEON_BONE_PALETTE_BATCH <= bones_count; i += PIGEON_BONE_PALETTE_BATCH) {
+		Bones4 b;
+		interpolate_4_bones(&b, &frame0[i], &frame1[i], &interpolation);
+		write_4_matrices(&out[i], &b);
+	}
+#endif
+
+	for (; i < bones_count; i++) {
+		PigeonWGIBoneData b;
+		interpolate_bone(&b, &frame0[i], &frame1[i], &interpolation);
+		write_matrix(out[i].mat3x4, &b);
+	}
+}
+
+void pigeon_bone_pose_interpolate(PigeonWGIBoneData* out, PigeonWGIBoneData const* frame0,
+	PigeonWGIBoneData const* frame1, float t, unsigned int bones_count)
+{
+	const Interpolation interpolation = get_interpolation(t);
+	unsigned int i = 0;
+
+#ifdef BONE_SIMD
+	for (; i + PIGEON_BONE_PALETTE_BATCH <= bones_count; i += PIGEON_BONE_PALETTE_BATCH) {
+		Bones4 b;
+		interpolate_4_bones(&b, &frame0[i], &frame1[i], &interpolation);
+		store_4_bones(&out[i], b);
+	}
+#endif
+
+	for (; i < bones_count; i++) {
+		interpolate_bone(&out[i], &frame0[i], &frame1[i], &interpolation);
+	}
+
+	for (i = 0; i < bones_count; i++) {
+		normalise_rotation(&out[i]);
+	}
+}
+
+void pigeon_bone_pose_accumulate(PigeonWGIBoneData* sum, float* weights, PigeonWGIBoneData const* pose, float weight,
+	const float* bone_weights, unsigned int bones_count)
+{
+	for (unsigned int i = 0; i < bones_count; i++) {
+		float w = bone_weights ? weight * bone_weights[i] : weight;
+		if (!(w > 0))
+			continue;
+
+		// Shortest path
+		float dot = sum[i].rotate[0] * pose[i].rotate[0] + sum[i].rotate[1] * pose[i].rotate[1]
+			+ sum[i].rotate[2] * pose[i].rotate[2] + sum[i].rotate[3] * pose[i].rotate[3];
+		float wr = dot < 0 ? -w : w;
+
+		for (unsigned int j = 0; j < 4; j++) {
+			sum[i].rotate[j] += wr * pose[i].rotate[j];
+		}
+		for (unsigned int j = 0; j < 3; j++) {
+			sum[i].translate[j] += w * pose[i].translate[j];
+		}
+		sum[i].scale += w * pose[i].scale;
+		weights[i] += w;
+	}
+}
+
+void pigeon_bone_pose_normalise(PigeonWGIBoneData* pose, const float* weights, unsigned int bones_count)
+{
+	for (unsigned int i = 0; i < bones_count; i++) {
+		float w = weights[i];
+		if (w < 1) {
+			// Identity transform
+			float remaining = 1 - w;
+			pose[i].rotate[0] += pose[i].rotate[0] < 0 ? -remaining : remaining;
+			pose[i].scale += remaining;
+			w = 1;
+		}
+
+		for (unsigned int j = 0; j < 3; j++) {
+			pose[i].translate[j] /= w;
+		}
+		pose[i].scale /= w;
+		normalise_rotation(&pose[i]);
+	}
+}
+
+// a * b, w,x,y,z
+static void quat_mul(const float* a, const float* b, float* out)
+{
+	float w = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	float x = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	float y = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	float z = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+	out[0] = w;
+	out[1] = x;
+	out[2] = y;
+	out[3] = z;
+}
+
+void pigeon_bone_pose_add(PigeonWGIBoneData* out, PigeonWGIBoneData const* pose, PigeonWGIBoneData const* reference,
+	float weight, const float* bone_weights, unsigned int bones_count)
+{
+	for (unsigned int i = 0; i < bones_count; i++) {
+		float w = bone_weights ? weight * bone_weights[i] : weight;
+		if (!(w > 0))
+			continue;
+
+		// Rotation from the reference to the pose, scaled by the weight (nlerp from the identity rotation)
+		const float reference_inverse[4]
+			= { reference[i].rotate[0], -reference[i].rotate[1], -reference[i].rotate[2], -reference[i].rotate[3] };
+		PigeonWGIBoneData delta;
+		quat_mul(pose[i].rotate, reference_inverse, delta.rotate);
+		if (delta.rotate[0] < 0) {
+			for (unsigned int j = 0; j < 4; j++) {
+				delta.rotate[j] = -delta.rotate[j];
+			}
+		}
+		for (unsigned int j = 0; j < 4; j++) {
+			delta.rotate[j] *= w;
+		}
+		delta.rotate[0] += 1 - w;
+
+		quat_mul(delta.rotate, out[i].rotate, out[i].rotate);
+		normalise_rotation(&out[i]);
+
+		for (unsigned int j = 0; j < 3; j++) {
+			out[i].translate[j] += w * (pose[i].translate[j] - reference[i].translate[j]);
+		}
+		if (reference[i].scale != 0)
+			out[i].scale *= 1 + w * (pose[i].scale / reference[i].scale - 1);
+	}
+}
+
+void pigeon_bone_palette_from_pose(PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* pose, unsigned int bones_count)
+{
+	unsigned int i = 0;
+
+#ifdef BONE_SIMD
+	for (; i + PIGEON_BONE_PALETTE_BATCH <= bones_count; i += PIGEON_BONE_PALETTE_BATCH) {
+		Bones4 b;
+		load_4_bones(&pose[i], &b);
+		write_4_matrices(&out[i], &b);
+	}
+#endif
+
+	for (; i < bones_count; i++) {
+		write_matrix(out[i].mat3x4, &pose[i]);
+	}
+}
+
+// Affine transform, 4 columns (rotation/scale then translation). The 4th row is not used
+typedef struct Affine {
+	float c[4][4];
+} Affine;
+
+// a * b where b is a PigeonWGIBoneMatrix
+static void affine_mul(Affine const* a, const float* b, Affine* out)
+{
+#ifdef BONE_SIMD
+	const V4 a0 = v4_load(a->c[0]), a1 = v4_load(a->c[1]), a2 = v4_load(a->c[2]);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		V4 c = v4_add(v4_add(v4_mul(a0, v4_set1(b[i * 3])), v4_mul(a1, v4_set1(b[i * 3 + 1]))),
+			v4_mul(a2, v4_set1(b[i * 3 + 2])));
+		if (i == 3)
+			c = v4_add(c, v4_load(a->c[3]));
+		v4_store(out->c[i], c);
+	}
+#else
+	for (unsigned int i = 0; i < 4; i++) {
+		for (unsigned int j = 0; j < 3; j++) {
+			out->c[i][j] = a->c[0][j] * b[i * 3] + a->c[1][j] * b[i * 3 + 1] + a->c[2][j] * b[i * 3 + 2]
+				+ (i == 3 ? a->c[3][j] : 0);
+		}
+		out->c[i][3] = 0;
+	}
+#endif
+}
+
+void pigeon_bone_palette_from_local_pose(
+	PigeonWGIBoneMatrix* out, PigeonWGIBoneData const* pose, PigeonSkeleton const* skeleton)
+{
+	const unsigned int bones_count = skeleton->bones_count;
+	assert(bones_count <= PIGEON_MAX_BONES);
+
+	// Local transforms to matrices, 4 bones at a time. Each is replaced with the final matrix below
+	pigeon_bone_palette_from_pose(out, pose, bones_count);
+
+	// Model space transform of each bone
+	Affine global[PIGEON_MAX_BONES];
+
+	for (unsigned int i = 0; i < bones_count; i++) {
+		const unsigned int b = skeleton->order[i];
+		const int parent = skeleton->parents[b];
+		const float* local = out[b].mat3x4;
+
+		if (parent < 0) {
+			for (unsigned int c = 0; c < 4; c++) {
+				memcpy(global[b].c[c], &local[c * 3], 3 * sizeof(float));
+				global[b].c[c][3] = 0;
+			}
+		} else {
+			affine_mul(&global[parent], local, &global[b]);
+		}
+
+		Affine skinning;
+		affine_mul(&global[b], skeleton->inverse_bind[b].mat3x4, &skinning);
+		for (unsigned int c = 0; c < 4; c++) {
+			memcpy(&out[b].mat3x4[c * 3], skinning.c[c], 3 * sizeof(float));
+		}
+	}
+}
@@ -2,10 +2,16 @@
 #include <pigeon/scene/mesh_renderer.h>
 #include <pigeon/scene/light.h>
 #include <pigeon/scene/transform.h>
+#include <pigeon/scene/occlusion.h>
+#include <pigeon/scene/bone_palette.h>
+#include <pigeon/scene/draw_object_record.h>
+#include <pigeon/scene/lod.h>
 #include <pigeon/array_list.h>
 #include <pigeon/object_pool.h>
+#include <pigeon/radix_sort.h>
 #include <pigeon/wgi/wgi.h>
 #include <pigeon/asset.h>
+#include <pigeon/compressed_animation.h>
 #include <pigeon/job_system/job.h>
 #include <pigeon/misc.h>
 #include <pigeon/assert.h>
@@ -13,7 +19,7 @@
     #define CGLM_FORCE_DEPTH_ZERO_TO_ONE
 #endif
 #include <cglm/mat4.h>
-#include <cglm/quat.h>
+#include <stdlib.h>
 #include <string.h>
 #include "scene.h"
 
@@ -22,11 +28,13 @@ extern PigeonTransform * pigeon_scene_root;
 static PigeonWGISceneUniformData scene_uniform_data = {0};
 extern PigeonObjectPool pigeon_pool_rs;
 extern PigeonObjectPool pigeon_pool_anim;
+extern PigeonObjectPool pigeon_pool_mr;
 extern PigeonArrayList pigeon_lights;
 
 static unsigned int total_draws;
 static unsigned int total_multidraw_draws;
 static unsigned int total_bones;
+static unsigned int total_materials;
 static unsigned int total_lights;
 static PigeonTransform* camera;
 static PigeonWGIShadowParameters shadows[4];
@@ -34,9 +42,164 @@ static PigeonWGIShadowParameters shadows[4];
 static void* draw_objects;
 static PigeonWGIBoneMatrix* bone_matrices;
 
+static PigeonDrawObjectRecords draw_object_records;
+static uint64_t frame_number;
+static uint64_t draw_objects_frame; // Draw objects that have not changed since this frame are already written
+
 static PigeonArrayList job_array_list;
 static PigeonJob* jobs;
 
+static bool occlusion_culling_enabled;
+static PigeonHiZ hiz;
+static PigeonArrayList instance_lods; // uint8_t for every draw, in scene graph order: LOD index | INSTANCE_* flags
+static bool prepass_failed;
+
+static bool meshlet_culling_enabled;
+static PigeonArrayList meshlet_draws; // PigeonMeshletDraw
+
+static bool gpu_culling_enabled;
+static unsigned int total_cull_groups; // One for each model of each render state, when GPU culling is used
+static unsigned int total_cull_render_states;
+static PigeonWGICullGroup* cull_groups;
+
+static unsigned int pose_sharing_steps; // Steps per animation frame, 0 if poses are not shared
+static unsigned int bone_jobs; // Animation states that evaluate their own bones this frame
+static bool bone_blocks_changed;
+
+static float animation_lod_screen_size; // 0 if the update-rate LOD is disabled
+static unsigned int animation_lod_max_interval;
+static uint64_t animation_frame; // Counts calls to assign_bone_blocks
+static unsigned int animation_state_index; // Spreads the updates of states with the same interval across frames
+
+// Open addressing hash table of the poses evaluated this frame. The size is a power of 2
+typedef struct SharedPose {
+    PigeonAsset const* asset; // NULL for empty slots
+    int animation_index; // -1 for the T pose
+    uint64_t step; // Frame * pose_sharing_steps
+    unsigned int first_bone_index;
+} SharedPose;
+static PigeonArrayList shared_poses;
+
+// Compute skinning. One job for each bone block drawn with a skinned render state. The jobs of each mesh are
+// consecutive (see PigeonWGISkinJob)
+static bool compute_skinning_enabled;
+static bool skin_jobs_in_instance_table; // Some first_bone_index values of the instance table are job indices
+
+typedef struct SkinJob {
+    PigeonAsset const* asset;
+    unsigned int first_bone_index;
+    unsigned int skin_mesh; // Index into skin_meshes
+    unsigned int index; // Index of the PigeonWGISkinJob
+    unsigned int output_offset;
+} SkinJob;
+
+typedef struct SkinMesh {
+    PigeonWGIMultiMesh * mesh;
+    unsigned int jobs;
+    unsigned int vertices;
+    unsigned int first_job;
+    unsigned int first_output;
+} SkinMesh;
+
+static PigeonArrayList skin_jobs; // SkinJob
+static PigeonArrayList skin_meshes; // SkinMesh
+static PigeonArrayList bone_block_jobs; // int32_t for each bone: index into skin_jobs of the block starting there
+static unsigned int total_skin_vertices;
+
+// Meshlet draws of one instance
+typedef struct InstanceMeshlets {
+    unsigned int first; // Index into meshlet_draws
+    unsigned int count;
+} InstanceMeshlets;
+
+static PigeonArrayList instance_meshlets; // InstanceMeshlets for every draw, in scene graph order
+
+// The instance table. The drawn instances in scene graph order (render state, model, material renderer,
+// transform) with one element per instance in each array.
+// Only rebuilt when pigeon_scene_topology_version changes so the per-frame passes are linear scans of it
+typedef struct InstanceTable {
+    PigeonArrayList transforms; // PigeonTransform*
+    PigeonArrayList mr; // PigeonMaterialRenderer*
+    PigeonArrayList material_index; // uint32_t, index into the WGI material table
+    PigeonArrayList first_bone_index; // int32_t, -1 if not animated
+} InstanceTable;
+
+static InstanceTable instance_table;
+
+// Instances of one model in the instance table
+typedef struct InstanceRange {
+    PigeonTransform * const* transforms;
+    PigeonMaterialRenderer * const* mr;
+    uint32_t const* material_index;
+    int32_t const* first_bone_index;
+} InstanceRange;
+
+// Models without instances are left out
+typedef struct SceneModel {
+    PigeonModelMaterial * model;
+    unsigned int first_instance; // Index into the instance table
+    unsigned int instances;
+    float bounds_min[3], bounds_max[3];
+} SceneModel;
+
+static PigeonArrayList scene_models; // SceneModel. Each render state has a range (_first_scene_model)
+static uint64_t scene_cache_version; // pigeon_scene_topology_version when the tables were built
+
+// A render state when multidraw is supported, otherwise instances of a material renderer or one meshlet draw
+typedef struct DrawCommand {
+    PigeonRenderState const* rs;
+
+    // Only used when multidraw is not supported
+    PigeonModelMaterial const* model;
+    PigeonMaterialRenderer const* mr;
+    uint32_t draw_index;
+    uint32_t instances; // Consecutive draw objects starting at draw_index
+    uint32_t first, count;
+
+    uint8_t stages; // DRAW_COMMAND_* flags
+} DrawCommand;
+
+#define DRAW_COMMAND_SHADOW 1 // Drawn in the shadow stages
+#define DRAW_COMMAND_CAMERA 2 // Drawn in the depth pre-pass and render stages
+
+// The draw list. Commands are written in scene graph order and draw_order is sorted before recording
+static PigeonArrayList draw_commands; // DrawCommand
+static PigeonArrayList draw_order; // PigeonSortItem, the value is an index into draw_commands
+static PigeonArrayList draw_order_temp;
+static unsigned int first_transparent_draw; // Index into draw_order
+
+// When multithreading is supported, each draw stage is split into this many secondary command buffers
+// (1 means the stages are recorded directly)
+static unsigned int record_chunks = 1;
+
+// Secondary command buffers have a cost of their own so small draw lists are not split
+#define RECORD_CHUNK_MIN_DRAWS 64
+
+// Pointers. The index of each pipeline and mesh is used in the sort keys
+static PigeonArrayList sort_pipelines;
+static PigeonArrayList sort_meshes;
+
+// Sort keys, most significant bits first
+// Opaque:      0 | pipeline | mesh | textures | depth
+// Transparent: 1 | inverted depth | pipeline | mesh | textures
+// Opaque draws are grouped by state and then drawn front-to-back. Transparent draws are drawn back-to-front.
+#define SORT_PIPELINE_BITS 12
+#define SORT_MESH_BITS 10
+#define SORT_TEXTURE_BITS 16
+#define SORT_DEPTH_BITS 25
+#define SORT_STATE_BITS (SORT_PIPELINE_BITS + SORT_MESH_BITS + SORT_TEXTURE_BITS)
+
+#define HIZ_WIDTH 256
+#define HIZ_HEIGHT 128
+
+#define INSTANCE_CULLED 0x80
+
+// The instance is drawn as meshlets in the culled stages. INSTANCE_CULLED is also set so that it is left out of
+// the instanced draws of those stages
+#define INSTANCE_MESHLETS 0x40
+
+#define INSTANCE_LOD_MASK 0x3f
+
 
 void pigeon_init_scene_module(void);
 void pigeon_init_scene_module(void)
@@ -47,12 +210,49 @@ void pigeon_init_scene_module(void)
     pigeon_init_light_array_list();
     pigeon_init_audio_player_pool();
     pigeon_create_array_list(&job_array_list, sizeof(PigeonJob));
+    pigeon_create_array_list(&instance_lods, sizeof(uint8_t));
+    pigeon_create_draw_object_records(&draw_object_records);
+    pigeon_create_array_list(&meshlet_draws, sizeof(PigeonMeshletDraw));
+    pigeon_create_array_list(&instance_meshlets, sizeof(InstanceMeshlets));
+    pigeon_create_array_list(&scene_models, sizeof(SceneModel));
+    pigeon_create_array_list(&instance_table.transforms, sizeof(PigeonTransform*));
+    pigeon_create_array_list(&instance_table.mr, sizeof(PigeonMaterialRenderer*));
+    pigeon_create_array_list(&instance_table.material_index, sizeof(uint32_t));
+    pigeon_create_array_list(&instance_table.first_bone_index, sizeof(int32_t));
+    pigeon_create_array_list(&draw_commands, sizeof(DrawCommand));
+    pigeon_create_array_list(&draw_order, sizeof(PigeonSortItem));
+    pigeon_create_array_list(&draw_order_temp, sizeof(PigeonSortItem));
+    pigeon_create_array_list(&sort_pipelines, sizeof(void*));
+    pigeon_create_array_list(&sort_meshes, sizeof(void*));
+    pigeon_create_array_list(&shared_poses, sizeof(SharedPose));
+    pigeon_create_array_list(&skin_jobs, sizeof(SkinJob));
+    pigeon_create_array_list(&skin_meshes, sizeof(SkinMesh));
+    pigeon_create_array_list(&bone_block_jobs, sizeof(int32_t));
 }
 
 void pigeon_deinit_scene_module(void);
 void pigeon_deinit_scene_module(void)
 {
     pigeon_destroy_array_list(&job_array_list);
+    pigeon_destroy_array_list(&shared_poses);
+    pigeon_destroy_array_list(&skin_jobs);
+    pigeon_destroy_array_list(&skin_meshes);
+    pigeon_destroy_array_list(&bone_block_jobs);
+    pigeon_destroy_array_list(&instance_lods);
+    pigeon_destroy_draw_object_records(&draw_object_records);
+    pigeon_destroy_array_list(&meshlet_draws);
+    pigeon_destroy_array_list(&instance_meshlets);
+    pigeon_destroy_array_list(&scene_models);
+    pigeon_destroy_array_list(&instance_table.transforms);
+    pigeon_destroy_array_list(&instance_table.mr);
+    pigeon_destroy_array_list(&instance_table.material_index);
+    pigeon_destroy_array_list(&instance_table.first_bone_index);
+    pigeon_destroy_array_list(&draw_commands);
+    pigeon_destroy_array_list(&draw_order);
+    pigeon_destroy_array_list(&draw_order_temp);
+    pigeon_destroy_array_list(&sort_pipelines);
+    pigeon_destroy_array_list(&sort_meshes);
+    if(hiz.data) pigeon_destroy_hiz(&hiz);
     pigeon_deinit_pointer_pool();
     pigeon_deinit_transform_pool();
     pigeon_deinit_mesh_renderer_pool();
@@ -60,6 +260,760 @@ void pigeon_deinit_scene_module(void)
     pigeon_deinit_audio_player_pool();
 }
 
+PIGEON_ERR_RET pigeon_set_occlusion_culling(bool enabled)
+{
+    if(enabled && !hiz.data) {
+        ASSERT_R1(!pigeon_create_hiz(&hiz, HIZ_WIDTH, HIZ_HEIGHT));
+    }
+    occlusion_culling_enabled = enabled;
+    return 0;
+}
+
+void pigeon_set_meshlet_culling(bool enabled)
+{
+    meshlet_culling_enabled = enabled;
+}
+
+void pigeon_set_gpu_culling(bool enabled)
+{
+    gpu_culling_enabled = enabled;
+}
+
+void pigeon_set_animation_pose_sharing(unsigned int steps_per_frame)
+{
+    pose_sharing_steps = steps_per_frame;
+}
+
+void pigeon_set_animation_update_lod(float screen_size, unsigned int max_interval)
+{
+    animation_lod_screen_size = screen_size;
+    animation_lod_max_interval = max_interval;
+}
+
+void pigeon_set_compute_skinning(bool enabled)
+{
+    compute_skinning_enabled = enabled;
+}
+
+static bool gpu_culling(void)
+{
+    return gpu_culling_enabled && pigeon_wgi_gpu_culling_supported();
+}
+
+static bool compute_skinning(void)
+{
+    return compute_skinning_enabled && pigeon_wgi_compute_skinning_supported();
+}
+
+// CPU culling is not used with GPU culling
+
+static bool occlusion_culling(void)
+{
+    return occlusion_culling_enabled && !gpu_culling();
+}
+
+static bool culling_enabled(void)
+{
+    return !gpu_culling() && (occlusion_culling_enabled || meshlet_culling_enabled);
+}
+
+static bool stage_is_culled(PigeonWGIRenderStage stage)
+{
+    // Objects hidden from the camera can still cast shadows
+    return culling_enabled() &&
+        (stage == PIGEON_WGI_RENDER_STAGE_DEPTH || stage == PIGEON_WGI_RENDER_STAGE_RENDER);
+}
+
+static void get_model_bounds(PigeonModelMaterial const* model, float bounds_min[3], float bounds_max[3])
+{
+    PigeonWGIMeshMeta const* meta = &model->model_asset->mesh_meta;
+    for(unsigned int i = 0; i < 3; i++) {
+        bounds_min[i] = meta->bounds_min[i];
+        bounds_max[i] = meta->bounds_min[i] + meta->bounds_range[i];
+    }
+}
+
+static unsigned int get_lods_count(PigeonModelMaterial const* model)
+{
+    return model->model_asset->lods_count ? model->model_asset->lods_count : 1;
+}
+
+// Index (or vertex) range in the multimesh
+static void get_lod_range(PigeonModelMaterial const* model, unsigned int lod, uint32_t * first, uint32_t * count)
+{
+    PigeonWGIMaterialImport const* material = &model->model_asset->materials[model->material_index];
+
+    if(lod == 0) {
+        *first = material->first;
+        *count = material->count;
+    }
+    else {
+        *first = material->lod_first[lod-1];
+        *count = material->lod_count[lod-1];
+    }
+    *first += model->model_asset->mesh_meta.multimesh_start_index;
+}
+
+// Returns NULL if the instance is drawn whole
+// Meshlet bounds are in model space so they can't be used for skinned meshes
+static const PigeonWGIMeshlet* get_meshlets(PigeonRenderState const* rs, PigeonModelMaterial const* model,
+    PigeonMaterialRenderer const* mr, unsigned int lod, unsigned int * count)
+{
+    if(!meshlet_culling_enabled || gpu_culling() || mr->animation_state || rs->pipeline->skinned) return NULL;
+
+    PigeonWGIMaterialImport const* material = &model->model_asset->materials[model->material_index];
+    const PigeonWGIMeshlet* meshlets = pigeon_get_model_meshlets(model->model_asset);
+    if(!meshlets || !material->meshlet_count[lod]) return NULL;
+
+    *count = material->meshlet_count[lod];
+    return &meshlets[material->meshlet_first[lod]];
+}
+
+// Normal cones are generated for anticlockwise front faces
+static bool pipeline_culls_back_faces(PigeonWGIPipeline const* pipeline)
+{
+    if(pipeline->cull_mode == PIGEON_WGI_CULL_MODE_NONE) return false;
+    return (pipeline->cull_mode == PIGEON_WGI_CULL_MODE_BACK) ==
+        (pipeline->front_face == PIGEON_WGI_FRONT_FACE_ANTICLOCKWISE);
+}
+
+static void get_world_centre(PigeonTransform const* t, const float bounds_min[3], const float bounds_max[3],
+    vec4 centre)
+{
+    centre[0] = (bounds_min[0] + bounds_max[0]) * 0.5f;
+    centre[1] = (bounds_min[1] + bounds_max[1]) * 0.5f;
+    centre[2] = (bounds_min[2] + bounds_max[2]) * 0.5f;
+    centre[3] = 1;
+    glm_mat4_mulv((vec4*)t->world_transform_cache, centre, centre);
+}
+
+// Distance from the camera to the centre of the bounding box
+static float get_depth(PigeonTransform const* t, const float bounds_min[3], const float bounds_max[3])
+{
+    vec4 centre;
+    get_world_centre(t, bounds_min, bounds_max, centre);
+    return glm_vec3_distance(centre, scene_uniform_data.eye_position);
+}
+
+// Projected diameter of the bounding sphere as a fraction of the screen height
+static float get_screen_size(PigeonTransform const* t, const float bounds_min[3], const float bounds_max[3])
+{
+    vec4 centre;
+    get_world_centre(t, bounds_min, bounds_max, centre);
+
+    float scale = 0;
+    for(unsigned int i = 0; i < 3; i++) {
+        float s = glm_vec3_norm((float*)t->world_transform_cache[i]);
+        if(s > scale) scale = s;
+    }
+    float radius = glm_vec3_distance((float*)bounds_min, (float*)bounds_max) * 0.5f * scale;
+
+    float distance = glm_vec3_distance(centre, scene_uniform_data.eye_position);
+    if(distance <= radius) return INFINITY;
+
+    return radius * fabsf(scene_uniform_data.proj[1][1]) / distance;
+}
+
+static unsigned int select_lod(PigeonModelMaterial const* model, PigeonTransform * t, float screen_size)
+{
+    unsigned int lod = pigeon_select_lod(model->model_asset->lod_screen_sizes, get_lods_count(model), t->_lod,
+        screen_size);
+    t->_lod = (uint8_t)lod;
+    return lod;
+}
+
+// Within each model, instances are grouped by LOD and the visible instances of each LOD are given
+// the first draw indices. Every stage can then draw a contiguous range of instances per LOD.
+typedef struct InstanceOrder {
+    unsigned int instances;
+    unsigned int lod_instances[PIGEON_WGI_MAX_LODS];
+    unsigned int lod_visible_instances[PIGEON_WGI_MAX_LODS];
+    unsigned int lod_first_draw_index[PIGEON_WGI_MAX_LODS];
+
+    unsigned int next_visible_draw_index[PIGEON_WGI_MAX_LODS];
+    unsigned int next_culled_draw_index[PIGEON_WGI_MAX_LODS];
+    unsigned int next_instance_index; // Index into instance_lods
+} InstanceOrder;
+
+// Model instances start at first_draw_index in both the draw objects and instance_lods
+static void get_instance_order(SceneModel const* model, unsigned int first_draw_index, InstanceOrder * order)
+{
+    const uint8_t * lods = instance_lods.elements;
+    memset(order, 0, sizeof *order);
+
+    for(unsigned int k = 0; k < model->instances; k++) {
+        assert(first_draw_index + order->instances < instance_lods.size);
+        uint8_t info = lods[first_draw_index + order->instances++];
+        unsigned int lod = info & INSTANCE_LOD_MASK;
+
+        order->lod_instances[lod]++;
+        if(!(info & INSTANCE_CULLED)) order->lod_visible_instances[lod]++;
+    }
+
+    unsigned int draw_index = first_draw_index;
+    for(unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS; lod++) {
+        order->lod_first_draw_index[lod] = draw_index;
+        order->next_visible_draw_index[lod] = draw_index;
+        order->next_culled_draw_index[lod] = draw_index + order->lod_visible_instances[lod];
+        draw_index += order->lod_instances[lod];
+    }
+    order->next_instance_index = first_draw_index;
+}
+
+// Call for each instance in scene graph order
+// meshlets is set to NULL if the instance is not drawn as meshlets
+static unsigned int get_next_draw_index(InstanceOrder * order, bool * visible, unsigned int * lod,
+    InstanceMeshlets const** meshlets)
+{
+    unsigned int i = order->next_instance_index++;
+    uint8_t info = ((const uint8_t *)instance_lods.elements)[i];
+    *lod = info & INSTANCE_LOD_MASK;
+    *visible = !(info & INSTANCE_CULLED);
+    *meshlets = (info & INSTANCE_MESHLETS) ? &((InstanceMeshlets const*)instance_meshlets.elements)[i] : NULL;
+    return *visible ? order->next_visible_draw_index[*lod]++ : order->next_culled_draw_index[*lod]++;
+}
+
+// Index of p in the list, added if not found. Indices that don't fit in the sort key share the last value
+static uint32_t get_sort_index(PigeonArrayList * list, void * p, unsigned int bits)
+{
+    const uint32_t max = (1u << bits) - 1;
+    void ** elements = list->elements;
+
+    unsigned int i = 0;
+    while(i < list->size && elements[i] != p) i++;
+
+    if(i == list->size) {
+        void ** new = pigeon_array_list_add(list, 1);
+        if(!new) {
+            prepass_failed = true;
+            return max;
+        }
+        *new = p;
+    }
+    return i < max ? i : max;
+}
+
+static uint64_t get_sort_key(PigeonRenderState const* rs, PigeonMaterialRenderer const* mr, float depth)
+{
+    uint64_t state = (uint64_t)rs->_sort_state << SORT_TEXTURE_BITS;
+    if(mr) {
+        // UINT32_MAX (no texture) becomes 0
+        state |= ((mr->diffuse_bind_point + 1) & 0xff) << 8 | ((mr->nmap_bind_point + 1) & 0xff);
+    }
+
+    // Positive floats are in the same order as their bit patterns
+    if(!(depth > 0)) depth = 0;
+    uint32_t depth_bits;
+    memcpy(&depth_bits, &depth, 4);
+    uint64_t d = depth_bits >> (31 - SORT_DEPTH_BITS);
+
+    if(rs->pipeline->transparent) {
+        d = ~d & ((1ull << SORT_DEPTH_BITS) - 1);
+        return 1ull << 63 | d << SORT_STATE_BITS | state;
+    }
+    return state << SORT_DEPTH_BITS | d;
+}
+
+// Commands of a render state are written to its range of the draw list
+static DrawCommand * set_draw_command(PigeonRenderState const* rs, unsigned int * next, uint64_t key, uint8_t stages)
+{
+    assert(*next < rs->_draw_commands);
+    unsigned int i = rs->_start_draw_command + (*next)++;
+
+    PigeonSortItem * item = &((PigeonSortItem *)draw_order.elements)[i];
+    item->key = key;
+    item->value = i;
+
+    DrawCommand * c = &((DrawCommand *)draw_commands.elements)[i];
+    memset(c, 0, sizeof *c);
+    c->rs = rs;
+    c->stages = stages;
+    return c;
+}
+
+// not parallelisable
+static void scene_graph_prepass_mr(void * mr_)
+{
+    PigeonMaterialRenderer * mr = mr_;
+    mr->_material_index = total_materials++;
+}
+
+// Adds n elements to every array of the instance table. Returns the index of the first
+static PIGEON_ERR_RET add_instances(unsigned int n, unsigned int * first)
+{
+    *first = instance_table.transforms.size;
+    ASSERT_R1(pigeon_array_list_add(&instance_table.transforms, n));
+    ASSERT_R1(pigeon_array_list_add(&instance_table.mr, n));
+    ASSERT_R1(pigeon_array_list_add(&instance_table.material_index, n));
+    ASSERT_R1(pigeon_array_list_add(&instance_table.first_bone_index, n));
+    return 0;
+}
+
+// not parallelisable
+static void cache_scene_rs(void * rs_)
+{
+    PigeonRenderState * rs = rs_;
+
+    rs->_first_scene_model = scene_models.size;
+    rs->_scene_models = 0;
+
+    if(!rs->models) return;
+
+    for(unsigned int i = 0; i < rs->models->size; i++) {
+        PigeonModelMaterial* model = ((PigeonModelMaterial**)rs->models->elements)[i];
+
+        if(!model->mr) continue;
+
+        unsigned int first_instance = instance_table.transforms.size;
+
+        for(unsigned int j = 0; j < model->mr->size; j++) {
+            PigeonMaterialRenderer* mr = ((PigeonMaterialRenderer**)model->mr->elements)[j];
+            if(!mr->c.transforms || !mr->c.transforms->size) continue;
+
+            unsigned int first;
+            if(add_instances(mr->c.transforms->size, &first)) {
+                prepass_failed = true;
+                return;
+            }
+
+            int32_t first_bone_index = mr->animation_state ? (int32_t)mr->animation_state->_first_bone_index : -1;
+
+            for(unsigned int k = 0; k < mr->c.transforms->size; k++) {
+                ((PigeonTransform**)instance_table.transforms.elements)[first + k] =
+                    ((PigeonTransform**)mr->c.transforms->elements)[k];
+                ((PigeonMaterialRenderer**)instance_table.mr.elements)[first + k] = mr;
+                ((uint32_t*)instance_table.material_index.elements)[first + k] = mr->_material_index;
+                ((int32_t*)instance_table.first_bone_index.elements)[first + k] = first_bone_index;
+            }
+        }
+
+        if(instance_table.transforms.size == first_instance) continue;
+
+        SceneModel * m = pigeon_array_list_add(&scene_models, 1);
+        if(!m) {
+            prepass_failed = true;
+            return;
+        }
+        m->model = model;
+        m->first_instance = first_instance;
+        m->instances = instance_table.transforms.size - first_instance;
+        get_model_bounds(model, m->bounds_min, m->bounds_max);
+        rs->_scene_models++;
+    }
+}
+
+// Material indices are assigned here as they only change when objects are created or destroyed.
+// Bone indices are assigned every frame by assign_bone_blocks
+static PIGEON_ERR_RET update_scene_cache(void)
+{
+    if(scene_cache_version == pigeon_scene_topology_version) return 0;
+
+    total_materials = 0;
+    pigeon_object_pool_for_each(&pigeon_pool_mr, scene_graph_prepass_mr);
+
+    scene_models.size = 0;
+    instance_table.transforms.size = instance_table.mr.size = 0;
+    instance_table.material_index.size = instance_table.first_bone_index.size = 0;
+
+    prepass_failed = false;
+    pigeon_object_pool_for_each(&pigeon_pool_rs, cache_scene_rs);
+    ASSERT_R1(!prepass_failed);
+
+    scene_cache_version = pigeon_scene_topology_version;
+    return 0;
+}
+
+// Time that animations are evaluated at, the same for all jobs
+static double bones_time;
+
+static bool has_animation_clips(PigeonAnimationState const* a)
+{
+    for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+        if(a->clips[i].animation_index >= 0) return true;
+    }
+    return false;
+}
+
+static bool valid_animation_index(PigeonAsset const* asset, int animation_index)
+{
+    return animation_index >= 0 && (unsigned)animation_index < asset->animations_count;
+}
+
+// Returns the slot for the pose (empty if it has not been evaluated yet)
+static SharedPose * find_shared_pose(PigeonAsset const* asset, int animation_index, uint64_t step)
+{
+    uint64_t h = (uint64_t)(uintptr_t)asset;
+    h = (h ^ (uint64_t)(uint32_t)animation_index) * 0x9E3779B97F4A7C15ull;
+    h = (h ^ step) * 0x9E3779B97F4A7C15ull;
+
+    SharedPose * poses = shared_poses.elements;
+    unsigned int mask = shared_poses.size - 1;
+    for(unsigned int i = (unsigned int)(h >> 32) & mask;; i = (i + 1) & mask) {
+        SharedPose * p = &poses[i];
+        if(!p->asset || (p->asset == asset && p->animation_index == animation_index && p->step == step))
+            return p;
+    }
+}
+
+// Largest screen size of the instances that use the animation state
+static float get_animation_screen_size(PigeonAnimationState const* a)
+{
+    if(!a->mr) return 0;
+
+    PigeonWGIMeshMeta const* meta = &a->model_asset->mesh_meta;
+    float bounds_min[3], bounds_max[3];
+    for(unsigned int i = 0; i < 3; i++) {
+        bounds_min[i] = meta->bounds_min[i];
+        bounds_max[i] = meta->bounds_min[i] + meta->bounds_range[i];
+    }
+
+    float screen_size = 0;
+    for(unsigned int i = 0; i < a->mr->size; i++) {
+        PigeonMaterialRenderer const* mr = ((PigeonMaterialRenderer**)a->mr->elements)[i];
+        if(!mr->c.transforms) continue;
+
+        for(unsigned int j = 0; j < mr->c.transforms->size; j++) {
+            PigeonTransform * t = ((PigeonTransform**)mr->c.transforms->elements)[j];
+            pigeon_scene_calculate_world_matrix(t);
+            float s = get_screen_size(t, bounds_min, bounds_max);
+            if(s > screen_size) screen_size = s;
+        }
+    }
+    return screen_size;
+}
+
+static unsigned int get_animation_update_interval(PigeonAnimationState const* a)
+{
+    unsigned int interval = a->update_interval ? a->update_interval : 1;
+    if(!(animation_lod_screen_size > 0)) return interval;
+
+    float screen_size = get_animation_screen_size(a);
+    unsigned int lod_interval = 1;
+    for(float s = animation_lod_screen_size; screen_size < s && lod_interval * 2 <= animation_lod_max_interval;
+        s *= 0.5f) {
+        lod_interval *= 2;
+    }
+    return lod_interval > interval ? lod_interval : interval;
+}
+
+// Decides whether the bones of the state are evaluated this frame or copied from the last evaluation
+static void update_animation_rate(PigeonAnimationState * a)
+{
+    unsigned int interval = get_animation_update_interval(a);
+    unsigned int index = animation_state_index++;
+
+    if(interval > 1 && !a->_previous_bones) {
+        a->_previous_bones = malloc(a->model_asset->bones_count * sizeof *a->_previous_bones);
+        a->_previous_bones_valid = false;
+        if(!a->_previous_bones) interval = 1;
+    }
+
+    a->_update_interval = interval;
+    a->_reuse_bones = interval > 1 && a->_previous_bones_valid && (animation_frame + index) % interval;
+
+    // set_object_bones writes _previous_bones when the bones are evaluated
+    a->_previous_bones_valid = interval > 1;
+}
+
+// not parallelisable
+static void assign_bone_block(void * anim_)
+{
+    PigeonAnimationState * a = anim_;
+    PigeonAsset const* asset = a->model_asset;
+
+    pigeon_remove_faded_animation_clips(a, bones_time);
+    const bool clips = has_animation_clips(a);
+
+    update_animation_rate(a);
+
+    uint64_t step = 0;
+    if(!clips && valid_animation_index(asset, a->animation_index)) {
+        PigeonWGIAnimationMeta const* animation = &asset->animations[a->animation_index];
+        a->_frame = (bones_time - a->animation_start_time) * (double)animation->fps;
+
+        if(pose_sharing_steps) {
+            // Quantised and wrapped so that states on the same step of the animation have the same frame
+            double steps = (double)animation->frame_count * pose_sharing_steps;
+            double s = fmod(floor(a->_frame * pose_sharing_steps), steps);
+            if(s < 0) s += steps;
+            step = (uint64_t)s;
+            a->_frame = s / pose_sharing_steps;
+        }
+    }
+
+    unsigned int first = total_bones;
+    a->_shared_pose = false;
+
+    // Invalid animation indices are left to set_object_bones to report.
+    // States that are not evaluated every frame keep their own bones to reuse
+    bool shareable = pose_sharing_steps && a->_update_interval <= 1 && !clips &&
+        !(asset->local_animations && a->modify_pose) &&
+        (a->animation_index < 0 || valid_animation_index(asset, a->animation_index));
+    if(shareable) {
+        int animation_index = a->animation_index < 0 ? -1 : a->animation_index;
+        SharedPose * p = find_shared_pose(asset, animation_index, step);
+        if(p->asset) {
+            first = p->first_bone_index;
+            a->_shared_pose = true;
+        }
+        else {
+            p->asset = asset;
+            p->animation_index = animation_index;
+            p->step = step;
+            p->first_bone_index = first;
+        }
+    }
+
+    if(!a->_shared_pose) {
+        total_bones += round_up(asset->bones_count, pigeon_wgi_get_bone_data_alignment());
+        bone_jobs++;
+    }
+
+    if(first != a->_first_bone_index) {
+        a->_first_bone_index = first;
+        bone_blocks_changed = true;
+    }
+}
+
+// Gives each animation state a block of bone matrices, or the block of a state with the same pose
+static PIGEON_ERR_RET assign_bone_blocks(void)
+{
+    bones_time = pigeon_wgi_get_time_seconds_double();
+    total_bones = bone_jobs = 0;
+    bone_blocks_changed = false;
+    animation_frame++;
+    animation_state_index = 0;
+
+    if(pose_sharing_steps) {
+        // At most half full
+        unsigned int size = 16;
+        while(size < pigeon_pool_anim.allocated_obj_count * 2) size *= 2;
+
+        shared_poses.size = 0;
+        ASSERT_R1(!pigeon_array_list_resize(&shared_poses, size));
+        pigeon_array_list_zero(&shared_poses);
+    }
+
+    pigeon_object_pool_for_each(&pigeon_pool_anim, assign_bone_block);
+
+    // The instance table only changes when the scene topology changes, except for these
+    if(bone_blocks_changed || skin_jobs_in_instance_table) {
+        PigeonMaterialRenderer * const* mr = instance_table.mr.elements;
+        int32_t * first_bone_index = instance_table.first_bone_index.elements;
+        for(unsigned int i = 0; i < instance_table.mr.size; i++) {
+            first_bone_index[i] = mr[i]->animation_state ? (int32_t)mr[i]->animation_state->_first_bone_index : -1;
+        }
+        skin_jobs_in_instance_table = false;
+    }
+    return 0;
+}
+
+static SceneModel const* get_scene_models(PigeonRenderState const* rs)
+{
+    return (SceneModel const*)scene_models.elements + rs->_first_scene_model;
+}
+
+static InstanceRange get_instances(SceneModel const* model)
+{
+    unsigned int i = model->first_instance;
+    return (InstanceRange) {
+        .transforms = (PigeonTransform * const*)instance_table.transforms.elements + i,
+        .mr = (PigeonMaterialRenderer * const*)instance_table.mr.elements + i,
+        .material_index = (uint32_t const*)instance_table.material_index.elements + i,
+        .first_bone_index = (int32_t const*)instance_table.first_bone_index.elements + i
+    };
+}
+
+// skin.comp reads normalised positions and bones
+static bool skinned_by_compute(PigeonRenderState const* rs)
+{
+    if(!rs->pipeline || !rs->pipeline->skinned || !rs->mesh || !rs->mesh->has_bones) return false;
+
+    for(unsigned int i = 0; i < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES; i++) {
+        if(rs->mesh->attribute_types[i] == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED) return true;
+    }
+    return false;
+}
+
+static unsigned int get_skin_mesh(PigeonWGIMultiMesh * mesh)
+{
+    SkinMesh * meshes = skin_meshes.elements;
+
+    unsigned int i = 0;
+    while(i < skin_meshes.size && meshes[i].mesh != mesh) i++;
+
+    if(i == skin_meshes.size) {
+        SkinMesh * m = pigeon_array_list_add(&skin_meshes, 1);
+        if(!m) {
+            prepass_failed = true;
+            return 0;
+        }
+        memset(m, 0, sizeof *m);
+        m->mesh = mesh;
+    }
+    return i;
+}
+
+// not parallelisable
+static void add_skin_jobs_rs(void * rs_)
+{
+    PigeonRenderState * rs = rs_;
+    if(prepass_failed || !skinned_by_compute(rs)) return;
+
+    SceneModel const* models = get_scene_models(rs);
+    int32_t * block_jobs = bone_block_jobs.elements;
+
+    for(unsigned int i = 0; i < rs->_scene_models; i++) {
+        InstanceRange instances = get_instances(&models[i]);
+        PigeonAsset const* asset = models[i].model->model_asset;
+
+        for(unsigned int k = 0; k < models[i].instances; k++) {
+            int32_t b = instances.first_bone_index[k];
+            if(b < 0 || block_jobs[b] >= 0) continue;
+
+            unsigned int skin_mesh = get_skin_mesh(rs->mesh);
+            SkinJob * job = pigeon_array_list_add(&skin_jobs, 1);
+            if(prepass_failed || !job) {
+                prepass_failed = true;
+                return;
+            }
+
+            block_jobs[b] = (int32_t)(skin_jobs.size - 1);
+            job->asset = asset;
+            job->first_bone_index = (unsigned)b;
+            job->skin_mesh = skin_mesh;
+
+            SkinMesh * m = &((SkinMesh*)skin_meshes.elements)[skin_mesh];
+            m->jobs++;
+            m->vertices += asset->mesh_meta.vertex_count;
+        }
+    }
+}
+
+// not parallelisable
+static void set_skin_job_indices_rs(void * rs_)
+{
+    PigeonRenderState * rs = rs_;
+    if(!skinned_by_compute(rs)) return;
+
+    SceneModel const* models = get_scene_models(rs);
+    int32_t const* block_jobs = bone_block_jobs.elements;
+    SkinJob const* jobs_ = skin_jobs.elements;
+    SkinMesh const* meshes = skin_meshes.elements;
+
+    for(unsigned int i = 0; i < rs->_scene_models; i++) {
+        int32_t * first_bone_index = (int32_t*)instance_table.first_bone_index.elements + models[i].first_instance;
+
+        for(unsigned int k = 0; k < models[i].instances; k++) {
+            int32_t b = first_bone_index[k];
+            if(b < 0) continue;
+
+            // A bone block drawn with more than one mesh is only skinned by compute for the first
+            SkinJob const* job = &jobs_[block_jobs[b]];
+            if(meshes[job->skin_mesh].mesh != rs->mesh) continue;
+
+            first_bone_index[k] = -2 - (int32_t)job->index;
+            skin_jobs_in_instance_table = true;
+        }
+    }
+}
+
+// After assign_bone_blocks. Every animated instance of a skinned render state is skinned (not only the visible
+// ones) because the shadow stages and GPU culling draw instances that the camera cannot see
+static PIGEON_ERR_RET assign_skin_jobs(void)
+{
+    ASSERT_R1(!pigeon_array_list_resize(&bone_block_jobs, total_bones));
+    if(total_bones) memset(bone_block_jobs.elements, 0xff, total_bones * sizeof(int32_t));
+
+    prepass_failed = false;
+    pigeon_object_pool_for_each(&pigeon_pool_rs, add_skin_jobs_rs);
+    ASSERT_R1(!prepass_failed);
+    if(!skin_jobs.size) return 0;
+
+    // Jobs and outputs grouped by mesh, in the order the jobs were added
+    SkinMesh * meshes = skin_meshes.elements;
+    unsigned int first_job = 0;
+    for(unsigned int i = 0; i < skin_meshes.size; i++) {
+        meshes[i].first_job = first_job;
+        meshes[i].first_output = total_skin_vertices;
+        first_job += meshes[i].jobs;
+        total_skin_vertices += meshes[i].vertices;
+        meshes[i].jobs = meshes[i].vertices = 0;
+    }
+
+    SkinJob * jobs_ = skin_jobs.elements;
+    for(unsigned int i = 0; i < skin_jobs.size; i++) {
+        SkinMesh * m = &meshes[jobs_[i].skin_mesh];
+        jobs_[i].index = m->first_job + m->jobs++;
+        jobs_[i].output_offset = m->first_output + m->vertices;
+        m->vertices += jobs_[i].asset->mesh_meta.vertex_count;
+    }
+
+    pigeon_object_pool_for_each(&pigeon_pool_rs, set_skin_job_indices_rs);
+    return 0;
+}
+
+// Call after pigeon_wgi_start_frame
+static PIGEON_ERR_RET write_skin_jobs(void)
+{
+    PigeonWGISkinJob * out = pigeon_wgi_get_skin_jobs();
+    SkinJob const* jobs_ = skin_jobs.elements;
+
+    for(unsigned int i = 0; i < skin_jobs.size; i++) {
+        PigeonWGIMeshMeta const* meta = &jobs_[i].asset->mesh_meta;
+        PigeonWGISkinJob * o = &out[jobs_[i].index];
+
+        o->first_vertex = meta->multimesh_start_vertex;
+        o->vertex_count = meta->vertex_count;
+        o->output_offset = jobs_[i].output_offset;
+        o->first_bone_index = (int32_t)jobs_[i].first_bone_index;
+        memcpy(o->position_min, meta->bounds_min, 3 * 4);
+        o->position_min[3] = 0;
+        memcpy(o->position_range, meta->bounds_range, 3 * 4);
+        o->position_range[3] = 0;
+    }
+
+    SkinMesh const* meshes = skin_meshes.elements;
+    for(unsigned int i = 0; i < skin_meshes.size; i++) {
+        ASSERT_R1(!pigeon_wgi_skin_mesh(meshes[i].mesh, meshes[i].first_job, meshes[i].jobs,
+            meshes[i].first_output, meshes[i].vertices));
+    }
+    return 0;
+}
+
+static PIGEON_ERR_RET scene_graph_prepass_occluders(void)
+{
+    PigeonTransform * const* transforms = instance_table.transforms.elements;
+
+    for(unsigned int i = 0; i < instance_table.transforms.size; i++) {
+        pigeon_scene_calculate_world_matrix(transforms[i]);
+    }
+
+    if(!occlusion_culling()) return 0;
+
+    SceneModel const* models = scene_models.elements;
+
+    for(unsigned int i = 0; i < scene_models.size; i++) {
+        InstanceRange instances = get_instances(&models[i]);
+
+        for(unsigned int k = 0; k < models[i].instances; k++) {
+            PigeonMaterialRenderer* mr = instances.mr[k];
+            if(!mr->occluder) continue;
+
+            float (*world)[4] = instances.transforms[k]->world_transform_cache;
+
+            int err;
+            if(mr->occluder_mesh)
+                err = pigeon_hiz_rasterise(&hiz, world, mr->occluder_mesh->positions,
+                    mr->occluder_mesh->vertex_count, mr->occluder_mesh->indices, mr->occluder_mesh->index_count);
+            else
+                err = pigeon_hiz_rasterise_box(&hiz, world, models[i].bounds_min, models[i].bounds_max);
+            ASSERT_R1(!err);
+        }
+    }
+    return 0;
+}
+
 static unsigned int render_state_index;
 
 // not parallelisable
@@ -69,107 +1023,237 @@ static void scene_graph_prepass_rs(void * rs_)
 
     rs->_start_draw_index = total_draws;
     rs->_start_multidraw_index = total_multidraw_draws;
+    rs->_start_draw_command = draw_commands.size;
     rs->_index = render_state_index++;
 
-    unsigned int draws = 0, multidraws = 0;
+    unsigned int draws = 0, multidraws = 0, visible_multidraws = 0, meshlet_multidraws = 0, meshlet_draws_count = 0;
+    unsigned int groups = 0;
     rs->count = 0;
+    rs->_draw_commands = 0;
+    rs->_cull_groups = 0;
 
-    if(!rs->models) return;
+    if(!rs->_scene_models) {
+        rs->_draws = rs->_multidraws = rs->_visible_multidraws = 0;
+        return;
+    }
 
-    for(unsigned int i = 0; i < rs->models->size; i++) {
-        PigeonModelMaterial* model = ((PigeonModelMaterial**)rs->models->elements)[i];
+    rs->_sort_state = get_sort_index(&sort_pipelines, rs->pipeline, SORT_PIPELINE_BITS) << SORT_MESH_BITS |
+        get_sort_index(&sort_meshes, rs->mesh, SORT_MESH_BITS);
 
-        if(!model->mr) continue;
+    // Nearest instance for opaque render states, furthest for transparent ones
+    float depth = rs->pipeline->transparent ? 0 : INFINITY;
+
+    SceneModel const* models = get_scene_models(rs);
+
+    for(unsigned int i = 0; i < rs->_scene_models; i++) {
+        PigeonModelMaterial* model = models[i].model;
+        InstanceRange model_instances = get_instances(&models[i]);
+        float const* bounds_min = models[i].bounds_min;
+        float const* bounds_max = models[i].bounds_max;
 
         unsigned int instances = 0;
-        for(unsigned int j = 0; j < model->mr->size; j++) {
-            PigeonMaterialRenderer* mr = ((PigeonMaterialRenderer**)model->mr->elements)[j];
+        unsigned int lod_instances[PIGEON_WGI_MAX_LODS] = {0};
+        unsigned int lod_visible_instances[PIGEON_WGI_MAX_LODS] = {0};
+
+        for(unsigned int k = 0; k < models[i].instances; k++, instances++) {
+            PigeonMaterialRenderer* mr = model_instances.mr[k];
+            PigeonTransform* t = model_instances.transforms[k];
+
+            // With GPU culling the compute shader chooses the LOD
+            unsigned int lod = 0;
+            if(get_lods_count(model) > 1 && !gpu_culling())
+                lod = select_lod(model, t, get_screen_size(t, bounds_min, bounds_max));
 
-            if(mr->c.transforms) {
-                for(unsigned int k = 0; k < mr->c.transforms->size; k++, instances++) {
-                    PigeonTransform* t = ((PigeonTransform**)mr->c.transforms->elements)[k];
-                    pigeon_scene_calculate_world_matrix(t);
+            if(pigeon_wgi_multidraw_supported()) {
+                float d = get_depth(t, bounds_min, bounds_max);
+                depth = rs->pipeline->transparent ? fmaxf(depth, d) : fminf(depth, d);
+            }
+
+            bool visible = true;
+            if(occlusion_culling() && !mr->occluder)
+                visible = pigeon_hiz_test_box(&hiz, t->world_transform_cache, bounds_min, bounds_max);
+
+            InstanceMeshlets * im = pigeon_array_list_add(&instance_meshlets, 1);
+            uint8_t * info = pigeon_array_list_add(&instance_lods, 1);
+            if(!im || !info) {
+                prepass_failed = true;
+                return;
+            }
+            im->first = meshlet_draws.size;
+            im->count = 0;
+            uint8_t flags = visible ? 0 : INSTANCE_CULLED;
+
+            unsigned int meshlets_count = 0;
+            const PigeonWGIMeshlet* meshlets = NULL;
+            if(visible) meshlets = get_meshlets(rs, model, mr, lod, &meshlets_count);
+
+            if(meshlets) {
+                if(pigeon_cull_meshlets(occlusion_culling() && !mr->occluder ? &hiz : NULL,
+                    scene_uniform_data.proj_view, t->world_transform_cache, scene_uniform_data.eye_position,
+                    pipeline_culls_back_faces(rs->pipeline), meshlets, meshlets_count, &meshlet_draws))
+                {
+                    prepass_failed = true;
+                    return;
                 }
+                im->count = meshlet_draws.size - im->first;
+                meshlet_draws_count += im->count;
+                if(pigeon_wgi_multidraw_supported()) meshlet_multidraws += im->count;
+
+                flags = INSTANCE_CULLED | INSTANCE_MESHLETS;
+                visible = false;
             }
+            *info = (uint8_t)(lod | flags);
+
+            lod_instances[lod]++;
+            if(visible) lod_visible_instances[lod]++;
         }
 
-        if(pigeon_wgi_multidraw_supported() && instances) {
-            // These are only used if there is only 1 multidraw for this render state
-            rs->start_vertex = model->model_asset->mesh_meta.multimesh_start_vertex;
-            rs->instances = instances;
-            rs->first = model->model_asset->mesh_meta.multimesh_start_index
-                    + model->model_asset->materials[model->material_index].first;
-            rs->count = model->model_asset->materials[model->material_index].count;
-            
-            multidraws++;
+        if(gpu_culling()) {
+            if(instances) groups++;
+        }
+        else if(pigeon_wgi_multidraw_supported()) {
+            for(unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS; lod++) {
+                if(!lod_instances[lod]) continue;
+
+                // These are only used if there is only 1 multidraw for this render state
+                rs->start_vertex = model->model_asset->mesh_meta.multimesh_start_vertex;
+                rs->instances = lod_instances[lod];
+                rs->visible_instances = lod_visible_instances[lod];
+                get_lod_range(model, lod, &rs->first, &rs->count);
+
+                multidraws++;
+                if(lod_visible_instances[lod]) visible_multidraws++;
+            }
         }
 
         draws += instances;
     }
 
-    if(multidraws == 1) multidraws = 0;
+    if(multidraws == 1 && !meshlet_multidraws) multidraws = visible_multidraws = 0;
 
     rs->_draws = draws;
     rs->_multidraws = multidraws;
 
+    if(culling_enabled()) {
+        rs->_start_visible_multidraw_index = total_multidraw_draws + multidraws;
+        rs->_visible_multidraws = visible_multidraws + meshlet_multidraws;
+        total_multidraw_draws += rs->_visible_multidraws;
+    }
+    else {
+        rs->_start_visible_multidraw_index = rs->_start_multidraw_index;
+        rs->_visible_multidraws = multidraws;
+    }
+
     total_draws += draws;
     total_multidraw_draws += multidraws;
-}
 
-// not parallelisable
-static void scene_graph_prepass_anim(void * anim_)
-{
-    PigeonAnimationState * anim = anim_;
+    // Each cull group can write a command for every LOD, for the shadow stages and the camera stages
+    if(groups) {
+        rs->_first_cull_group = total_cull_groups;
+        rs->_cull_groups = groups;
+        rs->_cull_render_state = total_cull_render_states++;
+        rs->_first_cull_command = 2 * PIGEON_WGI_MAX_LODS * total_cull_groups;
+        total_cull_groups += groups;
+    }
 
-    anim->_first_bone_index = total_bones;
-    total_bones += round_up(anim->model_asset->bones_count, pigeon_wgi_get_bone_data_alignment());
+    // Render states are drawn with multidraw commands. Otherwise there is a command for every instance and
+    // meshlet draw, written by set_uniform_data_per_rs_
+    if(pigeon_wgi_multidraw_supported()) rs->_draw_commands = draws ? 1 : 0;
+    else rs->_draw_commands = draws + meshlet_draws_count;
+
+    if(!rs->_draw_commands) return;
+
+    if(!pigeon_array_list_add(&draw_commands, rs->_draw_commands) ||
+        !pigeon_array_list_add(&draw_order, rs->_draw_commands))
+    {
+        prepass_failed = true;
+        return;
+    }
+
+    if(pigeon_wgi_multidraw_supported()) {
+        unsigned int next = 0;
+        set_draw_command(rs, &next, get_sort_key(rs, NULL, depth), DRAW_COMMAND_SHADOW | DRAW_COMMAND_CAMERA);
+    }
 }
 
-static void scene_graph_prepass(void)
+static PIGEON_ERR_RET scene_graph_prepass(void)
 {
-    total_draws = total_multidraw_draws = total_bones = render_state_index = 0;
+    total_draws = total_multidraw_draws = render_state_index = 0;
+    total_cull_groups = total_cull_render_states = 0;
+    instance_lods.size = 0;
+    instance_meshlets.size = 0;
+    meshlet_draws.size = 0;
+    draw_commands.size = draw_order.size = 0;
+    sort_pipelines.size = sort_meshes.size = 0;
+    skin_jobs.size = skin_meshes.size = 0;
+    total_skin_vertices = 0;
+    ASSERT_R1(!update_scene_cache());
+    prepass_failed = false;
+
+    if(occlusion_culling()) pigeon_hiz_clear(&hiz, scene_uniform_data.proj_view);
+    ASSERT_R1(!scene_graph_prepass_occluders());
+    if(occlusion_culling()) ASSERT_R1(!pigeon_hiz_build(&hiz));
+
+    // After the world matrices are calculated (for the update-rate LOD)
+    ASSERT_R1(!assign_bone_blocks());
+    if(compute_skinning()) ASSERT_R1(!assign_skin_jobs());
+
     pigeon_object_pool_for_each(&pigeon_pool_rs, scene_graph_prepass_rs);
-    pigeon_object_pool_for_each(&pigeon_pool_anim, scene_graph_prepass_anim);
+    ASSERT_R1(!prepass_failed);
+
+    // New records don't match any instance so those draw objects are written
+    ASSERT_R1(!pigeon_draw_object_records_resize(&draw_object_records, total_draws, scene_cache_version));
 
     // lights & shadow
 
+    // Shadow casters after the first 4 are lit without shadows (set_per_scene_uniform_data does the same)
+
     unsigned int light_index = 0;
-    for(unsigned int i = 0; i < pigeon_lights.size && light_index < 4; i++) {
+    unsigned int shadow_index = 0;
+    for(unsigned int i = 0; i < pigeon_lights.size; i++) {
         PigeonLight * l = ((PigeonLight**)pigeon_lights.elements)[i];
         if(!l || !l->c.transforms) continue;
 
-        for(unsigned int j = 0; j < l->c.transforms->size && light_index < 4; j++, light_index++) {
+        if(l->type != PIGEON_LIGHT_TYPE_DIRECTIONAL) l->shadow_resolution = 0;
+
+        for(unsigned int j = 0; j < l->c.transforms->size; j++, light_index++) {
             PigeonTransform * t = ((PigeonTransform**)l->c.transforms->elements)[j];
             pigeon_scene_calculate_world_matrix(t);
 
-            if(l->shadow_resolution) {
-                if(l->type == PIGEON_LIGHT_TYPE_DIRECTIONAL) {                
-                    memcpy(shadows[light_index].inv_view_matrix, t->world_transform_cache, 64);
-                    shadows[light_index].resolution = l->shadow_resolution;
-                    shadows[light_index].near_plane = l->shadow_near;
-                    shadows[light_index].far_plane = l->shadow_far;
-                    shadows[light_index].sizeX = l->shadow_size_x;
-                    shadows[light_index].sizeY = l->shadow_size_y;
-                }
-                else {
-                    l->shadow_resolution = 0;
-                }
-            }
-            else {
-                shadows[light_index].resolution = 0;            
+            if(l->shadow_resolution && shadow_index < 4) {
+                PigeonWGIShadowParameters * s = &shadows[shadow_index++];
+                memcpy(s->inv_view_matrix, t->world_transform_cache, 64);
+                s->resolution = l->shadow_resolution;
+                s->near_plane = l->shadow_near;
+                s->far_plane = l->shadow_far;
+                s->sizeX = l->shadow_size_x;
+                s->sizeY = l->shadow_size_y;
             }
         }        
     }
     total_lights = light_index;
+    return 0;
+}
 
-    
+// Returns true if the draw object needs writing
+static bool update_draw_object_record(InstanceRange const* instances, unsigned int k, uint32_t draw_index)
+{
+    PigeonTransform const* t = instances->transforms[k];
+    return pigeon_update_draw_object_record(&draw_object_records, draw_index, t, t->_world_transform_version,
+        instances->mr[k], instances->material_index[k], instances->first_bone_index[k], frame_number,
+        draw_objects_frame);
 }
 
-static void set_object_uniform(PigeonModelMaterial const* model, PigeonMaterialRenderer const* mr,
-    PigeonTransform const* t, uint32_t draw_index)
+// Instance k of the model
+static void set_object_uniform(SceneModel const* model, InstanceRange const* instances, unsigned int k,
+    uint32_t draw_index)
 {
     assert(draw_index < total_draws);
 
+    if(!update_draw_object_record(instances, k, draw_index)) return;
+
+    PigeonTransform const* t = instances->transforms[k];
+
     PigeonWGIDrawObject * data = (PigeonWGIDrawObject*) ((uintptr_t)draw_objects + draw_index * 
         round_up(sizeof(PigeonWGIDrawObject), pigeon_wgi_get_draw_data_alignment()));
 
@@ -177,206 +1261,270 @@ static void set_object_uniform(PigeonModelMaterial const* model, PigeonMaterialR
 
     // ** variables must be written in order
 
-    /* Vertex meta & matrices */
-
-    #define model_matrix t->world_transform_cache
+    // Rows of the model matrix. The view and projection matrices are in the per-frame uniform data
 
-	glm_mat4_mul(scene_uniform_data.proj_view, (vec4*)model_matrix, data->proj_view_model[0]);
-    pigeon_wgi_set_object_shadow_mvp_uniform(data, (vec4*)model_matrix);
-	memcpy(data->model, model_matrix, 64);
-	pigeon_wgi_get_normal_model_matrix(model_matrix, data->normal_model_matrix);
-
-    #undef model_matrix
-    
+    for(unsigned int i = 0; i < 3; i++) {
+        data->model[i][0] = t->world_transform_cache[0][i];
+        data->model[i][1] = t->world_transform_cache[1][i];
+        data->model[i][2] = t->world_transform_cache[2][i];
+        data->model[i][3] = t->world_transform_cache[3][i];
+    }
 
-	memcpy(data->position_min, model->model_asset->mesh_meta.bounds_min, 3 * 4);
-    data->first_bone_index = mr->animation_state ? (float)mr->animation_state->_first_bone_index : -1;
+	memcpy(data->position_min, model->model->model_asset->mesh_meta.bounds_min, 3 * 4);
+    data->first_bone_index = (float)instances->first_bone_index[k];
     
-	memcpy(data->position_range, model->model_asset->mesh_meta.bounds_range, 3 * 4);
-
-	data->ssao_intensity = 1.35f;
-
-
+	memcpy(data->position_range, model->model->model_asset->mesh_meta.bounds_range, 3 * 4);
+    data->material_index = (float)instances->material_index[k];
+}
 
+// not parallelisable
+static void set_material_data(void * mr_)
+{
+    PigeonMaterialRenderer const* mr = mr_;
+    PigeonModelMaterial const* model = mr->model;
 
-	/* Material data */
+    PigeonWGIMaterial data = {0};
 
     if (mr->diffuse_bind_point != UINT32_MAX)
     {
-        data->texture_sampler_index_plus1 = mr->diffuse_bind_point+1;
-        data->texture_index = (float)mr->diffuse_layer;
-    }
-    else
-    {
-        data->texture_sampler_index_plus1 = 0;
-        data->texture_index = 0;
+        data.texture_sampler_index_plus1 = mr->diffuse_bind_point+1;
+        data.texture_index = (float)mr->diffuse_layer;
     }
 
-	data->rsvd0 = 0;
-    data->specular_intensity = mr->specular_intensity * model->model_asset->materials[model->material_index].specular * 10.0f;
+    data.ssao_intensity = 1.35f;
+    data.specular_intensity = mr->specular_intensity * model->model_asset->materials[model->material_index].specular * 10.0f;
 
-    memcpy(data->colour, mr->colour, 3 * 4);
-    data->luminosity = mr->luminosity;
+    memcpy(data.colour, mr->colour, 3 * 4);
+    data.luminosity = mr->luminosity;
 
-    memcpy(data->under_colour, mr->under_colour, 3 * 4);
+    memcpy(data.under_colour, mr->under_colour, 3 * 4);
 
-    data->alpha_channel_usage = mr->use_transparency ?
+    data.alpha_channel_usage = mr->use_transparency ?
         (mr->use_under_colour ? PIGEON_WGI_ALPHA_CHANNEL_TRANSPARENCY : 
             PIGEON_WGI_ALPHA_CHANNEL_UNDER_COLOUR)
         : PIGEON_WGI_ALPHA_CHANNEL_UNUSED;
-    
 
     if (mr->nmap_bind_point != UINT32_MAX)
     {
-        data->normal_map_sampler_index_plus1 = mr->nmap_bind_point+1;
-        data->normal_map_index = (float)mr->nmap_layer;
+        data.normal_map_sampler_index_plus1 = mr->nmap_bind_point+1;
+        data.normal_map_index = (float)mr->nmap_layer;
     }
-    else
-    {
-        data->normal_map_sampler_index_plus1 = 0;
-        data->normal_map_index = 0;
-    }
-
-    data->rsvd1 = 0;
-    data->rsvd2 = 0;
-
-}
-
-
-// static void mat3x4_to_mat4(const float * mat3x4, float * mat4)
-// {
-// 	mat4[0] = mat3x4[0];
-// 	mat4[1] = mat3x4[1];
-// 	mat4[2] = mat3x4[2];
-// 	mat4[3] = 0;
-// 	mat4[4] = mat3x4[3];
-// 	mat4[5] = mat3x4[4];
-// 	mat4[6] = mat3x4[5];
-// 	mat4[7] = 0;
-// 	mat4[8] = mat3x4[6];
-// 	mat4[9] = mat3x4[7];
-// 	mat4[10] = mat3x4[8];
-// 	mat4[11] = 0;
-// 	mat4[12] = mat3x4[9];
-// 	mat4[13] = mat3x4[10];
-// 	mat4[14] = mat3x4[11];
-// 	mat4[15] = 1;
-// }
-
-static void mat4_to_mat3x4(const float * mat4, float * mat3x4)
-{
-	mat3x4[0] = mat4[0];
-	mat3x4[1] = mat4[1];
-	mat3x4[2] = mat4[2];
-	mat3x4[3] = mat4[4];
-	mat3x4[4] = mat4[5];
-	mat3x4[5] = mat4[6];
-	mat3x4[6] = mat4[8];
-	mat3x4[7] = mat4[9];
-	mat3x4[8] = mat4[10];
-	mat3x4[9] = mat4[12];
-	mat3x4[10] = mat4[13];
-	mat3x4[11] = mat4[14];
+
+    pigeon_wgi_set_material(mr->_material_index, &data);
 }
 
-static PIGEON_ERR_RET set_object_bones(uint64_t arg0, void* arg1)
+
+// Bones are evaluated in chunks so that the poses (and decoded compressed frames) fit on the stack
+#define BLEND_BONES_CHUNK 64
+
+static void get_frame_numbers(PigeonWGIAnimationMeta const* animation, double frame,
+    unsigned int * frame0, unsigned int * frame1, float * t)
 {
-    (void)arg0;
-    PigeonAnimationState const* a = arg1;
+    *frame0 = ((unsigned)frame) % animation->frame_count;
+    *frame1 = ((unsigned)ceil(frame)) % animation->frame_count;
+    *t = (float)fmod(frame - floor(frame), 1.0f);
+}
 
-    unsigned int current_bone_index = a->_first_bone_index;
+// Returns false if the animation does not exist
+static bool get_animation_frame_numbers(PigeonAsset const* asset, int animation_index, double start_time,
+    unsigned int * frame0, unsigned int * frame1, float * t)
+{
+    if(!valid_animation_index(asset, animation_index)) return false;
 
-    
-    if(a->animation_index < 0) {
-        for(unsigned int i = 0; i < a->model_asset->bones_count; i++) {
-            assert(current_bone_index < total_bones);
-            PigeonWGIBoneMatrix * bone_matrix = &bone_matrices[current_bone_index++];
-            bone_matrix->mat3x4[0] = 1;
-            bone_matrix->mat3x4[1] = 0;
-            bone_matrix->mat3x4[2] = 0;
-            bone_matrix->mat3x4[3] = 0;
-            bone_matrix->mat3x4[4] = 1;
-            bone_matrix->mat3x4[5] = 0;
-            bone_matrix->mat3x4[6] = 0;
-            bone_matrix->mat3x4[7] = 0;
-            bone_matrix->mat3x4[8] = 1;
-            bone_matrix->mat3x4[9] = 0;
-            bone_matrix->mat3x4[10] = 0;
-            bone_matrix->mat3x4[11] = 0;
+    PigeonWGIAnimationMeta const* animation = &asset->animations[animation_index];
+    get_frame_numbers(animation, (bones_time - start_time) * (double)animation->fps, frame0, frame1, t);
+    return true;
+}
+
+// Bones [first, first + n) of one frame. Compressed animations are decoded into buffer.
+// Returns NULL if the animation data is missing
+static PigeonWGIBoneData const* get_animation_bones(PigeonAsset const* asset, int animation_index,
+    unsigned int frame, unsigned int first, unsigned int n, PigeonWGIBoneData * buffer)
+{
+    PigeonWGIBoneData const* bone_data = pigeon_get_animation_bone_data(asset, (unsigned)animation_index);
+    if(bone_data) return &bone_data[frame * asset->bones_count + first];
+
+    const void * compressed = pigeon_get_compressed_animation(asset, (unsigned)animation_index);
+    if(!compressed) return NULL;
+
+    pigeon_decompress_animation_frame(compressed, frame, first, n, buffer);
+    return buffer;
+}
+
+// Blends the clips of bones [first, first + n) into sum
+static PIGEON_ERR_RET blend_bones_chunk(PigeonAnimationState const* a, unsigned int first, unsigned int n,
+    PigeonWGIBoneData * sum)
+{
+    PigeonWGIBoneData pose[BLEND_BONES_CHUNK];
+    PigeonWGIBoneData buffer0[BLEND_BONES_CHUNK];
+    PigeonWGIBoneData buffer1[BLEND_BONES_CHUNK];
+    float weights[BLEND_BONES_CHUNK];
+
+    memset(sum, 0, n * sizeof *sum);
+    memset(weights, 0, n * sizeof *weights);
+
+    for(unsigned int additive = 0; additive < 2; additive++) {
+        if(additive && a->model_asset->local_animations) {
+            // The identity transform is the T pose in model space only.
+            // Bones that are not fully weighted are blended with the local bind pose instead
+            float remaining[BLEND_BONES_CHUNK];
+            for(unsigned int i = 0; i < n; i++) {
+                remaining[i] = weights[i] < 1 ? 1 - weights[i] : 0;
+            }
+            pigeon_bone_pose_accumulate(sum, weights, &a->model_asset->skeleton.local_bind[first], 1, remaining, n);
         }
-        return 0;
-    }
+        if(additive) pigeon_bone_pose_normalise(sum, weights, n);
 
-    if((unsigned)a->animation_index >= a->model_asset->animations_count) {
-        assert(false);
-        return 1;
-    }
+        for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+            PigeonAnimationClip const* c = &a->clips[i];
+            if(c->animation_index < 0 || c->additive != (bool)additive) continue;
 
-    PigeonWGIAnimationMeta* animation = &a->model_asset->animations[a->animation_index];
+            float w = pigeon_get_animation_clip_weight(c, bones_time);
+            if(!(w > 0)) continue;
 
-    double frame = (pigeon_wgi_get_time_seconds_double() - a->animation_start_time) 
-        * (double)animation->fps;
+            unsigned int frame0_index, frame1_index;
+            float t;
+            ASSERT_R1(get_animation_frame_numbers(a->model_asset, c->animation_index, c->start_time,
+                &frame0_index, &frame1_index, &t));
 
-    unsigned int bones_per_frame = a->model_asset->bones_count;
+            PigeonWGIBoneData const* frame0 = get_animation_bones(a->model_asset, c->animation_index,
+                frame0_index, first, n, buffer0);
+            PigeonWGIBoneData const* frame1 = get_animation_bones(a->model_asset, c->animation_index,
+                frame1_index, first, n, buffer1);
+            ASSERT_R1(frame0 && frame1);
 
-    unsigned int frame0 = ((unsigned)frame) % animation->frame_count;
-    unsigned int frame1 = ((unsigned)ceil(frame)) % animation->frame_count;
-    float frame_interp = (float)fmod(frame - floor(frame), 1.0f);
+            pigeon_bone_pose_interpolate(pose, frame0, frame1, t, n);
 
-    unsigned int subr_i = 0;
-    for(;; subr_i++) {
-        if(!a->model_asset->mesh_meta.attribute_types[subr_i]) break;
+            const float * bone_weights = c->bone_weights ? &c->bone_weights[first] : NULL;
+
+            if(additive) {
+                // The interpolated frames are no longer needed
+                PigeonWGIBoneData const* reference = get_animation_bones(a->model_asset, c->animation_index,
+                    0, first, n, buffer0);
+                pigeon_bone_pose_add(sum, pose, reference, w, bone_weights, n);
+            }
+            else {
+                pigeon_bone_pose_accumulate(sum, weights, pose, w, bone_weights, n);
+            }
+        }
     }
-    if(a->model_asset->mesh_meta.index_count > 0) subr_i++;
-    subr_i += (unsigned) a->animation_index;
 
-    PigeonWGIBoneData const* bone_data = a->model_asset->subresources[subr_i].decompressed_data;
+    return 0;
+}
+
+// Interpolates bones [first, first + n) of the animation (not the clips).
+// Writes matrices if matrices is not NULL, otherwise writes the pose
+static PIGEON_ERR_RET interpolate_bones_chunk(PigeonAnimationState const* a, unsigned int frame0_index,
+    unsigned int frame1_index, float t, unsigned int first, unsigned int n,
+    PigeonWGIBoneMatrix * matrices, PigeonWGIBoneData * pose)
+{
+    PigeonWGIBoneData buffer0[BLEND_BONES_CHUNK];
+    PigeonWGIBoneData buffer1[BLEND_BONES_CHUNK];
 
-    for(unsigned int i = 0; i < a->model_asset->bones_count; i++) {
-        assert(current_bone_index < total_bones);
-        PigeonWGIBoneMatrix * bone_matrix = &bone_matrices[current_bone_index++];
+    PigeonWGIBoneData const* frame0 = get_animation_bones(a->model_asset, a->animation_index,
+        frame0_index, first, n, buffer0);
+    PigeonWGIBoneData const* frame1 = get_animation_bones(a->model_asset, a->animation_index,
+        frame1_index, first, n, buffer1);
+    ASSERT_R1(frame0 && frame1);
 
-        unsigned int animation_bone_index0 = frame0*bones_per_frame+ i;
-        unsigned int animation_bone_index1 = frame1*bones_per_frame+ i;
+    if(matrices) pigeon_bone_palette_interpolate(matrices, frame0, frame1, t, n);
+    else pigeon_bone_pose_interpolate(pose, frame0, frame1, t, n);
+    return 0;
+}
 
-        mat4 m = {0};
+static PIGEON_ERR_RET evaluate_object_bones(PigeonAnimationState const* a, PigeonWGIBoneMatrix * out)
+{
+    PigeonAsset const* asset = a->model_asset;
+    unsigned int bones_count = asset->bones_count;
 
-        float s = mixf(bone_data[animation_bone_index0].scale, bone_data[animation_bone_index1].scale, frame_interp);
-        m[0][0] = s;
-        m[1][1] = s;
-        m[2][2] = s;
-        m[3][3] = 1;
+    const bool clips = has_animation_clips(a);
+    const bool local = asset->local_animations;
 
+    if(!clips && a->animation_index < 0 && !(local && a->modify_pose)) {
+        pigeon_bone_palette_identity(out, bones_count);
+        return 0;
+    }
 
+    unsigned int frame0_index = 0, frame1_index = 0;
+    float t = 0;
+    if(!clips && a->animation_index >= 0) {
+        // a->_frame is set by assign_bone_block
+        ASSERT_R1(valid_animation_index(asset, a->animation_index));
+        get_frame_numbers(&asset->animations[a->animation_index], a->_frame, &frame0_index, &frame1_index, &t);
+    }
 
-        float q0[4] = {bone_data[animation_bone_index0].rotate[1], bone_data[animation_bone_index0].rotate[2],
-            bone_data[animation_bone_index0].rotate[3], bone_data[animation_bone_index0].rotate[0]};
-        float q1[4] = {bone_data[animation_bone_index1].rotate[1], bone_data[animation_bone_index1].rotate[2],
-            bone_data[animation_bone_index1].rotate[3], bone_data[animation_bone_index1].rotate[0]};
+    // Local poses are evaluated for all bones and then concatenated down the hierarchy.
+    // Model space poses are converted to matrices one chunk at a time
+    PigeonWGIBoneData pose[PIGEON_MAX_BONES];
+    assert(bones_count <= PIGEON_MAX_BONES);
 
-        float q[4];
-        glm_quat_slerp(q0, q1, frame_interp, q);
+    for(unsigned int first = 0; first < bones_count; first += BLEND_BONES_CHUNK) {
+        unsigned int n = bones_count - first;
+        if(n > BLEND_BONES_CHUNK) n = BLEND_BONES_CHUNK;
 
-        mat4 this_transform_rotation;
-        glm_quat_mat4(q, this_transform_rotation);
-        glm_mat4_mul(this_transform_rotation, m, m);
+        PigeonWGIBoneData * chunk_pose = local ? &pose[first] : pose;
 
+        if(clips) {
+            ASSERT_R1(!blend_bones_chunk(a, first, n, chunk_pose));
+            if(!local) pigeon_bone_palette_from_pose(&out[first], chunk_pose, n);
+        }
+        else if(a->animation_index >= 0) {
+            ASSERT_R1(!interpolate_bones_chunk(a, frame0_index, frame1_index, t, first, n,
+                local ? NULL : &out[first], chunk_pose));
+        }
+        else {
+            memcpy(chunk_pose, &asset->skeleton.local_bind[first], n * sizeof *chunk_pose);
+        }
+    }
 
-        mat4 this_transform_translate;
-        glm_mat4_identity(this_transform_translate);
-        this_transform_translate[3][0] = mixf(bone_data[animation_bone_index0].translate[0], 
-            bone_data[animation_bone_index1].translate[0], frame_interp);
-        this_transform_translate[3][1] = mixf(bone_data[animation_bone_index0].translate[1], 
-            bone_data[animation_bone_index1].translate[1], frame_interp);
-        this_transform_translate[3][2] = mixf(bone_data[animation_bone_index0].translate[2], 
-            bone_data[animation_bone_index1].translate[2], frame_interp);
-        glm_mat4_mul(this_transform_translate, m, m);
-        
-        mat4_to_mat3x4(&m[0][0], bone_matrix->mat3x4);
+    if(local) {
+        if(a->modify_pose) a->modify_pose(a, pose, a->modify_pose_arg);
+        pigeon_bone_palette_from_local_pose(out, pose, &asset->skeleton);
     }
     return 0;
 }
 
+static PIGEON_ERR_RET set_object_bones(uint64_t arg0, void* arg1)
+{
+    (void)arg0;
+    PigeonAnimationState const* a = arg1;
+
+    unsigned int bones_count = a->model_asset->bones_count;
+    assert(a->_first_bone_index + bones_count <= total_bones);
+    PigeonWGIBoneMatrix * out = &bone_matrices[a->_first_bone_index];
+
+    // Bones that are reused on later frames are evaluated into _previous_bones first
+    // so that they are never read back from the uniform buffer
+    if(a->_update_interval > 1) {
+        if(!a->_reuse_bones) ASSERT_R1(!evaluate_object_bones(a, a->_previous_bones));
+        memcpy(out, a->_previous_bones, bones_count * sizeof *out);
+        return 0;
+    }
+    return evaluate_object_bones(a, out);
+}
+
+static void set_cull_group(PigeonRenderState const* rs, PigeonModelMaterial const* model,
+    unsigned int first_draw_index, unsigned int instances, PigeonWGICullGroup * g)
+{
+    unsigned int lods = get_lods_count(model);
+
+    g->first_draw_object = first_draw_index;
+    g->instances = instances;
+    g->render_state = rs->_cull_render_state;
+    g->first_command = rs->_first_cull_command;
+    g->commands_per_set = PIGEON_WGI_MAX_LODS * rs->_cull_groups;
+    g->vertex_offset = (int32_t)model->model_asset->mesh_meta.multimesh_start_vertex;
+    g->lods = lods;
+    g->rsvd0 = 0;
+
+    for(unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS; lod++) {
+        if(lod < lods) get_lod_range(model, lod, &g->lod_first[lod], &g->lod_count[lod]);
+        else g->lod_first[lod] = g->lod_count[lod] = 0;
+
+        g->lod_screen_sizes[lod] = lod + 1 < lods ? model->model_asset->lod_screen_sizes[lod] : 0;
+    }
+}
+
 static PIGEON_ERR_RET set_uniform_data_per_rs_(uint64_t arg0, void * rs_)
 {
     (void)arg0;
@@ -385,52 +1533,140 @@ static PIGEON_ERR_RET set_uniform_data_per_rs_(uint64_t arg0, void * rs_)
     bool multidraw_supported = pigeon_wgi_multidraw_supported();
 
     if(!rs->_draws) return 0;
-    assert(rs->models && rs->models->size);
-
-
+    assert(rs->_scene_models);
 
     unsigned int draw_index = rs->_start_draw_index;
     unsigned int multidraw_index = rs->_start_multidraw_index;
+    unsigned int visible_multidraw_index = rs->_start_visible_multidraw_index;
+    unsigned int draw_command_index = 0;
+    unsigned int cull_group_index = rs->_first_cull_group;
 
-    for(unsigned int i = 0; i < rs->models->size; i++) {
-        PigeonModelMaterial* model = ((PigeonModelMaterial**)rs->models->elements)[i];
+    SceneModel const* models = get_scene_models(rs);
 
-        if(!model->mr) continue;
+    for(unsigned int i = 0; i < rs->_scene_models; i++) {
+        PigeonModelMaterial* model = models[i].model;
+        InstanceRange model_instances = get_instances(&models[i]);
 
-        unsigned int instances = 0;
-        for(unsigned int j = 0; j < model->mr->size; j++) {
-            PigeonMaterialRenderer* mr = ((PigeonMaterialRenderer**)model->mr->elements)[j];
-            
-            if(mr->c.transforms) {
-                for(unsigned int k = 0; k < mr->c.transforms->size; k++, draw_index++,instances++) {
-                    PigeonTransform* t = ((PigeonTransform**)mr->c.transforms->elements)[k];
-                    set_object_uniform(model, mr, t, draw_index);
+        InstanceOrder order;
+        get_instance_order(&models[i], draw_index, &order);
+
+        float const* bounds_min = models[i].bounds_min;
+        float const* bounds_max = models[i].bounds_max;
+
+        // Instances of a material renderer with the same LOD and visibility have consecutive draw indices
+        //  so they are drawn together. Transparent instances are sorted by depth so are drawn separately
+        DrawCommand * batches[PIGEON_WGI_MAX_LODS][2];
+        PigeonMaterialRenderer const* batches_mr = NULL;
+
+        for(unsigned int k = 0; k < models[i].instances; k++) {
+            PigeonMaterialRenderer* mr = model_instances.mr[k];
+            PigeonTransform* t = model_instances.transforms[k];
+
+            if(mr != batches_mr) {
+                memset(batches, 0, sizeof batches);
+                batches_mr = mr;
+            }
+
+            bool visible;
+            unsigned int lod;
+            InstanceMeshlets const* im;
+            unsigned int object_draw_index = get_next_draw_index(&order, &visible, &lod, &im);
+            set_object_uniform(&models[i], &model_instances, k, object_draw_index);
+
+            if(multidraw_supported) {
+                for(unsigned int m = 0; im && m < im->count; m++) {
+                    PigeonMeshletDraw const* d =
+                        &((PigeonMeshletDraw const*)meshlet_draws.elements)[im->first + m];
+                    pigeon_wgi_multidraw_draw(
+                        visible_multidraw_index++,
+                        model->model_asset->mesh_meta.multimesh_start_vertex,
+                        1,
+                        model->model_asset->mesh_meta.multimesh_start_index + d->first, d->count,
+                        object_draw_index
+                    );
                 }
-            }   
+                continue;
+            }
+
+            uint64_t key = get_sort_key(rs, mr, get_depth(t, bounds_min, bounds_max));
+
+            DrawCommand * c = batches[lod][visible];
+            if(c && c->draw_index + c->instances == object_draw_index) {
+                c->instances++;
+            }
+            else {
+                // Instances that were culled or drawn as meshlets still cast shadows
+                c = set_draw_command(rs, &draw_command_index, key,
+                    DRAW_COMMAND_SHADOW | (visible ? DRAW_COMMAND_CAMERA : 0));
+                c->model = model;
+                c->mr = mr;
+                c->draw_index = object_draw_index;
+                c->instances = 1;
+                get_lod_range(model, lod, &c->first, &c->count);
+
+                if(!rs->pipeline->transparent) batches[lod][visible] = c;
+            }
+
+            for(unsigned int m = 0; im && m < im->count; m++) {
+                PigeonMeshletDraw const* d =
+                    &((PigeonMeshletDraw const*)meshlet_draws.elements)[im->first + m];
+
+                c = set_draw_command(rs, &draw_command_index, key, DRAW_COMMAND_CAMERA);
+                c->model = model;
+                c->mr = mr;
+                c->draw_index = object_draw_index;
+                c->instances = 1;
+                c->first = model->model_asset->mesh_meta.multimesh_start_index + d->first;
+                c->count = d->count;
+            }
+        }
+
+
+        if(rs->_cull_groups && order.instances) {
+            assert(cull_group_index < rs->_first_cull_group + rs->_cull_groups);
+            set_cull_group(rs, model, draw_index, order.instances, &cull_groups[cull_group_index++]);
         }
 
+        if(multidraw_supported && rs->_multidraws) {
+            for(unsigned int lod = 0; lod < PIGEON_WGI_MAX_LODS; lod++) {
+                if(!order.lod_instances[lod]) continue;
+
+                uint32_t first, count;
+                get_lod_range(model, lod, &first, &count);
 
-        if(multidraw_supported && instances) {
-            if(rs->_multidraws) {
                 pigeon_wgi_multidraw_draw(
                     multidraw_index++,
                     model->model_asset->mesh_meta.multimesh_start_vertex,
-                    instances,
-                    model->model_asset->mesh_meta.multimesh_start_index
-                        + model->model_asset->materials[model->material_index].first, 
-                    model->model_asset->materials[model->material_index].count,
-                    draw_index - instances
+                    order.lod_instances[lod],
+                    first, count,
+                    order.lod_first_draw_index[lod]
                 );
+
+                if(culling_enabled() && order.lod_visible_instances[lod]) {
+                    pigeon_wgi_multidraw_draw(
+                        visible_multidraw_index++,
+                        model->model_asset->mesh_meta.multimesh_start_vertex,
+                        order.lod_visible_instances[lod],
+                        first, count,
+                        order.lod_first_draw_index[lod]
+                    );
+                }
             }
         }
+
+        draw_index += order.instances;
+    }
+
+    // Space was allocated for every instance to have its own command. The commands not needed are not drawn
+    while(!multidraw_supported && draw_command_index < rs->_draw_commands) {
+        set_draw_command(rs, &draw_command_index, 0, 0);
     }
 
     return 0;
 }
 
-static void set_per_scene_uniform_data(void)
+static void set_camera_uniform_data(void)
 {
-
 	unsigned int window_width, window_height;
 	pigeon_wgi_get_window_dimensions(&window_width, &window_height);
 
@@ -448,170 +1684,183 @@ static void set_per_scene_uniform_data(void)
 	scene_uniform_data.one_pixel_x = 1.0f / (float)window_width;
 	scene_uniform_data.one_pixel_y = 1.0f / (float)window_height;
 	scene_uniform_data.time = pigeon_wgi_get_time_seconds();
+}
 
+static void set_per_scene_uniform_data(void)
+{
     // lights
 
-    scene_uniform_data.number_of_lights = total_lights;
+    unsigned int max_lights;
+    PigeonWGILight * lights = pigeon_wgi_get_lights(&max_lights);
 
     unsigned int light_index = 0;
-    for(unsigned int i = 0; i < pigeon_lights.size && light_index < 4; i++) {
+    unsigned int shadow_index = 0;
+    for(unsigned int i = 0; i < pigeon_lights.size && light_index < max_lights; i++) {
         PigeonLight * l = ((PigeonLight**)pigeon_lights.elements)[i];
         if(!l || !l->c.transforms) continue;
 
-        for(unsigned int j = 0; j < l->c.transforms->size && light_index < 4; j++, light_index++) {
+        for(unsigned int j = 0; j < l->c.transforms->size && light_index < max_lights; j++, light_index++) {
             PigeonTransform * t = ((PigeonTransform**)l->c.transforms->elements)[j];
-            PigeonWGILight* ldata = &scene_uniform_data.lights[light_index];
+            PigeonWGILight* ldata = &lights[light_index];
                         
-            if(!l->shadow_resolution) {
-                ldata->light_type = l->type == PIGEON_LIGHT_TYPE_POINT ? 1 : 0;
+            ldata->light_type = l->type == PIGEON_LIGHT_TYPE_POINT ? 1 : 0;
 
-                vec4 position = {0, 0, 0, 1};
-                glm_mat4_mulv(t->world_transform_cache, position, position);
-                memcpy(ldata->world_position, position, 3*4); 
+            vec4 position = {0, 0, 0, 1};
+            glm_mat4_mulv(t->world_transform_cache, position, position);
+            memcpy(ldata->world_position, position, 3*4); 
 
-                vec4 dir = {0, 0, 1, 0};
-                glm_mat4_mulv(t->world_transform_cache, dir, dir);
-                memcpy(ldata->neg_direction, dir, 3*4);   
+            vec4 dir = {0, 0, 1, 0};
+            glm_mat4_mulv(t->world_transform_cache, dir, dir);
+            memcpy(ldata->neg_direction, dir, 3*4);   
 
-                ldata->is_shadow_caster = false;         
-            }
-            memcpy(ldata->intensity, l->intensity, 3*4);    
+            // Same shadow assignment as scene_graph_prepass
+            ldata->is_shadow_caster = 0;
+            if(l->shadow_resolution && shadow_index < 4) ldata->is_shadow_caster = (float)++shadow_index;
 
+            memcpy(ldata->intensity, l->intensity, 3*4);    
         }
     }
-    assert(light_index == total_lights);
-
+    scene_uniform_data.number_of_lights = light_index;
 }
 
-typedef enum {
-    NON_MULTI_DRAW_ALL,
-    NON_MULTI_DRAW_OPAQUE,
-    NON_MULTI_DRAW_TRANSPARENT
-} NonMultiDrawType;
-
-typedef struct NonMultiDrawParameters {
-    NonMultiDrawType type;
-    PigeonWGIRenderStage render_stage;
-} NonMultiDrawParameters;
-
-static void non_multi_draw_per_rs(void * rs_, void * arg0)
+// Must be called after set_uniform_data_per_rs_ when multidraw is not supported
+static PIGEON_ERR_RET sort_draw_commands(void)
 {
-    PigeonRenderState const* rs = rs_;
-    NonMultiDrawParameters parameters = *(NonMultiDrawParameters*)arg0;
-
-    if(!rs->_draws) return;
-
-    if(parameters.type == NON_MULTI_DRAW_OPAQUE && rs->pipeline->transparent) return;
-    if(parameters.type == NON_MULTI_DRAW_TRANSPARENT && !rs->pipeline->transparent) return;
-
-    unsigned int draw_index = rs->_start_draw_index;
-
-    for(unsigned int i = 0; i < rs->models->size; i++) {
-        PigeonModelMaterial* model = ((PigeonModelMaterial**)rs->models->elements)[i];
-
-        if(!model->mr) continue;
-
-        for(unsigned int j = 0; j < model->mr->size; j++) {
-            PigeonMaterialRenderer* mr = ((PigeonMaterialRenderer**)model->mr->elements)[j];
-
-            unsigned int bone_index = 0, bone_count = 0;
-
-            if(mr->animation_state) {
-                bone_index = mr->animation_state->_first_bone_index;
-                bone_count = model->model_asset->bones_count;
-            }
-            
-            if(mr->c.transforms) {
-                for(unsigned int k = 0; k < mr->c.transforms->size; k++, draw_index++) {                    
-                    pigeon_wgi_draw(parameters.render_stage, rs->pipeline, rs->mesh,
-                        model->model_asset->mesh_meta.multimesh_start_vertex,
-                        draw_index, 1,
-                        model->model_asset->mesh_meta.multimesh_start_index
-                            + model->model_asset->materials[model->material_index].first,
-                        model->model_asset->materials[model->material_index].count,
-                        (int) mr->diffuse_bind_point, (int) mr->nmap_bind_point,
-                        bone_index, bone_count);
-                }
-            }   
-        }
+    ASSERT_R1(draw_order.size == draw_commands.size);
+
+    draw_order_temp.size = 0;
+    ASSERT_R1(!pigeon_array_list_resize(&draw_order_temp, draw_order.size));
+    ASSERT_R1(!pigeon_radix_sort(draw_order.elements, draw_order_temp.elements, draw_order.size, true));
+
+    // Transparent draws have the top bit of the key set so they are all at the end
+    PigeonSortItem const* order = draw_order.elements;
+    unsigned int low = 0, high = draw_order.size;
+    while(low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if(order[mid].key >> 63) high = mid;
+        else low = mid + 1;
     }
+    first_transparent_draw = low;
+    return 0;
 }
 
-static void multi_draw_per_rs(void * rs_, void * arg0)
+static void multi_draw_rs(PigeonWGIRenderStage stage, unsigned int chunk, PigeonRenderState const* rs)
 {
-    PigeonRenderState const* rs = rs_;
-    NonMultiDrawParameters parameters = *(NonMultiDrawParameters*)arg0;
-
-    if(!rs->_draws) return;
+    if(rs->_cull_groups) {
+        pigeon_wgi_gpu_culled_draw(stage, chunk, rs->pipeline, rs->mesh, rs->_cull_render_state,
+            rs->_first_cull_command, PIGEON_WGI_MAX_LODS * rs->_cull_groups);
+        return;
+    }
 
-    if(parameters.type == NON_MULTI_DRAW_OPAQUE && rs->pipeline->transparent) return;
-    if(parameters.type == NON_MULTI_DRAW_TRANSPARENT && !rs->pipeline->transparent) return;
+    bool cull = stage_is_culled(stage);
 
     if(rs->_multidraws == 0) {
-        if(rs->count) {
-            pigeon_wgi_draw(parameters.render_stage, rs->pipeline, rs->mesh, 
-                rs->start_vertex, rs->_start_draw_index, rs->instances, rs->first, rs->count, -1, -1, 0, 0);
+        uint32_t instances = cull ? rs->visible_instances : rs->instances;
+        if(rs->count && instances) {
+            pigeon_wgi_draw(stage, chunk, rs->pipeline, rs->mesh, 
+                rs->start_vertex, rs->_start_draw_index, instances, rs->first, rs->count, -1, -1, 0, 0, 0);
         }
     }
-    else {
+    else if(!cull) {
         pigeon_wgi_multidraw_submit(
-            parameters.render_stage,
+            stage,
+            chunk,
             rs->pipeline,
             rs->mesh,
             rs->_start_multidraw_index,
             rs->_multidraws
         );
     }
+    else if(rs->_visible_multidraws) {
+        pigeon_wgi_multidraw_submit(
+            stage,
+            chunk,
+            rs->pipeline,
+            rs->mesh,
+            rs->_start_visible_multidraw_index,
+            rs->_visible_multidraws
+        );
+    }
 }
 
-static PIGEON_ERR_RET render_frame(uint64_t arg0, void* arg1)
+// Records draw_order[start] to draw_order[end-1]
+static void record_draws(PigeonWGIRenderStage stage, unsigned int chunk, unsigned int start, unsigned int end)
 {
-    PigeonWGIRenderStage render_stage = (PigeonWGIRenderStage) arg0;
-    PigeonWGIPipeline * skybox_pipeline = arg1;
-
-	ASSERT_R1(!pigeon_wgi_start_record(render_stage));
-
-    if(pigeon_wgi_multidraw_supported()) {
-        NonMultiDrawParameters parameters = {0};
-        parameters.render_stage = render_stage;
+    bool multidraw_supported = pigeon_wgi_multidraw_supported();
+    uint8_t stage_flag = stage >= PIGEON_WGI_RENDER_STAGE_SHADOW0 && stage <= PIGEON_WGI_RENDER_STAGE_SHADOW3 ?
+        DRAW_COMMAND_SHADOW : DRAW_COMMAND_CAMERA;
 
-        if(!skybox_pipeline) {
-            parameters.type = NON_MULTI_DRAW_ALL;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, multi_draw_per_rs, &parameters);
-        }
-        else {
-            parameters.type = NON_MULTI_DRAW_OPAQUE;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, multi_draw_per_rs, &parameters);
+    PigeonSortItem const* order = draw_order.elements;
+    DrawCommand const* commands = draw_commands.elements;
 
-            pigeon_wgi_draw_without_mesh(render_stage, skybox_pipeline, 3);
+    for(unsigned int i = start; i < end; i++) {
+        DrawCommand const* c = &commands[order[i].value];
+        if(!(c->stages & stage_flag)) continue;
 
-            parameters.type = NON_MULTI_DRAW_TRANSPARENT;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, multi_draw_per_rs, &parameters);
+        if(multidraw_supported) {
+            multi_draw_rs(stage, chunk, c->rs);
+            continue;
         }
-    }
-    else {
-        NonMultiDrawParameters parameters = {0};
-        parameters.render_stage = render_stage;
 
-        if(!skybox_pipeline) {
-            parameters.type = NON_MULTI_DRAW_ALL;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, non_multi_draw_per_rs, &parameters);
+        unsigned int bone_index = 0, bone_count = 0;
+        if(c->mr->animation_state) {
+            bone_index = c->mr->animation_state->_first_bone_index;
+            bone_count = c->model->model_asset->bones_count;
         }
-        else {
-            parameters.type = NON_MULTI_DRAW_OPAQUE;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, non_multi_draw_per_rs, &parameters);
 
-            pigeon_wgi_draw_without_mesh(render_stage, skybox_pipeline, 3);
+        pigeon_wgi_draw(stage, chunk, c->rs->pipeline, c->rs->mesh,
+            c->model->model_asset->mesh_meta.multimesh_start_vertex,
+            c->draw_index, c->instances, c->first, c->count,
+            (int) c->mr->diffuse_bind_point, (int) c->mr->nmap_bind_point, c->mr->_material_index,
+            bone_index, bone_count);
+    }
+}
 
-            parameters.type = NON_MULTI_DRAW_TRANSPARENT;
-            pigeon_object_pool_for_each2(&pigeon_pool_rs, non_multi_draw_per_rs, &parameters);
-        }
+// Records draw_order[start] to draw_order[end-1]
+// The skybox (if not NULL) is drawn after the opaque draws, by the chunk that has the first transparent draw
+static void record_draws_and_skybox(PigeonWGIRenderStage stage, unsigned int chunk,
+    unsigned int start, unsigned int end, PigeonWGIPipeline * skybox_pipeline)
+{
+    if(skybox_pipeline && first_transparent_draw >= start &&
+        (first_transparent_draw < end || end == draw_order.size))
+    {
+        record_draws(stage, chunk, start, first_transparent_draw);
+        pigeon_wgi_draw_without_mesh(stage, chunk, skybox_pipeline, 3);
+        record_draws(stage, chunk, first_transparent_draw, end);
+    }
+    else {
+        record_draws(stage, chunk, start, end);
     }
+}
+
+static PIGEON_ERR_RET render_frame(uint64_t arg0, void* arg1)
+{
+    PigeonWGIRenderStage render_stage = (PigeonWGIRenderStage) arg0;
+    PigeonWGIPipeline * skybox_pipeline = arg1;
 
+	ASSERT_R1(!pigeon_wgi_start_record(render_stage));
+    record_draws_and_skybox(render_stage, 0, 0, draw_order.size, skybox_pipeline);
 	ASSERT_R1(!pigeon_wgi_end_record(render_stage));
 	return 0;
 }
 
+// Each chunk of a stage records a contiguous range of the draw list so the chunks are executed in draw order.
+// arg0 is the render stage and the chunk index << 32
+static PIGEON_ERR_RET render_chunk(uint64_t arg0, void* arg1)
+{
+    PigeonWGIRenderStage render_stage = (PigeonWGIRenderStage) (arg0 & 0xffffffff);
+    unsigned int chunk = (unsigned int) (arg0 >> 32);
+    PigeonWGIPipeline * skybox_pipeline = arg1;
+
+    unsigned int start = (unsigned int) ((uint64_t)draw_order.size * chunk / record_chunks);
+    unsigned int end = (unsigned int) ((uint64_t)draw_order.size * (chunk + 1) / record_chunks);
+
+    ASSERT_R1(!pigeon_wgi_start_record_chunk(render_stage, chunk));
+    record_draws_and_skybox(render_stage, chunk, start, end, skybox_pipeline);
+    ASSERT_R1(!pigeon_wgi_end_record_chunk(render_stage, chunk));
+    return 0;
+}
+
 
 static unsigned int create_draw_data_job__index;
 static void create_draw_data_job_(void* e)
@@ -628,6 +1877,7 @@ static unsigned int set_bone_matrices__index;
 static void set_bone_matrices_(void* e)
 {
     PigeonAnimationState* a = e;
+    if(a->_shared_pose) return;
 
     unsigned int i = set_bone_matrices__index++;
     assert(i < job_array_list.size);
@@ -667,16 +1917,29 @@ PIGEON_ERR_RET pigeon_prepare_draw_frame(PigeonTransform * camera_)
     camera = camera_;
     memset(shadows, 0, sizeof shadows);
 
-    // Get minimum size of uniform data
-    scene_graph_prepass();
-
     pigeon_scene_calculate_world_matrix(camera);
+    set_camera_uniform_data();
+
+    // Get minimum size of uniform data
+    ASSERT_R1(!scene_graph_prepass());
 
 
     // Create uniform buffers, get pointers
+    // The GPU culling compute shader writes up to 2 more copies of each draw object
+
+    if(total_cull_groups)
+        pigeon_wgi_set_gpu_culling_sizes(total_draws, total_cull_groups, total_cull_render_states);
+    if(skin_jobs.size)
+        ASSERT_R1(!pigeon_wgi_set_compute_skinning_sizes(skin_jobs.size, total_skin_vertices, skin_meshes.size));
+
+    ASSERT_R1(!pigeon_wgi_start_frame(total_cull_groups ? total_draws * 3 : total_draws, total_multidraw_draws,
+        total_materials, total_lights, shadows, total_bones, &draw_objects, &bone_matrices));
 
-    ASSERT_R1(!pigeon_wgi_start_frame(total_draws, total_multidraw_draws, shadows, total_bones,
-        &draw_objects, &bone_matrices));
+    // The skinning work is recorded into the upload stage
+    if(skin_jobs.size) ASSERT_R1(!write_skin_jobs());
+
+    frame_number = pigeon_wgi_get_frame_number();
+    draw_objects_frame = pigeon_wgi_get_draw_objects_frame();
     return 0;
 }
 
@@ -684,6 +1947,11 @@ PIGEON_ERR_RET pigeon_draw_frame(PigeonWGIPipeline* skybox_pipeline)
 {
     set_per_scene_uniform_data();
 
+    // Materials are few and usually unchanged (only written by the WGI if they have changed)
+    pigeon_object_pool_for_each(&pigeon_pool_mr, set_material_data);
+
+    cull_groups = total_cull_groups ? pigeon_wgi_get_cull_groups() : NULL;
+
     // Render
 
     if(pigeon_wgi_multithreading_supported()) {
@@ -695,14 +1963,36 @@ PIGEON_ERR_RET pigeon_draw_frame(PigeonWGIPipeline* skybox_pipeline)
         bool ssao_record = pigeon_wgi_ssao_record_needed();
         bool post_bloom = pigeon_wgi_bloom_record_needed();
 
+        // The uniform data jobs run at the same time as recording so the draw list must already be complete.
+        // It is only written by set_uniform_data_per_rs_ when multidraw is not supported
+        ASSERT_R1(pigeon_wgi_multidraw_supported());
+        ASSERT_R1(!sort_draw_commands());
+
+        record_chunks = (draw_order.size + RECORD_CHUNK_MIN_DRAWS - 1) / RECORD_CHUNK_MIN_DRAWS;
+        if(record_chunks < 1) record_chunks = 1;
+        if(record_chunks > PIGEON_WGI_MAX_RECORD_CHUNKS) record_chunks = PIGEON_WGI_MAX_RECORD_CHUNKS;
+
+        PigeonWGIRenderStage draw_stages[6];
+        unsigned int draw_stages_count = 0;
+        for(unsigned int j = 0; j < 4; j++) {
+            if(shadows[j].resolution) draw_stages[draw_stages_count++] = PIGEON_WGI_RENDER_STAGE_SHADOW0 + j;
+        }
+        draw_stages[draw_stages_count++] = PIGEON_WGI_RENDER_STAGE_DEPTH;
+        draw_stages[draw_stages_count++] = PIGEON_WGI_RENDER_STAGE_RENDER;
+
+        // The render passes are begun here. Each chunk is then recorded by a job
+        if(record_chunks > 1) {
+            for(unsigned int j = 0; j < draw_stages_count; j++) {
+                ASSERT_R1(!pigeon_wgi_start_record_chunks(draw_stages[j], record_chunks));
+            }
+        }
+
         job_array_list.size = 0;
         ASSERT_R1(!pigeon_array_list_resize(&job_array_list,
-            pigeon_pool_anim.allocated_obj_count + 
+            bone_jobs +
             pigeon_pool_rs.allocated_obj_count +
-            1 + // depth
+            draw_stages_count * record_chunks + // shadows, depth & hdr render
             (ssao_record ? 1 : 0) +
-            shadow_lights_count +
-            1 + // hdr render
             (post_bloom ? 1 : 0) +
             1 // post-processing & gui
         ));
@@ -713,28 +2003,22 @@ PIGEON_ERR_RET pigeon_draw_frame(PigeonWGIPipeline* skybox_pipeline)
         // Fill uniform buffers
         ASSERT_R1(!pigeon_uniform_data_jobs());
 
-        unsigned int i = pigeon_pool_anim.allocated_obj_count + pigeon_pool_rs.allocated_obj_count;
-        
+        unsigned int i = bone_jobs + pigeon_pool_rs.allocated_obj_count;
         
-        for(unsigned int j = 0; j < 4; j++) {
-            if(!shadows[j].resolution) continue;
-
-            jobs[i].function = render_frame;
-            jobs[i++].arg0 = PIGEON_WGI_RENDER_STAGE_SHADOW0 + j;
+        for(unsigned int j = 0; j < draw_stages_count; j++) {
+            for(unsigned int chunk = 0; chunk < record_chunks; chunk++) {
+                jobs[i].function = record_chunks > 1 ? render_chunk : render_frame;
+                jobs[i].arg0 = draw_stages[j] | ((uint64_t)chunk << 32);
+                if(draw_stages[j] == PIGEON_WGI_RENDER_STAGE_RENDER) jobs[i].arg1 = skybox_pipeline;
+                i++;
+            }
         }
-        
-        jobs[i].function = render_frame;
-        jobs[i++].arg0 = PIGEON_WGI_RENDER_STAGE_DEPTH;
 
         if(ssao_record) {
             jobs[i].function = job_call_function;
             jobs[i++].arg1 = pigeon_wgi_record_ssao;
         }
 
-        jobs[i].function = render_frame;
-        jobs[i].arg0 = PIGEON_WGI_RENDER_STAGE_RENDER;
-        jobs[i++].arg1 = skybox_pipeline;
-
         if(post_bloom) {
             jobs[i].function = job_call_function;
             jobs[i++].arg1 = pigeon_wgi_record_bloom;
@@ -744,12 +2028,19 @@ PIGEON_ERR_RET pigeon_draw_frame(PigeonWGIPipeline* skybox_pipeline)
 
         ASSERT_R1(!pigeon_dispatch_jobs(jobs, job_array_list.size));
 
+        // Executes the secondary command buffers and ends the render passes
+        if(record_chunks > 1) {
+            for(unsigned int j = 0; j < draw_stages_count; j++) {
+                ASSERT_R1(!pigeon_wgi_end_record(draw_stages[j]));
+            }
+        }
+
         ASSERT_R1(!pigeon_wgi_set_uniform_data(&scene_uniform_data));
     }
     else {
         job_array_list.size = 0;
         ASSERT_R1(!pigeon_array_list_resize(&job_array_list,
-            pigeon_pool_anim.allocated_obj_count + 
+            bone_jobs +
             pigeon_pool_rs.allocated_obj_count
         ));
         pigeon_array_list_zero(&job_array_list);
@@ -760,6 +2051,7 @@ PIGEON_ERR_RET pigeon_draw_frame(PigeonWGIPipeline* skybox_pipeline)
         ASSERT_R1(!pigeon_uniform_data_jobs());
 
         ASSERT_R1(!pigeon_dispatch_jobs(jobs, job_array_list.size));
+        ASSERT_R1(!sort_draw_commands());
         
 
         // Copy data
@@ -0,0 +1,55 @@
+#include <pigeon/scene/draw_object_record.h>
+#include <pigeon/assert.h>
+#include <assert.h>
+#include <string.h>
+
+void pigeon_create_draw_object_records(PigeonDrawObjectRecords* r)
+{
+	memset(r, 0, sizeof *r);
+	pigeon_create_array_list(&r->records, sizeof(PigeonDrawObjectRecord));
+}
+
+void pigeon_destroy_draw_object_records(PigeonDrawObjectRecords* r)
+{
+	pigeon_destroy_array_list(&r->records);
+	r->topology_version = 0;
+}
+
+PIGEON_ERR_RET pigeon_draw_object_records_resize(
+	PigeonDrawObjectRecords* r, unsigned int draws, uint64_t topology_version)
+{
+	unsigned int old_records = r->records.size;
+	if (r->topology_version != topology_version) {
+		old_records = 0;
+		r->topology_version = topology_version;
+	}
+
+	if (draws > r->records.size)
+		ASSERT_R1(!pigeon_array_list_resize(&r->records, draws));
+
+	if (r->records.size > old_records) {
+		memset((PigeonDrawObjectRecord*)r->records.elements + old_records, 0,
+			(r->records.size - old_records) * sizeof(PigeonDrawObjectRecord));
+	}
+	return 0;
+}
+
+bool pigeon_update_draw_object_record(PigeonDrawObjectRecords* records, unsigned int draw_index,
+	struct PigeonTransform const* transform, uint32_t world_transform_version, struct PigeonMaterialRenderer const* mr,
+	uint32_t material_index, int first_bone_index, uint64_t frame, uint64_t written_frame)
+{
+	assert(draw_index < records->records.size);
+	PigeonDrawObjectRecord* r = &((PigeonDrawObjectRecord*)records->records.elements)[draw_index];
+
+	if (r->transform != transform || r->mr != mr || r->world_transform_version != world_transform_version
+		|| r->material_index != material_index || r->first_bone_index != first_bone_index) {
+		r->transform = transform;
+		r->mr = mr;
+		r->world_transform_version = world_transform_version;
+		r->material_index = material_index;
+		r->first_bone_index = first_bone_index;
+		r->changed_frame = frame;
+	}
+
+	return r->changed_frame > written_frame;
+}
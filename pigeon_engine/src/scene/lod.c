@@ -0,0 +1,16 @@
+#include <pigeon/scene/lod.h>
+
+unsigned int pigeon_select_lod(
+	const float* lod_screen_sizes, unsigned int lods_count, unsigned int previous_lod, float screen_size)
+{
+	unsigned int lod = 0;
+
+	while (lod + 1 < lods_count) {
+		float hysteresis = lod < previous_lod ? PIGEON_LOD_HYSTERESIS : -PIGEON_LOD_HYSTERESIS;
+		float threshold = lod_screen_sizes[lod] * (1.0f + hysteresis);
+		if (screen_size >= threshold)
+			break;
+		lod++;
+	}
+	return lod;
+}
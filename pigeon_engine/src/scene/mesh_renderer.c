@@ -4,6 +4,7 @@
 #include <pigeon/assert.h>
 #include <pigeon/asset.h>
 #include <pigeon/misc.h>
+#include <stdlib.h>
 #include <string.h>
 #include "scene.h"
 
@@ -22,8 +23,14 @@ void pigeon_init_mesh_renderer_pool(void)
 }
 
 
+static void free_previous_bones(void * a)
+{
+    free(((PigeonAnimationState *) a)->_previous_bones);
+}
+
 void pigeon_deinit_mesh_renderer_pool(void)
 {
+    pigeon_object_pool_for_each(&pigeon_pool_anim, free_previous_bones);
     pigeon_destroy_object_pool(&pigeon_pool_rs);
     pigeon_destroy_object_pool(&pigeon_pool_model);
     pigeon_destroy_object_pool(&pigeon_pool_mr);
@@ -37,6 +44,7 @@ PigeonRenderState* pigeon_create_render_state(struct PigeonWGIMultiMesh * mesh,
     ASSERT_R0(rs);
     rs->mesh = mesh;
     rs->pipeline = pipeline;
+    pigeon_scene_topology_version++;
     return rs;
 }
 
@@ -66,6 +74,7 @@ void pigeon_destroy_render_state(PigeonRenderState * rs)
     CLEAR_PTR_LIST2(rs, mr, PigeonMaterialRenderer, render_state);    
 
     pigeon_object_pool_free(&pigeon_pool_rs, rs);
+    pigeon_scene_topology_version++;
 }
 
 
@@ -76,6 +85,7 @@ PigeonModelMaterial* pigeon_create_model_renderer(struct PigeonAsset * model_ass
     ASSERT_R0(model);
     model->model_asset = model_asset;
     model->material_index = material_index;
+    pigeon_scene_topology_version++;
     return model;
 }
 
@@ -86,6 +96,7 @@ void pigeon_destroy_model_renderer(PigeonModelMaterial * model)
     CLEAR_PTR_LIST(model, rs, PigeonRenderState, models);
 
     pigeon_object_pool_free(&pigeon_pool_model, model);
+    pigeon_scene_topology_version++;
 }
 
 
@@ -109,6 +120,7 @@ PigeonMaterialRenderer* pigeon_create_material_renderer(PigeonModelMaterial* mod
     mr->colour[0] = mr->colour[1] = mr->colour[2] = 0.8f;
     mr->specular_intensity = 1;
 
+    pigeon_scene_topology_version++;
     return mr;
 }
 
@@ -133,6 +145,7 @@ void pigeon_destroy_material_renderer(PigeonMaterialRenderer * mr)
     
     pigeon_destroy_component(&mr->c);
     pigeon_object_pool_free(&pigeon_pool_mr, mr);
+    pigeon_scene_topology_version++;
 }
 
 
@@ -143,15 +156,21 @@ PigeonAnimationState* pigeon_create_animation_state(PigeonAsset* model_asset)
 
     a->animation_index = -1;
     a->model_asset = model_asset;
+    for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+        a->clips[i].animation_index = -1;
+    }
 
+    pigeon_scene_topology_version++;
     return a;
 }
 
 void pigeon_destroy_animation_state(PigeonAnimationState * a)
 {
     CLEAR_PTR_LIST2(a, mr, PigeonMaterialRenderer, animation_state);
+    free(a->_previous_bones);
     
     pigeon_object_pool_free(&pigeon_pool_anim, a);
+    pigeon_scene_topology_version++;
 }
 
 PIGEON_ERR_RET pigeon_join_rs_model(PigeonRenderState* rs, PigeonModelMaterial* model)
@@ -165,6 +184,7 @@ PIGEON_ERR_RET pigeon_join_rs_model(PigeonRenderState* rs, PigeonModelMaterial*
         remove_from_ptr_list(&rs->models, model);
         return 1;
     }
+    pigeon_scene_topology_version++;
     return 0;
 }
 
@@ -174,6 +194,7 @@ void pigeon_unjoin_rs_model(PigeonRenderState* rs, PigeonModelMaterial* model)
 
     remove_from_ptr_list(&rs->models, model);
     remove_from_ptr_list(&model->rs, rs);
+    pigeon_scene_topology_version++;
 }
 
 
@@ -184,6 +205,7 @@ PIGEON_ERR_RET pigeon_join_mr_anim(PigeonMaterialRenderer* mr, PigeonAnimationSt
 
     ASSERT_R1(!add_to_ptr_list(&a->mr, mr));
     mr->animation_state = a;
+    pigeon_scene_topology_version++;
     return 0;
 
 }
@@ -194,6 +216,95 @@ void pigeon_unjoin_mr_anim(PigeonMaterialRenderer* mr, PigeonAnimationState* a)
 
     remove_from_ptr_list(&a->mr, mr);
     mr->animation_state = NULL;
+    pigeon_scene_topology_version++;
+}
+
+
+int pigeon_add_animation_clip(PigeonAnimationState* a, unsigned int animation_index, float weight, double start_time)
+{
+    assert(a);
+    ASSERT_LOG_R(animation_index < a->model_asset->animations_count, "Invalid animation index", -1);
+
+    for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+        PigeonAnimationClip * c = &a->clips[i];
+        if(c->animation_index >= 0) continue;
+
+        memset(c, 0, sizeof *c);
+        c->animation_index = (int)animation_index;
+        c->start_time = start_time;
+        c->weight = weight;
+        return (int)i;
+    }
+    return -1;
+}
+
+void pigeon_remove_animation_clip(PigeonAnimationState* a, unsigned int clip)
+{
+    assert(a && clip < PIGEON_MAX_ANIMATION_CLIPS);
+    a->clips[clip].animation_index = -1;
+}
+
+float pigeon_get_animation_clip_weight(PigeonAnimationClip const* c, double time)
+{
+    if(c->_fade_duration <= 0 || time >= c->_fade_start_time + c->_fade_duration) return c->weight;
+    if(time <= c->_fade_start_time) return c->_fade_start_weight;
+    return mixf(c->_fade_start_weight, c->weight, (float)((time - c->_fade_start_time) / c->_fade_duration));
+}
+
+void pigeon_fade_animation_clip(PigeonAnimationState* a, unsigned int clip, float weight, double time,
+    double duration)
+{
+    assert(a && clip < PIGEON_MAX_ANIMATION_CLIPS && a->clips[clip].animation_index >= 0);
+    PigeonAnimationClip * c = &a->clips[clip];
+
+    c->_fade_start_weight = pigeon_get_animation_clip_weight(c, time);
+    c->_fade_start_time = time;
+    c->_fade_duration = duration > 0 ? duration : 0;
+    c->weight = weight;
+
+    if(!c->_fade_duration && weight <= 0) c->animation_index = -1;
+}
+
+int pigeon_cross_fade_animation(PigeonAnimationState* a, unsigned int animation_index, double time, double duration)
+{
+    assert(a);
+
+    int lowest_clip = -1;
+    float lowest_weight = 0;
+
+    for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+        PigeonAnimationClip * c = &a->clips[i];
+        if(c->animation_index < 0 || c->additive) continue;
+
+        float w = pigeon_get_animation_clip_weight(c, time);
+        if(lowest_clip < 0 || w < lowest_weight) {
+            lowest_clip = (int)i;
+            lowest_weight = w;
+        }
+        pigeon_fade_animation_clip(a, i, 0, time, duration);
+    }
+
+    int clip = pigeon_add_animation_clip(a, animation_index, 1, time);
+    if(clip < 0 && lowest_clip >= 0) {
+        pigeon_remove_animation_clip(a, (unsigned)lowest_clip);
+        clip = pigeon_add_animation_clip(a, animation_index, 1, time);
+    }
+    if(clip < 0) return -1;
+
+    a->clips[clip]._fade_start_weight = 0;
+    a->clips[clip]._fade_start_time = time;
+    a->clips[clip]._fade_duration = duration > 0 ? duration : 0;
+    return clip;
+}
+
+void pigeon_remove_faded_animation_clips(PigeonAnimationState* a, double time)
+{
+    for(unsigned int i = 0; i < PIGEON_MAX_ANIMATION_CLIPS; i++) {
+        PigeonAnimationClip * c = &a->clips[i];
+        if(c->animation_index >= 0 && c->weight <= 0 && time >= c->_fade_start_time + c->_fade_duration) {
+            c->animation_index = -1;
+        }
+    }
 }
 
 
@@ -0,0 +1,686 @@
+#include <pigeon/assert.h>
+#include <pigeon/asset.h>
+#include <pigeon/job_system/job.h>
+#include <pigeon/misc.h>
+#include <pigeon/scene/occlusion.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HIZ_SSE
+#endif
+
+// Screen-space triangle, ready to be rasterised
+typedef struct Triangle {
+	// Edge functions: w = a*x + (b*y + c), evaluated at pixel centres
+	float edge_a[3];
+	float edge_b[3];
+	float edge_c[3];
+
+	float z[3];
+	float inv_area;
+
+	// Pixel bounds (inclusive), clipped to the screen
+	unsigned int min_x, min_y, max_x, max_y;
+} Triangle;
+
+PIGEON_ERR_RET pigeon_create_hiz(PigeonHiZ* hiz, unsigned int width, unsigned int height)
+{
+	ASSERT_R1(hiz && width && height);
+
+	memset(hiz, 0, sizeof *hiz);
+	hiz->width = width;
+	hiz->height = height;
+
+#define CLEANUP() pigeon_destroy_hiz(hiz);
+
+	unsigned int total_size = 0;
+	unsigned int w = width, h = height;
+
+	while (hiz->levels < PIGEON_HIZ_MAX_LEVELS) {
+		hiz->level_width[hiz->levels] = w;
+		hiz->level_height[hiz->levels] = h;
+		hiz->level_offset[hiz->levels] = total_size;
+		hiz->levels++;
+		total_size += w * h;
+
+		if (w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+
+	hiz->data = calloc(total_size, sizeof *hiz->data);
+	ASSERT_R1(hiz->data);
+
+	hiz->tiles_x = (width + PIGEON_HIZ_TILE_SIZE - 1) / PIGEON_HIZ_TILE_SIZE;
+	hiz->tiles_y = (height + PIGEON_HIZ_TILE_SIZE - 1) / PIGEON_HIZ_TILE_SIZE;
+
+	hiz->tile_bins = calloc(hiz->tiles_x * hiz->tiles_y, sizeof *hiz->tile_bins);
+	ASSERT_R1(hiz->tile_bins);
+
+	for (unsigned int i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+		pigeon_create_array_list(&hiz->tile_bins[i], sizeof(uint32_t));
+	}
+	pigeon_create_array_list(&hiz->triangles, sizeof(Triangle));
+	pigeon_create_array_list(&hiz->jobs, sizeof(PigeonJob));
+
+#undef CLEANUP
+
+	return 0;
+}
+
+void pigeon_destroy_hiz(PigeonHiZ* hiz)
+{
+	assert(hiz);
+
+	if (hiz->tile_bins) {
+		for (unsigned int i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+			pigeon_destroy_array_list(&hiz->tile_bins[i]);
+		}
+		free(hiz->tile_bins);
+		hiz->tile_bins = NULL;
+	}
+	if (hiz->triangles.element_size)
+		pigeon_destroy_array_list(&hiz->triangles);
+	if (hiz->jobs.element_size)
+		pigeon_destroy_array_list(&hiz->jobs);
+	free_if(hiz->data);
+}
+
+void pigeon_hiz_clear(PigeonHiZ* hiz, mat4 proj_view)
+{
+	assert(hiz && hiz->data);
+
+	memcpy(hiz->proj_view, proj_view, sizeof hiz->proj_view);
+	memset(hiz->data, 0, hiz->width * hiz->height * sizeof *hiz->data);
+
+	hiz->triangles.size = 0;
+	for (unsigned int i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+		hiz->tile_bins[i].size = 0;
+	}
+}
+
+static void matrix_multiply(mat4 a, mat4 b, mat4 out)
+{
+	for (unsigned int c = 0; c < 4; c++) {
+		for (unsigned int r = 0; r < 4; r++) {
+			out[c][r] = a[0][r] * b[c][0] + a[1][r] * b[c][1] + a[2][r] * b[c][2] + a[3][r] * b[c][3];
+		}
+	}
+}
+
+// x,y are in level 0 pixels, z is depth.
+// Returns false if the point is behind the camera or in front of the near plane
+static bool project_point(PigeonHiZ const* hiz, mat4 mvp, const float p[3], float out[3])
+{
+	float clip[4];
+	for (unsigned int r = 0; r < 4; r++) {
+		clip[r] = mvp[0][r] * p[0] + mvp[1][r] * p[1] + mvp[2][r] * p[2] + mvp[3][r];
+	}
+
+	if (clip[3] <= 1e-6f || clip[2] > clip[3])
+		return false;
+
+	float inv_w = 1.0f / clip[3];
+	out[0] = (clip[0] * inv_w * 0.5f + 0.5f) * (float)hiz->width;
+	out[1] = (clip[1] * inv_w * 0.5f + 0.5f) * (float)hiz->height;
+	out[2] = clip[2] * inv_w;
+	if (out[2] < 0)
+		out[2] = 0;
+	return true;
+}
+
+// Returns false if the triangle is degenerate or off-screen
+static bool setup_triangle(PigeonHiZ const* hiz, const float* v0, const float* v1, const float* v2, Triangle* t)
+{
+	float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+	if (fabsf(area) < 1e-12f)
+		return false;
+
+	// Occluders are double-sided
+	if (area < 0) {
+		const float* tmp = v1;
+		v1 = v2;
+		v2 = tmp;
+		area = -area;
+	}
+
+	float min_x = fminf(v0[0], fminf(v1[0], v2[0]));
+	float max_x = fmaxf(v0[0], fmaxf(v1[0], v2[0]));
+	float min_y = fminf(v0[1], fminf(v1[1], v2[1]));
+	float max_y = fmaxf(v0[1], fmaxf(v1[1], v2[1]));
+
+	if (max_x < 0 || max_y < 0 || min_x >= (float)hiz->width || min_y >= (float)hiz->height)
+		return false;
+
+	t->min_x = min_x <= 0 ? 0 : (unsigned int)min_x;
+	t->min_y = min_y <= 0 ? 0 : (unsigned int)min_y;
+	t->max_x = max_x >= (float)(hiz->width - 1) ? hiz->width - 1 : (unsigned int)max_x;
+	t->max_y = max_y >= (float)(hiz->height - 1) ? hiz->height - 1 : (unsigned int)max_y;
+
+	// Edge i is opposite vertex i
+	const float* edge_start[3] = { v1, v2, v0 };
+	const float* edge_end[3] = { v2, v0, v1 };
+
+	for (unsigned int i = 0; i < 3; i++) {
+		const float* a = edge_start[i];
+		const float* b = edge_end[i];
+		t->edge_a[i] = a[1] - b[1];
+		t->edge_b[i] = b[0] - a[0];
+		t->edge_c[i] = (b[1] - a[1]) * a[0] - (b[0] - a[0]) * a[1];
+	}
+
+	t->z[0] = v0[2];
+	t->z[1] = v1[2];
+	t->z[2] = v2[2];
+	t->inv_area = 1.0f / area;
+	return true;
+}
+
+PIGEON_ERR_RET pigeon_hiz_rasterise(PigeonHiZ* hiz, mat4 model, const float* positions, unsigned int vertex_count,
+	const uint32_t* indices, unsigned int index_count)
+{
+	ASSERT_R1(hiz && hiz->data && positions);
+
+	mat4 mvp;
+	matrix_multiply(hiz->proj_view, model, mvp);
+
+	if (!indices)
+		index_count = vertex_count;
+
+	for (unsigned int i = 0; i + 2 < index_count; i += 3) {
+		float v[3][3];
+		bool ok = true;
+
+		for (unsigned int j = 0; j < 3 && ok; j++) {
+			uint32_t index = indices ? indices[i + j] : i + j;
+			ASSERT_R1(index < vertex_count);
+			ok = project_point(hiz, mvp, &positions[index * 3], v[j]);
+		}
+
+		Triangle t;
+		if (!ok || !setup_triangle(hiz, v[0], v[1], v[2], &t))
+			continue;
+
+		uint32_t triangle_index = hiz->triangles.size;
+		Triangle* dst = pigeon_array_list_add(&hiz->triangles, 1);
+		ASSERT_R1(dst);
+		*dst = t;
+
+		for (unsigned int y = t.min_y / PIGEON_HIZ_TILE_SIZE; y <= t.max_y / PIGEON_HIZ_TILE_SIZE; y++) {
+			for (unsigned int x = t.min_x / PIGEON_HIZ_TILE_SIZE; x <= t.max_x / PIGEON_HIZ_TILE_SIZE; x++) {
+				uint32_t* bin_entry = pigeon_array_list_add(&hiz->tile_bins[y * hiz->tiles_x + x], 1);
+				ASSERT_R1(bin_entry);
+				*bin_entry = triangle_index;
+			}
+		}
+	}
+	return 0;
+}
+
+PIGEON_ERR_RET pigeon_hiz_rasterise_box(PigeonHiZ* hiz, mat4 model, const float bounds_min[3], const float bounds_max[3])
+{
+	const float* b[2] = { bounds_min, bounds_max };
+
+	float corners[8 * 3];
+	for (unsigned int i = 0; i < 8; i++) {
+		corners[i * 3 + 0] = b[i & 1][0];
+		corners[i * 3 + 1] = b[(i >> 1) & 1][1];
+		corners[i * 3 + 2] = b[(i >> 2) & 1][2];
+	}
+
+	static const uint32_t box_indices[36] = {
+		0, 1, 3, 0, 3, 2, // -z
+		4, 6, 7, 4, 7, 5, // +z
+		0, 4, 5, 0, 5, 1, // -y
+		2, 3, 7, 2, 7, 6, // +y
+		0, 2, 6, 0, 6, 4, // -x
+		1, 5, 7, 1, 7, 3, // +x
+	};
+
+	return pigeon_hiz_rasterise(hiz, model, corners, 8, box_indices, 36);
+}
+
+void pigeon_hiz_load_depth(PigeonHiZ* hiz, mat4 proj_view, const float* depth, unsigned int width, unsigned int height)
+{
+	assert(hiz && hiz->data && depth && width && height);
+
+	pigeon_hiz_clear(hiz, proj_view);
+
+	for (unsigned int ty = 0; ty < hiz->height; ty++) {
+		unsigned int sy0 = ty * height / hiz->height;
+		unsigned int sy1 = ((ty + 1) * height + hiz->height - 1) / hiz->height;
+
+		for (unsigned int tx = 0; tx < hiz->width; tx++) {
+			unsigned int sx0 = tx * width / hiz->width;
+			unsigned int sx1 = ((tx + 1) * width + hiz->width - 1) / hiz->width;
+
+			float d = 1;
+			for (unsigned int sy = sy0; sy < sy1; sy++) {
+				for (unsigned int sx = sx0; sx < sx1; sx++) {
+					d = fminf(d, depth[sy * width + sx]);
+				}
+			}
+			hiz->data[ty * hiz->width + tx] = d;
+		}
+	}
+}
+
+// x0 to x1 inclusive. The scalar loop uses the same operations as the SIMD loop so results are identical
+static void rasterise_row(float* row, Triangle const* t, unsigned int x0, unsigned int x1, float py)
+{
+	float r0 = t->edge_b[0] * py + t->edge_c[0];
+	float r1 = t->edge_b[1] * py + t->edge_c[1];
+	float r2 = t->edge_b[2] * py + t->edge_c[2];
+
+	unsigned int x = x0;
+
+#ifdef HIZ_SSE
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 a0 = _mm_set1_ps(t->edge_a[0]);
+	const __m128 a1 = _mm_set1_ps(t->edge_a[1]);
+	const __m128 a2 = _mm_set1_ps(t->edge_a[2]);
+	const __m128 r0_4 = _mm_set1_ps(r0);
+	const __m128 r1_4 = _mm_set1_ps(r1);
+	const __m128 r2_4 = _mm_set1_ps(r2);
+	const __m128 z0 = _mm_set1_ps(t->z[0]);
+	const __m128 z1 = _mm_set1_ps(t->z[1]);
+	const __m128 z2 = _mm_set1_ps(t->z[2]);
+	const __m128 inv_area = _mm_set1_ps(t->inv_area);
+
+	for (; x + 3 <= x1; x += 4) {
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+
+		__m128 w0 = _mm_add_ps(_mm_mul_ps(a0, px), r0_4);
+		__m128 w1 = _mm_add_ps(_mm_mul_ps(a1, px), r1_4);
+		__m128 w2 = _mm_add_ps(_mm_mul_ps(a2, px), r2_4);
+
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+		if (!_mm_movemask_ps(inside))
+			continue;
+
+		__m128 z = _mm_mul_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, z0), _mm_mul_ps(w1, z1)), _mm_mul_ps(w2, z2)), inv_area);
+
+		__m128 old_depth = _mm_loadu_ps(&row[x]);
+		__m128 new_depth = _mm_max_ps(old_depth, z);
+		_mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+	}
+#endif
+
+	for (; x <= x1; x++) {
+		float px = (float)x + 0.5f;
+
+		float w0 = t->edge_a[0] * px + r0;
+		float w1 = t->edge_a[1] * px + r1;
+		float w2 = t->edge_a[2] * px + r2;
+
+		if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
+			float z = ((w0 * t->z[0] + w1 * t->z[1]) + w2 * t->z[2]) * t->inv_area;
+			if (z > row[x])
+				row[x] = z;
+		}
+	}
+}
+
+// Region is in texels of level l, end is exclusive
+static void build_level_region(PigeonHiZ* hiz, unsigned int l, unsigned int x0, unsigned int y0, unsigned int x1,
+	unsigned int y1)
+{
+	const float* src = &hiz->data[hiz->level_offset[l - 1]];
+	float* dst = &hiz->data[hiz->level_offset[l]];
+	unsigned int sw = hiz->level_width[l - 1];
+	unsigned int sh = hiz->level_height[l - 1];
+
+	for (unsigned int y = y0; y < y1; y++) {
+		unsigned int sy0 = y * 2;
+		unsigned int sy1 = sy0 + 1 < sh ? sy0 + 1 : sy0;
+
+		for (unsigned int x = x0; x < x1; x++) {
+			unsigned int sx0 = x * 2;
+			unsigned int sx1 = sx0 + 1 < sw ? sx0 + 1 : sx0;
+
+			dst[y * hiz->level_width[l] + x] = fminf(
+				fminf(src[sy0 * sw + sx0], src[sy0 * sw + sx1]), fminf(src[sy1 * sw + sx0], src[sy1 * sw + sx1]));
+		}
+	}
+}
+
+// Levels that fit entirely within one tile
+static unsigned int tile_local_levels(PigeonHiZ const* hiz)
+{
+	unsigned int l = 0;
+	while ((1u << (l + 1)) <= PIGEON_HIZ_TILE_SIZE && l + 1 < hiz->levels)
+		l++;
+	return l;
+}
+
+static PIGEON_ERR_RET rasterise_tile(uint64_t tile_index, void* hiz_)
+{
+	PigeonHiZ* hiz = hiz_;
+
+	unsigned int tile_x = (unsigned int)tile_index % hiz->tiles_x;
+	unsigned int tile_y = (unsigned int)tile_index / hiz->tiles_x;
+
+	unsigned int x0 = tile_x * PIGEON_HIZ_TILE_SIZE;
+	unsigned int y0 = tile_y * PIGEON_HIZ_TILE_SIZE;
+	unsigned int x_end = x0 + PIGEON_HIZ_TILE_SIZE < hiz->width ? x0 + PIGEON_HIZ_TILE_SIZE : hiz->width;
+	unsigned int y_end = y0 + PIGEON_HIZ_TILE_SIZE < hiz->height ? y0 + PIGEON_HIZ_TILE_SIZE : hiz->height;
+
+	PigeonArrayList const* bin = &hiz->tile_bins[tile_index];
+	const uint32_t* triangle_indices = bin->elements;
+	Triangle const* triangles = hiz->triangles.elements;
+
+	// Triangles are always processed in submission order
+
+	for (unsigned int i = 0; i < bin->size; i++) {
+		Triangle const* t = &triangles[triangle_indices[i]];
+
+		unsigned int tx0 = t->min_x > x0 ? t->min_x : x0;
+		unsigned int ty0 = t->min_y > y0 ? t->min_y : y0;
+		unsigned int tx1 = t->max_x < x_end - 1 ? t->max_x : x_end - 1;
+		unsigned int ty1 = t->max_y < y_end - 1 ? t->max_y : y_end - 1;
+
+		for (unsigned int y = ty0; y <= ty1; y++) {
+			rasterise_row(&hiz->data[y * hiz->width], t, tx0, tx1, (float)y + 0.5f);
+		}
+	}
+
+	unsigned int local_levels = tile_local_levels(hiz);
+	for (unsigned int l = 1; l <= local_levels; l++) {
+		unsigned int d = 1u << l;
+		build_level_region(hiz, l, x0 / d, y0 / d, (x_end + d - 1) / d, (y_end + d - 1) / d);
+	}
+
+	return 0;
+}
+
+PIGEON_ERR_RET pigeon_hiz_build(PigeonHiZ* hiz)
+{
+	ASSERT_R1(hiz && hiz->data);
+
+	unsigned int tiles = hiz->tiles_x * hiz->tiles_y;
+
+	hiz->jobs.size = 0;
+	ASSERT_R1(!pigeon_array_list_resize(&hiz->jobs, tiles));
+
+	PigeonJob* jobs = hiz->jobs.elements;
+	for (unsigned int i = 0; i < tiles; i++) {
+		jobs[i].function = rasterise_tile;
+		jobs[i].arg0 = i;
+		jobs[i].arg1 = hiz;
+	}
+
+	ASSERT_R1(!pigeon_dispatch_jobs(jobs, tiles));
+
+	for (unsigned int l = tile_local_levels(hiz) + 1; l < hiz->levels; l++) {
+		build_level_region(hiz, l, 0, 0, hiz->level_width[l], hiz->level_height[l]);
+	}
+	return 0;
+}
+
+static bool test_box(PigeonHiZ const* hiz, mat4 mvp, const float bounds_min[3], const float bounds_max[3])
+{
+	const float* b[2] = { bounds_min, bounds_max };
+
+	float min_x = INFINITY, min_y = INFINITY;
+	float max_x = -INFINITY, max_y = -INFINITY, max_z = 0;
+
+	for (unsigned int i = 0; i < 8; i++) {
+		float corner[3] = { b[i & 1][0], b[(i >> 1) & 1][1], b[(i >> 2) & 1][2] };
+		float p[3];
+
+		// Box intersects the near plane
+		if (!project_point(hiz, mvp, corner, p))
+			return true;
+
+		min_x = fminf(min_x, p[0]);
+		min_y = fminf(min_y, p[1]);
+		max_x = fmaxf(max_x, p[0]);
+		max_y = fmaxf(max_y, p[1]);
+		max_z = fmaxf(max_z, p[2]);
+	}
+
+	if (max_x < 0 || max_y < 0 || min_x >= (float)hiz->width || min_y >= (float)hiz->height)
+		return true; // Off-screen, let frustum culling deal with it
+
+	unsigned int x0 = min_x <= 0 ? 0 : (unsigned int)min_x;
+	unsigned int y0 = min_y <= 0 ? 0 : (unsigned int)min_y;
+	unsigned int x1 = max_x >= (float)(hiz->width - 1) ? hiz->width - 1 : (unsigned int)max_x;
+	unsigned int y1 = max_y >= (float)(hiz->height - 1) ? hiz->height - 1 : (unsigned int)max_y;
+
+	// Pick the first level where the box covers at most 4x4 texels
+
+	unsigned int l = 0;
+	while (l + 1 < hiz->levels && ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4))
+		l++;
+
+	const float* level = &hiz->data[hiz->level_offset[l]];
+	unsigned int lw = hiz->level_width[l];
+
+	for (unsigned int y = y0 >> l; y <= y1 >> l; y++) {
+		for (unsigned int x = x0 >> l; x <= x1 >> l; x++) {
+			if (level[y * lw + x] <= max_z)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool pigeon_hiz_test_box(PigeonHiZ const* hiz, mat4 model, const float bounds_min[3], const float bounds_max[3])
+{
+	assert(hiz && hiz->data);
+
+	mat4 mvp;
+	matrix_multiply((vec4*)hiz->proj_view, model, mvp);
+	return test_box(hiz, mvp, bounds_min, bounds_max);
+}
+
+static float dot3(const float a[3], const float b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+static void cross3(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Returns false if the matrix is singular
+static bool inverse_transform_point(mat4 m, const float p[3], float out[3])
+{
+	float d[3] = { p[0] - m[3][0], p[1] - m[3][1], p[2] - m[3][2] };
+
+	// Rows of the inverse of the upper 3x3
+	float r[3][3];
+	cross3(m[1], m[2], r[0]);
+	cross3(m[2], m[0], r[1]);
+	cross3(m[0], m[1], r[2]);
+
+	// Mirrored transforms flip the winding order so the normal cones would be backwards
+	float det = dot3(m[0], r[0]);
+	if (det < 1e-20f)
+		return false;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		out[i] = dot3(r[i], d) / det;
+	}
+	return true;
+}
+
+// Model space planes (xyz = normal pointing into the frustum, w = distance) of the clip space volume
+// -w <= x <= w, -w <= y <= w, 0 <= z <= w
+static void get_frustum_planes(mat4 mvp, float planes[6][4])
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		planes[0][i] = mvp[i][3] + mvp[i][0];
+		planes[1][i] = mvp[i][3] - mvp[i][0];
+		planes[2][i] = mvp[i][3] + mvp[i][1];
+		planes[3][i] = mvp[i][3] - mvp[i][1];
+		planes[4][i] = mvp[i][2];
+		planes[5][i] = mvp[i][3] - mvp[i][2];
+	}
+
+	for (unsigned int p = 0; p < 6; p++) {
+		float length = sqrtf(dot3(planes[p], planes[p]));
+		if (length > 0) {
+			for (unsigned int i = 0; i < 4; i++) {
+				planes[p][i] /= length;
+			}
+		}
+	}
+}
+
+PIGEON_ERR_RET pigeon_cull_meshlets(PigeonHiZ const* hiz, mat4 proj_view, mat4 model, const float camera[3],
+	bool cull_back_facing, const PigeonWGIMeshlet* meshlets, unsigned int meshlets_count, PigeonArrayList* draws)
+{
+	ASSERT_R1(draws && (meshlets || !meshlets_count));
+
+	mat4 mvp;
+	matrix_multiply(proj_view, model, mvp);
+
+	float planes[6][4];
+	get_frustum_planes(mvp, planes);
+
+	mat4 hiz_mvp;
+	if (hiz)
+		matrix_multiply((vec4*)hiz->proj_view, model, hiz_mvp);
+
+	// The normal cone test works in model space
+	float model_camera[3];
+	if (cull_back_facing)
+		cull_back_facing = inverse_transform_point(model, camera, model_camera);
+
+	unsigned int first_draw = draws->size;
+
+	for (unsigned int i = 0; i < meshlets_count; i++) {
+		PigeonWGIMeshlet const* m = &meshlets[i];
+
+		bool visible = true;
+		for (unsigned int p = 0; p < 6 && visible; p++) {
+			visible = dot3(planes[p], m->centre) + planes[p][3] >= -m->radius;
+		}
+		if (!visible)
+			continue;
+
+		if (cull_back_facing && m->cone_cutoff < 1) {
+			float d[3] = { m->centre[0] - model_camera[0], m->centre[1] - model_camera[1],
+				m->centre[2] - model_camera[2] };
+			if (dot3(d, m->cone_axis) >= m->cone_cutoff * sqrtf(dot3(d, d)) + m->radius)
+				continue;
+		}
+
+		if (hiz) {
+			float bounds_min[3], bounds_max[3];
+			for (unsigned int j = 0; j < 3; j++) {
+				bounds_min[j] = m->centre[j] - m->radius;
+				bounds_max[j] = m->centre[j] + m->radius;
+			}
+			if (!test_box(hiz, hiz_mvp, bounds_min, bounds_max))
+				continue;
+		}
+
+		PigeonMeshletDraw* last = NULL;
+		if (draws->size > first_draw)
+			last = &((PigeonMeshletDraw*)draws->elements)[draws->size - 1];
+
+		if (last && last->first + last->count == m->first) {
+			last->count += m->count;
+		} else {
+			PigeonMeshletDraw* draw = pigeon_array_list_add(draws, 1);
+			ASSERT_R1(draw);
+			draw->first = m->first;
+			draw->count = m->count;
+		}
+	}
+	return 0;
+}
+
+PIGEON_ERR_RET pigeon_create_occluder_mesh(PigeonOccluderMesh* mesh, PigeonAsset* asset)
+{
+	ASSERT_R1(mesh && asset && asset->type == PIGEON_ASSET_TYPE_MODEL);
+
+	PigeonWGIMeshMeta const* meta = &asset->mesh_meta;
+	ASSERT_R1(meta->vertex_count);
+
+	memset(mesh, 0, sizeof *mesh);
+
+	void* temp = NULL;
+
+#define CLEANUP()                                                                                                      \
+	free_if(temp);                                                                                                     \
+	pigeon_destroy_occluder_mesh(mesh);
+
+	int position_subresource = -1;
+	unsigned int attribute_count = 0;
+	for (; attribute_count < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES; attribute_count++) {
+		PigeonWGIVertexAttributeType type = meta->attribute_types[attribute_count];
+		if (!type)
+			break;
+		if (position_subresource < 0
+			&& (type == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION || type == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED))
+			position_subresource = (int)attribute_count;
+	}
+	ASSERT_LOG_R1(position_subresource >= 0, "Occluder mesh has no position attribute");
+	ASSERT_R1(asset->subresource_count >= attribute_count + (meta->index_count ? 1 : 0));
+
+	mesh->vertex_count = meta->vertex_count;
+	mesh->positions = malloc(meta->vertex_count * 3 * sizeof *mesh->positions);
+	ASSERT_R1(mesh->positions);
+
+	PigeonAssetSubresource const* subr = &asset->subresources[position_subresource];
+
+	if (meta->attribute_types[position_subresource] == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION) {
+		ASSERT_R1(subr->decompressed_data_length == meta->vertex_count * 3 * sizeof(float));
+		ASSERT_R1(!pigeon_decompress_asset(asset, mesh->positions, (unsigned int)position_subresource));
+	} else {
+		ASSERT_R1(subr->decompressed_data_length == meta->vertex_count * 4);
+		temp = malloc(subr->decompressed_data_length);
+		ASSERT_R1(temp);
+		ASSERT_R1(!pigeon_decompress_asset(asset, temp, (unsigned int)position_subresource));
+
+		const uint32_t* packed = temp;
+		for (unsigned int i = 0; i < meta->vertex_count; i++) {
+			pigeon_wgi_unpack_normalised_position(
+				packed[i], meta->bounds_min, meta->bounds_range, &mesh->positions[i * 3]);
+		}
+		free2(temp);
+	}
+
+	if (meta->index_count) {
+		subr = &asset->subresources[attribute_count];
+		ASSERT_R1(subr->decompressed_data_length == meta->index_count * (meta->big_indices ? 4 : 2));
+
+		mesh->index_count = meta->index_count;
+		mesh->indices = malloc(meta->index_count * sizeof *mesh->indices);
+		ASSERT_R1(mesh->indices);
+
+		if (meta->big_indices) {
+			ASSERT_R1(!pigeon_decompress_asset(asset, mesh->indices, attribute_count));
+		} else {
+			temp = malloc(subr->decompressed_data_length);
+			ASSERT_R1(temp);
+			ASSERT_R1(!pigeon_decompress_asset(asset, temp, attribute_count));
+
+			const uint16_t* indices16 = temp;
+			for (unsigned int i = 0; i < meta->index_count; i++) {
+				mesh->indices[i] = indices16[i];
+			}
+			free2(temp);
+		}
+	}
+
+#undef CLEANUP
+
+	return 0;
+}
+
+void pigeon_destroy_occluder_mesh(PigeonOccluderMesh* mesh)
+{
+	assert(mesh);
+	free_if(mesh->positions);
+	free_if(mesh->indices);
+}
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <stdint.h>
+
+// Incremented whenever render states, models, material renderers, animation states or transforms are created
+// or destroyed, or joined to / unjoined from each other. draw.c caches the instance table until this changes
+extern uint64_t pigeon_scene_topology_version;
+
 void pigeon_init_transform_pool(void);
 void pigeon_deinit_transform_pool(void);
 void pigeon_init_mesh_renderer_pool(void);
@@ -13,6 +13,7 @@
 #include "scene.h"
 
 PigeonTransform * pigeon_scene_root;
+uint64_t pigeon_scene_topology_version = 1;
 
 static PigeonObjectPool pool;
 extern PigeonObjectPool pigeon_pointer_list_pool;
@@ -48,6 +49,7 @@ PigeonTransform* pigeon_create_transform(PigeonTransform * parent)
         return NULL;
     }
 
+    pigeon_scene_topology_version++;
     return t;
 }
 
@@ -82,6 +84,7 @@ void pigeon_destroy_transform(PigeonTransform * t)
     }
 
     recursive_infanticide(t);
+    pigeon_scene_topology_version++;
 }
 
 
@@ -95,6 +98,7 @@ PIGEON_ERR_RET pigeon_join_transform_and_component(PigeonTransform* t, PigeonCom
         remove_from_ptr_list(&t->components, comp);
         return 1;
     }
+    pigeon_scene_topology_version++;
     return 0;
 }
 
@@ -104,6 +108,7 @@ void pigeon_unjoin_transform_and_component(PigeonTransform* t, PigeonComponent*
 
     remove_from_ptr_list(&comp->transforms, t);
     remove_from_ptr_list(&t->components, comp);
+    pigeon_scene_topology_version++;
 }
 
 void pigeon_invalidate_world_transform(PigeonTransform* t)
@@ -150,6 +155,7 @@ void pigeon_scene_calculate_world_matrix(PigeonTransform* t)
         glm_mat4_mul(t->parent->world_transform_cache, t->world_transform_cache, t->world_transform_cache);
     }
     t->world_transform_cached = true;
+    t->_world_transform_version++;
 }
 
 void pigeon_destroy_component(PigeonComponent* comp);
@@ -163,5 +169,6 @@ void pigeon_destroy_component(PigeonComponent* comp)
         }
         pigeon_object_pool_free(&pigeon_pointer_list_pool, comp->transforms);
         comp->transforms = NULL;
+        pigeon_scene_topology_version++;
     }
 }
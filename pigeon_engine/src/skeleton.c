@@ -0,0 +1,160 @@
+#include <pigeon/assert.h>
+#include <pigeon/skeleton.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bone transforms are similarity transforms (rotation, translation and uniform scale), so they can be combined and
+// inverted without converting them to matrices. rotate is w,x,y,z
+
+static void quat_mul(const float* a, const float* b, float* out)
+{
+	float w = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	float x = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	float y = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	float z = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+	out[0] = w;
+	out[1] = x;
+	out[2] = y;
+	out[3] = z;
+}
+
+static void quat_rotate(const float* q, const float* v, float* out)
+{
+	const float p[4] = { 0, v[0], v[1], v[2] };
+	const float q_inverse[4] = { q[0], -q[1], -q[2], -q[3] };
+	float qp[4], qpq[4];
+	quat_mul(q, p, qp);
+	quat_mul(qp, q_inverse, qpq);
+	out[0] = qpq[1];
+	out[1] = qpq[2];
+	out[2] = qpq[3];
+}
+
+// a * b (b is applied first)
+static void transform_mul(PigeonWGIBoneData const* a, PigeonWGIBoneData const* b, PigeonWGIBoneData* out)
+{
+	float t[3];
+	quat_rotate(a->rotate, b->translate, t);
+
+	quat_mul(a->rotate, b->rotate, out->rotate);
+	for (unsigned int i = 0; i < 3; i++) {
+		out->translate[i] = a->translate[i] + a->scale * t[i];
+	}
+	out->scale = a->scale * b->scale;
+}
+
+static void transform_inverse(PigeonWGIBoneData const* a, PigeonWGIBoneData* out)
+{
+	const float r[4] = { a->rotate[0], -a->rotate[1], -a->rotate[2], -a->rotate[3] };
+	const float s = a->scale != 0 ? 1 / a->scale : 0;
+
+	float t[3];
+	quat_rotate(r, a->translate, t);
+
+	memcpy(out->rotate, r, sizeof r);
+	for (unsigned int i = 0; i < 3; i++) {
+		out->translate[i] = -s * t[i];
+	}
+	out->scale = s;
+}
+
+PIGEON_ERR_RET pigeon_create_skeleton(PigeonSkeleton* s, PigeonWGIBone const* bones, unsigned int bones_count)
+{
+	memset(s, 0, sizeof *s);
+	ASSERT_LOG_R1(bones_count <= PIGEON_MAX_BONES, "Too many bones");
+	if (!bones_count)
+		return 0;
+
+	// One allocation, largest alignment first. Freed with inverse_bind
+	s->inverse_bind = malloc(bones_count
+		* (sizeof *s->inverse_bind + sizeof *s->bind + sizeof *s->local_bind + sizeof *s->parents
+			+ sizeof *s->order));
+	ASSERT_R1(s->inverse_bind);
+	s->bind = (PigeonWGIBoneData*)&s->inverse_bind[bones_count];
+	s->local_bind = &s->bind[bones_count];
+	s->parents = (int*)&s->local_bind[bones_count];
+	s->order = (uint8_t*)&s->parents[bones_count];
+	s->bones_count = bones_count;
+
+	bool added[PIGEON_MAX_BONES] = { 0 };
+	unsigned int added_count = 0;
+
+	for (unsigned int i = 0; i < bones_count; i++) {
+		int p = bones[i].parent_index;
+		s->parents[i] = p >= 0 && (unsigned)p < bones_count && (unsigned)p != i ? p : -1;
+	}
+
+	// Each pass adds the bones whose parents have been added. Bones exported from Blender are already in order
+	while (added_count < bones_count) {
+		unsigned int added_before = added_count;
+
+		for (unsigned int i = 0; i < bones_count; i++) {
+			if (!added[i] && (s->parents[i] < 0 || added[s->parents[i]])) {
+				added[i] = true;
+				s->order[added_count++] = (uint8_t)i;
+			}
+		}
+
+		if (added_count == added_before) {
+			pigeon_destroy_skeleton(s);
+			ASSERT_LOG_R1(false, "Bone hierarchy contains a cycle");
+		}
+	}
+
+	for (unsigned int i = 0; i < bones_count; i++) {
+		PigeonWGIBoneData* b = &s->bind[i];
+		b->rotate[0] = 1;
+		b->rotate[1] = b->rotate[2] = b->rotate[3] = 0;
+		memcpy(b->translate, bones[i].head, sizeof b->translate);
+		b->scale = 1;
+
+		float* m = s->inverse_bind[i].mat3x4;
+		memset(m, 0, sizeof s->inverse_bind[i].mat3x4);
+		m[0] = m[4] = m[8] = 1;
+		m[9] = -bones[i].head[0];
+		m[10] = -bones[i].head[1];
+		m[11] = -bones[i].head[2];
+	}
+
+	// The skinning transforms of the bind pose are the identity transform
+	for (unsigned int i = 0; i < bones_count; i++) {
+		float* r = s->local_bind[i].rotate;
+		r[0] = 1;
+		r[1] = r[2] = r[3] = 0;
+		memset(s->local_bind[i].translate, 0, sizeof s->local_bind[i].translate);
+		s->local_bind[i].scale = 1;
+	}
+	PigeonWGIBoneData identity[PIGEON_MAX_BONES];
+	memcpy(identity, s->local_bind, bones_count * sizeof *identity);
+	pigeon_skeleton_local_pose(s, identity, s->local_bind);
+
+	return 0;
+}
+
+void pigeon_destroy_skeleton(PigeonSkeleton* s)
+{
+	free(s->inverse_bind);
+	memset(s, 0, sizeof *s);
+}
+
+void pigeon_skeleton_local_pose(
+	PigeonSkeleton const* s, PigeonWGIBoneData const* model_space, PigeonWGIBoneData* local)
+{
+	for (unsigned int i = 0; i < s->bones_count; i++) {
+		// Model space transform of the bone: skinning transform * bind transform
+		PigeonWGIBoneData global;
+		transform_mul(&model_space[i], &s->bind[i], &global);
+
+		int p = s->parents[i];
+		if (p < 0) {
+			local[i] = global;
+			continue;
+		}
+
+		// Local transform: inverse(model space transform of the parent) * model space transform
+		PigeonWGIBoneData parent, parent_inverse;
+		transform_mul(&model_space[p], &s->bind[p], &parent);
+		transform_inverse(&parent, &parent_inverse);
+		transform_mul(&parent_inverse, &global, &local[i]);
+	}
+}
@@ -1,8 +1,18 @@
 #include <pigeon/misc.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define PIGEON_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 void* pigeon_load_file(const char* file, unsigned int extra, unsigned long * file_size) {
 	FILE* f = fopen(file, "rb");
 	if (!f) {
@@ -42,4 +52,68 @@ void* pigeon_load_file(const char* file, unsigned int extra, unsigned long * fil
 
 }
 
+#ifdef PIGEON_NO_MMAP
+
+void* pigeon_map_file(const char* file, unsigned long * file_size) {
+	return pigeon_load_file(file, 0, file_size);
+}
+
+void pigeon_unmap_file(void* data, unsigned long file_size) {
+	(void)file_size;
+	free(data);
+}
+
+void pigeon_discard_mapped_range(void* data, unsigned long offset, unsigned long length) {
+	(void)data;
+	(void)offset;
+	(void)length;
+}
+
+#else
+
+void* pigeon_map_file(const char* file, unsigned long * file_size) {
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "File not found: %s\n", file);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size < 1) {
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping keeps its own reference to the file
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	*file_size = (unsigned long)st.st_size;
+	return data;
+}
+
+void pigeon_unmap_file(void* data, unsigned long file_size) {
+	munmap(data, (size_t)file_size);
+}
+
+void pigeon_discard_mapped_range(void* data, unsigned long offset, unsigned long length) {
+	// Only whole pages inside the range are dropped, the pages at either end may hold other data
+	const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)data + offset;
+	uintptr_t end = start + length;
+
+	start = (start + page_size - 1) & ~(page_size - 1);
+	end &= ~(page_size - 1);
+
+	if (end > start) {
+		madvise((void*)start, end - start, MADV_DONTNEED);
+	}
+}
+
+#endif
+
 
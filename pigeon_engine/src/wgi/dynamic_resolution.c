@@ -0,0 +1,85 @@
+#include <pigeon/wgi/wgi.h>
+#include <pigeon/wgi/vulkan/query.h>
+#include "singleton.h"
+#include <pigeon/assert.h>
+#include <math.h>
+
+// The render scale is only changed when the GPU frame time is further than this fraction from the target
+#define FRAME_TIME_HYSTERESIS 0.1
+
+// Largest change of the render scale in one step
+#define MAX_RENDER_SCALE_STEP 0.1f
+
+bool pigeon_wgi_dynamic_resolution_supported(void)
+{
+    return VULKAN && pigeon_vulkan_general_queue_supports_timestamps();
+}
+
+static void set_render_scale(float scale)
+{
+    if(scale == singleton_data.render_scale) return;
+
+    singleton_data.render_scale = scale;
+    singleton_data.render_scale_changed_frame = singleton_data.frame_number;
+
+    // These command buffers are reused by later frames so must be recorded again
+    for(unsigned int i = 0; i < singleton_data.frame_objects_count; i++) {
+        PerFrameData * objects = &singleton_data.per_frame_objects[i];
+        objects->command_pools[PIGEON_WGI_RENDER_STAGE_SSAO].recorded = false;
+        objects->command_pools[PIGEON_WGI_RENDER_STAGE_BLOOM].recorded = false;
+    }
+}
+
+PIGEON_ERR_RET pigeon_wgi_set_dynamic_resolution(double target_milliseconds, float min_scale)
+{
+    ASSERT_R1(target_milliseconds >= 0 && min_scale > 0 && min_scale <= 1);
+    ASSERT_R1(!target_milliseconds || pigeon_wgi_dynamic_resolution_supported());
+
+    singleton_data.dynamic_resolution_target = target_milliseconds;
+    singleton_data.dynamic_resolution_min_scale = min_scale;
+
+    if(!target_milliseconds) set_render_scale(1);
+    else if(singleton_data.render_scale < min_scale) set_render_scale(min_scale);
+    return 0;
+}
+
+float pigeon_wgi_get_render_scale(void)
+{
+    return singleton_data.render_scale;
+}
+
+unsigned int pigeon_wgi_scale_render_size(unsigned int framebuffer_size)
+{
+    unsigned int size = (unsigned int)((float)framebuffer_size * singleton_data.render_scale + 0.5f);
+    if(size < 1) size = 1;
+    if(size > framebuffer_size) size = framebuffer_size;
+    return size;
+}
+
+void pigeon_wgi_update_render_scale(const double delayed_timer_values[PIGEON_WGI_RENDER_STAGE__COUNT])
+{
+    if(!singleton_data.dynamic_resolution_target) return;
+
+    // The timer results are from 2 or more frames ago. Frames drawn before the last change are ignored
+    if(singleton_data.frame_number <= singleton_data.render_scale_changed_frame + singleton_data.frame_objects_count)
+        return;
+
+    double frame_time = 0;
+    for(unsigned int i = 0; i < PIGEON_WGI_RENDER_STAGE__COUNT; i++) {
+        frame_time += delayed_timer_values[i];
+    }
+    if(!(frame_time > 0)) return;
+
+    double load = frame_time / singleton_data.dynamic_resolution_target;
+    if(load > 1 - FRAME_TIME_HYSTERESIS && load < 1 + FRAME_TIME_HYSTERESIS) return;
+
+    // The time taken by the scaled stages is roughly proportional to the number of pixels
+    float scale = singleton_data.render_scale * (float)sqrt(1 / load);
+
+    scale = fminf(scale, singleton_data.render_scale + MAX_RENDER_SCALE_STEP);
+    scale = fmaxf(scale, singleton_data.render_scale - MAX_RENDER_SCALE_STEP);
+    scale = fminf(scale, 1);
+    scale = fmaxf(scale, singleton_data.dynamic_resolution_min_scale);
+
+    set_render_scale(scale);
+}
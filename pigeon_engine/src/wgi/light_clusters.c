@@ -0,0 +1,157 @@
+#include <pigeon/wgi/wgi.h>
+#include "singleton.h"
+#include <cglm/mat4.h>
+#include <math.h>
+#include <string.h>
+#include <pigeon/assert.h>
+#include <stdlib.h>
+
+// Point lights (intensity / distance squared in object.frag) are not drawn where they are dimmer than this.
+// object.frag fades them out before that distance so there is no seam at the edges of clusters
+#define POINT_LIGHT_CUTOFF (1.0f / 256.0f)
+
+PIGEON_ERR_RET pigeon_wgi_prepare_light_list(void)
+{
+    unsigned int capacity = VULKAN ? singleton_data.max_lights : PIGEON_WGI_MAX_LIGHTS_OPENGL;
+
+    if(capacity > singleton_data.light_list_capacity) {
+        PigeonWGILight * lights = realloc(singleton_data.light_list, capacity * sizeof *lights);
+        ASSERT_R1(lights);
+        singleton_data.light_list = lights;
+        singleton_data.light_list_capacity = capacity;
+    }
+
+    unsigned int words = VULKAN ? PIGEON_WGI_LIGHT_CLUSTERS * ((singleton_data.max_lights + 31) / 32) : 0;
+
+    if(words > singleton_data.light_cluster_bits_capacity) {
+        uint32_t * bits = realloc(singleton_data.light_cluster_bits, words * 4);
+        ASSERT_R1(bits);
+        singleton_data.light_cluster_bits = bits;
+        singleton_data.light_cluster_bits_capacity = words;
+    }
+    return 0;
+}
+
+void pigeon_wgi_destroy_light_list(void)
+{
+    free(singleton_data.light_list);
+    free(singleton_data.light_cluster_bits);
+    singleton_data.light_list = NULL;
+    singleton_data.light_cluster_bits = NULL;
+    singleton_data.light_list_capacity = 0;
+    singleton_data.light_cluster_bits_capacity = 0;
+}
+
+static unsigned int clamp_cluster(float f, unsigned int n)
+{
+    if(!(f > 0)) return 0;
+    if(f >= (float)n) return n - 1;
+    return (unsigned int)f;
+}
+
+// Same as object.frag
+static unsigned int depth_slice(PigeonWGISceneUniformData const* data, float depth)
+{
+    return clamp_cluster(logf(depth / data->znear) / logf(data->zfar / data->znear) * PIGEON_WGI_LIGHT_CLUSTERS_Z,
+        PIGEON_WGI_LIGHT_CLUSTERS_Z);
+}
+
+// Returns false if the light is not in the view frustum
+// min and max are the first and last cluster in each dimension
+static bool get_point_light_clusters(PigeonWGISceneUniformData const* data, PigeonWGILight const* light,
+    unsigned int min[3], unsigned int max[3])
+{
+    vec4 p = {light->world_position[0], light->world_position[1], light->world_position[2], 1};
+    glm_mat4_mulv((vec4*)data->view, p, p);
+
+    // View space is right handed
+    float depth = -p[2];
+    float near = depth - light->radius;
+    float far = depth + light->radius;
+
+    if(far <= data->znear || near >= data->zfar) return false;
+    if(near < data->znear) near = data->znear;
+    if(far > data->zfar) far = data->zfar;
+
+    min[2] = depth_slice(data, near);
+    max[2] = depth_slice(data, far);
+
+    // Project the corners of the bounding box of the sphere (clipped to the depth range)
+    // The projection matrix is symmetric (pigeon_wgi_perspective) and proj[1][1] is negative
+    const unsigned int clusters[2] = {PIGEON_WGI_LIGHT_CLUSTERS_X, PIGEON_WGI_LIGHT_CLUSTERS_Y};
+
+    for(unsigned int axis = 0; axis < 2; axis++) {
+        float ndc_min = INFINITY;
+        float ndc_max = -INFINITY;
+
+        for(unsigned int corner = 0; corner < 4; corner++) {
+            float v = p[axis] + ((corner & 1) ? light->radius : -light->radius);
+            float ndc = data->proj[axis][axis] * v / ((corner & 2) ? far : near);
+
+            if(ndc < ndc_min) ndc_min = ndc;
+            if(ndc > ndc_max) ndc_max = ndc;
+        }
+
+        if(ndc_max < -1 || ndc_min > 1) return false;
+
+        min[axis] = clamp_cluster((ndc_min * 0.5f + 0.5f) * (float)clusters[axis], clusters[axis]);
+        max[axis] = clamp_cluster((ndc_max * 0.5f + 0.5f) * (float)clusters[axis], clusters[axis]);
+    }
+    return true;
+}
+
+static void assign_light_clusters(PigeonWGISceneUniformData const* data, uint32_t * bits)
+{
+    const unsigned int words = data->light_cluster_words;
+    memset(bits, 0, PIGEON_WGI_LIGHT_CLUSTERS * words * 4);
+
+    for(unsigned int i = 0; i < data->number_of_lights; i++) {
+        PigeonWGILight const* light = &singleton_data.light_list[i];
+
+        // Directional lights are in every cluster
+        unsigned int min[3] = {0, 0, 0};
+        unsigned int max[3] = {PIGEON_WGI_LIGHT_CLUSTERS_X-1, PIGEON_WGI_LIGHT_CLUSTERS_Y-1,
+            PIGEON_WGI_LIGHT_CLUSTERS_Z-1};
+
+        if(light->light_type == 1) {
+            if(!(light->radius > 0) || !get_point_light_clusters(data, light, min, max)) continue;
+        }
+
+        const uint32_t bit = 1u << (i % 32);
+
+        for(unsigned int z = min[2]; z <= max[2]; z++) {
+            for(unsigned int y = min[1]; y <= max[1]; y++) {
+                unsigned int cluster = (z * PIGEON_WGI_LIGHT_CLUSTERS_Y + y) * PIGEON_WGI_LIGHT_CLUSTERS_X + min[0];
+                uint32_t * w = &bits[cluster * words + i / 32];
+
+                for(unsigned int x = min[0]; x <= max[0]; x++, w += words) {
+                    *w |= bit;
+                }
+            }
+        }
+    }
+}
+
+void pigeon_wgi_write_lights(PigeonWGISceneUniformData* data, void* lights, void* clusters)
+{
+    assert(data->number_of_lights <= singleton_data.lights);
+
+    for(unsigned int i = 0; i < data->number_of_lights; i++) {
+        PigeonWGILight * light = &singleton_data.light_list[i];
+        if(light->light_type != 1) continue;
+
+        float max_intensity = fmaxf(fmaxf(light->intensity[0], light->intensity[1]), light->intensity[2]);
+        light->radius = max_intensity > 0 ? sqrtf(max_intensity / POINT_LIGHT_CUTOFF) : 0;
+    }
+
+    memcpy(lights, singleton_data.light_list, data->number_of_lights * sizeof(PigeonWGILight));
+
+    if(clusters) {
+        data->light_cluster_words = (data->number_of_lights + 31) / 32;
+        assign_light_clusters(data, singleton_data.light_cluster_bits);
+        memcpy(clusters, singleton_data.light_cluster_bits, PIGEON_WGI_LIGHT_CLUSTERS * data->light_cluster_words * 4);
+    }
+    else {
+        data->light_cluster_words = 0;
+    }
+}
@@ -71,6 +71,7 @@ PIGEON_ERR_RET pigeon_wgi_create_multimesh(PigeonWGIMultiMesh *mesh,
         PigeonVulkanBufferUsages usages = {0};
         usages.vertices = true;
         usages.indices = index_count > 0;
+        usages.ssbo = mesh->has_bones; // Read by the compute skinning shader
         if (pigeon_vulkan_create_staged_buffer(mesh->staged_buffer, *size, usages)) {
             OOPS();
         }
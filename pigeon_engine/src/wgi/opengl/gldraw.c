@@ -88,12 +88,21 @@ void pigeon_opengl_draw(PigeonOpenGLVAO* vao, unsigned int first, unsigned int c
 	glDrawArrays(GL_TRIANGLES, first, count);
 }
 
-void pigeon_opengl_draw_indexed(PigeonOpenGLVAO* vao, unsigned int start_vertex, unsigned int first, unsigned int count)
+void pigeon_opengl_draw_instanced(PigeonOpenGLVAO* vao, unsigned int first, unsigned int count, unsigned int instances)
+{
+	assert(vao->id);
+
+	pigeon_opengl_bind_vao_id(vao->id);
+	glDrawArraysInstanced(GL_TRIANGLES, first, count, instances);
+}
+
+void pigeon_opengl_draw_indexed(PigeonOpenGLVAO* vao, unsigned int start_vertex, unsigned int first, unsigned int count,
+	unsigned int instances)
 {
 	assert(vao->id);
 
 	pigeon_opengl_bind_vao_id(vao->id);
 
-	glDrawElementsBaseVertex(GL_TRIANGLES, count, vao->big_indices ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
-		(void*)(uintptr_t)(first * (vao->big_indices ? 4 : 2)), start_vertex);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, count, vao->big_indices ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
+		(void*)(uintptr_t)(first * (vao->big_indices ? 4 : 2)), instances, start_vertex);
 }
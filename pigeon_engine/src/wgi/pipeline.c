@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include "singleton.h"
 #include <pigeon/wgi/pipeline.h>
+#include <pigeon/wgi/wgi.h>
 #include <pigeon/wgi/vulkan/renderpass.h>
 #include <pigeon/wgi/vulkan/swapchain.h>
 #include <pigeon/wgi/vulkan/vulkan.h>
@@ -234,7 +235,7 @@ PIGEON_ERR_RET pigeon_wgi_create_standard_pipeline_objects(void)
 
 	
 	if (create_pipeine(&singleton_data.pipeline_ssao, SHADER_PATH("fullscreen.vert"), SHADER_PATH("ssao.frag"),
-		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 20, 0, NULL)) ASSERT_R1(false);
+		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 36, 0, NULL)) ASSERT_R1(false);
 
 	
 
@@ -242,13 +243,13 @@ PIGEON_ERR_RET pigeon_wgi_create_standard_pipeline_objects(void)
 
 	if (create_pipeine(&singleton_data.pipeline_ssao_downscale_x4,
 		SHADER_PATH("fullscreen.vert"), SHADER_PATH("downscale_ssao.frag"),
-		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 8, 1, spc)) return 1;
+		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 16, 1, spc)) return 1;
 
 		
 
 
 	if (create_pipeine(&singleton_data.pipeline_ssao_blur, SHADER_PATH("fullscreen.vert"), SHADER_PATH("kawase_ssao.frag"),
-		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 8, 0, NULL)) ASSERT_R1(false);
+		&singleton_data.rp_ssao, &singleton_data.one_texture_descriptor_layout, 16, 0, NULL)) ASSERT_R1(false);
 
 
 	
@@ -269,6 +270,26 @@ PIGEON_ERR_RET pigeon_wgi_create_standard_pipeline_objects(void)
 	if (create_pipeine(&singleton_data.pipeline_post, SHADER_PATH("post.vert"), SHADER_PATH("post.frag"),
 		&singleton_data.rp_post, &singleton_data.post_descriptor_layout, 12, 1, &sc_use_bloom)) return 1;
 
+	if (pigeon_wgi_gpu_culling_supported()) {
+		PigeonVulkanShader cs = { 0 };
+		if (pigeon_vulkan_load_shader(&cs, SHADER_PATH("cull.comp"))) return 1;
+
+		int err = pigeon_vulkan_create_compute_pipeline(
+			&singleton_data.pipeline_cull, &cs, 12, &singleton_data.cull_descriptor_layout);
+		pigeon_vulkan_destroy_shader(&cs);
+		if (err) return 1;
+	}
+
+	if (pigeon_wgi_compute_skinning_supported()) {
+		PigeonVulkanShader cs = { 0 };
+		if (pigeon_vulkan_load_shader(&cs, SHADER_PATH("skin.comp"))) return 1;
+
+		int err = pigeon_vulkan_create_compute_pipeline(
+			&singleton_data.pipeline_skin, &cs, sizeof(SkinDispatch), &singleton_data.skin_descriptor_layout);
+		pigeon_vulkan_destroy_shader(&cs);
+		if (err) return 1;
+	}
+
 #undef SHADER_PATH
 	return 0;
 }
@@ -285,6 +306,10 @@ void pigeon_wgi_destroy_standard_pipeline_objects()
 		pigeon_vulkan_destroy_pipeline(&singleton_data.pipeline_ssao_downscale_x4);
 		pigeon_vulkan_destroy_pipeline(&singleton_data.pipeline_ssao_blur);
 		pigeon_vulkan_destroy_pipeline(&singleton_data.pipeline_post);
+		if (singleton_data.pipeline_cull.vk_pipeline)
+			pigeon_vulkan_destroy_pipeline(&singleton_data.pipeline_cull);
+		if (singleton_data.pipeline_skin.vk_pipeline)
+			pigeon_vulkan_destroy_pipeline(&singleton_data.pipeline_skin);
 	}
 	else {
 		pigeon_opengl_destroy_shader_program(&singleton_data.gl.shader_ssao);
@@ -465,8 +490,13 @@ static PIGEON_ERR_RET pigeon_wgi_create_pipeline_gl(PigeonWGIPipeline* pipeline,
 		pigeon_opengl_set_uniform_buffer_binding(programs[i], "UniformBufferObject", 0);
 		pigeon_opengl_set_uniform_buffer_binding(programs[i], "DrawObjectUniform", 1);
 
-		if(transparent || i==1)
+		if(transparent || i==1) {
 			pigeon_opengl_set_shader_texture_binding_index(programs[i], "diffuse_texture", 4);
+			pigeon_opengl_set_uniform_buffer_binding(programs[i], "MaterialUniform", 3);
+		}
+
+		if(i == 1)
+			pigeon_opengl_set_uniform_buffer_binding(programs[i], "LightUniform", 4);
 
 		if(skinned)
 			pigeon_opengl_set_uniform_buffer_binding(programs[i], "BonesUniform", 2);
@@ -493,6 +523,14 @@ static PIGEON_ERR_RET pigeon_wgi_create_pipeline_gl(PigeonWGIPipeline* pipeline,
 	pipeline->gl.program_mvp_loc = pigeon_opengl_get_uniform_location(
 		pipeline->gl.program, "MODEL_VIEW_PROJ_INDEX");
 
+	pipeline->gl.program_depth_draw_offset = -1;
+	pipeline->gl.program_draw_offset = -1;
+
+	pipeline->gl.program_depth_draw_offset_loc = pigeon_opengl_get_uniform_location(
+		pipeline->gl.program_depth, "DRAW_INDEX_OFFSET");
+	pipeline->gl.program_draw_offset_loc = pigeon_opengl_get_uniform_location(
+		pipeline->gl.program, "DRAW_INDEX_OFFSET");
+
 	pipeline->gl.config_depth = *config;
 	pipeline->gl.config = *config;
 	pipeline->gl.config_shadow = *config;
@@ -528,6 +566,8 @@ PIGEON_ERR_RET pigeon_wgi_create_pipeline(PigeonWGIPipeline* pipeline,
 
 	pipeline->skinned = skinned;
 	pipeline->transparent = transparent;
+	pipeline->cull_mode = config->cull_mode;
+	pipeline->front_face = config->front_face;
 
 	if(OPENGL) {
 		return pigeon_wgi_create_pipeline_gl(pipeline, 
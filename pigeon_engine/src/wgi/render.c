@@ -13,6 +13,7 @@
 #include "singleton.h"
 #include <pigeon/misc.h>
 #include <string.h>
+#include <stdlib.h>
 #include <pigeon/wgi/opengl/limits.h>
 #include <pigeon/wgi/opengl/draw.h>
 #include <pigeon/wgi/opengl/shader.h>
@@ -136,6 +137,9 @@ PIGEON_ERR_RET pigeon_wgi_create_per_frame_objects()
             ASSERT_R1(!pigeon_vulkan_create_descriptor_pool(&objects->depth_descriptor_pool, 1, &singleton_data.depth_descriptor_layout));
             ASSERT_R1(!pigeon_vulkan_create_descriptor_pool(&objects->render_descriptor_pool, 1, &singleton_data.render_descriptor_layout));
 
+            if(pigeon_wgi_gpu_culling_supported())
+                ASSERT_R1(!pigeon_vulkan_create_descriptor_pool(&objects->cull_descriptor_pool, 1, &singleton_data.cull_descriptor_layout));
+
 
             for(unsigned int j = 0; j < 4; j++) {
                 pigeon_vulkan_set_descriptor_texture(&objects->render_descriptor_pool, 0, 4, j, 
@@ -204,13 +208,24 @@ void pigeon_wgi_destroy_per_frame_objects()
                 pigeon_vulkan_destroy_descriptor_pool(&objects->depth_descriptor_pool);
             if(objects->render_descriptor_pool.vk_descriptor_pool)
                 pigeon_vulkan_destroy_descriptor_pool(&objects->render_descriptor_pool);
+            if(objects->cull_descriptor_pool.vk_descriptor_pool)
+                pigeon_vulkan_destroy_descriptor_pool(&objects->cull_descriptor_pool);
+            if(objects->skin_descriptor_pool.vk_descriptor_pool)
+                pigeon_vulkan_destroy_descriptor_pool(&objects->skin_descriptor_pool);
 
-            for(unsigned int j = 0; j < PIGEON_WGI_RENDER_STAGE__COUNT; j++)
+            for(unsigned int j = 0; j < PIGEON_WGI_RENDER_STAGE__COUNT; j++) {
                 pigeon_vulkan_destroy_command_pool(&objects->command_pools[j]);
 
+                for(unsigned int k = 0; k < PIGEON_WGI_MAX_RECORD_CHUNKS; k++)
+                    pigeon_vulkan_destroy_command_pool(&objects->chunk_command_pools[j][k]);
+            }
+
             if(objects->uniform_buffer.vk_buffer) pigeon_vulkan_destroy_buffer(&objects->uniform_buffer);
             if(objects->uniform_buffer_memory.vk_device_memory)
                 pigeon_vulkan_free_memory(&objects->uniform_buffer_memory);
+
+            free(objects->materials);
+            objects->materials = NULL;
         }
     }
 
@@ -257,6 +272,115 @@ static PIGEON_ERR_RET create_uniform_buffer(PigeonVulkanMemoryAllocation * memor
 }
 
 
+// OpenGL draw objects are tightly packed so that the instances of a draw are consecutive in the DrawObjectUniform
+// block. There is space after the last draw object for a whole block so that it can be bound at any draw object
+static unsigned int get_draw_objects_size_gl(unsigned int align)
+{
+    return round_up(sizeof(PigeonWGIDrawObject) * (singleton_data.max_draws + PIGEON_WGI_DRAW_OBJECTS_OPENGL), align);
+}
+
+// The bone matrices are after the draw objects (and the multidraw commands with Vulkan)
+static unsigned int get_bone_matrices_offset(unsigned int align)
+{
+    unsigned int o = round_up(sizeof(PigeonWGISceneUniformData), align);
+
+    if(VULKAN) {
+        o += round_up(sizeof(PigeonWGIDrawObject) * singleton_data.max_draws, align);
+        o += round_up(sizeof(PigeonVulkanDrawIndexedIndirectCommand) * singleton_data.max_multidraw_draws, align);     
+    }
+    else {
+        o += get_draw_objects_size_gl(align);
+    }
+    return o;
+}
+
+// The material table is after the bone matrices
+static unsigned int get_material_table_offset(unsigned int align)
+{
+    return get_bone_matrices_offset(align) +
+        round_up((singleton_data.total_bones+256) * sizeof(PigeonWGIBoneMatrix), align);
+}
+
+// The light list is after the material table
+static unsigned int get_light_list_offset(unsigned int align)
+{
+    unsigned int o = get_material_table_offset(align);
+
+    if(VULKAN) return round_up(o + sizeof(PigeonWGIMaterial) * singleton_data.max_materials, align);
+    else return o + round_up(sizeof(PigeonWGIMaterial), align) * singleton_data.max_materials;
+}
+
+static unsigned int get_light_list_size(void)
+{
+    return sizeof(PigeonWGILight) * (VULKAN ? singleton_data.max_lights : PIGEON_WGI_MAX_LIGHTS_OPENGL);
+}
+
+// The light cluster bit masks are after the light list (Vulkan only)
+static unsigned int get_light_clusters_offset(unsigned int align)
+{
+    return round_up(get_light_list_offset(align) + get_light_list_size(), align);
+}
+
+static unsigned int get_light_clusters_size(void)
+{
+    return VULKAN ? PIGEON_WGI_LIGHT_CLUSTERS * ((singleton_data.max_lights + 31) / 32) * 4 : 0;
+}
+
+// GPU culling data is after the light clusters (Vulkan only)
+// Bindings 2-6 of the cull descriptor set: groups, instances per LOD, culling results, draw counts, draw commands
+#define CULL_BUFFERS 5
+
+static unsigned int get_cull_data_ranges(unsigned int align,
+    unsigned int offsets[CULL_BUFFERS], unsigned int sizes[CULL_BUFFERS])
+{
+    unsigned int groups = singleton_data.max_cull_groups ? singleton_data.max_cull_groups : 1;
+    unsigned int instances = singleton_data.max_cull_instances ? singleton_data.max_cull_instances : 1;
+    unsigned int render_states = singleton_data.max_cull_render_states ? singleton_data.max_cull_render_states : 1;
+
+    // Each group and LOD has an instance count for the shadow stages and another for the camera stages.
+    // Instances have a result for each of those too, and render states have a draw count for each
+    sizes[0] = sizeof(PigeonWGICullGroup) * groups;
+    sizes[1] = 4 * 2 * PIGEON_WGI_MAX_LODS * groups;
+    sizes[2] = 4 * 2 * instances;
+    sizes[3] = 4 * 2 * render_states;
+    sizes[4] = sizeof(PigeonVulkanDrawIndexedIndirectCommand) * 2 * PIGEON_WGI_MAX_LODS * groups;
+
+    unsigned int o = round_up(get_light_clusters_offset(align) + get_light_clusters_size(), align);
+
+    for(unsigned int i = 0; i < CULL_BUFFERS; i++) {
+        offsets[i] = o;
+        o += round_up(sizes[i], align);
+    }
+    return o;
+}
+
+// Compute skinning data is after the GPU culling data (Vulkan only). It is always there because the skinned
+// vertex shaders use it. Bindings 3-4 of the depth descriptor set and 9-10 of the render descriptor set:
+// jobs and skinned vertices (a position and a normal each)
+#define SKIN_BUFFERS 2
+
+static unsigned int get_skin_data_ranges(unsigned int align,
+    unsigned int offsets[SKIN_BUFFERS], unsigned int sizes[SKIN_BUFFERS])
+{
+    unsigned int jobs = singleton_data.max_skin_jobs ? singleton_data.max_skin_jobs : 1;
+    unsigned int vertices = singleton_data.max_skin_vertices ? singleton_data.max_skin_vertices : 1;
+
+    sizes[0] = sizeof(PigeonWGISkinJob) * jobs;
+    sizes[1] = 2 * 16 * vertices;
+
+    unsigned int o = round_up(get_light_clusters_offset(align) + get_light_clusters_size(), align);
+    if(singleton_data.max_cull_groups) {
+        unsigned int cull_offsets[CULL_BUFFERS], cull_sizes[CULL_BUFFERS];
+        o = get_cull_data_ranges(align, cull_offsets, cull_sizes);
+    }
+
+    for(unsigned int i = 0; i < SKIN_BUFFERS; i++) {
+        offsets[i] = o;
+        o += round_up(sizes[i], align);
+    }
+    return o;
+}
+
 static PIGEON_ERR_RET prepare_uniform_buffers()
 {
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
@@ -264,19 +388,23 @@ static PIGEON_ERR_RET prepare_uniform_buffers()
     const unsigned int align = VULKAN ? pigeon_vulkan_get_buffer_min_alignment()
         : pigeon_opengl_get_uniform_buffer_min_alignment();
 
-    unsigned int minimum_size = round_up(sizeof(PigeonWGISceneUniformData), align);
+    const unsigned int material_table_offset = get_material_table_offset(align);
+    const unsigned int light_list_offset = get_light_list_offset(align);
+    const unsigned int light_list_size = get_light_list_size();
+    unsigned int minimum_size = get_light_clusters_offset(align) + get_light_clusters_size();
 
-    if(VULKAN) {
-        minimum_size += round_up(sizeof(PigeonWGIDrawObject) * singleton_data.max_draws, align);
-        minimum_size += round_up(sizeof(PigeonVulkanDrawIndexedIndirectCommand) * singleton_data.max_multidraw_draws, align);     
-    }
-    else {
-        minimum_size += round_up(sizeof(PigeonWGIDrawObject), align) * singleton_data.max_draws;
-    }
-    minimum_size += (singleton_data.total_bones+256) * sizeof(PigeonWGIBoneMatrix);
+    unsigned int cull_offsets[CULL_BUFFERS], cull_sizes[CULL_BUFFERS];
+    if(VULKAN && singleton_data.max_cull_groups)
+        minimum_size = get_cull_data_ranges(align, cull_offsets, cull_sizes);
+    const unsigned int cull_data_end = minimum_size;
+
+    unsigned int skin_offsets[SKIN_BUFFERS], skin_sizes[SKIN_BUFFERS];
+    if(VULKAN)
+        minimum_size = get_skin_data_ranges(align, skin_offsets, skin_sizes);
 
     if(VULKAN) {
-        if(objects->uniform_buffer.size < minimum_size) {
+        bool recreated = objects->uniform_buffer.size < minimum_size;
+        if(recreated) {
             if(objects->uniform_buffer.size) {
                 pigeon_vulkan_destroy_buffer(&objects->uniform_buffer);
                 pigeon_vulkan_free_memory(&objects->uniform_buffer_memory);
@@ -284,6 +412,7 @@ static PIGEON_ERR_RET prepare_uniform_buffers()
 
             ASSERT_R1(!create_uniform_buffer(&objects->uniform_buffer_memory, 
                 &objects->uniform_buffer, minimum_size));
+            objects->draw_objects_frame = 0;
 
             unsigned int uniform_offset = 0;
             
@@ -310,6 +439,69 @@ static PIGEON_ERR_RET prepare_uniform_buffers()
             pigeon_vulkan_set_descriptor_ssbo2(&objects->depth_descriptor_pool, 0, 2, 0,
                 &objects->uniform_buffer, uniform_offset, singleton_data.total_bones * sizeof(PigeonWGIBoneMatrix));
         }
+
+        if(recreated || objects->material_table_offset != material_table_offset ||
+            objects->material_table_size != singleton_data.max_materials)
+        {
+            pigeon_vulkan_set_descriptor_ssbo2(&objects->render_descriptor_pool, 0, 6, 0,
+                &objects->uniform_buffer, material_table_offset,
+                sizeof(PigeonWGIMaterial) * singleton_data.max_materials);
+
+            PigeonWGIMaterial * materials = realloc(objects->materials,
+                sizeof(PigeonWGIMaterial) * singleton_data.max_materials);
+            ASSERT_R1(materials);
+            objects->materials = materials;
+
+            // No valid material has every byte set so every material is written in the next frame
+            memset(materials, 0xff, sizeof(PigeonWGIMaterial) * singleton_data.max_materials);
+            objects->material_table_offset = material_table_offset;
+            objects->material_table_size = singleton_data.max_materials;
+        }
+
+        if(recreated || objects->light_list_offset != light_list_offset ||
+            objects->light_list_size != light_list_size)
+        {
+            pigeon_vulkan_set_descriptor_ssbo2(&objects->render_descriptor_pool, 0, 7, 0,
+                &objects->uniform_buffer, light_list_offset, light_list_size);
+            pigeon_vulkan_set_descriptor_ssbo2(&objects->render_descriptor_pool, 0, 8, 0,
+                &objects->uniform_buffer, get_light_clusters_offset(align), get_light_clusters_size());
+            objects->light_list_offset = light_list_offset;
+            objects->light_list_size = light_list_size;
+        }
+
+        if(singleton_data.max_cull_groups && (recreated || objects->cull_data_offset != cull_offsets[0] ||
+            objects->cull_data_size != cull_data_end - cull_offsets[0]))
+        {
+            PigeonVulkanDescriptorPool * pool = &objects->cull_descriptor_pool;
+
+            pigeon_vulkan_set_descriptor_uniform_buffer2(pool, 0, 0, 0,
+                &objects->uniform_buffer, 0, sizeof(PigeonWGISceneUniformData));
+            pigeon_vulkan_set_descriptor_ssbo2(pool, 0, 1, 0,
+                &objects->uniform_buffer, round_up(sizeof(PigeonWGISceneUniformData), align),
+                sizeof(PigeonWGIDrawObject) * singleton_data.max_draws);
+
+            for(unsigned int i = 0; i < CULL_BUFFERS; i++) {
+                pigeon_vulkan_set_descriptor_ssbo2(pool, 0, 2+i, 0,
+                    &objects->uniform_buffer, cull_offsets[i], cull_sizes[i]);
+            }
+
+            objects->cull_data_offset = cull_offsets[0];
+            objects->cull_data_size = cull_data_end - cull_offsets[0];
+        }
+
+        if(recreated || objects->skin_data_offset != skin_offsets[0] ||
+            objects->skin_data_size != minimum_size - skin_offsets[0])
+        {
+            for(unsigned int i = 0; i < SKIN_BUFFERS; i++) {
+                pigeon_vulkan_set_descriptor_ssbo2(&objects->depth_descriptor_pool, 0, 3+i, 0,
+                    &objects->uniform_buffer, skin_offsets[i], skin_sizes[i]);
+                pigeon_vulkan_set_descriptor_ssbo2(&objects->render_descriptor_pool, 0, 9+i, 0,
+                    &objects->uniform_buffer, skin_offsets[i], skin_sizes[i]);
+            }
+
+            objects->skin_data_offset = skin_offsets[0];
+            objects->skin_data_size = minimum_size - skin_offsets[0];
+        }
     }
     else {
         if(objects->gl.uniform_buffer.size < minimum_size) {
@@ -471,9 +663,11 @@ PIGEON_ERR_RET pigeon_wgi_next_frame_poll(double delayed_timer_values[PIGEON_WGI
         {        
             memset(delayed_timer_values, 0, sizeof(double) * PIGEON_WGI_RENDER_STAGE__COUNT);
         }
-
-        for(unsigned int i = 0; i < PIGEON_WGI_RENDER_STAGE__COUNT; i++) {
-            delayed_timer_values[i] = absolute_times[2*i+1] - absolute_times[2*i];
+        else {
+            for(unsigned int i = 0; i < PIGEON_WGI_RENDER_STAGE__COUNT; i++) {
+                delayed_timer_values[i] = absolute_times[2*i+1] - absolute_times[2*i];
+            }
+            pigeon_wgi_update_render_scale(delayed_timer_values);
         }
     }
 
@@ -483,8 +677,7 @@ PIGEON_ERR_RET pigeon_wgi_next_frame_poll(double delayed_timer_values[PIGEON_WGI
 
 unsigned int pigeon_wgi_get_draw_data_alignment(void)
 {
-    if(VULKAN) return 1;
-    else return pigeon_opengl_get_uniform_buffer_min_alignment();
+    return 1;
 }
 
 unsigned int pigeon_wgi_get_bone_data_alignment(void)
@@ -493,27 +686,66 @@ unsigned int pigeon_wgi_get_bone_data_alignment(void)
     else return (pigeon_opengl_get_uniform_buffer_min_alignment() + 4*3*4 - 1) / (4*3*4);
 }
 
+// The per-frame buffers are recreated when a capacity grows.
+// Capacities grow by at least half so that a growing scene only causes a few reallocations
+static void grow_capacity(unsigned int * capacity, unsigned int required, unsigned int minimum)
+{
+    if(required > *capacity) {
+        unsigned int grown = *capacity + *capacity / 2;
+        *capacity = required > grown ? required : grown;
+    }
+    if(*capacity < minimum) *capacity = minimum;
+}
+
+// One descriptor set for each pigeon_wgi_skin_mesh call this frame
+static PIGEON_ERR_RET prepare_skin_descriptor_pool(PerFrameData * objects)
+{
+    if(singleton_data.skin_meshes <= objects->skin_descriptor_sets) return 0;
+
+    unsigned int sets = objects->skin_descriptor_sets;
+    grow_capacity(&sets, singleton_data.skin_meshes, 4);
+
+    if(objects->skin_descriptor_pool.vk_descriptor_pool)
+        pigeon_vulkan_destroy_descriptor_pool(&objects->skin_descriptor_pool);
+    objects->skin_descriptor_sets = 0;
+
+    PigeonVulkanDescriptorLayout * layouts = malloc(sizeof *layouts * sets);
+    ASSERT_R1(layouts);
+    for(unsigned int i = 0; i < sets; i++) layouts[i] = singleton_data.skin_descriptor_layout;
+
+    int err = pigeon_vulkan_create_descriptor_pool(&objects->skin_descriptor_pool, sets, layouts);
+    free(layouts);
+    ASSERT_R1(!err);
+
+    objects->skin_descriptor_sets = sets;
+    return 0;
+}
+
 PIGEON_ERR_RET pigeon_wgi_start_frame(unsigned int max_draws,
-    uint32_t max_multidraw_draws,
+    uint32_t max_multidraw_draws, uint32_t max_materials, uint32_t lights,
     PigeonWGIShadowParameters shadows[4], unsigned int total_bones,
     void ** draw_objects,
     PigeonWGIBoneMatrix ** bone_matrices)
 {
     ASSERT_R1(draw_objects && bone_matrices);
-    ASSERT_R1(max_draws <= 65536);
-    ASSERT_R1(total_bones <= max_draws*256);
-    ASSERT_R1(max_multidraw_draws <= max_draws);
+    ASSERT_R1(total_bones <= (uint64_t)max_draws*256);
 
-    if(max_draws > singleton_data.max_draws) singleton_data.max_draws = max_draws;
-    if(!singleton_data.max_draws) singleton_data.max_draws = 128;
-    
-    if(max_multidraw_draws > singleton_data.max_multidraw_draws)
-        singleton_data.max_multidraw_draws = max_multidraw_draws;
-    if(!singleton_data.max_multidraw_draws) singleton_data.max_multidraw_draws = 128;
+    grow_capacity(&singleton_data.max_draws, max_draws, 128);
 
     if(OPENGL) singleton_data.max_multidraw_draws = 0;
+    else grow_capacity(&singleton_data.max_multidraw_draws, max_multidraw_draws, 128);
+
+    grow_capacity(&singleton_data.max_materials, max_materials, 16);
+
+    // The OpenGL light list has a fixed size
+    if(VULKAN) grow_capacity(&singleton_data.max_lights, lights, 16);
+    singleton_data.lights = VULKAN || lights <= PIGEON_WGI_MAX_LIGHTS_OPENGL ? lights : PIGEON_WGI_MAX_LIGHTS_OPENGL;
+    ASSERT_R1(!pigeon_wgi_prepare_light_list());
+
+    // Culled draw objects are written after the ones written by the CPU
+    ASSERT_R1(singleton_data.cull_instances * 3 <= singleton_data.max_draws);
     
-    if(total_bones > singleton_data.total_bones) singleton_data.total_bones = total_bones;
+    grow_capacity(&singleton_data.total_bones, total_bones, 0);
 
     
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod]; 
@@ -525,6 +757,18 @@ PIGEON_ERR_RET pigeon_wgi_start_frame(unsigned int max_draws,
     objects->commands_in_progress = true;
     create_render_stage_info();
     ASSERT_R1(!prepare_uniform_buffers());
+    if(VULKAN) ASSERT_R1(!prepare_skin_descriptor_pool(objects));
+    singleton_data.skin_dispatches_count = 0;
+
+    // OpenGL buffers are invalidated when mapped
+    singleton_data.frame_number++;
+    if(VULKAN) {
+        singleton_data.draw_objects_frame = objects->draw_objects_frame;
+        objects->draw_objects_frame = singleton_data.frame_number;
+    }
+    else {
+        singleton_data.draw_objects_frame = 0;
+    }
 
 
     // Rebind ssao texture if render config has changed
@@ -567,6 +811,16 @@ PIGEON_ERR_RET pigeon_wgi_start_frame(unsigned int max_draws,
 
 
         *bone_matrices = (PigeonWGIBoneMatrix* ) (void*)dst;
+
+        // The compute shader adds to the instance and draw counts
+        if(singleton_data.cull_groups) {
+            unsigned int cull_offsets[CULL_BUFFERS], cull_sizes[CULL_BUFFERS];
+            get_cull_data_ranges(align, cull_offsets, cull_sizes);
+
+            dst = objects->uniform_buffer_memory.mapping;
+            memset(dst + cull_offsets[1], 0, 4 * 2 * PIGEON_WGI_MAX_LODS * singleton_data.cull_groups);
+            memset(dst + cull_offsets[3], 0, 4 * 2 * singleton_data.cull_render_states);
+        }
     }
     else {
         pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 0, 0, 
@@ -592,7 +846,7 @@ PIGEON_ERR_RET pigeon_wgi_start_frame(unsigned int max_draws,
 
         *draw_objects = dst;
 
-        dst += round_up(sizeof(PigeonWGIDrawObject), align) * singleton_data.max_draws;
+        dst += get_draw_objects_size_gl(align);
 
         *bone_matrices = (PigeonWGIBoneMatrix *) (void *) dst;
 
@@ -602,6 +856,190 @@ PIGEON_ERR_RET pigeon_wgi_start_frame(unsigned int max_draws,
     return 0;
 }
 
+void pigeon_wgi_set_material(unsigned int index, PigeonWGIMaterial const* material)
+{
+    assert(index < singleton_data.max_materials);
+
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+
+    if(VULKAN) {
+        // The table stays in the per-frame buffer between frames so only changed materials need writing
+        if(!memcmp(&objects->materials[index], material, sizeof *material)) return;
+        objects->materials[index] = *material;
+
+        const unsigned int align = pigeon_vulkan_get_buffer_min_alignment();
+        uint8_t * dst = objects->uniform_buffer_memory.mapping;
+        memcpy(dst + get_material_table_offset(align) + index * sizeof *material, material, sizeof *material);
+    }
+    else {
+        // The buffer is invalidated when it is mapped so every material is written every frame
+        const unsigned int align = pigeon_opengl_get_uniform_buffer_min_alignment();
+        uint8_t * dst = objects->gl.uniform_buffer.mapping;
+        memcpy(dst + get_material_table_offset(align) + index * round_up(sizeof *material, align),
+            material, sizeof *material);
+    }
+}
+
+PigeonWGILight* pigeon_wgi_get_lights(unsigned int * count)
+{
+    *count = singleton_data.lights;
+    return singleton_data.light_list;
+}
+
+uint64_t pigeon_wgi_get_frame_number(void)
+{
+    return singleton_data.frame_number;
+}
+
+uint64_t pigeon_wgi_get_draw_objects_frame(void)
+{
+    return singleton_data.draw_objects_frame;
+}
+
+bool pigeon_wgi_gpu_culling_supported(void)
+{
+    return VULKAN && pigeon_vulkan_draw_indirect_count_supported();
+}
+
+void pigeon_wgi_set_gpu_culling_sizes(unsigned int instances, unsigned int groups, unsigned int render_states)
+{
+    assert(pigeon_wgi_gpu_culling_supported());
+    assert(instances >= groups && groups >= render_states);
+
+    singleton_data.cull_instances = instances;
+    singleton_data.cull_groups = groups;
+    singleton_data.cull_render_states = render_states;
+
+    if(instances > singleton_data.max_cull_instances) singleton_data.max_cull_instances = instances;
+    if(groups > singleton_data.max_cull_groups) singleton_data.max_cull_groups = groups;
+    if(render_states > singleton_data.max_cull_render_states) singleton_data.max_cull_render_states = render_states;
+}
+
+PigeonWGICullGroup* pigeon_wgi_get_cull_groups(void)
+{
+    assert(singleton_data.cull_groups);
+
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+    unsigned int cull_offsets[CULL_BUFFERS], cull_sizes[CULL_BUFFERS];
+    get_cull_data_ranges(pigeon_vulkan_get_buffer_min_alignment(), cull_offsets, cull_sizes);
+
+    return (PigeonWGICullGroup*)(void*)((uint8_t*)objects->uniform_buffer_memory.mapping + cull_offsets[0]);
+}
+
+bool pigeon_wgi_compute_skinning_supported(void)
+{
+    return VULKAN && pigeon_vulkan_compute_supported();
+}
+
+PIGEON_ERR_RET pigeon_wgi_set_compute_skinning_sizes(unsigned int jobs, unsigned int vertices, unsigned int meshes)
+{
+    ASSERT_R1(pigeon_wgi_compute_skinning_supported());
+    ASSERT_R1(meshes <= jobs);
+
+    if(meshes > singleton_data.skin_dispatches_capacity) {
+        unsigned int capacity = singleton_data.skin_dispatches_capacity;
+        grow_capacity(&capacity, meshes, 4);
+
+        SkinDispatch * dispatches = realloc(singleton_data.skin_dispatches, sizeof *dispatches * capacity);
+        ASSERT_R1(dispatches);
+        singleton_data.skin_dispatches = dispatches;
+        singleton_data.skin_dispatches_capacity = capacity;
+    }
+
+    singleton_data.skin_jobs = jobs;
+    singleton_data.skin_vertices = vertices;
+    singleton_data.skin_meshes = meshes;
+
+    if(jobs > singleton_data.max_skin_jobs) singleton_data.max_skin_jobs = jobs;
+    if(vertices > singleton_data.max_skin_vertices) singleton_data.max_skin_vertices = vertices;
+    return 0;
+}
+
+PigeonWGISkinJob* pigeon_wgi_get_skin_jobs(void)
+{
+    assert(singleton_data.skin_jobs);
+
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+    unsigned int skin_offsets[SKIN_BUFFERS], skin_sizes[SKIN_BUFFERS];
+    get_skin_data_ranges(pigeon_vulkan_get_buffer_min_alignment(), skin_offsets, skin_sizes);
+
+    return (PigeonWGISkinJob*)(void*)((uint8_t*)objects->uniform_buffer_memory.mapping + skin_offsets[0]);
+}
+
+PIGEON_ERR_RET pigeon_wgi_skin_mesh(PigeonWGIMultiMesh* mesh, unsigned int first_job, unsigned int jobs,
+    unsigned int first_output, unsigned int outputs)
+{
+    ASSERT_R1(mesh && mesh->staged_buffer && mesh->has_bones);
+    ASSERT_R1(singleton_data.skin_dispatches_count < singleton_data.skin_meshes);
+    ASSERT_R1(first_job + jobs <= singleton_data.skin_jobs && first_output + outputs <= singleton_data.skin_vertices);
+
+    SkinDispatch d = {first_job, jobs, first_output, outputs, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+    // Vertex attributes are not interleaved and every attribute type is a multiple of 4 bytes
+    for(unsigned int i = 0; i < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES && mesh->attribute_types[i]; i++) {
+        uint32_t offset = (uint32_t)(mesh->attribute_start_offsets[i] / 4);
+
+        if(mesh->attribute_types[i] == PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED) d.position_offset = offset;
+        else if(mesh->attribute_types[i] == PIGEON_WGI_VERTEX_ATTRIBUTE_BONE) d.bone_offset = offset;
+        else if(mesh->attribute_types[i] == PIGEON_WGI_VERTEX_ATTRIBUTE_NORMAL) d.normal_offset = offset;
+    }
+    ASSERT_LOG_R1(d.position_offset != UINT32_MAX && d.bone_offset != UINT32_MAX,
+        "Compute skinning needs normalised positions and bones");
+
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+    PigeonVulkanDescriptorPool * pool = &objects->skin_descriptor_pool;
+    const unsigned int set = singleton_data.skin_dispatches_count;
+    const unsigned int align = pigeon_vulkan_get_buffer_min_alignment();
+
+    unsigned int skin_offsets[SKIN_BUFFERS], skin_sizes[SKIN_BUFFERS];
+    get_skin_data_ranges(align, skin_offsets, skin_sizes);
+
+    pigeon_vulkan_set_descriptor_ssbo2(pool, set, 0, 0, &objects->uniform_buffer,
+        get_bone_matrices_offset(align), singleton_data.total_bones * sizeof(PigeonWGIBoneMatrix));
+    for(unsigned int i = 0; i < SKIN_BUFFERS; i++) {
+        pigeon_vulkan_set_descriptor_ssbo2(pool, set, 1+i, 0,
+            &objects->uniform_buffer, skin_offsets[i], skin_sizes[i]);
+    }
+    pigeon_vulkan_set_descriptor_ssbo(pool, set, 3, 0, &mesh->staged_buffer->buffer);
+
+    singleton_data.skin_dispatches[singleton_data.skin_dispatches_count++] = d;
+    return 0;
+}
+
+// One thread per skinned vertex. The stages that draw wait for the upload stage so they see the skinned vertices
+static void record_compute_skinning(PigeonVulkanCommandPool * p)
+{
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+
+    const unsigned int group_size = 64;
+
+    for(unsigned int i = 0; i < singleton_data.skin_dispatches_count; i++) {
+        SkinDispatch * d = &singleton_data.skin_dispatches[i];
+        pigeon_vulkan_dispatch(p, 0, &singleton_data.pipeline_skin, &objects->skin_descriptor_pool, i,
+            sizeof *d, d, (d->outputs + group_size - 1) / group_size);
+    }
+}
+
+// Pass 0: choose the LOD of each instance and count the instances of each group and LOD
+// Pass 1: write the draw commands of each group and find where its culled draw objects go
+// Pass 2: copy the draw objects
+static void record_gpu_culling(PigeonVulkanCommandPool * p)
+{
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+
+    const unsigned int group_size = 64;
+    uint32_t pushc[3] = {0, singleton_data.cull_instances, singleton_data.cull_groups};
+
+    for(unsigned int pass = 0; pass < 3; pass++) {
+        pushc[0] = pass;
+        unsigned int threads = pass == 1 ? singleton_data.cull_groups * 2 : singleton_data.cull_instances;
+
+        if(pass) pigeon_vulkan_wait_for_compute_write(p, 0);
+        pigeon_vulkan_dispatch(p, 0, &singleton_data.pipeline_cull, &objects->cull_descriptor_pool, 0,
+            sizeof pushc, pushc, (threads + group_size - 1) / group_size);
+    }
+}
+
 PIGEON_ERR_RET pigeon_wgi_set_uniform_data(PigeonWGISceneUniformData * uniform_data)
 {
     uniform_data->znear = singleton_data.znear;
@@ -614,6 +1052,11 @@ PIGEON_ERR_RET pigeon_wgi_set_uniform_data(PigeonWGISceneUniformData * uniform_d
 
     uint8_t * dst = VULKAN ? objects->uniform_buffer_memory.mapping : 
         objects->gl.uniform_buffer.mapping;
+    const unsigned int align = VULKAN ? pigeon_vulkan_get_buffer_min_alignment()
+        : pigeon_opengl_get_uniform_buffer_min_alignment();
+
+    pigeon_wgi_write_lights(uniform_data, dst + get_light_list_offset(align),
+        VULKAN ? dst + get_light_clusters_offset(align) : NULL);
 
     memcpy(dst, uniform_data, sizeof(PigeonWGISceneUniformData));
 
@@ -626,6 +1069,8 @@ PIGEON_ERR_RET pigeon_wgi_set_uniform_data(PigeonWGISceneUniformData * uniform_d
 
         pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 0, 0, 
             sizeof(PigeonWGISceneUniformData));
+        pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 4,
+            get_light_list_offset(align), get_light_list_size());
     }
     
 
@@ -661,7 +1106,20 @@ static PipelineOrProgram get_pipeline(PigeonWGIRenderStage stage, PigeonWGIPipel
     }
 }
 
-void pigeon_wgi_draw_without_mesh(PigeonWGIRenderStage stage, PigeonWGIPipeline* pipeline, 
+// The command buffer that the draws of the stage and chunk are recorded into
+static PigeonVulkanCommandPool * get_draw_command_pool(PigeonWGIRenderStage stage, unsigned int chunk)
+{
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+
+    if(!singleton_data.stages[stage].record_chunks) {
+        assert(!chunk);
+        return &objects->command_pools[stage];
+    }
+    assert(chunk < singleton_data.stages[stage].record_chunks);
+    return &objects->chunk_command_pools[stage][chunk];
+}
+
+void pigeon_wgi_draw_without_mesh(PigeonWGIRenderStage stage, unsigned int chunk, PigeonWGIPipeline* pipeline, 
     unsigned int vertices)
 {
     assert(pipeline);
@@ -669,12 +1127,15 @@ void pigeon_wgi_draw_without_mesh(PigeonWGIRenderStage stage, PigeonWGIPipeline*
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
 
     if(VULKAN) {
-        PigeonVulkanCommandPool * p = &objects->command_pools[stage];
+        PigeonVulkanCommandPool * p = get_draw_command_pool(stage, chunk);
         assert(p->recording);
         pigeon_vulkan_bind_pipeline(p, 0, pipeline->pipeline);
         pigeon_vulkan_bind_descriptor_set(p, 0, pipeline->pipeline, 
             &objects->render_descriptor_pool, 0);
 
+        singleton_data.stages[stage].bound[chunk].pipeline = pipeline->pipeline;
+        singleton_data.stages[stage].bound[chunk].descriptor_pool = &objects->render_descriptor_pool;
+
         pigeon_vulkan_draw(p, 0, 0, vertices, 1,
             get_pipeline(stage, pipeline), 0, NULL);
     }
@@ -686,23 +1147,65 @@ void pigeon_wgi_draw_without_mesh(PigeonWGIRenderStage stage, PigeonWGIPipeline*
     }
 }
 
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while(b) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Binds the DrawObjectUniform block so that it starts at or before draw_index.
+// instances is reduced to the number of instances in the block. Returns the offset of draw_index in the block
+static int bind_draw_objects_gl(PigeonWGIRenderStageInfo * info, uint32_t draw_index, uint32_t * instances)
+{
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+    const unsigned int align = pigeon_opengl_get_uniform_buffer_min_alignment();
+
+    // The block can only be bound at draw objects with aligned offsets
+    const unsigned int step = align / gcd(sizeof(PigeonWGIDrawObject), align);
+    assert(step < PIGEON_WGI_DRAW_OBJECTS_OPENGL);
+
+    // Draws are sorted by state so nearby draws often use the same block
+    if(!info->bound[0].draw_objects || draw_index < info->bound[0].first_draw_object ||
+        draw_index + *instances > info->bound[0].first_draw_object + PIGEON_WGI_DRAW_OBJECTS_OPENGL)
+    {
+        unsigned int first = draw_index - draw_index % step;
+        pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 1, 
+            round_up(sizeof(PigeonWGISceneUniformData), align) + first * sizeof(PigeonWGIDrawObject),
+            sizeof(PigeonWGIDrawObject) * PIGEON_WGI_DRAW_OBJECTS_OPENGL);
+        info->bound[0].draw_objects = true;
+        info->bound[0].first_draw_object = first;
+    }
+
+    unsigned int offset = draw_index - info->bound[0].first_draw_object;
+    if(*instances > PIGEON_WGI_DRAW_OBJECTS_OPENGL - offset) *instances = PIGEON_WGI_DRAW_OBJECTS_OPENGL - offset;
+    return (int) offset;
+}
+
 static void draw_setup_common_gl(PigeonWGIRenderStage stage, PigeonWGIPipeline* pipeline, 
-    uint32_t draw_index, int diffuse_texture, int nmap_texture, 
+    uint32_t draw_index, uint32_t * instances, int diffuse_texture, int nmap_texture, unsigned int material_index,
     unsigned int first_bone_index, unsigned int bones_count)
 {
-    const PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
+    PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
 
-    // Bind shader, set mvp index uniform
+    // Bind shader, set mvp index and draw index offset uniforms
 
     PigeonOpenGLShaderProgram * program = NULL;
     int location = -1;
     int * value_cache = NULL;
+    int draw_offset_location = -1;
+    int * draw_offset_cache = NULL;
     PigeonWGIPipelineConfig const* cfg;
 
     if(info->render_mode == PIGEON_WGI_RENDER_STAGE_MODE_DEPTH_ONLY) {
         program = pipeline->gl.program_depth;
         location = pipeline->gl.program_depth_mvp_loc;
         value_cache = &pipeline->gl.program_depth_mvp;
+        draw_offset_location = pipeline->gl.program_depth_draw_offset_loc;
+        draw_offset_cache = &pipeline->gl.program_depth_draw_offset;
         cfg = &pipeline->gl.config_depth;
 
         if(stage >= PIGEON_WGI_RENDER_STAGE_SHADOW0 && stage <= PIGEON_WGI_RENDER_STAGE_SHADOW3) {
@@ -713,6 +1216,8 @@ static void draw_setup_common_gl(PigeonWGIRenderStage stage, PigeonWGIPipeline*
         program = pipeline->gl.program;
         location = pipeline->gl.program_mvp_loc;
         value_cache = &pipeline->gl.program_mvp;
+        draw_offset_location = pipeline->gl.program_draw_offset_loc;
+        draw_offset_cache = &pipeline->gl.program_draw_offset;
         cfg = &pipeline->gl.config;
     }
 
@@ -729,17 +1234,24 @@ static void draw_setup_common_gl(PigeonWGIRenderStage stage, PigeonWGIPipeline*
 
     const unsigned int align = pigeon_opengl_get_uniform_buffer_min_alignment();
 
-    unsigned int o = round_up(sizeof(PigeonWGISceneUniformData), align) +
-        draw_index * round_up(sizeof(PigeonWGIDrawObject), align);
+    int draw_offset = bind_draw_objects_gl(info, draw_index, instances);
+    if(*draw_offset_cache != draw_offset) {
+        pigeon_opengl_set_uniform_i(program, draw_offset_location, draw_offset);
+        *draw_offset_cache = draw_offset;
+    }
 
-    pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 1, o, sizeof(PigeonWGIDrawObject));
+    assert(material_index < singleton_data.max_materials);
+    unsigned int o = get_material_table_offset(align) + material_index * round_up(sizeof(PigeonWGIMaterial), align);
+    pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 3, o, sizeof(PigeonWGIMaterial));
 
-    o = round_up(sizeof(PigeonWGISceneUniformData), align) +
-        round_up(sizeof(PigeonWGIDrawObject), align) * singleton_data.max_draws +
+    o = round_up(sizeof(PigeonWGISceneUniformData), align) + get_draw_objects_size_gl(align) +
         first_bone_index * sizeof(PigeonWGIBoneMatrix);
     
-    if(bones_count)
+    if(bones_count && (!info->bound[0].bones || info->bound[0].first_bone_index != first_bone_index)) {
         pigeon_opengl_bind_uniform_buffer2(&objects->gl.uniform_buffer, 2, o, 256*sizeof(PigeonWGIBoneMatrix));
+        info->bound[0].bones = true;
+        info->bound[0].first_bone_index = first_bone_index;
+    }
 
 
     // Bind textures
@@ -752,30 +1264,45 @@ static void draw_setup_common_gl(PigeonWGIRenderStage stage, PigeonWGIPipeline*
     
 }
 
-static void draw_setup_common(PigeonWGIRenderStage stage, PigeonWGIPipeline* pipeline, 
-    PipelineOrProgram * vpipeline, PigeonWGIMultiMesh* mesh, uint32_t draw_index, 
-    int diffuse_texture, int nmap_texture, unsigned int first_bone_index, unsigned int bones_count)
+// With OpenGL instances is reduced to the number of instances that can be drawn at once
+static void draw_setup_common(PigeonWGIRenderStage stage, unsigned int chunk, PigeonWGIPipeline* pipeline, 
+    PipelineOrProgram * vpipeline, PigeonWGIMultiMesh* mesh, uint32_t draw_index, uint32_t * instances,
+    int diffuse_texture, int nmap_texture, unsigned int material_index,
+    unsigned int first_bone_index, unsigned int bones_count)
 {
     if(OPENGL) { 
+        assert(!chunk);
         *vpipeline = NULL;
-        draw_setup_common_gl(stage, pipeline, draw_index, diffuse_texture, nmap_texture, first_bone_index, bones_count); 
+        draw_setup_common_gl(stage, pipeline, draw_index, instances, diffuse_texture, nmap_texture, material_index,
+            first_bone_index, bones_count); 
         return; 
     }
 
     *vpipeline = get_pipeline(stage, pipeline);
     
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
-    const PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
-    PigeonVulkanCommandPool * p = &objects->command_pools[stage];
+    PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
+    PigeonVulkanCommandPool * p = get_draw_command_pool(stage, chunk);
     assert(p->recording);
 
-    pigeon_vulkan_bind_pipeline(p, 0, *vpipeline);
-
-    
-    pigeon_vulkan_bind_descriptor_set(p, 0, *vpipeline, 
+    PigeonVulkanDescriptorPool * descriptor_pool = 
         info->render_mode == PIGEON_WGI_RENDER_STAGE_MODE_DEPTH_ONLY ?
             (pipeline->transparent ? &objects->render_descriptor_pool : &objects->depth_descriptor_pool) : 
-            &objects->render_descriptor_pool, 0);
+            &objects->render_descriptor_pool;
+
+    // Descriptor sets are bound again when the pipeline changes in case the layouts are not compatible
+    if(info->bound[chunk].pipeline != *vpipeline || info->bound[chunk].descriptor_pool != descriptor_pool) {
+        if(info->bound[chunk].pipeline != *vpipeline)
+            pigeon_vulkan_bind_pipeline(p, 0, *vpipeline);
+
+        pigeon_vulkan_bind_descriptor_set(p, 0, *vpipeline, descriptor_pool, 0);
+
+        info->bound[chunk].pipeline = *vpipeline;
+        info->bound[chunk].descriptor_pool = descriptor_pool;
+    }
+
+    if(info->bound[chunk].mesh == mesh) return;
+    info->bound[chunk].mesh = mesh;
 
     unsigned int attribute_count = 0;
     for (; attribute_count < PIGEON_WGI_MAX_VERTEX_ATTRIBUTES; attribute_count++) {
@@ -791,10 +1318,11 @@ static void draw_setup_common(PigeonWGIRenderStage stage, PigeonWGIPipeline* pip
     }
 }
 
-void pigeon_wgi_draw(PigeonWGIRenderStage stage, PigeonWGIPipeline* pipeline, 
+void pigeon_wgi_draw(PigeonWGIRenderStage stage, unsigned int chunk, PigeonWGIPipeline* pipeline, 
     PigeonWGIMultiMesh* mesh, uint32_t start_vertex,
     uint32_t draw_index, uint32_t instances, uint32_t first, uint32_t count,
-    int diffuse_texture, int nmap_texture, unsigned int first_bone_index, unsigned int bones_count)
+    int diffuse_texture, int nmap_texture, unsigned int material_index,
+    unsigned int first_bone_index, unsigned int bones_count)
 {
     assert(pipeline && mesh);
     if(VULKAN) assert(pipeline->pipeline && mesh->staged_buffer);
@@ -803,37 +1331,36 @@ void pigeon_wgi_draw(PigeonWGIRenderStage stage, PigeonWGIPipeline* pipeline,
     if(!instances) instances = 1;
     if(!count) return;
 
-    if(OPENGL && instances > 1) {
-        assert(false);
-        return;
+    if(count == UINT32_MAX) {
+        count = (mesh->index_count ? mesh->index_count : mesh->vertex_count) - first;
     }
+    if(!mesh->index_count) assert(!start_vertex);
 
-    PipelineOrProgram vpipeline;
-    draw_setup_common(stage, pipeline, &vpipeline, mesh, draw_index, diffuse_texture, nmap_texture, first_bone_index, bones_count);
-
-    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
     const PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
-    uint32_t pushc[2] = {draw_index, info->mvp_index};
-    
-    if(mesh->index_count) {
-        if(count == UINT32_MAX) {
-            count = mesh->index_count - first;
-        }
 
-        if(VULKAN) pigeon_vulkan_draw_indexed(&objects->command_pools[stage], 0, 
-            start_vertex, first, count, instances, vpipeline, sizeof pushc, &pushc);
-        else pigeon_opengl_draw_indexed(mesh->opengl_vao, start_vertex, first, count);
-    }
-    else {
-        if(count == UINT32_MAX) {
-            count = mesh->vertex_count - first;
-        }
+    // With OpenGL the instances that are not in the bound DrawObjectUniform block are drawn with another call
+    while(instances) {
+        uint32_t n = instances;
 
-        assert(!start_vertex);
+        PipelineOrProgram vpipeline;
+        draw_setup_common(stage, chunk, pipeline, &vpipeline, mesh, draw_index, &n, diffuse_texture, nmap_texture,
+            material_index, first_bone_index, bones_count);
 
-        if(VULKAN) pigeon_vulkan_draw(&objects->command_pools[stage], 0, 
-            first, count, instances, vpipeline, sizeof pushc, &pushc);
-        else pigeon_opengl_draw(mesh->opengl_vao, first, count);
+        uint32_t pushc[2] = {draw_index, info->mvp_index};
+        
+        if(mesh->index_count) {
+            if(VULKAN) pigeon_vulkan_draw_indexed(get_draw_command_pool(stage, chunk), 0, 
+                start_vertex, first, count, n, vpipeline, sizeof pushc, &pushc);
+            else pigeon_opengl_draw_indexed(mesh->opengl_vao, start_vertex, first, count, n);
+        }
+        else {
+            if(VULKAN) pigeon_vulkan_draw(get_draw_command_pool(stage, chunk), 0, 
+                first, count, n, vpipeline, sizeof pushc, &pushc);
+            else pigeon_opengl_draw_instanced(mesh->opengl_vao, first, count, n);
+        }
+
+        draw_index += n;
+        instances -= n;
     }
 }
 
@@ -857,10 +1384,7 @@ void pigeon_wgi_multidraw_draw(unsigned int multidraw_draw_index, unsigned int s
 
     unsigned int o = round_up(sizeof(PigeonWGISceneUniformData), align);
 
-    if(VULKAN)
-        o += round_up(sizeof(PigeonWGIDrawObject) * singleton_data.max_draws, align);
-    else
-        o += round_up(sizeof(PigeonWGIDrawObject), align) * singleton_data.max_draws;
+    o += round_up(sizeof(PigeonWGIDrawObject) * singleton_data.max_draws, align);
 
     PigeonVulkanDrawIndexedIndirectCommand* indirect_cmds =
         (PigeonVulkanDrawIndexedIndirectCommand*)((uintptr_t)objects->uniform_buffer_memory.mapping + o);
@@ -876,7 +1400,35 @@ void pigeon_wgi_multidraw_draw(unsigned int multidraw_draw_index, unsigned int s
     cmd->firstInstance = first_instance;
 }
 
-void pigeon_wgi_multidraw_submit(PigeonWGIRenderStage stage,
+void pigeon_wgi_gpu_culled_draw(PigeonWGIRenderStage stage, unsigned int chunk, PigeonWGIPipeline* pipeline,
+    PigeonWGIMultiMesh* mesh, unsigned int render_state, unsigned int first_command, unsigned int commands_per_set)
+{
+    assert(pigeon_wgi_gpu_culling_supported());
+    assert(pipeline && pipeline->pipeline && mesh && mesh->staged_buffer);
+    assert(render_state < singleton_data.cull_render_states);
+    assert(mesh->index_count && mesh->vertex_count);
+
+    PipelineOrProgram vpipeline;
+    draw_setup_common(stage, chunk, pipeline, &vpipeline, mesh, 0, NULL, -1, -1, 0, 0, 0);
+
+    PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
+    unsigned int cull_offsets[CULL_BUFFERS], cull_sizes[CULL_BUFFERS];
+    get_cull_data_ranges(pigeon_vulkan_get_buffer_min_alignment(), cull_offsets, cull_sizes);
+
+    // Objects hidden from the camera can still cast shadows
+    unsigned int set = stage >= PIGEON_WGI_RENDER_STAGE_SHADOW0 && stage <= PIGEON_WGI_RENDER_STAGE_SHADOW3 ? 0 : 1;
+
+    const PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
+    uint32_t pushc[2] = {0, info->mvp_index};
+
+    pigeon_vulkan_multidraw_indexed_count(get_draw_command_pool(stage, chunk), 0,
+        vpipeline, sizeof pushc, &pushc,
+        &objects->uniform_buffer, cull_offsets[4],
+        first_command + set * commands_per_set, commands_per_set,
+        &objects->uniform_buffer, cull_offsets[3] + (render_state*2 + set) * 4);
+}
+
+void pigeon_wgi_multidraw_submit(PigeonWGIRenderStage stage, unsigned int chunk,
     PigeonWGIPipeline* pipeline, PigeonWGIMultiMesh* mesh,
     uint32_t first_multidraw_index, uint32_t multidraw_count)
 {
@@ -890,7 +1442,7 @@ void pigeon_wgi_multidraw_submit(PigeonWGIRenderStage stage,
     assert(mesh->index_count && mesh->vertex_count);
 
     PipelineOrProgram vpipeline;
-    draw_setup_common(stage, pipeline, &vpipeline, mesh, 0, -1, -1, 0, 0);
+    draw_setup_common(stage, chunk, pipeline, &vpipeline, mesh, 0, NULL, -1, -1, 0, 0, 0);
 
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
     
@@ -902,7 +1454,7 @@ void pigeon_wgi_multidraw_submit(PigeonWGIRenderStage stage,
     const PigeonWGIRenderStageInfo * info = &singleton_data.stages[stage];
     uint32_t pushc[2] = {0, info->mvp_index};
 
-    pigeon_vulkan_multidraw_indexed(&objects->command_pools[stage], 0, 
+    pigeon_vulkan_multidraw_indexed(get_draw_command_pool(stage, chunk), 0, 
         vpipeline, sizeof pushc, &pushc,
         &objects->uniform_buffer, o,
         first_multidraw_index, multidraw_count);
@@ -982,10 +1534,69 @@ static PIGEON_ERR_RET pigeon_wgi_start_record_gl(PigeonWGIRenderStage stage)
     return 0;
 }
 
-PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage stage)
+// The depth pre-pass and render stages draw to the top left of their framebuffers when the render scale is below 1
+static void set_stage_viewport(PigeonVulkanCommandPool * p, PigeonWGIRenderStage stage,
+    unsigned int width, unsigned int height)
+{
+    if(stage == PIGEON_WGI_RENDER_STAGE_DEPTH || stage == PIGEON_WGI_RENDER_STAGE_RENDER) {
+        width = pigeon_wgi_scale_render_size(width);
+        height = pigeon_wgi_scale_render_size(height);
+    }
+    pigeon_vulkan_set_viewport_size(p, 0, width, height);
+}
+
+// Full screen passes of the SSAO and bloom stages keep the whole viewport so that texture coordinates are the
+// same in framebuffers of different sizes. The scissor skips the pixels outside of the scaled area
+// (plus a margin for filtering)
+static void set_full_screen_pass_viewport(PigeonVulkanCommandPool * p, unsigned int width, unsigned int height)
+{
+    pigeon_vulkan_set_viewport_size(p, 0, width, height);
+
+    if(singleton_data.render_scale < 1) {
+        unsigned int w = pigeon_wgi_scale_render_size(width) + 2;
+        unsigned int h = pigeon_wgi_scale_render_size(height) + 2;
+        pigeon_vulkan_set_scissor_size(p, 0, w < width ? w : width, h < height ? h : height);
+    }
+}
+
+// One window pixel in texture coordinates of the part of a framebuffer that was drawn to.
+// The same as 1 / window_size at render scale 1
+static float get_scaled_one_pixel(unsigned int window_size)
+{
+    return (float)pigeon_wgi_scale_render_size(window_size) / ((float)window_size * (float)window_size);
+}
+
+// Centre of the last texel that was drawn to, in an image of image_size texels that covers the window.
+// Filters clamp to this so that they do not read the pixels outside of the scaled area
+static float get_max_tex_coord(unsigned int window_size, unsigned int image_size)
+{
+    float half_texel = 0.5f / (float)image_size;
+    float max = (float)pigeon_wgi_scale_render_size(window_size) / (float)window_size - half_texel;
+    return max > half_texel ? max : half_texel;
+}
+
+// Full screen passes and stages without a framebuffer draw to the swapchain image
+static PigeonVulkanFramebuffer * get_stage_framebuffer(PigeonWGIRenderStageInfo const* stage_info,
+    unsigned int * width, unsigned int * height)
+{
+    if(stage_info->render_mode != PIGEON_WGI_RENDER_STAGE_MODE_FULL_SCREEN_PASS && stage_info->framebuffer) {
+        *width = stage_info->framebuffer->width;
+        *height = stage_info->framebuffer->height;
+        return stage_info->framebuffer;
+    }
+
+    PigeonWGISwapchainInfo sc_info = pigeon_wgi_get_swapchain_info();
+    *width = sc_info.width;
+    *height = sc_info.height;
+    return &singleton_data.post_framebuffers[singleton_data.swapchain_image_index];
+}
+
+static PIGEON_ERR_RET start_record(PigeonWGIRenderStage stage, unsigned int chunks)
 {
     ASSERT_R1(stage != PIGEON_WGI_RENDER_STAGE_SSAO && stage != PIGEON_WGI_RENDER_STAGE_BLOOM);
     ASSERT_R1(singleton_data.stages[stage].active);
+    memset(&singleton_data.stages[stage].bound, 0, sizeof singleton_data.stages[stage].bound);
+    singleton_data.stages[stage].record_chunks = chunks;
     if(OPENGL) return pigeon_wgi_start_record_gl(stage);
 
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
@@ -1018,29 +1629,25 @@ PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage stage)
     }
     
     PigeonWGISwapchainInfo sc_info = pigeon_wgi_get_swapchain_info();
-    
-    unsigned int vp_w, vp_h;
-    PigeonVulkanFramebuffer * fb = NULL;
 
     if(stage_info->render_mode == PIGEON_WGI_RENDER_STAGE_MODE_FULL_SCREEN_PASS) {
         ASSERT_R1(stage == PIGEON_WGI_RENDER_STAGE_POST_AND_UI);
     }
     
-    if(stage_info->render_mode != PIGEON_WGI_RENDER_STAGE_MODE_FULL_SCREEN_PASS && stage_info->framebuffer) {
-        vp_w = stage_info->framebuffer->width;
-        vp_h = stage_info->framebuffer->height;
-        fb = stage_info->framebuffer;
-    }
-    else {
-        vp_w = sc_info.width;
-        vp_h = sc_info.height;
-        fb = &singleton_data.post_framebuffers[singleton_data.swapchain_image_index];
-    }
+    unsigned int vp_w, vp_h;
+    PigeonVulkanFramebuffer * fb = get_stage_framebuffer(stage_info, &vp_w, &vp_h);
 
-    pigeon_vulkan_set_viewport_size(p, 0, vp_w, vp_h);
+    set_stage_viewport(p, stage, vp_w, vp_h);
 
     if(stage_info->render_mode != PIGEON_WGI_RENDER_STAGE_MODE_FULL_SCREEN_PASS) {
-        pigeon_vulkan_start_render_pass(p, 0, stage_info->render_pass, fb, vp_w, vp_h, false);
+        pigeon_vulkan_start_render_pass(p, 0, stage_info->render_pass, fb, vp_w, vp_h, chunks > 0);
+    }
+
+    // Created here because pigeon_wgi_start_record_chunk can be called on any thread
+    for(unsigned int i = 0; i < chunks; i++) {
+        PigeonVulkanCommandPool * chunk_pool = &objects->chunk_command_pools[stage][i];
+        if(!chunk_pool->vk_command_pool)
+            ASSERT_R1(!pigeon_vulkan_create_command_pool(chunk_pool, 1, false, false, true));
     }
     
 
@@ -1051,8 +1658,9 @@ PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage stage)
             float one_pixel_x, one_pixel_y;
             float bloom_intensity;
         } post_pushc;
-        post_pushc.one_pixel_x = 1 / (float)sc_info.width;
-        post_pushc.one_pixel_y = 1 / (float)sc_info.height;
+        // Maps the window to the part of the render image that was drawn to
+        post_pushc.one_pixel_x = get_scaled_one_pixel(sc_info.width);
+        post_pushc.one_pixel_y = get_scaled_one_pixel(sc_info.height);
         post_pushc.bloom_intensity = singleton_data.bloom_intensity;
 
         pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_post, fb, vp_w, vp_h, false);
@@ -1066,6 +1674,48 @@ PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage stage)
     return 0;
 }
 
+PIGEON_ERR_RET pigeon_wgi_start_record(PigeonWGIRenderStage stage)
+{
+    return start_record(stage, 0);
+}
+
+PIGEON_ERR_RET pigeon_wgi_start_record_chunks(PigeonWGIRenderStage stage, unsigned int chunks)
+{
+    ASSERT_R1(VULKAN && chunks && chunks <= PIGEON_WGI_MAX_RECORD_CHUNKS);
+    ASSERT_R1(singleton_data.stages[stage].render_mode == PIGEON_WGI_RENDER_STAGE_MODE_DEPTH_ONLY ||
+        (singleton_data.stages[stage].render_mode == PIGEON_WGI_RENDER_STAGE_MODE_NORMAL &&
+            stage != PIGEON_WGI_RENDER_STAGE_POST_AND_UI));
+    return start_record(stage, chunks);
+}
+
+PIGEON_ERR_RET pigeon_wgi_start_record_chunk(PigeonWGIRenderStage stage, unsigned int chunk)
+{
+    PigeonWGIRenderStageInfo const* stage_info = &singleton_data.stages[stage];
+    ASSERT_R1(chunk < stage_info->record_chunks);
+
+    PigeonVulkanCommandPool * p = get_draw_command_pool(stage, chunk);
+    ASSERT_R1(!p->recording);
+    ASSERT_R1(!pigeon_vulkan_reset_command_pool(p));
+
+    unsigned int vp_w, vp_h;
+    PigeonVulkanFramebuffer * fb = get_stage_framebuffer(stage_info, &vp_w, &vp_h);
+
+    ASSERT_R1(!pigeon_vulkan_start_submission2(p, 0, stage_info->render_pass, fb));
+
+    // Dynamic state is not inherited from the primary command buffer
+    set_stage_viewport(p, stage, vp_w, vp_h);
+    return 0;
+}
+
+PIGEON_ERR_RET pigeon_wgi_end_record_chunk(PigeonWGIRenderStage stage, unsigned int chunk)
+{
+    ASSERT_R1(chunk < singleton_data.stages[stage].record_chunks);
+
+    PigeonVulkanCommandPool * p = get_draw_command_pool(stage, chunk);
+    ASSERT_R1(p->recording);
+    return pigeon_vulkan_end_submission(p, 0);
+}
+
 PIGEON_ERR_RET pigeon_wgi_end_record(PigeonWGIRenderStage stage)
 {
     PerFrameData * objects = &singleton_data.per_frame_objects[singleton_data.current_frame_index_mod];
@@ -1082,8 +1732,20 @@ PIGEON_ERR_RET pigeon_wgi_end_record(PigeonWGIRenderStage stage)
     ASSERT_R1(!p->recorded);
     ASSERT_R1(p->recording);
 
+    for(unsigned int i = 0; i < singleton_data.stages[stage].record_chunks; i++) {
+        PigeonVulkanCommandPool * chunk_pool = &objects->chunk_command_pools[stage][i];
+        ASSERT_R1(chunk_pool->recorded);
+        pigeon_vulkan_execute_secondary(p, 0, chunk_pool, 0);
+    }
+
     if(singleton_data.stages[stage].render_mode != PIGEON_WGI_RENDER_STAGE_MODE_NO_RENDER)
         pigeon_vulkan_end_render_pass(p, 0);
+
+    // The other stages wait for the upload stage so they see the culled draws
+    if(stage == PIGEON_WGI_RENDER_STAGE_UPLOAD && singleton_data.skin_dispatches_count)
+        record_compute_skinning(p);
+    if(stage == PIGEON_WGI_RENDER_STAGE_UPLOAD && singleton_data.cull_groups)
+        record_gpu_culling(p);
     
     if(pigeon_vulkan_general_queue_supports_timestamps())
         pigeon_vulkan_set_timer(p, 0, &objects->timer_query_pool, 1+2*stage);
@@ -1158,15 +1820,19 @@ PIGEON_ERR_RET pigeon_wgi_record_ssao(void)
 
         // SSAO
 
-        float pushc[5] = {
+        // The sample kernel is a fixed number of window pixels, so it covers the same part of the scene at any
+        // render scale
+        float pushc[9] = {
             singleton_data.znear, singleton_data.zfar,
             1 / (float)sc_info.width, 1 / (float)sc_info.height,
+            get_scaled_one_pixel(sc_info.width), get_scaled_one_pixel(sc_info.height),
+            get_max_tex_coord(sc_info.width, sc_info.width), get_max_tex_coord(sc_info.height, sc_info.height),
             singleton_data.ssao_cutoff
         };
 
         pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_ssao, 
             &singleton_data.ssao_framebuffers[0], sc_info.width, sc_info.height, false);
-        pigeon_vulkan_set_viewport_size(p, 0, sc_info.width, sc_info.height);
+        set_full_screen_pass_viewport(p, sc_info.width, sc_info.height);
         pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_ssao);
         pigeon_vulkan_bind_descriptor_set(p, 0, &singleton_data.pipeline_ssao, &singleton_data.ssao_descriptor_pools[0], 0);
         pigeon_vulkan_draw(p, 0, 0, 3, 1, &singleton_data.pipeline_ssao, sizeof pushc, pushc);
@@ -1182,10 +1848,12 @@ PIGEON_ERR_RET pigeon_wgi_record_ssao(void)
         unsigned int dst_w = sc_info.width / 4;
         unsigned int dst_h = sc_info.height / 4;
 
-        float downscale_pushc[2] = {1 / (float)src_w, 1 / (float)src_h};
+        // Each texel is the average of 4x4 source texels at any render scale
+        float downscale_pushc[4] = {1 / (float)src_w, 1 / (float)src_h,
+            get_max_tex_coord(sc_info.width, src_w), get_max_tex_coord(sc_info.height, src_h)};
 
 
-        pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+        set_full_screen_pass_viewport(p, dst_w, dst_h);
         pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_ssao, 
             &singleton_data.ssao_framebuffers[1], dst_w, dst_h, false);
         pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_ssao_downscale_x4);
@@ -1197,14 +1865,18 @@ PIGEON_ERR_RET pigeon_wgi_record_ssao(void)
 
         // ssao blur
         
+        // Sample distances are scaled in the same way as the SSAO kernel
         src_w = dst_w;
         src_h = dst_h;
-        float blur_pushc[2] = {0.5f / (float) src_w, 0.5f / (float) src_h};
+        const float blur_scale_x = (float)pigeon_wgi_scale_render_size(sc_info.width) / (float)sc_info.width;
+        const float blur_scale_y = (float)pigeon_wgi_scale_render_size(sc_info.height) / (float)sc_info.height;
+        float blur_pushc[4] = {0.5f * blur_scale_x / (float) src_w, 0.5f * blur_scale_y / (float) src_h,
+            get_max_tex_coord(sc_info.width, src_w), get_max_tex_coord(sc_info.height, src_h)};
 
         for(unsigned int i = 0; i < 2; i++) {
             pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_ssao, 
                 &singleton_data.ssao_framebuffers[1 + 1-(i % 2)], dst_w, dst_h, false);
-            pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+            set_full_screen_pass_viewport(p, dst_w, dst_h);
             pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_ssao_blur);
             pigeon_vulkan_bind_descriptor_set(p, 0, &singleton_data.pipeline_ssao_blur,
                 &singleton_data.ssao_descriptor_pools[!i ? 2 : 3], 0);
@@ -1214,8 +1886,8 @@ PIGEON_ERR_RET pigeon_wgi_record_ssao(void)
             if(!i)
                 pigeon_vulkan_wait_for_colour_write(p, 0, &singleton_data.ssao_images[1 + 1-(i % 2)].image);
 
-            blur_pushc[0] += 1.0f / (float) src_w;
-            blur_pushc[1] += 1.0f / (float) src_h;
+            blur_pushc[0] += blur_scale_x / (float) src_w;
+            blur_pushc[1] += blur_scale_y / (float) src_h;
         }
         if(pigeon_vulkan_general_queue_supports_timestamps())
             pigeon_vulkan_set_timer(p, 0, &objects->timer_query_pool, 1+2*PIGEON_WGI_RENDER_STAGE_SSAO);
@@ -1332,7 +2004,7 @@ PIGEON_ERR_RET pigeon_wgi_record_bloom(void)
             };
             
 
-            pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+            set_full_screen_pass_viewport(p, dst_w, dst_h);
             pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_bloom_blur, 
                 &singleton_data.bloom_framebuffers[i][0], dst_w, dst_h, false);
             pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_downscale_x2);
@@ -1347,7 +2019,7 @@ PIGEON_ERR_RET pigeon_wgi_record_bloom(void)
             
             float blur_pushc[2] = {0.5f / (float) src_w, 0.5f / (float) src_h};
 
-            pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+            set_full_screen_pass_viewport(p, dst_w, dst_h);
             pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_bloom_blur, 
                 &singleton_data.bloom_framebuffers[i][1], dst_w, dst_h, false);
             pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_blur);
@@ -1367,7 +2039,7 @@ PIGEON_ERR_RET pigeon_wgi_record_bloom(void)
             
         float blur_pushc[2] = {1.5f / (float) src_w, 1.5f / (float) src_h};
 
-        pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+        set_full_screen_pass_viewport(p, dst_w, dst_h);
         pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_bloom_blur, 
             &singleton_data.bloom_framebuffers[2][0], dst_w, dst_h, false);
         pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_blur);
@@ -1386,7 +2058,7 @@ PIGEON_ERR_RET pigeon_wgi_record_bloom(void)
             blur_pushc[0] = 1.5f / (float)src_w;
             blur_pushc[1] = 1.5f / (float)src_h;
 
-            pigeon_vulkan_set_viewport_size(p, 0, dst_w, dst_h);
+            set_full_screen_pass_viewport(p, dst_w, dst_h);
             pigeon_vulkan_start_render_pass(p, 0, &singleton_data.rp_bloom_blur, 
                 &singleton_data.bloom_framebuffers[1-i][0], dst_w, dst_h, false);
             pigeon_vulkan_bind_pipeline(p, 0, &singleton_data.pipeline_kawase_merge);
@@ -1429,6 +2101,10 @@ PIGEON_ERR_RET pigeon_wgi_submit_frame(void)
 
     objects->first_frame_submitted = true;    
 
+    // The GPU culling sizes are set again for the next frame
+    singleton_data.cull_instances = singleton_data.cull_groups = singleton_data.cull_render_states = 0;
+    singleton_data.skin_jobs = singleton_data.skin_vertices = singleton_data.skin_meshes = 0;
+
 
     ASSERT_R1(
         objects->command_pools[PIGEON_WGI_RENDER_STAGE_UPLOAD].recorded &&
@@ -161,42 +161,30 @@ PIGEON_ERR_RET pigeon_wgi_assign_shadow_framebuffers(void)
     return 0;
 }
 
-void pigeon_wgi_set_object_shadow_mvp_uniform(PigeonWGIDrawObject * data, mat4 model_matrix)
-{
-    for(unsigned int i = 0; i < 4; i++) {
-        PigeonWGIShadowParameters * p = &singleton_data.shadow_parameters[i];
-
-        if(p->resolution)
-            glm_mat4_mul(p->proj_view, model_matrix, data->proj_view_model[1+i]);
-        else
-            memset(data->proj_view_model[1+i], 0, 64);
-    }
-}
-
 void pigeon_wgi_set_shadow_uniforms(PigeonWGISceneUniformData* data)
 {
     for(unsigned int i = 0; i < 4; i++) {
         PigeonWGIShadowParameters * p = &singleton_data.shadow_parameters[i];
         if(!p->resolution) continue;
         
-        data->lights[i].shadow_pixel_offset = 1.0f / (float)p->resolution;
+        data->shadow_lights[i].shadow_pixel_offset = 1.0f / (float)p->resolution;
 
-        memcpy(data->lights[i].shadow_proj_view, p->proj_view, 64);
-        data->lights[i].is_shadow_caster = 1.0f;
+        memcpy(data->shadow_lights[i].shadow_proj_view, p->proj_view, 64);
+        data->shadow_lights[i].is_shadow_caster = (float)(i + 1);
 
         vec4 dir = {0, 0, 1, 0};
         glm_mat4_mulv(p->inv_view_matrix, dir, dir);
 
-        data->lights[i].neg_direction[0] = dir[0];
-        data->lights[i].neg_direction[1] = dir[1];
-        data->lights[i].neg_direction[2] = dir[2];
+        data->shadow_lights[i].neg_direction[0] = dir[0];
+        data->shadow_lights[i].neg_direction[1] = dir[1];
+        data->shadow_lights[i].neg_direction[2] = dir[2];
 
         vec4 position = {0, 0, 0, 1};
         glm_mat4_mulv(p->inv_view_matrix, position, position);
 
-        data->lights[i].world_position[0] = position[0];
-        data->lights[i].world_position[1] = position[1];
-        data->lights[i].world_position[2] = position[2];
-        data->lights[i].light_type = 0;
+        data->shadow_lights[i].world_position[0] = position[0];
+        data->shadow_lights[i].world_position[1] = position[1];
+        data->shadow_lights[i].world_position[2] = position[2];
+        data->shadow_lights[i].light_type = 0;
     }
 }
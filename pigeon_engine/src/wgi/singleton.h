@@ -60,6 +60,23 @@ typedef struct PigeonWGIRenderStageInfo {
 		} gl;
 	};
 
+	// 0 if the draws are recorded into the stage's primary command buffer (see pigeon_wgi_start_record_chunks)
+	unsigned int record_chunks;
+
+	// State set by the draws recorded so far, for each chunk. Cleared by pigeon_wgi_start_record.
+	// Draws are sorted by pipeline and mesh so consecutive draws can skip binding these again
+	struct {
+		void* pipeline; // PigeonVulkanPipeline*
+		PigeonVulkanDescriptorPool* descriptor_pool;
+		struct PigeonWGIMultiMesh* mesh;
+
+		bool bones; // OpenGL
+		unsigned int first_bone_index;
+
+		bool draw_objects; // OpenGL
+		unsigned int first_draw_object; // of the DrawObjectUniform block
+	} bound[PIGEON_WGI_MAX_RECORD_CHUNKS];
+
 } PigeonWGIRenderStageInfo;
 
 typedef struct PerFrameData {
@@ -67,6 +84,9 @@ typedef struct PerFrameData {
 		struct {
 			PigeonVulkanCommandPool command_pools[PIGEON_WGI_RENDER_STAGE__COUNT];
 
+			// Secondary command buffers of stages recorded in chunks. Created when first used
+			PigeonVulkanCommandPool chunk_command_pools[PIGEON_WGI_RENDER_STAGE__COUNT][PIGEON_WGI_MAX_RECORD_CHUNKS];
+
 			PigeonVulkanMemoryAllocation uniform_buffer_memory;
 			PigeonVulkanBuffer uniform_buffer;
 
@@ -94,6 +114,31 @@ typedef struct PerFrameData {
 
 			// 2 timer values for every render stage- before & after
 			PigeonVulkanTimerQueryPool timer_query_pool;
+
+			// Copy of the material table in uniform_buffer so that unchanged materials are not written again
+			// Reset when the table is moved or the buffer is recreated
+			PigeonWGIMaterial* materials;
+			unsigned int material_table_offset;
+			unsigned int material_table_size;
+
+			// Range of the light list descriptor, 0 size if it has not been set
+			unsigned int light_list_offset;
+			unsigned int light_list_size;
+
+			// Draw objects written by the CPU stay in uniform_buffer between frames. 0 if uniform_buffer was recreated
+			uint64_t draw_objects_frame; // Frame number (see pigeon_wgi_get_frame_number) of the last write
+
+			// GPU culling. Buffers are in uniform_buffer after the material table
+			PigeonVulkanDescriptorPool cull_descriptor_pool;
+			unsigned int cull_data_offset;
+			unsigned int cull_data_size; // Of the descriptor ranges, 0 if they have not been set
+
+			// Compute skinning. Buffers are in uniform_buffer after the GPU culling data.
+			// One descriptor set for each pigeon_wgi_skin_mesh call
+			PigeonVulkanDescriptorPool skin_descriptor_pool;
+			unsigned int skin_descriptor_sets;
+			unsigned int skin_data_offset;
+			unsigned int skin_data_size; // Of the descriptor ranges, 0 if they have not been set
 		};
 		struct {
 			PigeonOpenGLBuffer uniform_buffer;
@@ -109,6 +154,17 @@ typedef struct PerFrameData {
 	bool first_frame_submitted; // set to true when a frame has been rendered using this PerFrameData struct
 } PerFrameData;
 
+// Push constants of skin.comp. Attribute offsets are in words from the start of the mesh buffer
+typedef struct SkinDispatch {
+	uint32_t first_job;
+	uint32_t jobs;
+	uint32_t first_output;
+	uint32_t outputs;
+	uint32_t position_offset;
+	uint32_t bone_offset;
+	uint32_t normal_offset; // UINT32_MAX if the mesh has no normals
+} SkinDispatch;
+
 typedef struct SingletonData {
 	bool using_vulkan;
 	bool using_opengl;
@@ -138,6 +194,8 @@ typedef struct SingletonData {
 			PigeonVulkanDescriptorLayout two_texture_descriptor_layout;
 			PigeonVulkanDescriptorLayout render_descriptor_layout;
 			PigeonVulkanDescriptorLayout post_descriptor_layout;
+			PigeonVulkanDescriptorLayout cull_descriptor_layout;
+			PigeonVulkanDescriptorLayout skin_descriptor_layout;
 
 			PigeonVulkanSampler nearest_filter_sampler;
 			PigeonVulkanSampler bilinear_sampler;
@@ -162,6 +220,9 @@ typedef struct SingletonData {
 			PigeonVulkanPipeline pipeline_kawase_merge;
 			PigeonVulkanPipeline pipeline_post;
 
+			PigeonVulkanPipeline pipeline_cull; // Only if pigeon_wgi_gpu_culling_supported()
+			PigeonVulkanPipeline pipeline_skin; // Only if pigeon_wgi_compute_skinning_supported()
+
 			PigeonVulkanMemoryAllocation default_textures_memory;
 			PigeonVulkanMemoryAllocation default_textures_memory_black;
 			PigeonVulkanMemoryAllocation default_shadow_map_memory;
@@ -245,7 +306,36 @@ typedef struct SingletonData {
 
 	unsigned int max_draws;
 	unsigned int max_multidraw_draws;
+	unsigned int max_materials;
 	unsigned int total_bones;
+	unsigned int max_lights;
+
+	// Number of lights that can be written this frame (see pigeon_wgi_get_lights)
+	unsigned int lights;
+
+	// Written by the scene then copied to the per-frame buffer by pigeon_wgi_write_lights
+	PigeonWGILight* light_list;
+	unsigned int light_list_capacity;
+
+	// Bit masks of the lights in each cluster (Vulkan only)
+	uint32_t* light_cluster_bits;
+	unsigned int light_cluster_bits_capacity; // In words
+
+	// Set by pigeon_wgi_set_gpu_culling_sizes. The max_ values only grow
+	unsigned int cull_instances, cull_groups, cull_render_states;
+	unsigned int max_cull_instances, max_cull_groups, max_cull_render_states;
+
+	// Set by pigeon_wgi_set_compute_skinning_sizes. The max_ values only grow
+	unsigned int skin_jobs, skin_vertices, skin_meshes;
+	unsigned int max_skin_jobs, max_skin_vertices;
+
+	// Push constants of each pigeon_wgi_skin_mesh call, dispatched by pigeon_wgi_end_record
+	SkinDispatch* skin_dispatches;
+	unsigned int skin_dispatches_count;
+	unsigned int skin_dispatches_capacity;
+
+	uint64_t frame_number; // Incremented by pigeon_wgi_start_frame
+	uint64_t draw_objects_frame; // See pigeon_wgi_get_draw_objects_frame
 
 	unsigned int swapchain_image_index;
 	unsigned int previous_frame_index_mod;
@@ -259,6 +349,12 @@ typedef struct SingletonData {
 	float ambient[3];
 	float ssao_cutoff;
 
+	// Dynamic resolution (see pigeon_wgi_set_dynamic_resolution). render_scale is 1 while it is disabled
+	float render_scale;
+	double dynamic_resolution_target; // Milliseconds. 0 if disabled
+	float dynamic_resolution_min_scale;
+	uint64_t render_scale_changed_frame;
+
 } SingletonData;
 
 #ifndef WGI_C_
@@ -307,6 +403,18 @@ PIGEON_ERR_RET pigeon_wgi_create_descriptor_pools(void);
 PIGEON_ERR_RET pigeon_wgi_assign_shadow_framebuffers(void);
 void pigeon_wgi_set_shadow_uniforms(PigeonWGISceneUniformData* data);
 
+PIGEON_ERR_RET pigeon_wgi_prepare_light_list(void);
+void pigeon_wgi_destroy_light_list(void);
+// Called by pigeon_wgi_next_frame_poll with the GPU time of each stage
+void pigeon_wgi_update_render_scale(const double delayed_timer_values[PIGEON_WGI_RENDER_STAGE__COUNT]);
+
+// Width or height of the part of a framebuffer that the depth, SSAO, render and bloom stages draw to
+unsigned int pigeon_wgi_scale_render_size(unsigned int framebuffer_size);
+
+// Sets the radius of point lights and light_cluster_words then copies the lights and clusters.
+// clusters is NULL with OpenGL
+void pigeon_wgi_write_lights(PigeonWGISceneUniformData* data, void* lights, void* clusters);
+
 int pigeon_wgi_create_framebuffer_images(FramebufferImageObjects* objects, PigeonWGIImageFormat format,
 	unsigned int width, unsigned int height, bool to_be_transfer_src, bool to_be_transfer_dst, bool shadow);
 
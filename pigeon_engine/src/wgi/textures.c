@@ -13,7 +13,7 @@
 
 PIGEON_ERR_RET pigeon_wgi_create_descriptor_layouts(void)
 {
-	PigeonVulkanDescriptorBinding bindings[6];
+	PigeonVulkanDescriptorBinding bindings[11];
 
 	/* depth */
 
@@ -34,7 +34,14 @@ PIGEON_ERR_RET pigeon_wgi_create_descriptor_layouts(void)
 	bindings[2].vertex_shader_accessible = true;
 	bindings[2].elements = 1;
 
-	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.depth_descriptor_layout, 3, bindings));
+	// Compute skinning jobs and skinned vertices
+	for (unsigned int i = 3; i < 5; i++) {
+		bindings[i].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+		bindings[i].vertex_shader_accessible = true;
+		bindings[i].elements = 1;
+	}
+
+	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.depth_descriptor_layout, 5, bindings));
 
 	/* 1 texture */
 
@@ -98,7 +105,56 @@ PIGEON_ERR_RET pigeon_wgi_create_descriptor_layouts(void)
 	bindings[5].fragment_shader_accessible = true;
 	bindings[5].elements = 59;
 
-	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.render_descriptor_layout, 6, bindings));
+	// Material table
+	bindings[6].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+	bindings[6].fragment_shader_accessible = true;
+	bindings[6].elements = 1;
+
+	// Light list
+	bindings[7].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+	bindings[7].fragment_shader_accessible = true;
+	bindings[7].elements = 1;
+
+	// Light cluster bit masks
+	bindings[8].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+	bindings[8].fragment_shader_accessible = true;
+	bindings[8].elements = 1;
+
+	// Compute skinning jobs and skinned vertices
+	for (unsigned int i = 9; i < 11; i++) {
+		bindings[i].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+		bindings[i].vertex_shader_accessible = true;
+		bindings[i].elements = 1;
+	}
+
+	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.render_descriptor_layout, 11, bindings));
+
+	/* GPU culling */
+
+	memset(bindings, 0, sizeof bindings);
+
+	// Per-frame data, draw objects, cull groups, instance counts per LOD, culling results per instance,
+	// draw counts, indirect draw commands
+	for (unsigned int i = 0; i < 7; i++) {
+		bindings[i].type = i ? PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO : PIGEON_VULKAN_DESCRIPTOR_TYPE_UNIFORM;
+		bindings[i].compute_shader_accessible = true;
+		bindings[i].elements = 1;
+	}
+
+	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.cull_descriptor_layout, 7, bindings));
+
+	/* Compute skinning */
+
+	memset(bindings, 0, sizeof bindings);
+
+	// Bone matrices, jobs, skinned vertices, mesh vertices
+	for (unsigned int i = 0; i < 4; i++) {
+		bindings[i].type = PIGEON_VULKAN_DESCRIPTOR_TYPE_SSBO;
+		bindings[i].compute_shader_accessible = true;
+		bindings[i].elements = 1;
+	}
+
+	ASSERT_R1(!pigeon_vulkan_create_descriptor_layout(&singleton_data.skin_descriptor_layout, 4, bindings));
 
 	return 0;
 }
@@ -115,6 +171,10 @@ void pigeon_wgi_destroy_descriptor_layouts(void)
 		pigeon_vulkan_destroy_descriptor_layout(&singleton_data.two_texture_descriptor_layout);
 	if (singleton_data.post_descriptor_layout.handle)
 		pigeon_vulkan_destroy_descriptor_layout(&singleton_data.post_descriptor_layout);
+	if (singleton_data.cull_descriptor_layout.handle)
+		pigeon_vulkan_destroy_descriptor_layout(&singleton_data.cull_descriptor_layout);
+	if (singleton_data.skin_descriptor_layout.handle)
+		pigeon_vulkan_destroy_descriptor_layout(&singleton_data.skin_descriptor_layout);
 }
 
 PIGEON_ERR_RET pigeon_wgi_create_samplers(void)
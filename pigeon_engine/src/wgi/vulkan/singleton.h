@@ -25,6 +25,12 @@ typedef struct SingletonData {
 	bool etc2_optimal_available;
 	bool etc2_rgba_optimal_available;
 
+	bool general_queue_supports_compute;
+
+	// VK_KHR_draw_indirect_count is available and the general queue supports compute
+	bool draw_indirect_count_supported;
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count;
+
 	uint32_t general_queue_family;
 	uint32_t transfer_queue_family;
 
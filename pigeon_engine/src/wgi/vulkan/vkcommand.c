@@ -189,6 +189,19 @@ void pigeon_vulkan_set_viewport_size(
 	vkCmdSetScissor(get_cmd_buf(command_pool, buffer_index), 0, 1, &scissor);
 }
 
+void pigeon_vulkan_set_scissor_size(
+	PigeonVulkanCommandPool* command_pool, unsigned int buffer_index, unsigned int width, unsigned int height)
+{
+	assert(command_pool && command_pool->vk_command_pool && command_pool->vk_command_buffer);
+	assert(buffer_index < command_pool->buffer_count);
+	assert(width && height);
+
+	VkRect2D scissor = { 0 };
+	scissor.extent.width = width;
+	scissor.extent.height = height;
+	vkCmdSetScissor(get_cmd_buf(command_pool, buffer_index), 0, 1, &scissor);
+}
+
 void pigeon_vulkan_start_render_pass(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index,
 	PigeonVulkanRenderPass* render_pass, PigeonVulkanFramebuffer* framebuffer, unsigned int viewport_width,
 	unsigned int viewport_height, bool using_secondary_buffers)
@@ -309,6 +322,24 @@ void pigeon_vulkan_wait_for_vertex_data_transfer(PigeonVulkanCommandPool* comman
 		0, 1, &memory_barrier, 0, NULL, 0, NULL);
 }
 
+// Compute shader writes are made visible to later compute dispatches and to indirect draws in the same submission
+void pigeon_vulkan_wait_for_compute_write(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index)
+{
+	assert(command_pool && command_pool->vk_command_pool && command_pool->vk_command_buffer);
+	assert(buffer_index < command_pool->buffer_count);
+
+	VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier.dstAccessMask
+		= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(get_cmd_buf(command_pool, buffer_index),
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // source stage
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+			| VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, // destination stage
+		0, 1, &memory_barrier, 0, NULL, 0, NULL);
+}
+
 // Bilinear filtering will look bad if downsampling an image more than 2x
 void pigeon_vulkan_wait_and_blit_image(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index,
 	PigeonVulkanImage* src, PigeonVulkanImage* dst, bool bilinear_filter)
@@ -617,6 +648,56 @@ void pigeon_vulkan_multidraw_indexed(PigeonVulkanCommandPool* command_pool, unsi
 		sizeof(VkDrawIndexedIndirectCommand));
 }
 
+void pigeon_vulkan_multidraw_indexed_count(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index,
+	PigeonVulkanPipeline* pipeline, unsigned int push_constants_size, void* push_constants_data,
+	PigeonVulkanBuffer* buffer, uint64_t buffer_offset, uint32_t first_multidraw_index, uint32_t max_multidraw_cmd_count,
+	PigeonVulkanBuffer* count_buffer, uint64_t count_buffer_offset)
+{
+	assert(command_pool && command_pool->vk_command_pool && command_pool->vk_command_buffer);
+	assert(buffer_index < command_pool->buffer_count);
+	assert(!push_constants_size || push_constants_data);
+	assert(pipeline && pipeline->vk_pipeline_layout);
+	assert(singleton_data.draw_indirect_count_supported);
+	assert((uint64_t)buffer_offset
+			+ ((uint64_t)first_multidraw_index + (uint64_t)max_multidraw_cmd_count)
+				* sizeof(VkDrawIndexedIndirectCommand)
+		<= buffer->size);
+	assert(count_buffer && count_buffer_offset + 4 <= count_buffer->size && !(count_buffer_offset % 4));
+
+	VkCommandBuffer cmd_buf = get_cmd_buf(command_pool, buffer_index);
+	set_push_constants(cmd_buf, pipeline, push_constants_size, push_constants_data);
+
+	singleton_data.draw_indexed_indirect_count(cmd_buf, buffer->vk_buffer,
+		buffer_offset + first_multidraw_index * sizeof(VkDrawIndexedIndirectCommand), count_buffer->vk_buffer,
+		count_buffer_offset, max_multidraw_cmd_count, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void pigeon_vulkan_dispatch(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index,
+	PigeonVulkanPipeline* pipeline, PigeonVulkanDescriptorPool* descriptor_pool, unsigned int descriptor_set,
+	unsigned int push_constants_size, void* push_constants_data, uint32_t group_count)
+{
+	assert(command_pool && command_pool->vk_command_pool && command_pool->vk_command_buffer);
+	assert(buffer_index < command_pool->buffer_count);
+	assert(!push_constants_size || push_constants_data);
+	assert(pipeline && pipeline->vk_pipeline && pipeline->vk_pipeline_layout);
+	assert(descriptor_pool && descriptor_pool->vk_descriptor_pool);
+
+	if (!group_count)
+		return;
+
+	VkCommandBuffer cmd_buf = get_cmd_buf(command_pool, buffer_index);
+	vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->vk_pipeline);
+	vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->vk_pipeline_layout, 0, 1,
+		descriptor_pool->number_of_sets > 1 ? &descriptor_pool->vk_descriptor_sets[descriptor_set]
+											: &descriptor_pool->vk_descriptor_set,
+		0, NULL);
+	if (push_constants_data && push_constants_size) {
+		vkCmdPushConstants(cmd_buf, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constants_size,
+			push_constants_data);
+	}
+	vkCmdDispatch(cmd_buf, group_count, 1, 1);
+}
+
 void pigeon_vulkan_buffer_transfer(PigeonVulkanCommandPool* command_pool, unsigned int buffer_index,
 	PigeonVulkanBuffer* dst, uint64_t dst_offset, PigeonVulkanBuffer* src, uint64_t src_offset, uint64_t size)
 {
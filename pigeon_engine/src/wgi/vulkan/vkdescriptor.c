@@ -48,6 +48,9 @@ int pigeon_vulkan_create_descriptor_layout(
 		if (bindings[i].fragment_shader_accessible) {
 			layouts[i].stageFlags |= VK_SHADER_STAGE_FRAGMENT_BIT;
 		}
+		if (bindings[i].compute_shader_accessible) {
+			layouts[i].stageFlags |= VK_SHADER_STAGE_COMPUTE_BIT;
+		}
 		layouts[i].binding = i;
 	}
 
@@ -4,9 +4,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-static bool is_device_swapchain_capable(VkPhysicalDevice physical_device)
+static bool device_has_extension(VkPhysicalDevice physical_device, const char* name)
 {
-	assert(physical_device);
+	assert(physical_device && name);
 
 	uint32_t extension_count;
 	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, NULL);
@@ -18,7 +18,7 @@ static bool is_device_swapchain_capable(VkPhysicalDevice physical_device)
 	vkEnumerateDeviceExtensionProperties(physical_device, NULL, &extension_count, available_extensions);
 
 	for (unsigned int i = 0; i < extension_count; i++) {
-		if (strcmp(available_extensions[i].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+		if (strcmp(available_extensions[i].extensionName, name) == 0) {
 			free(available_extensions);
 			return true;
 		}
@@ -56,7 +56,7 @@ static bool is_device_suitable(VkPhysicalDevice physical_device, bool dedicated)
 {
 	assert(physical_device);
 
-	if (!is_device_swapchain_capable(physical_device)) {
+	if (!device_has_extension(physical_device, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
 		return false;
 	}
 
@@ -73,6 +73,7 @@ static bool is_device_suitable(VkPhysicalDevice physical_device, bool dedicated)
 
 	singleton_data.general_queue_family = UINT32_MAX;
 	bool found_general_queue = find_general_queue(physical_device, queue_properties, queue_family_count, true);
+	bool general_queue_supports_compute = found_general_queue;
 
 	if (!found_general_queue) {
 		found_general_queue = find_general_queue(physical_device, queue_properties, queue_family_count, false);
@@ -114,6 +115,9 @@ static bool is_device_suitable(VkPhysicalDevice physical_device, bool dedicated)
 	}
 
 	singleton_data.depth_clamp_supported = device_features.depthClamp;
+	singleton_data.general_queue_supports_compute = general_queue_supports_compute;
+	singleton_data.draw_indirect_count_supported = general_queue_supports_compute
+		&& device_has_extension(physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
 	singleton_data.anisotropy_supported
 		= device_features.samplerAnisotropy && device_properties.limits.maxSamplerAnisotropy >= 16;
 
@@ -171,6 +175,8 @@ static bool is_device_suitable(VkPhysicalDevice physical_device, bool dedicated)
 		puts("Dedicated allocation supported");
 	if (singleton_data.b10g11r11_ufloat_pack32_optimal_available)
 		puts("VK_FORMAT_B10G11R11_UFLOAT_PACK32 render+blend target supported");
+	if (singleton_data.draw_indirect_count_supported)
+		puts("Draw indirect count supported");
 
 	return true;
 }
@@ -74,8 +74,8 @@ void pigeon_vulkan_destroy_shader(PigeonVulkanShader* shader)
 	}
 }
 
-static PIGEON_ERR_RET create_layout(
-	VkPipelineLayout* layout, PigeonVulkanDescriptorLayout* descriptor_layout, unsigned int push_constants_size)
+static PIGEON_ERR_RET create_layout(VkPipelineLayout* layout, PigeonVulkanDescriptorLayout* descriptor_layout,
+	unsigned int push_constants_size, VkShaderStageFlags push_constants_stages)
 {
 	ASSERT_R1(layout && !*layout);
 	if (descriptor_layout)
@@ -93,7 +93,7 @@ static PIGEON_ERR_RET create_layout(
 	VkPushConstantRange push_constants = { 0 };
 
 	if (push_constants_size) {
-		push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		push_constants.stageFlags = push_constants_stages;
 		push_constants.size = push_constants_size;
 		pipeline_layout_create.pushConstantRangeCount = 1;
 		pipeline_layout_create.pPushConstantRanges = &push_constants;
@@ -115,7 +115,8 @@ PIGEON_ERR_RET pigeon_vulkan_create_pipeline(PigeonVulkanPipeline* pipeline, Pig
 		ASSERT_R1(false);
 	}
 
-	ASSERT_R1(!create_layout(&pipeline->vk_pipeline_layout, descriptor_layout, push_constants_size));
+	ASSERT_R1(!create_layout(&pipeline->vk_pipeline_layout, descriptor_layout, push_constants_size,
+		VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT));
 
 	VkPipelineShaderStageCreateInfo shaders[2] = { { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
 		{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO } };
@@ -268,6 +269,34 @@ PIGEON_ERR_RET pigeon_vulkan_create_pipeline(PigeonVulkanPipeline* pipeline, Pig
 	return 0;
 }
 
+PIGEON_ERR_RET pigeon_vulkan_create_compute_pipeline(PigeonVulkanPipeline* pipeline, PigeonVulkanShader* shader,
+	unsigned int push_constants_size, PigeonVulkanDescriptorLayout* descriptor_layout)
+{
+	if (!pipeline || !shader || !shader->vk_shader_module || push_constants_size > 128) {
+		ASSERT_R1(false);
+	}
+
+	ASSERT_R1(!create_layout(
+		&pipeline->vk_pipeline_layout, descriptor_layout, push_constants_size, VK_SHADER_STAGE_COMPUTE_BIT));
+	pipeline->push_constants_size = (unsigned char)push_constants_size;
+
+	VkComputePipelineCreateInfo pipeline_create = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	pipeline_create.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create.stage.module = shader->vk_shader_module;
+	pipeline_create.stage.pName = "main";
+	pipeline_create.layout = pipeline->vk_pipeline_layout;
+	pipeline_create.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(vkdev, VK_NULL_HANDLE, 1, &pipeline_create, NULL, &pipeline->vk_pipeline)
+		!= VK_SUCCESS) {
+		vkDestroyPipelineLayout(vkdev, pipeline->vk_pipeline_layout, NULL);
+		pipeline->vk_pipeline_layout = NULL;
+		ASSERT_LOG_R1(false, "vkCreateComputePipelines error");
+	}
+	return 0;
+}
+
 void pigeon_vulkan_destroy_pipeline(PigeonVulkanPipeline* pipeline)
 {
 	assert(pipeline);
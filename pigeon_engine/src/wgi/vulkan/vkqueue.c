@@ -36,9 +36,9 @@ PIGEON_ERR_RET pigeon_create_vulkan_logical_device_and_queues(void)
 	device_create_info.queueCreateInfoCount = singleton_data.transfer_queue_family == UINT32_MAX ? 1 : 2;
 	device_create_info.pEnabledFeatures = &physical_device_features;
 
-	const char* extensions[1] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	const char* extensions[2] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME };
 
-	device_create_info.enabledExtensionCount = 1;
+	device_create_info.enabledExtensionCount = singleton_data.draw_indirect_count_supported ? 2 : 1;
 	device_create_info.ppEnabledExtensionNames = extensions;
 
 #ifndef NDEBUG
@@ -51,6 +51,13 @@ PIGEON_ERR_RET pigeon_create_vulkan_logical_device_and_queues(void)
 		vkCreateDevice(singleton_data.physical_device, &device_create_info, NULL, &singleton_data.device) == VK_SUCCESS,
 		"vkCreateDevice error");
 
+	if (singleton_data.draw_indirect_count_supported) {
+		singleton_data.draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+			singleton_data.device, "vkCmdDrawIndexedIndirectCountKHR");
+		if (!singleton_data.draw_indexed_indirect_count)
+			singleton_data.draw_indirect_count_supported = false;
+	}
+
 	/* Create queues */
 
 	vkGetDeviceQueue(singleton_data.device, singleton_data.general_queue_family, 0, &singleton_data.general_queue);
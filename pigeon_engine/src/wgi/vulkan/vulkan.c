@@ -53,6 +53,9 @@ bool pigeon_vulkan_etc1_optimal_available(void) { return singleton_data.etc1_opt
 bool pigeon_vulkan_etc2_optimal_available(void) { return singleton_data.etc2_optimal_available; }
 bool pigeon_vulkan_etc2_rgba_optimal_available(void) { return singleton_data.etc2_rgba_optimal_available; }
 
+bool pigeon_vulkan_compute_supported(void) { return singleton_data.general_queue_supports_compute; }
+bool pigeon_vulkan_draw_indirect_count_supported(void) { return singleton_data.draw_indirect_count_supported; }
+
 void pigeon_vulkan_wait_idle(void)
 {
 	if (vkdev)
@@ -12,6 +12,7 @@
 #include <pigeon/wgi/vulkan/swapchain.h>
 #include <pigeon/wgi/vulkan/vulkan.h>
 #include <pigeon/wgi/wgi.h>
+#include <stdlib.h>
 #include <string.h>
 
 void pigeon_wgi_validate_render_cfg(PigeonWGIRenderConfig* render_cfg) { (void)render_cfg; }
@@ -42,6 +43,7 @@ PIGEON_ERR_RET pigeon_wgi_init(PigeonWindowParameters window_parameters, bool pr
 	singleton_data.ambient[1] = 0.08f;
 	singleton_data.ambient[2] = 0.083f;
 	singleton_data.ssao_cutoff = 0.02f;
+	singleton_data.render_scale = 1;
 
 	pigeon_wgi_set_depth_range(znear, zfar);
 
@@ -159,6 +161,10 @@ void pigeon_wgi_deinit(void)
 	if (pigeon_wgi_assign_shadow_framebuffers()) { }
 
 	pigeon_wgi_destroy_per_frame_objects();
+	pigeon_wgi_destroy_light_list();
+	free(singleton_data.skin_dispatches);
+	singleton_data.skin_dispatches = NULL;
+	singleton_data.skin_dispatches_capacity = 0;
 	pigeon_wgi_destroy_default_textures();
 	pigeon_wgi_destroy_standard_pipeline_objects();
 	if (VULKAN) {
@@ -192,35 +198,6 @@ void pigeon_wgi_perspective(mat4 m, float fovy, float aspect)
 	m[1][1] *= -1.0f;
 }
 
-void pigeon_wgi_get_normal_model_matrix(const mat4 model, mat4 normal_model_matrix)
-{
-	mat4 m;
-	glm_mat4_inv((vec4*)model, m);
-
-#if defined(__SSE__) || defined(__SSE2__)
-	glm_mat4_transpose_to(m, normal_model_matrix);
-#else
-	// glm_mat4_transpose_to does not write in order (preferred for writing uniform data)
-	//	so it is reimplemented here
-	normal_model_matrix[0][0] = model[0][0];
-	normal_model_matrix[0][1] = model[1][0];
-	normal_model_matrix[0][2] = model[2][0];
-	normal_model_matrix[0][3] = model[3][0];
-	normal_model_matrix[1][0] = model[0][1];
-	normal_model_matrix[1][1] = model[1][1];
-	normal_model_matrix[1][2] = model[2][1];
-	normal_model_matrix[1][3] = model[3][1];
-	normal_model_matrix[2][0] = model[0][2];
-	normal_model_matrix[2][1] = model[1][2];
-	normal_model_matrix[2][2] = model[2][2];
-	normal_model_matrix[2][3] = model[3][2];
-	normal_model_matrix[3][0] = model[0][3];
-	normal_model_matrix[3][1] = model[1][3];
-	normal_model_matrix[3][2] = model[2][3];
-	normal_model_matrix[3][3] = model[3][3];
-#endif
-}
-
 bool pigeon_wgi_bc1_optimal_available(void)
 {
 	if (VULKAN)
@@ -18,13 +18,16 @@ layout (constant_id = 0) const int SC_DOWNSCALE_SAMPLES = 8;
 layout(push_constant) uniform PushConstantsObject
 {
 	vec2 offset; // UV offset for 1 pixel in src image
+	vec2 max_tex_coord; // Centre of the bottom right texel of src image that was drawn to
 } push_constants;
 
 #define OFFSET push_constants.offset
+#define MAX_TEX_COORD push_constants.max_tex_coord
 
 #else
 
 uniform vec2 OFFSET;
+#define MAX_TEX_COORD vec2(1.0)
 
 #endif
 
@@ -36,7 +39,7 @@ void main() {
 	for(int y = 0; y < SC_DOWNSCALE_SAMPLES; y++) {
 		offset.x = -OFFSET.x * (SC_DOWNSCALE_SAMPLES-1);
 		for(int x = 0; x < SC_DOWNSCALE_SAMPLES; x++) {
-			ao += texture(src_image, pass_tex_coord + offset).r;
+			ao += texture(src_image, min(pass_tex_coord + offset, MAX_TEX_COORD)).r;
 
 			offset.x += OFFSET.x*2;
 		}
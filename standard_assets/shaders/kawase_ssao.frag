@@ -13,13 +13,16 @@ BINDING(0) uniform sampler2D src_image;
 layout(push_constant) uniform PushConstantsObject
 {
 	vec2 sample_distance;
+	vec2 max_tex_coord; // Centre of the bottom right texel of src image that was drawn to
 } push_constants;
 
 #define SAMPLE_DISTANCE push_constants.sample_distance
+#define MAX_TEX_COORD push_constants.max_tex_coord
 
 #else
 
 uniform vec2 SAMPLE_DISTANCE;
+#define MAX_TEX_COORD vec2(1.0)
 
 #endif
 
@@ -31,7 +34,7 @@ void main() {
 		for(int x = -1; x <= 1; x += 2) {
 			vec2 p = pass_tex_coord + vec2(x,y) * SAMPLE_DISTANCE;
 
-			ao += texture(src_image, p).r;
+			ao += texture(src_image, min(p, MAX_TEX_COORD)).r;
 		}
 	}
 
@@ -5,7 +5,7 @@
 
 LOCATION(0) in vec3 pass_normal;
 LOCATION(1) in vec2 pass_uv;
-LOCATION(2) flat in int pass_draw_index;
+LOCATION(2) flat in int pass_material_index;
 LOCATION(3) in mat3 pass_tangent_to_world;
 LOCATION(6) in vec3 pass_position_world_space;
 
@@ -39,14 +39,17 @@ uniform sampler2DArray nmap_texture; // opengl binding 6
 
 #endif
 
+#define NO_DRAW_OBJECTS
+#define MATERIAL_TABLE
+#define LIGHT_LIST
 #include "ubo.glsl"
 #include "random.glsl"
 
 
 #if __VERSION__ >= 460
-    #define data draw_objects.obj[pass_draw_index]
+    #define data materials.m[pass_material_index]
 #else
-    #define data draw_object.obj
+    #define data material.m
 #endif
 
 float sample_shadow_map(int i, vec3 coords_and_refz)
@@ -89,7 +92,7 @@ vec3 get_normal() {
 }
 
 float calculate_light(int i, vec3 normal) {
-#define light ubo.lights[i]
+#define light lights.l[i]
 
     float intensity;
 
@@ -106,6 +109,11 @@ float calculate_light(int i, vec3 normal) {
         to_light_norm = to_light / dist_to_light;
         intensity = max(dot(normal, to_light_norm), 0.0);
         intensity /= max(0.1, dist_to_light*dist_to_light);
+
+        // Fades to 0 at the radius of the light (see light_clusters.c)
+        float f = dist_to_light / max(light.light_intensity_and_shadow_pixel_offset.w, 0.0001);
+        f = clamp(1.0 - f*f*f*f, 0.0, 1.0);
+        intensity *= f*f;
     }
 
     if(data.specular_intensity > 0.0) {
@@ -121,75 +129,93 @@ float calculate_light(int i, vec3 normal) {
 #undef light
 }
 
-void calculate_basic_lighting(vec3 normal, out float intensities[4]) {
-    for(int i = 0; i < ubo.number_of_lights && i < 4; i++) {
-        intensities[i] = calculate_light(i, normal);
-    }
-}
-
-vec3 apply_lighting(vec2 tex_coord, float intensities[4]) {
-    vec3 colour = ubo.ambient.rgb;
-
-	float random_value;
-
-    if(SC_SHADOW_TYPE == SHADOW_TYPE_NOISY) {
-        random_value = rand(tex_coord);
-    }
-
-    for(int i = 0; i < ubo.number_of_lights && i < 4; i++) {
-        #define light ubo.lights[i]
+vec3 apply_light(int i, vec3 normal, float random_value) {
+    #define light lights.l[i]
 
-        float intensity = intensities[i];
+    float intensity = calculate_light(i, normal);
 
-        if(light.neg_direction_and_is_shadow_caster.w != 0.0) {
-            vec4 shadow_xyzw = light.shadow_proj_view * vec4(pass_position_world_space, 1.0);
-            vec2 abs_xy = abs(shadow_xyzw.xy);
-            shadow_xyzw.xy = shadow_xyzw.xy*0.5 + vec2(0.5);
+    if(light.neg_direction_and_is_shadow_caster.w != 0.0) {
+        int s = int(light.neg_direction_and_is_shadow_caster.w) - 1;
+        vec4 shadow_xyzw = ubo.shadow_lights[s].shadow_proj_view * vec4(pass_position_world_space, 1.0);
+        vec2 abs_xy = abs(shadow_xyzw.xy);
+        shadow_xyzw.xy = shadow_xyzw.xy*0.5 + vec2(0.5);
 #ifdef VULKAN
-            const float bias_multiplier = 1.0;
+        const float bias_multiplier = 1.0;
 #else
-            const float bias_multiplier = 1.4;
-            shadow_xyzw.y = 1.0 - shadow_xyzw.y;
+        const float bias_multiplier = 1.4;
+        shadow_xyzw.y = 1.0 - shadow_xyzw.y;
 #endif
-            shadow_xyzw.z += 0.001 * bias_multiplier;
+        shadow_xyzw.z += 0.001 * bias_multiplier;
 
-            if(abs_xy.x < 1.0 && abs_xy.y < 1.0 && shadow_xyzw.z > 0) {
-                float shadow = 0.0;
-                #define shadow_texture_offset light.light_intensity_and_shadow_pixel_offset.w
+        if(abs_xy.x < 1.0 && abs_xy.y < 1.0 && shadow_xyzw.z > 0) {
+            float shadow = 0.0;
+            #define shadow_texture_offset ubo.shadow_lights[s].light_intensity_and_shadow_pixel_offset.w
 
-                if(SC_SHADOW_TYPE == SHADOW_TYPE_NOISY) {
-                    vec2 o = vec2(mod(random_value, 1.0), mod(random_value * 10.0, 1.0)) * 4 - vec2(2.0);
-                    float d = shadow_xyzw.z;
-                    if(o.x+o.y >= 2.0) d += 0.0005 * bias_multiplier;
-                    shadow = sample_shadow_map(i, vec3(shadow_xyzw.xy + o*shadow_texture_offset, d));
-                }
-                else if(SC_SHADOW_TYPE == SHADOW_TYPE_PCF4) {
-                    for (float y = -0.5; y <= 0.5; y += 1.0) {   
-                        for (float x = -0.5; x <= 0.5; x += 1.0) {
-                            shadow += sample_shadow_map(i, vec3(shadow_xyzw.xy + vec2(x,y) * shadow_texture_offset, shadow_xyzw.z));
-                        }
+            if(SC_SHADOW_TYPE == SHADOW_TYPE_NOISY) {
+                vec2 o = vec2(mod(random_value, 1.0), mod(random_value * 10.0, 1.0)) * 4 - vec2(2.0);
+                float d = shadow_xyzw.z;
+                if(o.x+o.y >= 2.0) d += 0.0005 * bias_multiplier;
+                shadow = sample_shadow_map(s, vec3(shadow_xyzw.xy + o*shadow_texture_offset, d));
+            }
+            else if(SC_SHADOW_TYPE == SHADOW_TYPE_PCF4) {
+                for (float y = -0.5; y <= 0.5; y += 1.0) {   
+                    for (float x = -0.5; x <= 0.5; x += 1.0) {
+                        shadow += sample_shadow_map(s, vec3(shadow_xyzw.xy + vec2(x,y) * shadow_texture_offset, shadow_xyzw.z));
                     }
-                    shadow /= 4.0; 
                 }
-                else { // SHADOW_TYPE_PCF16
-                    for (float y = -1.5; y <= 1.5; y += 1.0) {   
-                        for (float x = -1.5; x <= 1.5; x += 1.0) {
-                            float d = shadow_xyzw.z;
-                            if(abs(y) == 1.5 || abs(x) == 1.5) d += 0.0005 * bias_multiplier;
-                            shadow += sample_shadow_map(i, vec3(shadow_xyzw.xy + vec2(x,y) * shadow_texture_offset, d));
-                        }
+                shadow /= 4.0; 
+            }
+            else { // SHADOW_TYPE_PCF16
+                for (float y = -1.5; y <= 1.5; y += 1.0) {   
+                    for (float x = -1.5; x <= 1.5; x += 1.0) {
+                        float d = shadow_xyzw.z;
+                        if(abs(y) == 1.5 || abs(x) == 1.5) d += 0.0005 * bias_multiplier;
+                        shadow += sample_shadow_map(s, vec3(shadow_xyzw.xy + vec2(x,y) * shadow_texture_offset, d));
                     }
-                    shadow /= 16.0; 
                 }
-                shadow *= shadow;
-                intensity *= shadow;
-                #undef shadow_texture_offset
+                shadow /= 16.0; 
             }
+            shadow *= shadow;
+            intensity *= shadow;
+            #undef shadow_texture_offset
         }
+    }
 
-        colour += intensity*light.light_intensity_and_shadow_pixel_offset.rgb;
-        #undef l
+    return intensity*light.light_intensity_and_shadow_pixel_offset.rgb;
+    #undef light
+}
+
+vec3 apply_lighting(vec2 tex_coord, vec3 normal) {
+    vec3 colour = ubo.ambient.rgb;
+
+	float random_value;
+
+    if(SC_SHADOW_TYPE == SHADOW_TYPE_NOISY) {
+        random_value = rand(tex_coord);
     }
+
+#if __VERSION__ >= 460
+    // Only the lights that overlap the cluster of this fragment (see light_clusters.c)
+    vec4 clip = ubo.viewProj * vec4(pass_position_world_space, 1.0);
+    ivec2 xy = clamp(ivec2((clip.xy / clip.w * 0.5 + 0.5) * vec2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y)),
+        ivec2(0), ivec2(LIGHT_CLUSTERS_X-1, LIGHT_CLUSTERS_Y-1));
+    int z = clamp(int(log(clip.w / ubo.znear) / log(ubo.zfar / ubo.znear) * LIGHT_CLUSTERS_Z), 0, LIGHT_CLUSTERS_Z-1);
+    int cluster = (z * LIGHT_CLUSTERS_Y + xy.y) * LIGHT_CLUSTERS_X + xy.x;
+
+    for(int w = 0; w < ubo.light_cluster_words; w++) {
+        uint bits = light_clusters.bits[cluster * ubo.light_cluster_words + w];
+
+        while(bits != 0u) {
+            int i = w * 32 + findLSB(bits);
+            bits &= bits - 1u;
+            colour += apply_light(i, normal, random_value);
+        }
+    }
+#else
+    for(int i = 0; i < ubo.number_of_lights; i++) {
+        colour += apply_light(i, normal, random_value);
+    }
+#endif
     return colour;
 }
 
@@ -236,10 +262,7 @@ void main() {
 
     vec3 normal = get_normal();
 
-    float intensities[4];
-    calculate_basic_lighting(normal, intensities);
-
-    vec3 colour = apply_lighting(tex_coord, intensities);
+    vec3 colour = apply_lighting(tex_coord, normal);
 
     if(SC_SSAO_ENABLED) {
         colour *= vec3((1.0-texture(ssao_texture, tex_coord).r)*0.5+0.5 * data.ssao_intensity);
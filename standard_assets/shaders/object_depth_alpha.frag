@@ -4,7 +4,7 @@
 
 
 LOCATION(0) in vec2 pass_uv;
-LOCATION(1) flat in int pass_draw_index;
+LOCATION(1) flat in int pass_material_index;
 
 
 
@@ -15,14 +15,16 @@ uniform sampler2DArray diffuse_texture; // opengl binding 4
 uniform sampler2DArray nmap_texture; // opengl binding 7
 #endif
 
+#define NO_DRAW_OBJECTS
+#define MATERIAL_TABLE
 #include "ubo.glsl"
 
 
 void main() {
 #if __VERSION__ >= 460
-    #define data draw_objects.obj[pass_draw_index]
+    #define data materials.m[pass_material_index]
 #else
-    #define data draw_object.obj
+    #define data material.m
 #endif
 
     float alpha = 1;
@@ -52,6 +52,45 @@ vec4 get_bones_vec4(int first_bone_index, int bone_index, int i) {
     return bones.x[(first_bone_index + bone_index)*3 + i];
 }
 
+#ifdef VULKAN
+
+// Vertices skinned by skin.comp, for draw objects with first_bone_index <= -2.
+// The depth descriptor set has them at bindings 3 and 4, the render descriptor set at 9 and 10
+#ifdef OBJECT_DEPTH
+#define SKIN_JOBS_BINDING 3
+#define SKINNED_VERTICES_BINDING 4
+#else
+#define SKIN_JOBS_BINDING 9
+#define SKINNED_VERTICES_BINDING 10
+#endif
+
+struct SkinJob {
+    uint first_vertex;
+    uint vertex_count;
+    uint output_offset;
+    int first_bone_index;
+
+    vec4 position_min;
+    vec4 position_range;
+};
+
+struct SkinnedVertex {
+    vec4 position;
+    vec4 normal;
+};
+
+layout(binding = SKIN_JOBS_BINDING, std430) readonly restrict buffer SkinJobSSBO {
+    SkinJob j[];
+} skin_jobs;
+
+layout(binding = SKINNED_VERTICES_BINDING, std430) readonly restrict buffer SkinnedVertexSSBO {
+    SkinnedVertex v[];
+} skinned_vertices;
+
+#define COMPUTE_SKINNING
+
+#endif
+
 #else
 
 layout(std140) uniform BonesUniform {
@@ -97,13 +136,13 @@ LOCATION(3) in vec4 in_tangent;
 #elif defined(OBJECT_DEPTH_ALPHA)
 
 LOCATION(0) out vec2 pass_uv;
-LOCATION(1) flat out int pass_draw_index;
+LOCATION(1) flat out int pass_material_index;
 
 #elif defined(OBJECT)
 
 LOCATION(0) out vec3 pass_normal;
 LOCATION(1) out vec2 pass_uv;
-LOCATION(2) flat out int pass_draw_index;
+LOCATION(2) flat out int pass_material_index;
 LOCATION(3) out mat3 pass_tangent_to_world;
 LOCATION(6) out vec3 pass_position_world_space;
 
@@ -126,6 +165,7 @@ layout(push_constant) uniform PushConstantsObject
 
 #else
 
+uniform int DRAW_INDEX_OFFSET; // Index of the first instance in the bound DrawObjectUniform block
 uniform int MODEL_VIEW_PROJ_INDEX;
 
 #endif
@@ -152,14 +192,23 @@ void main() {
 #endif
     #define data draw_objects.obj[draw_index]
 #else
-    #define draw_index gl_InstanceID
-    #define data draw_object.obj
+    int draw_index = DRAW_INDEX_OFFSET + gl_InstanceID;
+    #define data draw_objects.obj[draw_index]
 #endif
 
-    vec3 p = raw_position * data.position_range.xyz + data.position_min_and_first_bone.xyz;
+    vec3 p = raw_position * data.position_range_and_material.xyz + data.position_min_and_first_bone.xyz;
+
+    // Columns are the rows of the model matrix so vec4 * model_rows is the model matrix transform
+    mat3x4 model_rows = mat3x4(data.model_rows[0], data.model_rows[1], data.model_rows[2]);
 
 #if defined(OBJECT)
-    mat3 nmat = mat3(data.normal_model_matrix);
+    // Inverse transpose of the model matrix from its cofactors. Normals are normalised after this so only the
+    // sign of the determinant is needed
+    vec3 r0 = data.model_rows[0].xyz;
+    vec3 r1 = data.model_rows[1].xyz;
+    vec3 r2 = data.model_rows[2].xyz;
+    mat3 nmat = transpose(mat3(cross(r1, r2), cross(r2, r0), cross(r0, r1)));
+    if(dot(r0, cross(r1, r2)) < 0.0) nmat = -nmat;
 #endif
 
 
@@ -171,6 +220,18 @@ void main() {
     #define first_bone_index 0
 #endif
 
+#ifdef COMPUTE_SKINNING
+    if(first_bone_index <= -2) {
+        uint job = uint(-2 - first_bone_index);
+        uint v = skin_jobs.j[job].output_offset + uint(gl_VertexIndex) - skin_jobs.j[job].first_vertex;
+        p = skinned_vertices.v[v].position.xyz;
+
+        #if defined(OBJECT)
+            pass_normal = normalize(nmat * skinned_vertices.v[v].normal.xyz);
+        #endif
+    }
+    else
+#endif
     if(first_bone_index >= 0){
         int bone_index0 = int(in_bone.x >> 8u);
         int bone_index1 = int(in_bone.x & 0xffu);
@@ -201,14 +262,18 @@ void main() {
     #endif
     
     
-    gl_Position = data.modelViewProj[MODEL_VIEW_PROJ_INDEX] * vec4(p, 1.0);
+    vec3 world_position = vec4(p, 1.0) * model_rows;
+
+    // 0 is the camera, 1-4 are the shadow casting lights
+    mat4 view_proj = MODEL_VIEW_PROJ_INDEX == 0 ? ubo.viewProj : ubo.shadow_lights[MODEL_VIEW_PROJ_INDEX-1].shadow_proj_view;
+    gl_Position = view_proj * vec4(world_position, 1.0);
     
 
 
-    // UV, draw index
+    // UV, material index
 #ifndef OBJECT_DEPTH
     pass_uv = in_uv;
-    pass_draw_index = draw_index;
+    pass_material_index = int(data.position_range_and_material.w);
 #endif
 
     // position
@@ -227,7 +292,7 @@ void main() {
         vec3(normal_world_space) 
     );
 
-    pass_position_world_space = (data.model * vec4(p, 1.0)).xyz;
+    pass_position_world_space = world_position;
 #endif
 
 }
@@ -11,6 +11,9 @@ layout(push_constant) uniform PushConstantsObject
 {
 	float nearz, farz;
 	vec2 one_pixel;
+	// One window pixel in the part of the depth image that was drawn to (the same as one_pixel at render scale 1)
+	vec2 sample_pixel;
+	vec2 max_tex_coord; // Centre of the bottom right texel that was drawn to
 	float ssao_cutoff;
 } push_constants;
 
@@ -18,6 +21,8 @@ layout(push_constant) uniform PushConstantsObject
 #define NEARZ push_constants.farz
 #define CUTOFF push_constants.ssao_cutoff
 #define ONE_PIXEL push_constants.one_pixel
+#define SAMPLE_PIXEL push_constants.sample_pixel
+#define MAX_TEX_COORD push_constants.max_tex_coord
 
 #else
 
@@ -28,6 +33,10 @@ uniform vec2 ONE_PIXEL;
 #define NEARZ u_near_far_cutoff.y
 #define CUTOFF u_near_far_cutoff.z
 
+// No dynamic resolution in OpenGL
+#define SAMPLE_PIXEL ONE_PIXEL
+#define MAX_TEX_COORD vec2(1.0)
+
 #endif
 
 LOCATION(0) in vec2 pass_tex_coord;
@@ -40,6 +49,11 @@ float relinearise_depth(float d) {
 	return FARZ*NEARZ / (-d*(FARZ - NEARZ) - FARZ);
 }
 
+// Depth outside of the drawn part of the image is not from this frame
+float get_depth(vec2 tex_coord) {
+	return relinearise_depth(texture(depth_image, min(tex_coord, MAX_TEX_COORD)).r);
+}
+
 float rand(vec2 co){
     return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
 }
@@ -55,7 +69,7 @@ void main() {
 		sin(theta), cos(theta)
 	);
 
-	float depth = relinearise_depth(texture(depth_image, vec2(pass_tex_coord)).r);// 0 = near, 1 = far
+	float depth = get_depth(pass_tex_coord);// 0 = near, 1 = far
 
 	if(depth == 0.0) {
 		out_ao = 0.0;
@@ -63,8 +77,8 @@ void main() {
 	}
 
 
-	float depth_right = relinearise_depth(texture(depth_image, vec2(pass_tex_coord) + vec2(ONE_PIXEL.x, 0)).r);
-	float depth_down = relinearise_depth(texture(depth_image, vec2(pass_tex_coord) + vec2(0, ONE_PIXEL.y)).r);
+	float depth_right = get_depth(pass_tex_coord + vec2(ONE_PIXEL.x, 0));
+	float depth_down = get_depth(pass_tex_coord + vec2(0, ONE_PIXEL.y));
 
 	vec2 surface_direction = normalize(vec2(depth_right - depth, depth_down-depth));
 	
@@ -73,7 +87,7 @@ void main() {
 	float occlusion = 0.0;
 
 	for(int i = 0; i < SC_SSAO_SAMPLES; i++) {
-		vec2 p = vec2(ONE_PIXEL.x, ONE_PIXEL.y) * 20 * rotation_matrix
+		vec2 p = SAMPLE_PIXEL * 20 * rotation_matrix
 			* length_random_mul * coordinate_offsets[(i + int(random_value*16.0)) % 16];
 
 		// Flip points that are in the wrong direction
@@ -82,7 +96,7 @@ void main() {
 		}
 		// p *= sign(min(0, dot(p, surface_direction)))*2 + 1;
 
-		float neighbour_depth = relinearise_depth(texture(depth_image, pass_tex_coord + p).r);
+		float neighbour_depth = get_depth(pass_tex_coord + p);
 
 		float delta = depth - neighbour_depth;
 
@@ -6,9 +6,9 @@
 
 struct Light {
     vec4 world_pos_and_type;
-    vec4 neg_direction_and_is_shadow_caster; // a == 0 -> no shadows
-    vec4 light_intensity_and_shadow_pixel_offset; // shadow_pixel_offset = 0.5 / resolution
-    mat4 shadow_proj_view;
+    vec4 neg_direction_and_is_shadow_caster; // a == 0 -> no shadows, otherwise index into ubo.shadow_lights + 1
+    vec4 light_intensity_and_shadow_pixel_offset; // shadow_pixel_offset = 0.5 / resolution. Radius of point lights
+    mat4 shadow_proj_view; // Only set in ubo.shadow_lights
 };
 
 
@@ -25,10 +25,10 @@ uniform UniformBufferObject {
     vec2 viewport_size;
     vec2 one_pixel;
     float time;
-    int number_of_lights;
-	float rsvd2;
+    int number_of_lights; // In the light list
+    int light_cluster_words;
     float rsvd3;
-    Light lights[4];
+    Light shadow_lights[4];
     vec4 ambient;
     float znear;
     float zfar;
@@ -39,55 +39,97 @@ uniform UniformBufferObject {
 
 #ifndef NO_DRAW_OBJECTS
 
-struct DrawObjectDepthOnly {
-	mat4 modelViewProj;
-	mat4 model;
-    vec4 position_min;
-    vec4 position_range;
-};
-
+// The camera or shadow projection is in the per-frame data (ubo)
 struct DrawObject {
-	mat4 modelViewProj[5];
-    
-	mat4 model;
-    mat4 normal_model_matrix;
+    vec4 model_rows[3]; // The last row of the model matrix is 0,0,0,1
 
     vec4 position_min_and_first_bone;
-    vec4 position_range_and_ssao_intensity;
+    vec4 position_range_and_material;
+};
+
+
+#if __VERSION__ >= 460
+
+    layout(binding = 1, std140) readonly restrict buffer DrawObjectSSBO {
+        DrawObject obj[];
+    } draw_objects;
+
+#else
 
+
+    #define DRAW_OBJECTS_OPENGL 204 // PIGEON_WGI_DRAW_OBJECTS_OPENGL
+
+    layout(std140) uniform DrawObjectUniform {
+        DrawObject obj[DRAW_OBJECTS_OPENGL];
+    } draw_objects;
+
+#endif
+
+#endif
+
+
+#ifdef LIGHT_LIST
+
+#if __VERSION__ >= 460
+
+    layout(binding = 7, std430) readonly restrict buffer LightSSBO {
+        Light l[];
+    } lights;
+
+    // PIGEON_WGI_LIGHT_CLUSTERS_*
+    #define LIGHT_CLUSTERS_X 16
+    #define LIGHT_CLUSTERS_Y 9
+    #define LIGHT_CLUSTERS_Z 24
+
+    // light_cluster_words words per cluster. Bit i is set if light i overlaps the cluster
+    layout(binding = 8, std430) readonly restrict buffer LightClusterSSBO {
+        uint bits[];
+    } light_clusters;
+
+#else
+
+    #define MAX_LIGHTS_OPENGL 64 // PIGEON_WGI_MAX_LIGHTS_OPENGL
+
+    layout(std140) uniform LightUniform {
+        Light l[MAX_LIGHTS_OPENGL];
+    } lights;
+
+#endif
+
+#endif
+
+
+#ifdef MATERIAL_TABLE
+
+struct Material {
     int texture_sampler_index_plus1; // into array of glsl samplers
     float texture_index; // into array texture
-    
-    int rsvd0;
-
+    float ssao_intensity;
     float specular_intensity;
 
     vec4 colour; // colour components should be in [0,1], alpha = luminosity
-    vec4 under_colour;
+    vec4 under_colour; // alpha = alpha channel usage
 
     int normal_map_sampler_index_plus1;
     float normal_map_index;
-    
+
+    int rsvd0;
     int rsvd1;
-    int rsvd2;
 };
 
-#define position_range position_range_and_ssao_intensity.xyz
-#define ssao_intensity position_range_and_ssao_intensity.w
-
 
 #if __VERSION__ >= 460
 
-    layout(binding = 1, std140) readonly restrict buffer DrawObjectSSBO {
-        DrawObject obj[];
-    } draw_objects;
+    layout(binding = 6, std140) readonly restrict buffer MaterialSSBO {
+        Material m[];
+    } materials;
 
 #else
 
 
-    layout(std140) uniform DrawObjectUniform {
-        DrawObject obj;
-    } draw_object;
+    layout(std140) uniform MaterialUniform {
+        Material m;
+    } material;
 
 #endif
 
@@ -7,6 +7,7 @@
 #include <pigeon/scene/audio.h>
 #include <pigeon/scene/light.h>
 #include <pigeon/scene/mesh_renderer.h>
+#include <pigeon/scene/occlusion.h>
 #include <pigeon/scene/scene.h>
 #include <pigeon/scene/transform.h>
 #include <pigeon/wgi/input.h>
@@ -125,6 +126,7 @@ PigeonModelMaterial** model_character;
 PigeonModelMaterial* model_sphere;
 
 PigeonMaterialRenderer* mr_white_cuboid;
+PigeonOccluderMesh occluder_cube;
 PigeonMaterialRenderer* mr_spinning_cube;
 PigeonMaterialRenderer* mr_sphere;
 PigeonMaterialRenderer** mr_character;
@@ -150,6 +152,16 @@ static void key_callback(PigeonWGIKeyEvent e)
 	if (e.key == PIGEON_WGI_KEY_2 && !e.pressed) {
 		render_config.bloom = !render_config.bloom;
 	}
+	if (e.key == PIGEON_WGI_KEY_3 && !e.pressed) {
+		static bool gpu_culling = false;
+		gpu_culling = !gpu_culling;
+		pigeon_set_gpu_culling(gpu_culling);
+	}
+	if (e.key == PIGEON_WGI_KEY_4 && !e.pressed) {
+		static bool compute_skinning = false;
+		compute_skinning = !compute_skinning;
+		pigeon_set_compute_skinning(compute_skinning);
+	}
 
 	if (e.key == PIGEON_WGI_KEY_0 && !e.pressed && AUDIO_ASSET_COUNT) {
 		pigeon_audio_player_play(audio_pigeon, audio_buffers[0]);
@@ -210,7 +222,7 @@ static PIGEON_ERR_RET load_model_assets(void)
 			|| memcmp(skinned_mesh_attribs, model_assets[i].mesh_meta.attribute_types, sizeof static_mesh_attribs)
 				== 0);
 
-		ASSERT_R1(!pigeon_load_asset_data(&model_assets[i], model_file_paths[i][1]));
+		ASSERT_R1(!pigeon_map_asset_data(&model_assets[i], model_file_paths[i][1]));
 	}
 	return 0;
 }
@@ -244,7 +256,7 @@ static PIGEON_ERR_RET load_texture_asset(const char* asset_name, PigeonAsset* as
 	char* data_file_path = meta_file_path;
 	memcpy(&data_file_path[prefix_len + asset_name_len], ".data", 6);
 
-	ASSERT_R1(!pigeon_load_asset_data(asset, data_file_path));
+	ASSERT_R1(!pigeon_map_asset_data(asset, data_file_path));
 
 	return 0;
 }
@@ -1151,6 +1163,11 @@ int main(void)
 	ASSERT_R1(mr_white_cuboid && mr_spinning_cube && mr_sphere);
 
 	mr_white_cuboid->specular_intensity = 0;
+	mr_white_cuboid->occluder = true; // floor & wall
+	ASSERT_R1(!pigeon_create_occluder_mesh(&occluder_cube, &model_assets[0]));
+	mr_white_cuboid->occluder_mesh = &occluder_cube;
+	ASSERT_R1(!pigeon_set_occlusion_culling(true));
+	pigeon_set_meshlet_culling(true);
 
 	mr_spinning_cube->colour[0] = 1.1f;
 	mr_spinning_cube->colour[1] = 0.5f;
@@ -1225,6 +1242,7 @@ int main(void)
 	pigeon_destroy_audio_player(audio_pigeon);
 
 	pigeon_destroy_material_renderer(mr_white_cuboid);
+	pigeon_destroy_occluder_mesh(&occluder_cube);
 	pigeon_destroy_material_renderer(mr_spinning_cube);
 
 	for (unsigned int i = 0; i < model_assets[1].materials_count; i++) {
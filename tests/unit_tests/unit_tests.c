@@ -1,10 +1,24 @@
 #include <config_parser_test.h>
 #include <pigeon/array_list.h>
+#include <pigeon/compressed_animation.h>
 #include <pigeon/assert.h>
+#include <pigeon/asset.h>
 #include <pigeon/object_pool.h>
+#include <pigeon/radix_sort.h>
+#include <pigeon/scene/bone_palette.h>
+#include <pigeon/scene/draw_object_record.h>
+#include <pigeon/scene/lod.h>
+#include <pigeon/scene/occlusion.h>
 #include <pigeon/util.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+
+PIGEON_ERR_RET pigeon_init_job_system(unsigned int threads);
+void pigeon_deinit_job_system(void);
 
 static PIGEON_ERR_RET pigeon_test_array_list(void)
 {
@@ -83,11 +97,950 @@ static PIGEON_ERR_RET pigeon_test_object_pool(void)
 	return 0;
 }
 
+static void identity_matrix(mat4 m)
+{
+	memset(m, 0, sizeof(mat4));
+	m[0][0] = m[1][1] = m[2][2] = m[3][3] = 1;
+}
+
+// Identity projection: x,y are NDC, z is (reversed) depth
+static PIGEON_ERR_RET pigeon_test_hiz(void)
+{
+	PigeonHiZ hiz;
+	ASSERT_R1(!pigeon_create_hiz(&hiz, 64, 32));
+	ASSERT_R1(hiz.levels == 7 && hiz.level_width[1] == 32 && hiz.level_height[1] == 16);
+	ASSERT_R1(hiz.level_width[6] == 1 && hiz.level_height[6] == 1);
+
+	mat4 identity;
+	identity_matrix(identity);
+
+	const float occluder_min[3] = { -0.5f, -0.5f, 0.9f };
+	const float occluder_max[3] = { 0.5f, 0.5f, 0.9f };
+
+	// Nothing rasterised, everything is visible
+
+	pigeon_hiz_clear(&hiz, identity);
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, occluder_min, occluder_max));
+
+	// Flat quad at depth 0.9 covering the middle of the screen
+
+	const float quad[4 * 3] = { -0.5f, -0.5f, 0.9f, 0.5f, -0.5f, 0.9f, 0.5f, 0.5f, 0.9f, -0.5f, 0.5f, 0.9f };
+	const uint32_t quad_indices[6] = { 0, 1, 2, 0, 2, 3 };
+
+	pigeon_hiz_clear(&hiz, identity);
+	ASSERT_R1(!pigeon_hiz_rasterise(&hiz, identity, quad, 4, quad_indices, 6));
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+
+	ASSERT_R1(hiz.data[16 * 64 + 32] == 0.9f);
+	ASSERT_R1(hiz.data[0] == 0);
+	ASSERT_R1(hiz.data[hiz.level_offset[6]] == 0);
+
+	const float behind_min[3] = { -0.2f, -0.2f, 0.1f };
+	const float behind_max[3] = { 0.2f, 0.2f, 0.5f };
+	ASSERT_R1(!pigeon_hiz_test_box(&hiz, identity, behind_min, behind_max));
+
+	const float in_front_min[3] = { -0.2f, -0.2f, 0.1f };
+	const float in_front_max[3] = { 0.2f, 0.2f, 0.95f };
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, in_front_min, in_front_max));
+
+	const float partially_covered_min[3] = { 0.3f, -0.2f, 0.1f };
+	const float partially_covered_max[3] = { 0.8f, 0.2f, 0.5f };
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, partially_covered_min, partially_covered_max));
+
+	// The occluder does not hide itself
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, occluder_min, occluder_max));
+
+	// Same result with a model matrix (translate the box behind the quad)
+
+	mat4 model;
+	identity_matrix(model);
+	model[3][2] = -0.5f;
+	ASSERT_R1(!pigeon_hiz_test_box(&hiz, model, in_front_min, in_front_max));
+
+	// Solid box occluder
+
+	pigeon_hiz_clear(&hiz, identity);
+	ASSERT_R1(!pigeon_hiz_rasterise_box(&hiz, identity, occluder_min, occluder_max));
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+	ASSERT_R1(!pigeon_hiz_test_box(&hiz, identity, behind_min, behind_max));
+
+	// Depth image (e.g. previous frame)
+
+	float depth[128 * 64];
+	for (unsigned int y = 0; y < 64; y++) {
+		for (unsigned int x = 0; x < 128; x++) {
+			depth[y * 128 + x] = x < 64 ? 0.8f : 0.2f;
+		}
+	}
+	pigeon_hiz_load_depth(&hiz, identity, depth, 128, 64);
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+
+	const float left_min[3] = { -0.9f, -0.9f, 0.1f };
+	const float left_max[3] = { -0.1f, 0.9f, 0.5f };
+	ASSERT_R1(!pigeon_hiz_test_box(&hiz, identity, left_min, left_max));
+
+	const float right_min[3] = { 0.1f, -0.9f, 0.1f };
+	const float right_max[3] = { 0.9f, 0.9f, 0.5f };
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, right_min, right_max));
+
+	const float across_min[3] = { -0.5f, -0.5f, 0.1f };
+	const float across_max[3] = { 0.5f, 0.5f, 0.5f };
+	ASSERT_R1(pigeon_hiz_test_box(&hiz, identity, across_min, across_max));
+
+	pigeon_destroy_hiz(&hiz);
+	return 0;
+}
+
+static uint32_t random_u32(uint32_t* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static float random_float(uint32_t* state, float min, float max)
+{
+	return min + (float)(random_u32(state) & 0xffff) / 65535.0f * (max - min);
+}
+
+// Straightforward single-threaded rasteriser for comparison
+static void reference_rasterise(float* depth, unsigned int w, unsigned int h, const float* positions,
+	const uint32_t* indices, unsigned int index_count)
+{
+	for (unsigned int i = 0; i < index_count; i += 3) {
+		float v[3][3];
+		for (unsigned int j = 0; j < 3; j++) {
+			const float* p = &positions[indices[i + j] * 3];
+			v[j][0] = (p[0] * 0.5f + 0.5f) * (float)w;
+			v[j][1] = (p[1] * 0.5f + 0.5f) * (float)h;
+			v[j][2] = p[2];
+		}
+
+		float area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) - (v[1][1] - v[0][1]) * (v[2][0] - v[0][0]);
+		if (area == 0)
+			continue;
+
+		for (unsigned int y = 0; y < h; y++) {
+			for (unsigned int x = 0; x < w; x++) {
+				float px = (float)x + 0.5f, py = (float)y + 0.5f;
+				float b[3];
+				for (unsigned int j = 0; j < 3; j++) {
+					const float* a = v[(j + 1) % 3];
+					const float* c = v[(j + 2) % 3];
+					b[j] = ((c[0] - a[0]) * (py - a[1]) - (c[1] - a[1]) * (px - a[0])) / area;
+				}
+				if (b[0] < 0 || b[1] < 0 || b[2] < 0)
+					continue;
+
+				float z = b[0] * v[0][2] + b[1] * v[1][2] + b[2] * v[2][2];
+				if (z > depth[y * w + x])
+					depth[y * w + x] = z;
+			}
+		}
+	}
+}
+
+// Random triangles on a screen that is not a multiple of the tile size
+static PIGEON_ERR_RET pigeon_test_hiz_tiled(void)
+{
+#define W 200
+#define H 120
+#define TRIANGLES 64
+
+	static float positions[TRIANGLES * 3 * 3];
+	static uint32_t indices[TRIANGLES * 3];
+	static float reference[W * H];
+	static float first_build[W * H];
+
+	uint32_t rng = 1234;
+	for (unsigned int i = 0; i < TRIANGLES * 3; i++) {
+		positions[i * 3 + 0] = random_float(&rng, -1.2f, 1.2f);
+		positions[i * 3 + 1] = random_float(&rng, -1.2f, 1.2f);
+		positions[i * 3 + 2] = random_float(&rng, 0.05f, 0.95f);
+		indices[i] = i;
+	}
+
+	memset(reference, 0, sizeof reference);
+	reference_rasterise(reference, W, H, positions, indices, TRIANGLES * 3);
+
+	mat4 identity;
+	identity_matrix(identity);
+
+	PigeonHiZ hiz;
+	ASSERT_R1(!pigeon_create_hiz(&hiz, W, H));
+	ASSERT_R1(hiz.tiles_x == 7 && hiz.tiles_y == 4);
+
+#define CLEANUP() pigeon_destroy_hiz(&hiz);
+
+	pigeon_hiz_clear(&hiz, identity);
+	ASSERT_R1(!pigeon_hiz_rasterise(&hiz, identity, positions, TRIANGLES * 3, indices, TRIANGLES * 3));
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+
+	// Pixel centres exactly on an edge can go either way
+
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < W * H; i++) {
+		if (fabsf(hiz.data[i] - reference[i]) > 1e-4f)
+			mismatches++;
+	}
+	ASSERT_R1(mismatches <= W * H / 1000);
+
+	// Every level is the minimum of the level below
+
+	for (unsigned int l = 1; l < hiz.levels; l++) {
+		const float* src = &hiz.data[hiz.level_offset[l - 1]];
+		const float* dst = &hiz.data[hiz.level_offset[l]];
+		unsigned int sw = hiz.level_width[l - 1], sh = hiz.level_height[l - 1];
+
+		for (unsigned int y = 0; y < hiz.level_height[l]; y++) {
+			for (unsigned int x = 0; x < hiz.level_width[l]; x++) {
+				float d = 1;
+				for (unsigned int sy = y * 2; sy < y * 2 + 2 && sy < sh; sy++) {
+					for (unsigned int sx = x * 2; sx < x * 2 + 2 && sx < sw; sx++) {
+						d = fminf(d, src[sy * sw + sx]);
+					}
+				}
+				ASSERT_R1(dst[y * hiz.level_width[l] + x] == d);
+			}
+		}
+	}
+
+	// Deterministic
+
+	memcpy(first_build, hiz.data, sizeof first_build);
+	pigeon_hiz_clear(&hiz, identity);
+	ASSERT_R1(!pigeon_hiz_rasterise(&hiz, identity, positions, TRIANGLES * 3, indices, TRIANGLES * 3));
+	ASSERT_R1(!pigeon_hiz_build(&hiz));
+	ASSERT_R1(!memcmp(first_build, hiz.data, sizeof first_build));
+
+#undef CLEANUP
+#undef W
+#undef H
+#undef TRIANGLES
+
+	pigeon_destroy_hiz(&hiz);
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_occluder_mesh(void)
+{
+	// 3 vertices, normalised positions, 16-bit indices
+
+	uint32_t packed[3] = {
+		0, // bounds_min
+		1023u | (1023u << 10) | (1023u << 20) | (3u << 30), // bounds_max
+		512u << 20,
+	};
+	uint16_t indices16[3] = { 2, 1, 0 };
+
+	PigeonAssetSubresource subresources[2] = { 0 };
+	subresources[0].decompressed_data = packed;
+	subresources[0].decompressed_data_length = sizeof packed;
+	subresources[1].decompressed_data = indices16;
+	subresources[1].decompressed_data_length = sizeof indices16;
+
+	PigeonAsset asset = { 0 };
+	asset.type = PIGEON_ASSET_TYPE_MODEL;
+	asset.subresource_count = 2;
+	asset.subresources = subresources;
+	asset.mesh_meta.attribute_types[0] = PIGEON_WGI_VERTEX_ATTRIBUTE_POSITION_NORMALISED;
+	asset.mesh_meta.vertex_count = 3;
+	asset.mesh_meta.index_count = 3;
+	asset.mesh_meta.bounds_min[0] = -1;
+	asset.mesh_meta.bounds_min[1] = -2;
+	asset.mesh_meta.bounds_min[2] = -3;
+	asset.mesh_meta.bounds_range[0] = 2;
+	asset.mesh_meta.bounds_range[1] = 4;
+	asset.mesh_meta.bounds_range[2] = 6;
+
+	PigeonOccluderMesh mesh;
+	ASSERT_R1(!pigeon_create_occluder_mesh(&mesh, &asset));
+
+	ASSERT_R1(mesh.vertex_count == 3 && mesh.index_count == 3);
+	ASSERT_R1(mesh.indices[0] == 2 && mesh.indices[1] == 1 && mesh.indices[2] == 0);
+	ASSERT_R1(mesh.positions[0] == -1 && mesh.positions[1] == -2 && mesh.positions[2] == -3);
+	ASSERT_R1(mesh.positions[3] == 1 && mesh.positions[4] == 2 && mesh.positions[5] == 3);
+	ASSERT_R1(mesh.positions[6] == -1 && mesh.positions[7] == -2 && fabsf(mesh.positions[8]) < 0.01f);
+
+	pigeon_destroy_occluder_mesh(&mesh);
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_meshlet_culling(void)
+{
+	// Identity projection: x,y are NDC, z is (reversed) depth
+	mat4 proj_view, model;
+	identity_matrix(proj_view);
+	identity_matrix(model);
+	float camera[3] = { 0, 0, -5 };
+
+	PigeonWGIMeshlet meshlets[6] = {
+		{ 0, 6, { 0, 0, 0.5f }, 0.1f, { 0, 0, -1 }, 0.5f }, // Facing the camera
+		{ 6, 3, { 0, 0, 0.5f }, 0.1f, { 0, 0, -1 }, 0.5f }, // Merged with the previous meshlet
+		{ 9, 3, { 0, 0, 0.5f }, 0.1f, { 0, 0, 1 }, 0.5f }, // Facing away
+		{ 12, 3, { 3, 0, 0.5f }, 0.1f, { 0, 0, -1 }, 0.5f }, // Outside the frustum
+		{ 15, 6, { 0, 0, 0.5f }, 0.1f, { 0, 0, 1 }, 1 }, // Cone too wide to cull
+		{ 21, 3, { 0, 0, 0.5f }, 0.1f, { 0, 0, 1 }, 0.5f }, // Facing away
+	};
+
+	PigeonArrayList draws = { 0 };
+	pigeon_create_array_list(&draws, sizeof(PigeonMeshletDraw));
+
+#define CLEANUP() pigeon_destroy_array_list(&draws);
+
+	ASSERT_R1(!pigeon_cull_meshlets(NULL, proj_view, model, camera, true, meshlets, 6, &draws));
+	PigeonMeshletDraw* d = draws.elements;
+	ASSERT_R1(draws.size == 2);
+	ASSERT_R1(d[0].first == 0 && d[0].count == 9);
+	ASSERT_R1(d[1].first == 15 && d[1].count == 6);
+
+	// Draws are appended and only merged with draws from the same call
+	ASSERT_R1(!pigeon_cull_meshlets(NULL, proj_view, model, camera, false, meshlets, 6, &draws));
+	d = draws.elements;
+	ASSERT_R1(draws.size == 4);
+	ASSERT_R1(d[2].first == 0 && d[2].count == 12);
+	ASSERT_R1(d[3].first == 15 && d[3].count == 9);
+
+	// Hidden behind an occluder on the near plane
+	PigeonHiZ hiz;
+	ASSERT_R1(!pigeon_create_hiz(&hiz, 16, 16));
+	float depth[16 * 16];
+	for (unsigned int i = 0; i < 16 * 16; i++) {
+		depth[i] = 1;
+	}
+	pigeon_hiz_clear(&hiz, proj_view);
+	pigeon_hiz_load_depth(&hiz, proj_view, depth, 16, 16);
+	int err = pigeon_hiz_build(&hiz);
+	if (!err)
+		err = pigeon_cull_meshlets(&hiz, proj_view, model, camera, false, meshlets, 6, &draws);
+	pigeon_destroy_hiz(&hiz);
+	ASSERT_R1(!err && draws.size == 4);
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_radix_sort(void)
+{
+	const unsigned int count = 100000;
+	PigeonSortItem* items = malloc(count * sizeof *items);
+	PigeonSortItem* temp = malloc(count * sizeof *temp);
+
+#define CLEANUP()                                                                                                      \
+	free(items);                                                                                                       \
+	free(temp);
+
+	ASSERT_R1(items && temp);
+
+	uint32_t random_state = 7;
+	for (unsigned int test = 0; test < 3; test++) {
+		// Small arrays are sorted on one thread. Only some bytes differ so some passes are skipped
+		unsigned int n = test == 0 ? 100 : count;
+		for (unsigned int i = 0; i < n; i++) {
+			uint64_t r = random_u32(&random_state);
+			items[i].key = test == 2 ? (r & 0xff) << 40 | 0xabcd : (uint64_t)random_u32(&random_state) << 40 | r;
+			items[i].value = i;
+		}
+
+		ASSERT_R1(!pigeon_radix_sort(items, temp, n, true));
+
+		for (unsigned int i = 1; i < n; i++) {
+			ASSERT_R1(items[i - 1].key < items[i].key
+				|| (items[i - 1].key == items[i].key && items[i - 1].value < items[i].value));
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static void random_bone(uint32_t* rng, PigeonWGIBoneData* b)
+{
+	float length = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		b->rotate[i] = random_float(rng, -1, 1);
+		length += b->rotate[i] * b->rotate[i];
+	}
+	length = sqrtf(length);
+	for (unsigned int i = 0; i < 4; i++) {
+		b->rotate[i] /= length;
+	}
+	for (unsigned int i = 0; i < 3; i++) {
+		b->translate[i] = random_float(rng, -2, 2);
+	}
+	b->scale = random_float(rng, 0.5f, 1.5f);
+}
+
+// Slerp and glm-style translate * rotate * scale
+static void reference_bone_matrix(PigeonWGIBoneData const* b0, PigeonWGIBoneData const* b1, float t, float* m)
+{
+	double dot = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		dot += (double)b0->rotate[i] * b1->rotate[i];
+	}
+	double sign = dot < 0 ? -1 : 1;
+	double angle = acos(fmin(fabs(dot), 1));
+	double a = 1 - t, b = t;
+	if (angle > 1e-6) {
+		a = sin((1 - t) * angle) / sin(angle);
+		b = sin(t * angle) / sin(angle);
+	}
+
+	double q[4];
+	for (unsigned int i = 0; i < 4; i++) {
+		q[i] = a * b0->rotate[i] + b * sign * b1->rotate[i];
+	}
+	double w = q[0], x = q[1], y = q[2], z = q[3];
+	double s = b0->scale + (b1->scale - b0->scale) * t;
+
+	const double r[9] = { 1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y), 2 * (x * y - w * z),
+		1 - 2 * (x * x + z * z), 2 * (y * z + w * x), 2 * (x * z + w * y), 2 * (y * z - w * x),
+		1 - 2 * (x * x + y * y) };
+	for (unsigned int i = 0; i < 9; i++) {
+		m[i] = (float)(r[i] * s);
+	}
+	for (unsigned int i = 0; i < 3; i++) {
+		m[9 + i] = b0->translate[i] + (b1->translate[i] - b0->translate[i]) * t;
+	}
+}
+
+static PIGEON_ERR_RET pigeon_test_bone_palette(void)
+{
+	// Not a multiple of PIGEON_BONE_PALETTE_BATCH so that the remaining bones are tested too
+	const unsigned int bones = 63;
+
+	PigeonWGIBoneData* frames = malloc(2 * bones * sizeof *frames);
+	PigeonWGIBoneMatrix* matrices = malloc(bones * sizeof *matrices);
+
+#define CLEANUP()                                                                                                      \
+	free(frames);                                                                                                      \
+	free(matrices);
+
+	ASSERT_R1(frames && matrices);
+
+	uint32_t rng = 3;
+	for (unsigned int i = 0; i < 2 * bones; i++) {
+		random_bone(&rng, &frames[i]);
+	}
+
+	pigeon_bone_palette_identity(matrices, bones);
+	for (unsigned int i = 0; i < bones; i++) {
+		for (unsigned int j = 0; j < 12; j++) {
+			ASSERT_R1(matrices[i].mat3x4[j] == (j == 0 || j == 4 || j == 8 ? 1 : 0));
+		}
+	}
+
+	// Rotations are random so some pairs are more than 180 degrees apart (negative dot product)
+	const float t_values[] = { 0, 0.1f, 0.25f, 0.5f, 0.8f, 1 };
+	for (unsigned int ti = 0; ti < sizeof t_values / sizeof t_values[0]; ti++) {
+		float t = t_values[ti];
+		pigeon_bone_palette_interpolate(matrices, frames, &frames[bones], t, bones);
+
+		for (unsigned int i = 0; i < bones; i++) {
+			float reference[12];
+			reference_bone_matrix(&frames[i], &frames[bones + i], t, reference);
+			for (unsigned int j = 0; j < 12; j++) {
+				ASSERT_R1(fabsf(matrices[i].mat3x4[j] - reference[j]) < 0.002f);
+			}
+		}
+	}
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static bool bone_matrices_equal(PigeonWGIBoneMatrix const* a, PigeonWGIBoneMatrix const* b, float tolerance)
+{
+	for (unsigned int j = 0; j < 12; j++) {
+		if (!(fabsf(a->mat3x4[j] - b->mat3x4[j]) <= tolerance))
+			return false;
+	}
+	return true;
+}
+
+static PIGEON_ERR_RET pigeon_test_bone_pose_blending(void)
+{
+#define BONES 13
+	PigeonWGIBoneData frames[BONES * 2];
+	PigeonWGIBoneData pose[BONES], sum[BONES];
+	float weights[BONES];
+	PigeonWGIBoneMatrix expected[BONES], matrices[BONES], identity[BONES];
+
+	uint32_t rng = 11;
+	for (unsigned int i = 0; i < BONES * 2; i++) {
+		random_bone(&rng, &frames[i]);
+	}
+	pigeon_bone_palette_identity(identity, BONES);
+
+	// A pose converted to matrices is the same as interpolating directly
+	pigeon_bone_palette_interpolate(expected, frames, &frames[BONES], 0.3f, BONES);
+	pigeon_bone_pose_interpolate(pose, frames, &frames[BONES], 0.3f, BONES);
+	pigeon_bone_palette_from_pose(matrices, pose, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		ASSERT_R1(bone_matrices_equal(&matrices[i], &expected[i], 1e-5f));
+	}
+
+	// Blending a pose with itself (the second time with the rotations negated) changes nothing.
+	// Bones with a mask of 0 are half blended with the T pose
+	float mask[BONES];
+	for (unsigned int i = 0; i < BONES; i++) {
+		mask[i] = i % 2 ? 1 : 0;
+	}
+	memset(sum, 0, sizeof sum);
+	memset(weights, 0, sizeof weights);
+	pigeon_bone_pose_accumulate(sum, weights, pose, 0.5f, NULL, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		for (unsigned int j = 0; j < 4; j++) {
+			pose[i].rotate[j] = -pose[i].rotate[j];
+		}
+	}
+	pigeon_bone_pose_accumulate(sum, weights, pose, 0.5f, mask, BONES);
+	pigeon_bone_pose_normalise(sum, weights, BONES);
+	pigeon_bone_palette_from_pose(matrices, sum, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		ASSERT_R1(weights[i] == (i % 2 ? 1.0f : 0.5f));
+		float tolerance = i % 2 ? 1e-5f : 1e-3f;
+		ASSERT_R1(bone_matrices_equal(&matrices[i], &expected[i], tolerance) == (i % 2 == 1));
+	}
+
+	// Nothing blended is the T pose
+	memset(sum, 0, sizeof sum);
+	memset(weights, 0, sizeof weights);
+	pigeon_bone_pose_normalise(sum, weights, BONES);
+	pigeon_bone_palette_from_pose(matrices, sum, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		ASSERT_R1(bone_matrices_equal(&matrices[i], &identity[i], 1e-6f));
+	}
+
+	// Adding the difference between 2 frames to the first frame gives the second frame. A weight of 0 does nothing
+	memcpy(sum, frames, sizeof sum);
+	pigeon_bone_pose_add(sum, &frames[BONES], frames, 0, NULL, BONES);
+	pigeon_bone_palette_interpolate(expected, frames, frames, 0, BONES);
+	pigeon_bone_palette_from_pose(matrices, sum, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		ASSERT_R1(bone_matrices_equal(&matrices[i], &expected[i], 1e-5f));
+	}
+
+	pigeon_bone_pose_add(sum, &frames[BONES], frames, 1, NULL, BONES);
+	pigeon_bone_palette_interpolate(expected, &frames[BONES], &frames[BONES], 0, BONES);
+	pigeon_bone_palette_from_pose(matrices, sum, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		ASSERT_R1(bone_matrices_equal(&matrices[i], &expected[i], 1e-4f));
+	}
+
+#undef BONES
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_skeleton(void)
+{
+#define BONES 40
+	PigeonWGIBone bones[BONES];
+	PigeonWGIBoneData model_space[BONES], local[BONES];
+	PigeonWGIBoneMatrix expected[BONES], matrices[BONES];
+
+	// Random tree with shuffled indices so that some parents come after their children
+	uint32_t rng = 17;
+	unsigned int index[BONES];
+	for (unsigned int i = 0; i < BONES; i++) {
+		index[i] = i;
+	}
+	for (unsigned int i = BONES - 1; i > 0; i--) {
+		unsigned int j = random_u32(&rng) % (i + 1);
+		unsigned int x = index[i];
+		index[i] = index[j];
+		index[j] = x;
+	}
+
+	memset(bones, 0, sizeof bones);
+	for (unsigned int i = 0; i < BONES; i++) {
+		PigeonWGIBone* b = &bones[index[i]];
+		b->parent_index = i ? (int)index[random_u32(&rng) % i] : -1;
+		for (unsigned int j = 0; j < 3; j++) {
+			b->head[j] = random_float(&rng, -1, 1);
+		}
+		random_bone(&rng, &model_space[index[i]]);
+	}
+
+	PigeonSkeleton skeleton;
+	ASSERT_R1(!pigeon_create_skeleton(&skeleton, bones, BONES));
+
+	// Converting a model space pose to local space and concatenating it gives the same matrices
+	pigeon_skeleton_local_pose(&skeleton, model_space, local);
+	pigeon_bone_palette_from_pose(expected, model_space, BONES);
+	pigeon_bone_palette_from_local_pose(matrices, local, &skeleton);
+	bool equal = true;
+	for (unsigned int i = 0; i < BONES; i++) {
+		equal = equal && bone_matrices_equal(&matrices[i], &expected[i], 1e-3f);
+	}
+
+	// The local bind pose is the T pose
+	pigeon_bone_palette_from_local_pose(matrices, skeleton.local_bind, &skeleton);
+	pigeon_bone_palette_identity(expected, BONES);
+	for (unsigned int i = 0; i < BONES; i++) {
+		equal = equal && bone_matrices_equal(&matrices[i], &expected[i], 1e-5f);
+	}
+
+	pigeon_destroy_skeleton(&skeleton);
+	ASSERT_R1(equal);
+
+#undef BONES
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_compressed_animation(void)
+{
+#define BONES 20
+#define FRAMES 240
+	PigeonWGIBoneData* frames = malloc(BONES * FRAMES * sizeof *frames);
+	ASSERT_R1(frames);
+
+	// Smooth rotations. Every 4th bone does not move and only the first bone has a moving translation
+	uint32_t rng = 5;
+	for (unsigned int b = 0; b < BONES; b++) {
+		float axis[3] = { random_float(&rng, -1, 1), random_float(&rng, -1, 1), random_float(&rng, -1, 1) };
+		float axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		float speed = b % 4 ? random_float(&rng, 0.01f, 0.05f) : 0;
+
+		for (unsigned int f = 0; f < FRAMES; f++) {
+			PigeonWGIBoneData* bone = &frames[f * BONES + b];
+			float angle = sinf((float)f * speed + (float)b);
+			bone->rotate[0] = cosf(angle * 0.5f);
+			for (unsigned int i = 0; i < 3; i++) {
+				bone->rotate[i + 1] = sinf(angle * 0.5f) * axis[i] / axis_length;
+				bone->translate[i] = axis[i] + (b ? 0 : sinf((float)f * 0.05f + (float)i) * 0.3f);
+			}
+			bone->scale = 1;
+		}
+	}
+
+	const PigeonAnimationCompressionErrors errors = { PIGEON_ANIMATION_DEFAULT_ROTATION_ERROR,
+		PIGEON_ANIMATION_DEFAULT_TRANSLATION_ERROR, PIGEON_ANIMATION_DEFAULT_SCALE_ERROR };
+
+	unsigned int size;
+	void* compressed = pigeon_compress_animation(frames, BONES, FRAMES, &errors, &size);
+
+#define CLEANUP()                                                                                                      \
+	free(frames);                                                                                                      \
+	free(compressed);
+
+	if (!compressed || !pigeon_compressed_animation_valid(compressed, size, BONES, FRAMES)
+		|| pigeon_compressed_animation_valid(compressed, size - 1, BONES, FRAMES)
+		|| pigeon_compressed_animation_valid(compressed, size, BONES + 1, FRAMES)) {
+		CLEANUP();
+		ASSERT_R1(false);
+	}
+
+	// Decoded in 2 chunks
+	PigeonWGIBoneData decoded[BONES];
+	for (unsigned int f = 0; f < FRAMES; f++) {
+		pigeon_decompress_animation_frame(compressed, f, 0, BONES / 2, decoded);
+		pigeon_decompress_animation_frame(compressed, f, BONES / 2, BONES - BONES / 2, &decoded[BONES / 2]);
+
+		for (unsigned int b = 0; b < BONES; b++) {
+			PigeonWGIBoneData const* original = &frames[f * BONES + b];
+
+			float dot = 0, difference = 0, sum = 0, distance = 0;
+			for (unsigned int i = 0; i < 4; i++) {
+				dot += decoded[b].rotate[i] * original->rotate[i];
+			}
+			for (unsigned int i = 0; i < 4; i++) {
+				float d = decoded[b].rotate[i] - original->rotate[i] * (dot < 0 ? -1 : 1);
+				float s = decoded[b].rotate[i] + original->rotate[i] * (dot < 0 ? -1 : 1);
+				difference += d * d;
+				sum += s * s;
+			}
+			for (unsigned int i = 0; i < 3; i++) {
+				float d = decoded[b].translate[i] - original->translate[i];
+				distance += d * d;
+			}
+
+			if (4 * atan2f(sqrtf(difference), sqrtf(sum)) > errors.rotation * 1.01f
+				|| sqrtf(distance) > errors.translation * 1.01f
+				|| fabsf(decoded[b].scale - original->scale) > errors.scale) {
+				CLEANUP();
+				ASSERT_R1(false);
+			}
+		}
+	}
+
+	// Damaged tracks. The header is 4 uint32_t, then each track is first_key, keys_count and 6 floats.
+	// The frames of the keys come after the tracks
+	uint8_t* damaged = malloc(size);
+	if (!damaged) {
+		CLEANUP();
+		ASSERT_R1(false);
+	}
+	const unsigned int track_size = 8 * sizeof(uint32_t);
+	const unsigned int key_frames_offset = 4 * sizeof(uint32_t) + BONES * 3 * track_size;
+	uint32_t keys_count, track_first_key, track_keys_count;
+	memcpy(&keys_count, &((uint8_t*)compressed)[12], 4);
+
+	// Bone 1 rotates so its rotation track has more than 1 key
+	const unsigned int moving_track = 3;
+	memcpy(&track_first_key, &((uint8_t*)compressed)[16 + moving_track * track_size], 4);
+	memcpy(&track_keys_count, &((uint8_t*)compressed)[16 + moving_track * track_size + 4], 4);
+
+	const uint32_t damaged_tracks[][2] = {
+		{ 0, 0 }, // No keys
+		{ keys_count, 1 }, // Past the last key
+		{ keys_count - 1, 2 },
+		{ UINT32_MAX, 2 }, // Overflow
+	};
+	bool rejected = track_keys_count > 1;
+	for (unsigned int i = 0; i < sizeof damaged_tracks / sizeof damaged_tracks[0]; i++) {
+		memcpy(damaged, compressed, size);
+		memcpy(&damaged[16], damaged_tracks[i], 8);
+		rejected = rejected && !pigeon_compressed_animation_valid(damaged, size, BONES, FRAMES);
+	}
+
+	// Key frame out of range
+	memcpy(damaged, compressed, size);
+	uint16_t key_frame = FRAMES;
+	memcpy(&damaged[key_frames_offset], &key_frame, 2);
+	rejected = rejected && !pigeon_compressed_animation_valid(damaged, size, BONES, FRAMES);
+
+	// Key frames not increasing
+	memcpy(damaged, compressed, size);
+	memcpy(&damaged[key_frames_offset + (track_first_key + 1) * 2],
+		&damaged[key_frames_offset + track_first_key * 2], 2);
+	rejected = rejected && !pigeon_compressed_animation_valid(damaged, size, BONES, FRAMES);
+
+	free(damaged);
+	if (!rejected) {
+		CLEANUP();
+		ASSERT_R1(false);
+	}
+
+	// If every frame was a key, each bone would take 3 keys of 8 bytes (instead of 32 bytes) so this checks that most
+	// frames are not keys
+	const unsigned int uncompressed_size = BONES * FRAMES * sizeof *frames;
+	CLEANUP();
+#undef CLEANUP
+	ASSERT_R1(size * 10 < uncompressed_size);
+
+#undef BONES
+#undef FRAMES
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_lod_selection(void)
+{
+	const float lod_screen_sizes[2] = { 0.5f, 0.1f };
+	const float h = PIGEON_LOD_HYSTERESIS;
+
+	// No hysteresis band to cross from the LOD that is already chosen
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 0, 1) == 0);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 1, 0.3f) == 1);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 2, 0.01f) == 2);
+
+	// Moving away (smaller): LOD 0 is kept until the screen size is below 0.5 * (1 - h)
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 0, 0.5f * (1 - h * 0.5f)) == 0);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 0, 0.5f * (1 - h * 1.5f)) == 1);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 1, 0.1f * (1 - h * 0.5f)) == 1);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 1, 0.1f * (1 - h * 1.5f)) == 2);
+
+	// Moving closer (larger): LOD 1 is kept until the screen size is at least 0.5 * (1 + h)
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 1, 0.5f * (1 + h * 0.5f)) == 1);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 1, 0.5f * (1 + h * 1.5f)) == 0);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 2, 0.1f * (1 + h * 0.5f)) == 2);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 2, 0.1f * (1 + h * 1.5f)) == 1);
+
+	// Jumping over several LODs in one frame
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 0, 0.01f) == 2);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 2, 1) == 0);
+
+	// Inside the camera (INFINITY) and models without extra LODs
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 3, 2, INFINITY) == 0);
+	ASSERT_R1(pigeon_select_lod(lod_screen_sizes, 1, 0, 0) == 0);
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_draw_object_records(void)
+{
+	// Object pool slots. The addresses stay the same when the objects are destroyed and created again
+	uint64_t transform_slot, mr_slot;
+	struct PigeonTransform const* t = (struct PigeonTransform const*)&transform_slot;
+	struct PigeonMaterialRenderer const* mr = (struct PigeonMaterialRenderer const*)&mr_slot;
+
+	PigeonDrawObjectRecords records;
+	pigeon_create_draw_object_records(&records);
+
+#define CLEANUP() pigeon_destroy_draw_object_records(&records);
+
+	// Frame 1: written. Frame 2: the buffer being written to has the frame 1 draw object. Nothing changed
+	ASSERT_R1(!pigeon_draw_object_records_resize(&records, 2, 1));
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 1, t, 1, mr, 0, -1, 1, 0));
+	ASSERT_R1(!pigeon_update_draw_object_record(&records, 1, t, 1, mr, 0, -1, 2, 1));
+
+	// Transform moved
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 3, 2));
+	ASSERT_R1(!pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 4, 3));
+
+	// The transform is destroyed and a new one is made in the same slot, computed once (version 2 again)
+	ASSERT_R1(!pigeon_draw_object_records_resize(&records, 2, 2));
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 5, 4));
+	ASSERT_R1(!pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 6, 5));
+
+	// The material renderer is replaced by one of another model in the same slot, with the same material index
+	ASSERT_R1(!pigeon_draw_object_records_resize(&records, 2, 3));
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 7, 6));
+
+	// A draw object written in a frame that the buffer does not have yet is written again
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 8, 6));
+
+	// More draws. The existing record is kept
+	ASSERT_R1(!pigeon_draw_object_records_resize(&records, 3, 3));
+	ASSERT_R1(!pigeon_update_draw_object_record(&records, 1, t, 2, mr, 0, -1, 9, 8));
+	ASSERT_R1(pigeon_update_draw_object_record(&records, 2, t, 2, mr, 0, -1, 9, 8));
+
+	CLEANUP();
+#undef CLEANUP
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_mapped_asset_data(void)
+{
+	// Data file: a 3-page uncompressed subresource followed by a ZSTD subresource
+	uint32_t uncompressed[3 * 1024];
+	uint32_t original[2 * 1024];
+	for (unsigned int i = 0; i < 3 * 1024; i++)
+		uncompressed[i] = i * 7;
+	for (unsigned int i = 0; i < 2 * 1024; i++)
+		original[i] = i % 100;
+
+	uint8_t compressed[4096];
+	size_t compressed_size = ZSTD_compress(compressed, sizeof compressed, original, sizeof original, 1);
+	ASSERT_R1(!ZSTD_isError(compressed_size));
+
+	const char* path = "unit_tests_mapped_asset.data";
+	FILE* f = fopen(path, "wb");
+	ASSERT_R1(f);
+	bool written = fwrite(uncompressed, sizeof uncompressed, 1, f) == 1
+		&& fwrite(compressed, compressed_size, 1, f) == 1;
+	fclose(f);
+	ASSERT_R1(written);
+
+	PigeonAsset asset = { 0 };
+	asset.type = PIGEON_ASSET_TYPE_MODEL;
+	asset.subresource_count = 2;
+	asset.subresources = calloc(2, sizeof *asset.subresources);
+	ASSERT_R1(asset.subresources);
+	asset.subresources[0].type = PIGEON_ASSET_SUBRESOURCE_TYPE_UNCOMPRESSED;
+	asset.subresources[0].decompressed_data_length = sizeof uncompressed;
+	asset.subresources[1].type = PIGEON_ASSET_SUBRESOURCE_TYPE_ZSTD;
+	asset.subresources[1].original_file_data_offset = sizeof uncompressed;
+	asset.subresources[1].compressed_data_length = (uint32_t)compressed_size;
+	asset.subresources[1].decompressed_data_length = sizeof original;
+
+	uint32_t copy[3 * 1024];
+	int err = pigeon_map_asset_data(&asset, path);
+	remove(path);
+
+	// The uncompressed subresource is read from the mapping, then copied (which discards its pages)
+	// and read again. The ZSTD subresource is decompressed into a malloc'd buffer
+	if (err || memcmp(asset.subresources[0].decompressed_data, uncompressed, sizeof uncompressed)
+		|| pigeon_decompress_asset(&asset, copy, 0) || memcmp(copy, uncompressed, sizeof uncompressed)
+		|| memcmp(asset.subresources[0].decompressed_data, uncompressed, sizeof uncompressed)
+		|| pigeon_decompress_asset(&asset, NULL, 1)
+		|| memcmp(asset.subresources[1].decompressed_data, original, sizeof original)) {
+		pigeon_free_asset(&asset);
+		ASSERT_R1(false);
+	}
+
+	pigeon_free_asset(&asset);
+	ASSERT_R1(!asset.original_data);
+	return 0;
+}
+
+static PIGEON_ERR_RET pigeon_test_unaligned_compressed_animation(void)
+{
+#define BONES 3
+#define FRAMES 10
+	PigeonWGIBoneData frames[BONES * FRAMES];
+	uint32_t rng = 7;
+	for (unsigned int i = 0; i < BONES * FRAMES; i++)
+		random_bone(&rng, &frames[i]);
+
+	const PigeonAnimationCompressionErrors errors = { PIGEON_ANIMATION_DEFAULT_ROTATION_ERROR,
+		PIGEON_ANIMATION_DEFAULT_TRANSLATION_ERROR, PIGEON_ANIMATION_DEFAULT_SCALE_ERROR };
+	unsigned int size;
+	void* compressed = pigeon_compress_animation(frames, BONES, FRAMES, &errors, &size);
+	ASSERT_R1(compressed);
+
+	// The animation is stored uncompressed after 1 byte of other data
+	const char* path = "unit_tests_unaligned_animation.data";
+	FILE* f = fopen(path, "wb");
+	bool written = f && fputc(0, f) == 0 && fwrite(compressed, size, 1, f) == 1;
+	if (f)
+		fclose(f);
+
+	PigeonAsset asset = { 0 };
+	asset.type = PIGEON_ASSET_TYPE_MODEL;
+	asset.subresource_count = 1;
+	asset.subresources = calloc(1, sizeof *asset.subresources);
+	asset.animations_count = 1;
+	asset.animations = calloc(1, sizeof *asset.animations);
+	asset.bones_count = BONES;
+
+#define CLEANUP()                                                                                                      \
+	free(compressed);                                                                                                  \
+	pigeon_free_asset(&asset);                                                                                         \
+	remove(path);
+
+	ASSERT_R1(written && asset.subresources && asset.animations);
+	asset.subresources[0].type = PIGEON_ASSET_SUBRESOURCE_TYPE_UNCOMPRESSED;
+	asset.subresources[0].original_file_data_offset = 1;
+	asset.subresources[0].decompressed_data_length = size;
+	asset.animations[0].compressed = true;
+	asset.animations[0].frame_count = FRAMES;
+
+	ASSERT_R1(!pigeon_map_asset_data(&asset, path));
+
+	const void* data = pigeon_get_compressed_animation(&asset, 0);
+	ASSERT_R1(data && (uintptr_t)data % PIGEON_COMPRESSED_ANIMATION_ALIGNMENT == 0);
+	ASSERT_R1(!memcmp(data, compressed, size));
+
+	PigeonWGIBoneData decoded[BONES], expected[BONES];
+	pigeon_decompress_animation_frame(compressed, FRAMES - 1, 0, BONES, expected);
+	pigeon_decompress_animation_frame(data, FRAMES - 1, 0, BONES, decoded);
+	ASSERT_R1(!memcmp(decoded, expected, sizeof decoded));
+
+	// Misaligned data is never decoded
+	ASSERT_R1(!pigeon_compressed_animation_valid(&((uint8_t*)asset.original_data)[1], size, BONES, FRAMES));
+
+	CLEANUP();
+#undef CLEANUP
+#undef BONES
+#undef FRAMES
+	return 0;
+}
+
 int main(void)
 {
+	ASSERT_R1(!pigeon_init_job_system(4));
+
 	ASSERT_R1(!pigeon_test_config_parser());
 	ASSERT_R1(!pigeon_test_array_list());
 	ASSERT_R1(!pigeon_test_object_pool());
+	ASSERT_R1(!pigeon_test_hiz());
+	ASSERT_R1(!pigeon_test_hiz_tiled());
+	ASSERT_R1(!pigeon_test_occluder_mesh());
+	ASSERT_R1(!pigeon_test_meshlet_culling());
+	ASSERT_R1(!pigeon_test_radix_sort());
+	ASSERT_R1(!pigeon_test_bone_palette());
+	ASSERT_R1(!pigeon_test_bone_pose_blending());
+	ASSERT_R1(!pigeon_test_skeleton());
+	ASSERT_R1(!pigeon_test_compressed_animation());
+	ASSERT_R1(!pigeon_test_lod_selection());
+	ASSERT_R1(!pigeon_test_draw_object_records());
+	ASSERT_R1(!pigeon_test_mapped_asset_data());
+	ASSERT_R1(!pigeon_test_unaligned_compressed_animation());
+
+	pigeon_deinit_job_system();
 	puts("Success");
 	return 0;
-}
\ No newline at end of file
+}